@@ -74,7 +74,7 @@ char *lighting_file[NUM_LIGHTING_TYPES] = {0};
 bool combined_gu(0), underwater(0), kbd_text_mode(0), univ_stencil_shadows(1), use_waypoint_app_spots(0), enable_tiled_mesh_ao(0), tiled_terrain_only(0);
 bool show_lightning(0), disable_shader_effects(0), use_waypoints(0), group_back_face_cull(0), start_maximized(0), claim_planet(0), skip_light_vis_test(0);
 bool no_smoke_over_mesh(0), enable_model3d_tex_comp(0), global_lighting_update(0), lighting_update_offline(0), mesh_difuse_tex_comp(1), smoke_dlights(0), keep_keycards_on_death(0);
-bool texture_alpha_in_red_comp(0), use_model3d_tex_mipmaps(1), mt_cobj_tree_build(0), two_sided_lighting(0), inf_terrain_scenery(1), invert_model_nmap_bscale(0);
+bool texture_alpha_in_red_comp(0), use_model3d_tex_mipmaps(1), mt_cobj_tree_build(0), sah_cobj_tree_build(1), cobj_tree_timing(0), two_sided_lighting(0), inf_terrain_scenery(1), invert_model_nmap_bscale(0);
 bool gen_tree_roots(1), fast_water_reflect(0), vsync_enabled(0), use_voxel_cobjs(0), disable_sound(0), enable_depth_clamp(0), volume_lighting(0), no_subdiv_model(0);
 bool detail_normal_map(0), init_core_context(0), use_core_context(0), enable_multisample(1), dynamic_smap_bias(0), model3d_wn_normal(0), snow_shadows(0), user_action_key(0);
 bool enable_dlight_shadows(1), tree_indir_lighting(0), ctrl_key_pressed(0), only_pine_palm_trees(0), enable_gamma_correct(0), use_z_prepass(0), reflect_dodgeballs(0);
@@ -104,8 +104,9 @@ int read_snow_file(0), write_snow_file(0), mesh_detail_tex(NOISE_TEX);
 int read_light_files[NUM_LIGHTING_TYPES] = {0}, write_light_files[NUM_LIGHTING_TYPES] = {0};
 unsigned num_snowflakes(0), create_voxel_landscape(0), hmap_filter_width(0), num_dynam_parts(100), snow_coverage_resolution(2), show_map_view_fractal(0);
 unsigned num_birds_per_tile(2), num_fish_per_tile(15), num_bflies_per_tile(4);
-unsigned erosion_iters(0), erosion_iters_tt(0), skybox_tid(0), tiled_terrain_gen_heightmap_sz(0), game_mode_disable_mask(0), num_frame_draw_calls(0);
-float NEAR_CLIP(DEF_NEAR_CLIP), FAR_CLIP(DEF_FAR_CLIP), system_max_orbit(1.0), sky_occlude_scale(0.0), tree_slope_thresh(5.0), mouse_sensitivity(1.0), tt_grass_scale_factor(1.0);
+unsigned univ_bench_frames(0), univ_bench_ships(50);
+unsigned erosion_iters(0), erosion_iters_tt(0), erosion_tile_size(256), tt_gen_worker_threads(0), skybox_tid(0), tiled_terrain_gen_heightmap_sz(0), game_mode_disable_mask(0), num_frame_draw_calls(0);
+float NEAR_CLIP(DEF_NEAR_CLIP), FAR_CLIP(DEF_FAR_CLIP), system_max_orbit(1.0), univ_bench_fticks(1.0), sky_occlude_scale(0.0), tree_slope_thresh(5.0), mouse_sensitivity(1.0), tt_grass_scale_factor(1.0);
 float water_plane_z(0.0), base_gravity(1.0), crater_depth(1.0), crater_radius(1.0), disabled_mesh_z(FAR_CLIP), vegetation(1.0), atmosphere(1.0), biome_x_offset(0.0);
 float mesh_file_scale(1.0), mesh_file_tz(0.0), speed_mult(1.0), mesh_z_cutoff(-FAR_CLIP), relh_adj_tex(0.0), dodgeball_metalness(1.0), ray_step_size_mult(1.0);
 float water_h_off(0.0), water_h_off_rel(0.0), perspective_fovy(0.0), perspective_nclip(0.0), read_mesh_zmm(0.0), indir_light_exp(1.0), cloud_height_offset(0.0);
@@ -134,11 +135,13 @@ char player_name[MAX_CHARS] = "Player";
 bool vert_opt_flags[3] = {0}; // {enable, full_opt, verbose}
 
 
+extern bool write_model3d_v2, model3d_lazy_load, parallel_obj_file_parse;
+extern bool simd_mesh_noise_gen, mesh_gen_gpu_modes_on_cpu, mesh_noise_benchmark;
 extern bool clear_landscape_vbo, use_dense_voxels, tree_4th_branches, model_calc_tan_vect, water_is_lava, use_grass_tess, def_tex_compress, ship_cube_map_reflection;
-extern bool flashlight_on, player_wait_respawn, camera_in_building;
+extern bool flashlight_on, player_wait_respawn, camera_in_building, progressive_lighting_checkpoint, sparse_lighting_files, pack_lighting_file_colors;
 extern int camera_flight, DISABLE_WATER, DISABLE_SCENERY, camera_invincible, onscreen_display, mesh_freq_filter, show_waypoints, last_inventory_frame;
 extern int tree_coll_level, GLACIATE, UNLIMITED_WEAPONS, destroy_thresh, MAX_RUN_DIST, mesh_gen_mode, mesh_gen_shape, map_drag_x, map_drag_y, player_in_water;
-extern unsigned NPTS, NRAYS, LOCAL_RAYS, GLOBAL_RAYS, DYNAMIC_RAYS, NUM_THREADS, MAX_RAY_BOUNCES, grass_density, max_unique_trees, shadow_map_sz;
+extern unsigned NPTS, NRAYS, LOCAL_RAYS, GLOBAL_RAYS, DYNAMIC_RAYS, NUM_THREADS, MAX_RAY_BOUNCES, RAY_PACKET_SIZE, progressive_lighting_passes, grass_density, max_unique_trees, shadow_map_sz;
 extern unsigned scene_smap_vbo_invalid, spheres_mode, max_cube_map_tex_sz, DL_GRID_BS;
 extern float fticks, team_damage, self_damage, player_damage, smiley_damage, smiley_speed, tree_deadness, tree_dead_prob, lm_dz_adj, nleaves_scale, flower_density, universe_ambient_scale;
 extern float mesh_scale, tree_scale, mesh_height_scale, smiley_acc, hmv_scale, last_temp, grass_length, grass_width, branch_radius_scale, tree_height_scale, planet_update_rate;
@@ -148,7 +151,7 @@ extern point hmv_pos, camera_last_pos;
 extern colorRGBA sunlight_color;
 extern int coll_id[];
 extern float tree_lod_scales[4];
-extern string read_hmap_modmap_fn, write_hmap_modmap_fn, read_voxel_brush_fn, write_voxel_brush_fn, font_texture_atlas_fn;
+extern string read_hmap_modmap_fn, write_hmap_modmap_fn, tt_tile_cache_dir, read_voxel_brush_fn, write_voxel_brush_fn, font_texture_atlas_fn;
 extern vector<bbox> team_starts;
 extern player_state *sstates;
 extern pt_line_drawer obj_pld;
@@ -187,6 +190,7 @@ void teleport_to_map_location();
 void building_gameplay_action_key(int mode, bool mouse_wheel);
 float get_player_building_speed_mult();
 void toggle_city_spectate_mode();
+void run_universe_benchmark();
 
 float get_tt_building_sound_gain();
 
@@ -1750,6 +1754,11 @@ int load_config(string const &config_file) {
 	kwmb.add("use_dense_voxels", use_dense_voxels);
 	kwmb.add("use_voxel_cobjs", use_voxel_cobjs);
 	kwmb.add("mt_cobj_tree_build", mt_cobj_tree_build);
+	kwmb.add("sah_cobj_tree_build", sah_cobj_tree_build);
+	kwmb.add("cobj_tree_timing", cobj_tree_timing);
+	kwmb.add("progressive_lighting_checkpoint", progressive_lighting_checkpoint);
+	kwmb.add("sparse_lighting_files", sparse_lighting_files);
+	kwmb.add("pack_lighting_file_colors", pack_lighting_file_colors);
 	kwmb.add("global_lighting_update", global_lighting_update);
 	kwmb.add("lighting_update_offline", lighting_update_offline);
 	kwmb.add("two_sided_lighting", two_sided_lighting);
@@ -1765,6 +1774,9 @@ int load_config(string const &config_file) {
 	kwmb.add("tree_4th_branches", tree_4th_branches);
 	kwmb.add("skip_light_vis_test", skip_light_vis_test);
 	kwmb.add("model_calc_tan_vect", model_calc_tan_vect);
+	kwmb.add("write_model3d_v2", write_model3d_v2);
+	kwmb.add("model3d_lazy_load", model3d_lazy_load);
+	kwmb.add("parallel_obj_file_parse", parallel_obj_file_parse);
 	kwmb.add("invert_model_nmap_bscale", invert_model_nmap_bscale);
 	kwmb.add("enable_dlight_shadows", enable_dlight_shadows);
 	kwmb.add("tree_indir_lighting", tree_indir_lighting);
@@ -1779,6 +1791,9 @@ int load_config(string const &config_file) {
 	kwmb.add("enable_mouse_look", enable_mouse_look);
 	kwmb.add("enable_init_shields", enable_init_shields);
 	kwmb.add("tt_triplanar_tex", tt_triplanar_tex);
+	kwmb.add("simd_mesh_noise_gen", simd_mesh_noise_gen);
+	kwmb.add("mesh_gen_gpu_modes_on_cpu", mesh_gen_gpu_modes_on_cpu);
+	kwmb.add("mesh_noise_benchmark", mesh_noise_benchmark);
 	kwmb.add("enable_model3d_bump_maps", enable_model3d_bump_maps);
 	kwmb.add("use_obj_file_bump_grayscale", use_obj_file_bump_grayscale);
 	kwmb.add("invert_bump_maps", invert_bump_maps);
@@ -1865,10 +1880,14 @@ int load_config(string const &config_file) {
 	kwmu.add("max_unique_trees", max_unique_trees);
 	kwmu.add("shadow_map_sz", shadow_map_sz);
 	kwmu.add("max_ray_bounces", MAX_RAY_BOUNCES);
+	kwmu.add("ray_packet_size", RAY_PACKET_SIZE);
+	kwmu.add("progressive_lighting_passes", progressive_lighting_passes);
 	kwmu.add("num_test_snowflakes", num_snowflakes);
 	kwmu.add("hmap_filter_width", hmap_filter_width);
 	kwmu.add("erosion_iters", erosion_iters);
 	kwmu.add("erosion_iters_tt", erosion_iters_tt);
+	kwmu.add("erosion_tile_size", erosion_tile_size);
+	kwmu.add("tt_gen_worker_threads", tt_gen_worker_threads);
 	kwmu.add("num_dynam_parts", num_dynam_parts);
 	kwmu.add("num_birds_per_tile", num_birds_per_tile);
 	kwmu.add("num_fish_per_tile", num_fish_per_tile);
@@ -1879,6 +1898,8 @@ int load_config(string const &config_file) {
 	kwmu.add("tiled_terrain_gen_heightmap_sz", tiled_terrain_gen_heightmap_sz);
 	kwmu.add("game_mode_disable_mask", game_mode_disable_mask);
 	kwmu.add("show_map_view_fractal", show_map_view_fractal);
+	kwmu.add("universe_benchmark_frames", univ_bench_frames);
+	kwmu.add("universe_benchmark_ships", univ_bench_ships);
 
 	kw_to_val_map_t<float> kwmf(error);
 	kwmf.add("gravity", base_gravity);
@@ -1951,6 +1972,7 @@ int load_config(string const &config_file) {
 	kwmf.add("ambient_scale", ambient_scale);
 	kwmf.add("ray_step_size_mult", ray_step_size_mult);
 	kwmf.add("system_max_orbit", system_max_orbit);
+	kwmf.add("universe_benchmark_fticks", univ_bench_fticks);
 	kwmf.add("sky_occlude_scale", sky_occlude_scale);
 	kwmf.add("mouse_sensitivity", mouse_sensitivity);
 	kwmf.add("tt_grass_scale_factor", tt_grass_scale_factor);
@@ -1986,6 +2008,7 @@ int load_config(string const &config_file) {
 	kwms.add("coll_damage_name",   coll_damage_name);
 	kwms.add("read_hmap_modmap_filename",  read_hmap_modmap_fn);
 	kwms.add("write_hmap_modmap_filename", write_hmap_modmap_fn);
+	kwms.add("tt_tile_cache_dir",          tt_tile_cache_dir);
 	kwms.add("read_voxel_brush_filename",  read_voxel_brush_fn);
 	kwms.add("write_voxel_brush_filename", write_voxel_brush_fn);
 	kwms.add("font_texture_atlas_fn", font_texture_atlas_fn);
@@ -2253,6 +2276,7 @@ int load_config(string const &config_file) {
 		if (error) {cout << "Parse error in config file." << endl; break;}
 	} // while read
 	if (universe_only && disable_universe) {cout << "Error: universe_only and disable_universe are mutually exclusive" << endl; error = 1;}
+	if (univ_bench_frames > 0 && !(univ_bench_fticks > 0.0)) {cout << "Error: universe_benchmark_fticks must be positive" << endl; error = 1;}
 	if (mh_filename_tt != nullptr && tiled_terrain_gen_heightmap_sz > 0) {cout << "Error: can't specify both mh_filename_tiled_terrain and tiled_terrain_gen_heightmap_sz" << endl; error = 1;}
 	checked_fclose(fp);
 	temperature    = init_temperature;
@@ -2340,6 +2364,11 @@ int main(int argc, char** argv) {
 	load_texture_names(); // needs to be before config file load
 	load_top_level_config(defaults_file);
 	gen_gauss_rand_arr(); // after reading seed from config file
+
+	if (univ_bench_frames > 0) { // headless universe simulation; no window or GL context is created
+		run_universe_benchmark();
+		return 0;
+	}
 	cout << "Loading."; cout.flush();
 	
  	// Initialize GLUT
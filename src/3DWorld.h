@@ -381,6 +381,10 @@ template<typename T> unsigned hash_vect_as_int(vector<T> const &v) {
 	assert((sizeof(T) % sizeof(int)) == 0); // must be a multiple of 4 bytes
 	return jenkins_one_at_a_time_hash((int const*)v.data(), sizeof(T)*v.size()/sizeof(int));
 }
+template<typename T> void append_pod_bytes(vector<uint8_t> &data, T const &val) { // for building hashable/comparable keys from POD values
+	uint8_t const *const ptr((uint8_t const *)&val);
+	data.insert(data.end(), ptr, ptr+sizeof(T));
+}
 
 
 struct vector4d : public vector3d { // size = 16
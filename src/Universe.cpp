@@ -8,6 +8,9 @@
 #include "shaders.h"
 #include "gl_ext_arb.h"
 #include "asteroid.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 
 // temperatures
@@ -27,6 +30,7 @@ float const NDIV_SIZE_SCALE  = 15.0;
 float const NEBULA_PROB      = 0.7;
 
 bool const SHOW_SPHERE_TIME  = 0; // debugging
+bool const ASYNC_PLANET_TEXTURES = 1; // generate larger rocky planet/moon textures on a background thread, and keep drawing the smaller texture until they're ready
 
 unsigned const MAX_TRIES     = 100;
 unsigned const SPHERE_MAX_ND = 256;
@@ -47,6 +51,7 @@ float const ROT_RATE_CONST   = 0.5*ROTREV_TIMESCALE;
 float const REV_RATE_CONST   = 1.0*ROTREV_TIMESCALE;
 float const STAR_BRIGHTNESS  = 1.4;
 float const MIN_TEX_OBJ_SZ   = 4.0;
+float const PREFETCH_TEX_OBJ_SZ = 1.0; // start generating the surface and first texture in the background at this size
 float const MAX_WATER        = 0.75;
 float const GLOBAL_AMBIENT   = 0.25;
 float const GAS_GIANT_MIN_REL_SZ = 0.34;
@@ -146,12 +151,12 @@ void setup_universe_fog(s_object const &closest) {
 }
 
 
-// Note: not threadsafe
+// Note: threadsafe for concurrent queries, as long as the universe isn't being modified
 uobject *line_intersect_universe(point const &start, vector3d const &dir, float length, float line_radius, float &dist) {
 
 	point coll;
 	s_object target;
-	static line_query_state lqs;
+	thread_local line_query_state lqs; // thread_local because ship AI target queries may be run in parallel
 
 	if (universe.get_trajectory_collisions(lqs, target, coll, dir, start, length, line_radius)) { // destroy, query, beams
 		if (target.is_solid()) {
@@ -506,6 +511,7 @@ void universe_t::draw_all_cells(s_object const &clobj, bool skip_closest, bool n
 	if (animate2) {cloud_time += fticks;}
 	unpack_color(water_c, P_WATER_C); // recalculate every time
 	unpack_color(ice_c,   P_ICE_C  );
+	if (!gen_only) {purge_stale_async_textures();}
 	std::unique_ptr<ushader_group> usg_ptr(new ushader_group(&planet_manager)); // allocate on the heap since this object is large
 	ushader_group &usg(*usg_ptr);
 
@@ -1234,7 +1240,9 @@ point ugalaxy::gen_valid_system_pos() const {
 
 float ugalaxy::get_radius_at(point const &pos_, bool exact) const {
 
-	if (!exact && lrq_rad > 0.0 && p2p_dist_sq(pos_, lrq_pos) < 0.000001*min(radius*radius, p2p_dist_sq(pos_, pos))) {
+	bool const use_cache(omp_get_thread_num_3dw() == 0); // the cache isn't thread safe, so only the master thread uses it
+
+	if (use_cache && !exact && lrq_rad > 0.0 && p2p_dist_sq(pos_, lrq_pos) < 0.000001*min(radius*radius, p2p_dist_sq(pos_, pos))) {
 		return 1.001*lrq_rad; // point is so close to last point that we can used the cached value (be conservative)
 	}
 	vector3d dir(pos_);
@@ -1243,8 +1251,7 @@ float ugalaxy::get_radius_at(point const &pos_, bool exact) const {
 	dir[1] *= scale[1];
 	dir[2] *= scale[2];
 	float const rval(radius*dir.mag());
-	lrq_rad = rval;
-	lrq_pos = pos_;
+	if (use_cache) {lrq_rad = rval; lrq_pos = pos_;}
 	return rval;
 }
 
@@ -2057,10 +2064,139 @@ void uobj_solid::gen_colorAB(float delta) {
 // *** TEXTURES ***
 
 
+// single background worker that generates rocky planet/moon texture data; bodies are only used as keys and are never dereferenced here,
+// and the surface is held by shared_ptr so that it stays valid if the body is freed; completed jobs are only destroyed on the main thread;
+// for bodies that aren't textured yet, the worker also generates the surface noise, and the surface is given to the body along with the texture
+class surface_tex_gen_queue_t {
+public:
+	struct job_t {
+		urev_body const *body=nullptr; // key only
+		p_upsurface surface;
+		surface_color_params_t cparams;
+		unsigned size=0, num_sines=0;
+		int done_frame=-1; // set on the main thread
+		int body_id=0; // for new surfaces, in case the body was freed and another body reuses its address
+		bool gen_surface=0;
+		float mag=0.0, freq=0.0; // for upsurface::gen() when gen_surface=1
+		vector<unsigned char> data;
+		vector<float> heightmap;
+	};
+private:
+	unsigned const MAX_PENDING = 8, MAX_RESULT_AGE = 300; // in frames
+	std::deque<job_t> pending, done;
+	urev_body const *cur_body=nullptr; // job in flight
+	std::mutex mtx;
+	std::condition_variable cv;
+	std::thread worker;
+	bool stop_req=0;
+
+	void run() {
+		while (1) {
+			job_t job;
+			{
+				std::unique_lock<std::mutex> lock(mtx);
+				cv.wait(lock, [this]{return (stop_req || !pending.empty());});
+				if (stop_req) return;
+				job = std::move(pending.front());
+				pending.pop_front();
+				cur_body = job.body;
+			}
+			if (job.gen_surface) {job.surface->gen(job.mag, job.freq);}
+			job.data.resize(3*job.size*job.size);
+			job.heightmap.resize(job.size*job.size);
+			gen_rocky_texture_data(job.cparams, *job.surface, job.num_sines, job.size, job.data.data(), job.heightmap.data());
+			std::lock_guard<std::mutex> lock(mtx);
+			cur_body = nullptr;
+			done.push_back(std::move(job));
+		} // while
+	}
+	bool has_job(urev_body const *body, unsigned size) const { // mtx must be held
+		if (cur_body == body) return 1; // only one job per body in flight
+		for (job_t const &j : pending) {if (j.body == body) return 1;}
+		for (job_t const &j : done   ) {if (j.body == body && j.size == size) return 1;}
+		return 0;
+	}
+public:
+	~surface_tex_gen_queue_t() {stop();}
+
+	void stop() {
+		if (!worker.joinable()) return;
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			stop_req = 1;
+		}
+		cv.notify_one();
+		worker.join();
+	}
+	bool can_add(urev_body const *body, unsigned size) { // only the main thread adds jobs, so this remains valid until add() is called
+		std::lock_guard<std::mutex> lock(mtx);
+		return (pending.size() < MAX_PENDING && !has_job(body, size));
+	}
+	void add(job_t &job) {
+		assert(job.body != nullptr && job.surface != nullptr);
+		job.num_sines = upsurface::calc_num_sines(job.size);
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			pending.push_back(std::move(job));
+		}
+		if (!worker.joinable()) {worker = std::thread(&surface_tex_gen_queue_t::run, this);}
+		cv.notify_one();
+	}
+	// returns the largest completed result for this body with size in [min_size, max_size]; results for other sizes or an older surface are dropped
+	bool take(urev_body const *body, p_upsurface const &surface, unsigned min_size, unsigned max_size, job_t &result) {
+		std::lock_guard<std::mutex> lock(mtx);
+		bool found(0);
+
+		for (auto i = done.begin(); i != done.end();) {
+			if (i->body != body) {++i; continue;}
+
+			if (i->surface == surface && i->size >= min_size && i->size <= max_size && (!found || i->size > result.size)) {
+				result = std::move(*i);
+				found  = 1;
+			}
+			else if (i->surface == surface && i->size > max_size) {++i; continue;} // prefetched for later
+			i = done.erase(i);
+		}
+		return found;
+	}
+	// returns a completed result with a new surface for this body with size <= max_size
+	bool take_new_surface(urev_body const *body, int body_id, unsigned max_size, job_t &result) {
+		std::lock_guard<std::mutex> lock(mtx);
+
+		for (auto i = done.begin(); i != done.end(); ++i) {
+			if (i->body != body || !i->gen_surface || i->body_id != body_id || i->size > max_size) continue;
+			result = std::move(*i);
+			done.erase(i);
+			return 1;
+		}
+		return 0;
+	}
+	void purge_stale() { // drop results that were never used, for example because the body was freed
+		std::lock_guard<std::mutex> lock(mtx);
+
+		for (auto i = done.begin(); i != done.end();) {
+			if (i->done_frame < 0) {i->done_frame = frame_counter;}
+			if (frame_counter - i->done_frame > (int)MAX_RESULT_AGE) {i = done.erase(i);} else {++i;}
+		}
+	}
+};
+
+surface_tex_gen_queue_t surface_tex_gen_queue;
+
+void purge_stale_async_textures() {
+	if (ASYNC_PLANET_TEXTURES) {surface_tex_gen_queue.purge_stale();}
+}
+
+
 void urev_body::check_gen_texture(unsigned size) {
 
 	if (use_procedural_shader()) return; // no texture used
-	if (size <= MIN_TEX_OBJ_SZ)  return; // too small to be textured
+
+	if (size <= MIN_TEX_OBJ_SZ) { // too small to be textured
+		// approaching the size where this body will be textured; generate its surface and first texture in the background
+		if (ASYNC_PLANET_TEXTURES && !gas_giant && size >= PREFETCH_TEX_OBJ_SZ && !glIsTexture(tid)) {prefetch_surface_texture(get_texture_size(MIN_TEX_OBJ_SZ + 1));}
+		return;
+	}
 
 	if (gas_giant) { // perfectly spherical, no surface used
 		if (!glIsTexture(tid)) {create_gas_giant_texture();} // texture has not been generated
@@ -2069,18 +2205,85 @@ void urev_body::check_gen_texture(unsigned size) {
 	unsigned const tsize0(get_texture_size(size));
 
 	if (!glIsTexture(tid)) { // texture has not been generated
+		if (ASYNC_PLANET_TEXTURES && upload_async_surface_texture(tsize0)) return; // prefetched as this body was approached
 		gen_surface();
 	}
-	else if (tsize0 != tsize) { // new texture size
-		::free_texture(tid); // delete old texture
+	else if (tsize0 == tsize) { // nothing to do
+		if (ASYNC_PLANET_TEXTURES && tsize < MAX_TEXTURE_SIZE && get_texture_size(1.5*size) > tsize) {prefetch_texture(2*tsize);} // approaching the next size
+		return;
 	}
-	else {
-		return; // nothing to do
+	else if (ASYNC_PLANET_TEXTURES && tsize0 > tsize) { // larger texture: keep drawing the current one until the background thread is done with it
+		if (!upload_async_texture(tsize0)) {prefetch_texture(tsize0);}
+		return;
+	}
+	else { // smaller texture size
+		::free_texture(tid); // delete old texture
 	}
 	create_rocky_texture(tsize0); // new texture
 }
 
 
+void urev_body::prefetch_texture(unsigned size) const {
+
+	if (surface == nullptr || use_procedural_shader() || gas_giant) return;
+	assert(size <= MAX_TEXTURE_SIZE);
+	if (!surface_tex_gen_queue.can_add(this, size)) return;
+	surface_tex_gen_queue_t::job_t job;
+	job.body    = this;
+	job.surface = surface;
+	job.cparams = get_color_params();
+	job.size    = size;
+	surface_tex_gen_queue.add(job);
+}
+
+
+void urev_body::prefetch_surface_texture(unsigned size) const { // for bodies that don't have a texture yet; generates a new surface as well
+
+	assert(size <= MAX_TEXTURE_SIZE);
+	if (!surface_tex_gen_queue.can_add(this, size)) return;
+	surface_tex_gen_queue_t::job_t job;
+	job.body        = this;
+	job.body_id     = get_id();
+	job.gen_surface = 1;
+	job.surface.reset(create_surface(job.mag, job.freq));
+	job.cparams     = get_color_params();
+	job.size        = size;
+	surface_tex_gen_queue.add(job);
+}
+
+
+void urev_body::upload_texture_data(unsigned size, vector<unsigned char> const &data, vector<float> &heightmap) {
+
+	tsize = size;
+	surface->setup(tsize, max(water, lava), 0); // use_heightmap=0
+	surface->heightmap.swap(heightmap);
+	setup_texture(tid, 0, 1, 0);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, tsize, tsize, 0, GL_RGB, GL_UNSIGNED_BYTE, &data.front());
+}
+
+
+bool urev_body::upload_async_texture(unsigned max_size) { // returns 1 if a larger texture was uploaded
+
+	if (surface == nullptr) return 0;
+	surface_tex_gen_queue_t::job_t job;
+	if (!surface_tex_gen_queue.take(this, surface, tsize+1, max_size, job)) return 0;
+	::free_texture(tid); // delete old texture
+	upload_texture_data(job.size, job.data, job.heightmap);
+	return 1;
+}
+
+
+bool urev_body::upload_async_surface_texture(unsigned max_size) { // returns 1 if a prefetched surface and texture were used
+
+	surface_tex_gen_queue_t::job_t job;
+	if (!surface_tex_gen_queue.take_new_surface(this, get_id(), max_size, job)) return 0;
+	set_rseeds(); // same as gen_surface()
+	surface = job.surface; // may delete a previous surface
+	upload_texture_data(job.size, job.data, job.heightmap);
+	return 1;
+}
+
+
 void urev_body::create_rocky_texture(unsigned size) {
 
 	tsize = size;
@@ -2136,7 +2339,28 @@ void urev_body::upload_colors_to_shader(shader_t &s) const {
 }
 
 
-void urev_body::get_surface_color(unsigned char *data, float val, float phi) const { // val in [0,1]
+surface_color_params_t urev_body::get_color_params() const {
+
+	surface_color_params_t cparams;
+	get_colors(cparams.a, cparams.b);
+	RGB_BLOCK_COPY(cparams.wic[0], water_c);
+	RGB_BLOCK_COPY(cparams.wic[1], ice_c);
+	cparams.temp        = temp;
+	cparams.water       = water;
+	cparams.lava        = lava;
+	cparams.atmos       = atmos;
+	cparams.snow_thresh = snow_thresh;
+	cparams.wr_scale    = 1.0/max(0.01, (1.0 - water));
+	return cparams;
+}
+
+
+void urev_body::get_surface_color(unsigned char *data, float val, float phi) const {
+	get_color_params().get_surface_color(data, val, phi);
+}
+
+
+void surface_color_params_t::get_surface_color(unsigned char *data, float val, float phi) const { // val in [0,1]
 
 	bool const frozen(temp < FREEZE_TEMP);
 	unsigned char const white[3] = {255, 255, 255};
@@ -2782,7 +3006,7 @@ int universe_t::get_closest_object(s_object &result, point pos, int max_level, b
 	pos -= cell.pos;
 	float const planet_thresh(expand*4.0*MAX_PLANET_EXTENT + r_add), moon_thresh(expand*2.0*MAX_PLANET_EXTENT + r_add);
 	float const pt_sq(planet_thresh*planet_thresh), mt_sq(moon_thresh*moon_thresh);
-	static int last_galaxy(-1), last_cluster(-1), last_system(-1);
+	thread_local int last_galaxy(-1), last_cluster(-1), last_system(-1); // search hints; thread_local because queries may be run in parallel
 	int const first_galaxy_to_try((galaxy_hint >= 0) ? galaxy_hint : last_galaxy);
 	unsigned const ng((unsigned)cell.galaxies->size());
 	unsigned const go((first_galaxy_to_try >= 0 && first_galaxy_to_try < int(ng)) ? last_galaxy : 0);
@@ -2917,6 +3141,149 @@ int universe_t::get_closest_object(s_object &result, point pos, int max_level, b
 }
 
 
+float const SOBJ_CACHE_GRID_SZ  = 0.5*MAX_PLANET_EXTENT; // size of the grid cells used by sobj_query_cache_t
+float const SOBJ_CACHE_MAX_RADD = MAX_PLANET_EXTENT; // queries with a larger r_add aren't cached
+
+void sobj_query_cache_t::clear() {
+
+	entry_map.clear();
+	entries.clear();
+	planets.clear();
+	moons.clear();
+	num_hits = num_misses = 0;
+}
+
+
+// center is in offset universe coords; the entry is left invalid unless the whole grid cell is inside a single system
+void sobj_query_cache_t::build_entry(universe_t const &universe, entry_t &entry, point const &center) {
+
+	float const half_diag(0.5*sqrt(3.0)*SOBJ_CACHE_GRID_SZ);
+	vector3d const half_sz(0.5*SOBJ_CACHE_GRID_SZ, 0.5*SOBJ_CACHE_GRID_SZ, 0.5*SOBJ_CACHE_GRID_SZ);
+	s_object clo, chi, sres;
+	if (!universe.get_closest_object(clo, (center - half_sz), UTYPE_CELL, 0, 0, 1.0)) return;
+	if (!universe.get_closest_object(chi, (center + half_sz), UTYPE_CELL, 0, 0, 1.0)) return;
+	UNROLL_3X(if (clo.cellxyz[i_] != chi.cellxyz[i_]) return;) // spans two universe cells
+	universe.get_closest_object(sres, center, UTYPE_SYSTEM, 0, 0, 1.0, 1); // get_destroyed=1
+	if (!sres.has_valid_system()) return;
+	ucell const &cell(sres.get_ucell());
+	ussystem const &system(sres.get_system());
+	point const lpos(center - cell.pos);
+	if (system.radius <= half_diag || !dist_less_than(lpos, system.pos, (system.radius - half_diag))) return; // not fully inside the system
+	float const pad(SOBJ_CACHE_MAX_RADD + half_diag);
+
+	for (auto g = cell.galaxies->begin(); g != cell.galaxies->end(); ++g) { // check for nearby asteroid fields in any galaxy
+		if (!g->gen) continue;
+
+		for (auto i = g->asteroid_fields.begin(); i != g->asteroid_fields.end(); ++i) {
+			if (dist_less_than(lpos, i->pos, (i->radius + pad))) {entry.asteroids_near = 1;}
+		}
+	}
+	if (system.asteroid_belt != nullptr && system.asteroid_belt->sphere_might_intersect(lpos, (system.asteroid_belt->get_max_asteroid_radius() + pad))) {
+		entry.asteroids_near = 1;
+	}
+	float const planet_thresh(4.0*MAX_PLANET_EXTENT + pad), moon_thresh(2.0*MAX_PLANET_EXTENT + pad); // conservative versions of get_closest_object() thresholds
+	entry.p_start = (unsigned)planets.size();
+
+	for (unsigned pc = 0; pc < system.planets.size(); ++pc) {
+		uplanet const &planet(system.planets[pc]);
+		if (!dist_less_than(lpos, planet.pos, planet_thresh)) continue;
+		planets.emplace_back(pc, (unsigned)moons.size());
+
+		for (unsigned mc = 0; mc < planet.moons.size(); ++mc) {
+			if (dist_less_than(lpos, planet.moons[mc].pos, moon_thresh)) {moons.push_back(mc);}
+		}
+		planets.back().m_end = (unsigned)moons.size();
+	}
+	entry.p_end    = (unsigned)planets.size();
+	UNROLL_3X(entry.cellxyz[i_] = sres.cellxyz[i_];)
+	entry.galaxy   = sres.galaxy;
+	entry.cluster  = sres.cluster;
+	entry.system   = sres.system;
+	entry.cell_pos = cell.pos;
+	entry.valid    = 1;
+}
+
+
+// same result as universe.get_object_closest_to_pos(result, pos, include_asteroids, 1.0, r_add), but only tests bodies cached for this grid cell
+int sobj_query_cache_t::get_object_closest_to_pos(universe_t const &universe, s_object &result, point const &pos, bool include_asteroids, float r_add) {
+
+	if (r_add <= SOBJ_CACHE_MAX_RADD) {
+		point opos(pos);
+		offset_pos(opos);
+		int ix[3] = {};
+		bool in_range(1);
+
+		for (unsigned d = 0; d < 3; ++d) {
+			float const v(floor(opos[d]/SOBJ_CACHE_GRID_SZ));
+			in_range &= (fabs(v) < float(1<<20));
+			ix[d] = int(v);
+		}
+		if (in_range) {
+			uint64_t const key(uint64_t(ix[0] + (1<<20)) | (uint64_t(ix[1] + (1<<20)) << 21) | (uint64_t(ix[2] + (1<<20)) << 42));
+			auto it(entry_map.find(key));
+
+			if (it == entry_map.end()) { // first query in this grid cell this frame
+				it = entry_map.insert(make_pair(key, (unsigned)entries.size())).first;
+				entries.push_back(entry_t());
+				point center;
+				UNROLL_3X(center[i_] = (ix[i_] + 0.5)*SOBJ_CACHE_GRID_SZ;)
+				build_entry(universe, entries.back(), center);
+			}
+			entry_t const &entry(entries[it->second]);
+
+			if (entry.valid && !(include_asteroids && entry.asteroids_near)) {
+				++num_hits;
+				result.init();
+				UNROLL_3X(result.cellxyz[i_] = entry.cellxyz[i_];)
+				result.galaxy = entry.galaxy;
+				result.type   = UTYPE_GALAXY;
+				ussystem &system(result.get_galaxy().sols[entry.system]);
+				point const lpos(opos - entry.cell_pos);
+				float const planet_thresh(4.0*MAX_PLANET_EXTENT + r_add), moon_thresh(2.0*MAX_PLANET_EXTENT + r_add);
+				float const pt_sq(planet_thresh*planet_thresh), mt_sq(moon_thresh*moon_thresh);
+				float const dists(p2p_dist(lpos, system.pos) - system.sun.radius);
+
+				if (system.sun.is_ok() && dists < result.dist) {
+					result.assign(entry.galaxy, entry.cluster, entry.system, dists, UTYPE_SYSTEM, &system.sun);
+					if (dists <= 0.0) {result.val = 2; return 2;} // sun collision
+				}
+				for (unsigned p = entry.p_start; p < entry.p_end; ++p) {
+					planet_ref_t const &pr(planets[p]);
+					uplanet &planet(system.planets[pr.pix]);
+					float const distp_sq(p2p_dist_sq(lpos, planet.pos));
+					if (distp_sq > pt_sq) continue;
+					float const distp(sqrt(distp_sq) - planet.radius);
+
+					if (planet.is_ok() && distp < result.dist) {
+						result.assign(entry.galaxy, entry.cluster, entry.system, distp, UTYPE_PLANET, &planet);
+						result.planet = pr.pix;
+						if (distp <= 0.0) {result.val = 2; return 2;} // planet collision
+					}
+					for (unsigned m = pr.m_start; m < pr.m_end; ++m) {
+						umoon &moon(planet.moons[moons[m]]);
+						if (!moon.is_ok()) continue;
+						float const distm_sq(p2p_dist_sq(lpos, moon.pos));
+						if (distm_sq > mt_sq) continue;
+						float const distm(sqrt(distm_sq) - moon.radius);
+
+						if (distm < result.dist) {
+							result.assign(entry.galaxy, entry.cluster, entry.system, distm, UTYPE_MOON, &moon);
+							result.planet = pr.pix;
+							result.moon   = moons[m];
+							if (distm <= 0.0) {result.val = 1; return 2;} // moon collision
+						}
+					} // for m
+				} // for p
+				result.val = ((result.dist < CELL_SIZE) ? 1 : -1);
+				return (result.val == 1);
+			}
+		}
+	}
+	++num_misses;
+	return universe.get_object_closest_to_pos(result, pos, include_asteroids, 1.0, r_add);
+}
+
+
 void check_asteroid_belt_coll(std::shared_ptr<uasteroid_belt> asteroid_belt, point const &curr, vector3d const &dir, float dist, float line_radius,
 	int cix, int six, int pix, s_object &result, point &coll, float &ctest_dist, float &asteroid_dist, float &ldist)
 {
@@ -8,6 +8,8 @@
 #include "asteroid.h"
 #include "timetest.h"
 #include "openal_wrap.h"
+#include "profiler.h"
+#include <thread>
 #ifdef _OPENMP
 #include <omp.h>
 #endif
@@ -17,23 +19,25 @@ bool const TIMETEST           = (GLOBAL_TIMETEST || 0);
 bool const ORBITAL_REGEN      = 0;
 bool const PRINT_OWNERSHIP    = 0;
 bool const PLAYER_SLOW_PLANET_APPROACH = 1;
+bool const USE_SOBJ_QUERY_CACHE = 1; // cache closest body queries for objects inside star systems
 unsigned const GRAV_CHECK_MOD = 4; // must be a multiple of 2
 
 
 float last_temp(-100.0);
 string player_killer;
 s_object clobj0; // closest object to player
+sobj_query_cache_t sobj_query_cache;
 pos_dir_up player_pdu;
 cobj_vector_t const empty_cobjs; // always empty
 unsigned owner_counts[NUM_ALIGNMENT] = {0};
 float resource_counts[NUM_ALIGNMENT] = {0.0};
 
 
-extern bool claim_planet, water_is_lava, no_shift_universe;
-extern int uxyz[], window_width, window_height, do_run, fire_key, display_mode, DISABLE_WATER, frame_counter;
-extern unsigned NUM_THREADS;
+extern bool claim_planet, water_is_lava, no_shift_universe, disable_sound;
+extern int uxyz[], window_width, window_height, do_run, fire_key, display_mode, DISABLE_WATER, frame_counter, world_mode, animate2, iticks;
+extern unsigned NUM_THREADS, univ_bench_frames, univ_bench_ships;
 extern float zmax, zmin, fticks, univ_temp, temperature, atmosphere, vegetation, base_gravity, urm_static;
-extern float water_h_off_rel, init_temperature, camera_shake;
+extern float water_h_off_rel, init_temperature, camera_shake, univ_bench_fticks;
 extern double tfticks;
 extern unsigned char **water_enabled;
 extern unsigned team_credits[];
@@ -64,9 +68,17 @@ void add_player_ship_engine_light();
 
 #ifdef _OPENMP
 int omp_get_thread_num_3dw() {return omp_get_thread_num();} // where does this belong?
+int omp_get_max_threads_3dw() {return omp_get_max_threads();}
+void omp_enable_nested_3dw() {if (omp_get_max_active_levels() < 2) {omp_set_max_active_levels(2);}} // for parallel loops inside parallel sections
+void omp_set_num_threads_3dw(int num) {omp_set_num_threads(num);} // applies to the calling thread only
 #else
 int omp_get_thread_num_3dw() {return 0;}
+int omp_get_max_threads_3dw() {return 1;}
+void omp_enable_nested_3dw() {}
+void omp_set_num_threads_3dw(int num) {}
 #endif
+std::thread::id const main_thread_id(std::this_thread::get_id()); // static init runs on the main thread
+bool on_main_thread_3dw() {return (std::this_thread::get_id() == main_thread_id);} // the thread with the GL context; false for OpenMP and std::thread workers
 
 void init_universe_display() {
 
@@ -325,6 +337,91 @@ void draw_universe(bool static_only, bool skip_closest, bool no_move, int no_dis
 }
 
 
+void spawn_benchmark_battle(unsigned ships_per_team) {
+
+	unsigned const ship_types[] = {USC_FIGHTER, USC_FRIGATE, USC_DESTROYER, USC_LCRUISER, USC_HCRUISER, USC_GUNSHIP};
+	unsigned const num_types(sizeof(ship_types)/sizeof(unsigned)), teams[2] = {ALIGN_RED, ALIGN_BLUE};
+	point center(get_player_pos2());
+	s_object result;
+
+	if (universe.get_close_system(center, result, 4.0)) { // place the battle inside the closest system so that bodies affect the ships
+		ussystem const &system(result.get_system());
+		center = result.get_ucell().rel_center + system.pos + vector3d(0.5*system.radius, 0.0, 0.0);
+	}
+	for (unsigned t = 0; t < 2; ++t) {
+		point const team_center(center + vector3d(0.0, (t ? 0.05 : -0.05), 0.0));
+		unsigned num_added(0);
+
+		for (unsigned i = 0; i < ships_per_team; ++i) {
+			unsigned const sclass(ship_types[i % num_types]);
+			if (!sclasses[sclass].inited || sclasses[sclass].orbiting_dock || !sclasses[sclass].can_move()) continue;
+			add_ship(sclass, teams[t], AI_ATT_ENEMY, TARGET_CLOSEST, team_center, 0.04);
+			++num_added;
+		}
+		cout << "Added " << num_added << " benchmark ships to team " << t << endl;
+	}
+}
+
+
+size_t get_universe_state_hash() { // FNV-1a over the state of all free objects
+
+	size_t hash(14695981039346656037ULL);
+	auto add_bytes([&hash](void const *data, size_t sz) {
+		for (size_t i = 0; i < sz; ++i) {hash = (hash ^ ((unsigned char const *)data)[i])*1099511628211ULL;}
+	});
+	for (auto i = uobjs.begin(); i != uobjs.end(); ++i) {
+		free_obj const *const obj(*i);
+		unsigned const vals[3] = {obj->get_obj_id(), obj->get_align(), obj->is_ok()};
+		float const damage(obj->get_damage());
+		add_bytes(vals, sizeof(vals));
+		add_bytes(&obj->get_pos(), sizeof(upos_point_type));
+		add_bytes(&obj->get_velocity(), sizeof(vector3d));
+		add_bytes(&damage, sizeof(float));
+	}
+	return hash;
+}
+
+
+// headless: steps the universe simulation with fixed fticks without creating a window or GL context, then prints per-phase timings and a state hash;
+// the universe itself is generated from cell positions, while ship spawning and AI use the rand_seed config value
+void run_universe_benchmark() {
+
+	cout << "Running universe benchmark for " << univ_bench_frames << " frames with " << univ_bench_ships << " ships per team" << endl;
+	world_mode    = WMODE_UNIVERSE;
+	animate2      = 1;
+	disable_sound = 1;
+	fticks        = univ_bench_fticks;
+	iticks        = 1;
+	do_univ_init();
+	check_shift_universe();
+	set_univ_pdu();
+	draw_universe_all(1, 0, 0, 0, 1, 1); // generate the universe around the player; gen_only=1
+	spawn_benchmark_battle(univ_bench_ships);
+	proc_uobjs_first_frame();
+	toggle_timing_profiler(); // accumulate phase timings rather than printing them every frame
+	highres_timer_t total_timer("Univ Benchmark Total");
+
+	for (unsigned frame = 0; frame < univ_bench_frames; ++frame) {
+		tfticks += fticks;
+		set_univ_pdu();
+		apply_univ_physics(); // purge, cached objs, AI, physics, collision
+		++frame_counter;
+		{
+			highres_timer_t timer("Univ Proc Objs");
+			process_ships(0);
+		}
+		{
+			highres_timer_t timer("Univ Update Bodies");
+			draw_universe_all(1, 0, 0, 0, 1, 1); // orbits and generation only; gen_only=1
+		}
+		check_shift_universe();
+	}
+	total_timer.end();
+	timing_profiler_stats();
+	cout << "Final objects: " << uobjs.size() << ", state hash: " << std::hex << get_universe_state_hash() << std::dec << endl;
+}
+
+
 void proc_collision(free_obj *const uobj, upos_point_type const &cpos, point const &coll_pos, float radius, vector3d const &velocity, float mass, float elastic, int coll_tid) {
 
 	assert(mass > 0.0);
@@ -338,6 +435,7 @@ void proc_collision(free_obj *const uobj, upos_point_type const &cpos, point con
 void process_univ_objects() {
 
 	vector<free_obj const*> stat_obj_query_res;
+	sobj_query_cache.clear(); // planets and moons have moved since the last call
 
 	for (unsigned i = 0; i < uobjs.size(); ++i) { // can we use cached_objs?
 		free_obj *const uobj(uobjs[i]);
@@ -355,7 +453,9 @@ void process_univ_objects() {
 		// skip orbiting objects (no collisions or gravity effects, temperature is mostly constant)
 		s_object clobj; // closest object
 		bool const include_asteroids(!particle); // disable particle-asteroid collisions because they're too slow
-		int const found_close(orbiting ? 0 : universe.get_object_closest_to_pos(clobj, obj_pos, include_asteroids, 1.0, (no_coll ? 0.0 : radius)));
+		float const r_add(no_coll ? 0.0 : radius);
+		int const found_close(orbiting ? 0 : (USE_SOBJ_QUERY_CACHE ? sobj_query_cache.get_object_closest_to_pos(universe, clobj, obj_pos, include_asteroids, r_add) :
+			universe.get_object_closest_to_pos(clobj, obj_pos, include_asteroids, 1.0, r_add)));
 		bool temp_known(0), has_rings(0);
 		float limit_speed_dist(clobj.dist);
 
@@ -502,6 +602,7 @@ void process_univ_objects() {
 			}
 		}
 	} // for i
+	if (TIMETEST && USE_SOBJ_QUERY_CACHE) {cout << "sobj query cache hits: " << sobj_query_cache.num_hits << ", misses: " << sobj_query_cache.num_misses << endl;}
 	claim_planet = 0; // unset the flag - should have been used by this point
 }
 
@@ -17,11 +17,11 @@ public:
 	binary_file_io() : fp(nullptr), gzf(nullptr) {}
 	~binary_file_io() {close();}
 
-	bool open(string const &filename, char const *const mode, string const &purpose) {
+	bool open(string const &filename, char const *const mode, string const &purpose, bool report_errors=1) {
 		if (filename.empty()) return 0;
 		if (is_gz_file(filename)) {gzf = gzopen(filename.c_str(), mode);} else {fp = fopen(filename.c_str(), mode);}
 		if (is_valid()) return 1;
-		std::cerr << "Failed to open file " << filename << " for " << purpose << ".";
+		if (report_errors) {std::cerr << "Failed to open file " << filename << " for " << purpose << ".";}
 		return 0;
 	}
 	bool is_valid() const {return (fp || gzf);}
@@ -38,6 +38,12 @@ public:
 			gzf = nullptr;
 		}
 	}
+	bool try_close() { // returns 0 on error rather than exiting; for best effort files such as caches
+		bool ret(1);
+		if (fp ) {ret &= (fclose(fp) == 0); fp = nullptr;}
+		if (gzf) {ret &= (gzclose(gzf) == Z_OK); gzf = nullptr;}
+		return ret;
+	}
 	static string get_extension(string const &filename) {return filename.substr(filename.find_last_of(".") + 1);}
 	static bool   is_gz_file   (string const &filename) {return (get_extension(filename) == "gz");}
 };
@@ -434,47 +434,60 @@ colorRGBA get_outdoor_light_color() {
 }
 
 unsigned const IS_WINDOW_BIT = (1<<24); // if this bit is set, the light is from a window; if not, it's from a light room object
+unsigned const MAX_LIGHTS_PER_BATCH = 8; // number of lights ray cast concurrently in one background job
 
 class building_indir_light_mgr_t {
+	struct light_job_t { // per-light ray casting parameters, computed before the rays are cast
+		unsigned light_id=0, dim=2, dir=0; // default dim is z; dir=2 is omnidirectional
+		int num_rays=0, num_pri_splits=1;
+		bool is_window=0, is_skylight=0, in_attic=0, in_ext_basement=0;
+		float weight=100.0, light_radius=0.0, tolerance=0.0;
+		point light_center;
+		vector3d ray_scale, llc_shift; // transform from building space to global scene space
+		cube_t light_cube;
+		colorRGBA lcolor, pri_lcolor;
+		vector3d light_dir; // points toward the light
+	};
 	bool is_running, kill_thread, lighting_updated, needs_to_join, need_bvh_rebuild, update_windows, is_negative_light, in_ext_basement;
-	int cur_bix, cur_light, cur_floor;
+	int cur_bix, cur_floor;
 	unsigned cur_tid;
 	colorRGBA outdoor_color;
 	cube_t valid_area, light_bounds;
 	vector<unsigned char> tex_data;
-	vector<unsigned> light_ids;
+	vector<unsigned> light_ids, cur_lights; // cur_lights are all added or all removed, depending on is_negative_light
 	vector<pair<float, unsigned>> lights_to_sort;
 	deque<unsigned> remove_queue;
 	set<unsigned> lights_complete, lights_seen;
 	vect_cube_with_ix_t windows;
 	cube_bvh_t bvh;
-	lmap_manager_t lmgr;
+	lmap_manager_t lmgr; // sum of all completed lights
+	vector<std::unique_ptr<lmap_manager_t>> light_lmgrs; // one per light in the current batch, reduced into lmgr when the batch is complete
 	std::thread rt_thread;
 
 	void init_lmgr(bool clear_lighting) {
 		if (clear_lighting) {lmgr.reset_all();}
 		if (lmgr.is_allocated()) return; // already setup
-		unsigned const tot_sz(XY_MULT_SIZE*MESH_SIZE[2]); // Note: MESH_SIZE[2], not MESH_Z_SIZE; want clipped size that lmap uses rather than user-specified size
-		lmcell init_lmcell;
-		lmgr.alloc(tot_sz, MESH_X_SIZE, MESH_Y_SIZE, MESH_SIZE[2], (unsigned char **)nullptr, init_lmcell);
+		// Note: MESH_SIZE[2], not MESH_Z_SIZE; want clipped size that lmap uses rather than user-specified size;
+		// sparse, since rays only reach the interior of the current building floor, and reset_all() frees the bricks
+		lmgr.alloc_sparse(MESH_X_SIZE, MESH_Y_SIZE, MESH_SIZE[2], lmcell());
 	}
 	void start_lighting_compute(building_t const &b) {
-		assert(cur_light >= 0);
+		assert(!cur_lights.empty());
 		init_lmgr(0); // clear_lighting=0
 		is_running = 1;
 		lighting_updated = 1;
 
-		if (USE_BKG_THREAD) { // start a thread to compute cur_light for building b
+		if (USE_BKG_THREAD) { // start a thread to compute cur_lights for building b
 			rt_thread = std::thread(&building_indir_light_mgr_t::cast_light_rays, this, b);
 			needs_to_join = 1;
 		}
 		else {
 			// per-light time for large office building: orig: 194ms, per-floor BVH: 96ms, clip rays to floor: 44ms, now 37ms
-			highres_timer_t timer("Ray Cast Building Light");
+			highres_timer_t timer("Ray Cast Building Lights");
 			cast_light_rays(b);
 		}
 	}
-	vector3d get_reflect_dir(vector3d const &dir, vector3d const &cnorm) {
+	vector3d get_reflect_dir(vector3d const &dir, vector3d const &cnorm) const {
 		vector3d v_ref;
 		calc_reflection_angle(dir, v_ref, cnorm);
 		v_ref.normalize();
@@ -486,150 +499,175 @@ class building_indir_light_mgr_t {
 		if (dot_product(dir, cnorm) < 0.0) {dir.negate();} // make sure it points away from the surface (is this needed?)
 		pos = cpos + tolerance*dir; // move slightly away from the surface
 	}
-	void cast_light_rays(building_t const &b) {
-		// Note: modifies lmgr, but otherwise thread safe
-		unsigned const num_rt_threads(max(1U, (NUM_THREADS - (USE_BKG_THREAD ? 1 : 0)))); // reserve a thread for the main thread if running in the background
-		unsigned base_num_rays(LOCAL_RAYS), dim(2), dir(0); // default dim is z; dir=2 is omnidirectional
+	light_job_t setup_light_job(building_t const &b, unsigned light_id) const {
 		cube_t const scene_bounds(get_scene_bounds_bcube()); // expected by lmap update code
-		vector3d const ray_scale(scene_bounds.get_size()/light_bounds.get_size()), llc_shift(scene_bounds.get_llc() - light_bounds.get_llc()*ray_scale);
-		float const tolerance(1.0E-5*valid_area.get_max_dim_sz());
-		bool const is_window(cur_light & IS_WINDOW_BIT);
-		bool in_attic(0), in_ext_basement(0), is_skylight(0);
-		float weight(100.0), light_radius(0.0);
-		point light_center;
-		cube_t light_cube;
-		colorRGBA lcolor, pri_lcolor;
-		vector3d light_dir; // points toward the light
-		assert(cur_light >= 0);
-
-		if (is_window) { // window
-			unsigned const window_ix(cur_light & ~IS_WINDOW_BIT);
+		light_job_t job;
+		job.light_id  = light_id;
+		job.is_window = (light_id & IS_WINDOW_BIT);
+		job.ray_scale = scene_bounds.get_size()/light_bounds.get_size();
+		job.llc_shift = scene_bounds.get_llc() - light_bounds.get_llc()*job.ray_scale;
+		job.tolerance = 1.0E-5*valid_area.get_max_dim_sz();
+		unsigned base_num_rays(LOCAL_RAYS);
+
+		if (job.is_window) { // window
+			unsigned const window_ix(light_id & ~IS_WINDOW_BIT);
 			assert(window_ix < windows.size());
 			cube_with_ix_t const &window(windows[window_ix]);
 			float surface_area(0.0);
-			light_cube = window;
+			job.light_cube = window;
 
 			if (window.dz() < min(window.dx(), window.dy())) { // skylight; we could encode skylights as a different ix, but testing aspect ratio is easier
-				is_skylight    = 1;
-				surface_area   = window.dx()*window.dy();
-				base_num_rays *= 8; // more rays, since skylights are larger and can cover multiple rooms
-				weight        *= 10.0; // stronger due to direct sun/moon/cloud lighting and reduced occlusion from buildings and terrain
-				light_cube.translate_dim(2, -b.get_fc_thickness()); // shift slightly down into the building to avoid collision with the roof/ceiling
+				job.is_skylight = 1;
+				surface_area    = window.dx()*window.dy();
+				base_num_rays  *= 8; // more rays, since skylights are larger and can cover multiple rooms
+				job.weight     *= 10.0; // stronger due to direct sun/moon/cloud lighting and reduced occlusion from buildings and terrain
+				job.light_cube.translate_dim(2, -b.get_fc_thickness()); // shift slightly down into the building to avoid collision with the roof/ceiling
 				// select primary light rays oriented away from the sun/moon; doesn't work well due to reduced ray scattering
-				light_dir     = get_light_pos().get_norm(); // more accurate, but requires indir to be recomputed when sun/moon pos changes
-				//light_dir     = plus_z; // make it vertical so that it doesn't need to be updated when the sun/moon pos changes
-				lcolor        = cur_ambient*2.0; // split rays into two groups for ambient and diffuse
-				pri_lcolor    = cur_diffuse;
-				dir           = 1; // pointed up
+				job.light_dir   = get_light_pos().get_norm(); // more accurate, but requires indir to be recomputed when sun/moon pos changes
+				//job.light_dir   = plus_z; // make it vertical so that it doesn't need to be updated when the sun/moon pos changes
+				job.lcolor      = cur_ambient*2.0; // split rays into two groups for ambient and diffuse
+				job.pri_lcolor  = cur_diffuse;
+				job.dir         = 1; // pointed up
 			}
 			else { // normal window
 				assert(window.ix < 4); // encodes 2*dim + dir
-				dim =  bool(window.ix >> 1);
-				dir = !bool(window.ix &  1); // cast toward the interior
-				surface_area = window.dz()*window.get_sz_dim(!bool(dim));
-				light_cube.translate_dim(dim, (dir ? 1.0 : -1.0)*0.5*b.get_wall_thickness()); // shift slightly inside the building to avoid collision with the exterior wall
-				lcolor = outdoor_color;
+				job.dim =  bool(window.ix >> 1);
+				job.dir = !bool(window.ix &  1); // cast toward the interior
+				surface_area = window.dz()*window.get_sz_dim(!bool(job.dim));
+				job.light_cube.translate_dim(job.dim, (job.dir ? 1.0 : -1.0)*0.5*b.get_wall_thickness()); // shift slightly inside the building to avoid collision with the exterior wall
+				job.lcolor = outdoor_color;
 			}
 			// light intensity scales with surface area, since incoming light is a constant per unit area (large windows = more light)
-			weight *= surface_area/0.0016f; // a fraction the surface area weight of lights
+			job.weight *= surface_area/0.0016f; // a fraction the surface area weight of lights
 		}
 		else { // room light or lamp, pointing downward
 			vect_room_object_t const &objs(b.interior->room_geom->objs);
-			assert((unsigned)cur_light < objs.size());
-			room_object_t const &ro(objs[cur_light]);
+			assert(light_id < objs.size());
+			room_object_t const &ro(objs[light_id]);
 			bool const light_in_basement(ro.z1() < b.ground_floor_z1), is_lamp(ro.type == TYPE_LAMP);
-			light_cube      = ro;
-			light_cube.z1() = light_cube.z2() = (ro.z1() - 0.01*ro.dz()); // set slightly below bottom of light
-			light_center    = light_cube.get_cube_center();
-			in_attic        = ro.in_attic();
-			in_ext_basement = (light_in_basement && b.point_in_extended_basement_not_basement(light_center));
-			if (in_attic) {base_num_rays *= 4;} // more rays in attic, since light is large and there are only 1-2 of them
-			if (is_lamp ) {base_num_rays /= 2;} // half the rays for lamps
-			if (is_lamp ) {dir = 2;} // onmidirectional; dim stays at 2/Z
+			job.light_cube      = ro;
+			job.light_cube.z1() = job.light_cube.z2() = (ro.z1() - 0.01*ro.dz()); // set slightly below bottom of light
+			job.light_center    = job.light_cube.get_cube_center();
+			job.in_attic        = ro.in_attic();
+			job.in_ext_basement = (light_in_basement && b.point_in_extended_basement_not_basement(job.light_center));
+			if (job.in_attic) {base_num_rays *= 4;} // more rays in attic, since light is large and there are only 1-2 of them
+			if (is_lamp     ) {base_num_rays /= 2;} // half the rays for lamps
+			if (is_lamp     ) {job.dir = 2;} // onmidirectional; dim stays at 2/Z
 			float const surface_area(ro.dx()*ro.dy() + 2.0f*(ro.dx() + ro.dy())*ro.dz()); // bottom + 4 sides (top is occluded), 0.0003 for houses
-			lcolor  = (is_lamp ? LAMP_COLOR : ro.get_color());
-			weight *= surface_area/0.0003f;
-			if (b.has_pri_hall())     {weight *= 0.70;} // floorplan is open and well lit, indir lighting value seems too high
-			if (ro.type == TYPE_LAMP) {weight *= 0.33;} // lamps are less bright
-			if (light_in_basement)    {weight *= ((b.has_parking_garage && !in_ext_basement) ? 0.25 : 0.5);} // basement is darker, parking garages are even darker
-			if (in_attic)             {weight *= ATTIC_LIGHT_RADIUS_SCALE*ATTIC_LIGHT_RADIUS_SCALE;} // based on surface area rather than radius
-			if (ro.is_round())        {light_radius = ro.get_radius();}
-		}
-		if (b.is_house)        {weight *=  2.0;} // houses have dimmer lights and seem to work better with more indir
-		if (is_negative_light) {weight *= -1.0;}
-		weight /= base_num_rays; // normalize to the number of rays
-		unsigned NUM_PRI_SPLITS(is_window ? 4 : 16); // we're counting primary rays for windows, use fewer primary splits to reduce noise at the cost of increased time
-		max_eq(base_num_rays, NUM_PRI_SPLITS);
-		int const num_rays(base_num_rays/NUM_PRI_SPLITS);
+			job.lcolor  = (is_lamp ? LAMP_COLOR : ro.get_color());
+			job.weight *= surface_area/0.0003f;
+			if (b.has_pri_hall())     {job.weight *= 0.70;} // floorplan is open and well lit, indir lighting value seems too high
+			if (ro.type == TYPE_LAMP) {job.weight *= 0.33;} // lamps are less bright
+			if (light_in_basement)    {job.weight *= ((b.has_parking_garage && !job.in_ext_basement) ? 0.25 : 0.5);} // basement is darker, parking garages are even darker
+			if (job.in_attic)         {job.weight *= ATTIC_LIGHT_RADIUS_SCALE*ATTIC_LIGHT_RADIUS_SCALE;} // based on surface area rather than radius
+			if (ro.is_round())        {job.light_radius = ro.get_radius();}
+		}
+		if (b.is_house)        {job.weight *=  2.0;} // houses have dimmer lights and seem to work better with more indir
+		if (is_negative_light) {job.weight *= -1.0;}
+		job.weight /= base_num_rays; // normalize to the number of rays
+		job.num_pri_splits = (job.is_window ? 4 : 16); // we're counting primary rays for windows, use fewer primary splits to reduce noise at the cost of increased time
+		max_eq(base_num_rays, (unsigned)job.num_pri_splits);
+		job.num_rays = base_num_rays/job.num_pri_splits;
+		return job;
+	}
+	void cast_light_rays(building_t const &b) {
+		// Note: modifies lmgr and light_lmgrs, but otherwise thread safe
+		unsigned const num_rt_threads(max(1U, (NUM_THREADS - (USE_BKG_THREAD ? 1 : 0)))); // reserve a thread for the main thread if running in the background
+		unsigned const num_lights(cur_lights.size());
+		assert(num_lights > 0);
+		vector<light_job_t> jobs;
+		vector<int> ray_start(1, 0); // prefix sum of jobs[i].num_rays
 		building_colors_t bcolors;
 		b.set_building_colors(bcolors);
-		
+
+		for (unsigned light_id : cur_lights) {
+			jobs.push_back(setup_light_job(b, light_id));
+			ray_start.push_back(ray_start.back() + jobs.back().num_rays);
+		}
+		while (light_lmgrs.size() < num_lights) {light_lmgrs.emplace_back(new lmap_manager_t);}
+
+		for (unsigned i = 0; i < num_lights; ++i) {
+			if (!light_lmgrs[i]->is_allocated()) {light_lmgrs[i]->alloc_sparse(MESH_X_SIZE, MESH_Y_SIZE, MESH_SIZE[2], lmcell());}
+		}
+		// rays for all lights in the batch are processed in one loop so that threads don't go idle at the end of each light;
+		// each light accumulates into its own lmap, so that rays from different lights don't race on the same cells
 		// Note: dynamic scheduling is faster, and using blocks doesn't help
 #pragma omp parallel for schedule(dynamic) num_threads(num_rt_threads)
-		for (int n = 0; n < num_rays; ++n) {
+		for (int r = 0; r < ray_start.back(); ++r) {
 			if (kill_thread) continue;
-			rand_gen_t rgen;
-			rgen.set_state(n+1, cur_light); // should be deterministic, though add_path_to_lmcs() is not (due to thread races)
-			vector3d pri_dir;
-			colorRGBA ray_lcolor(lcolor), ccolor(WHITE);
-			bool const is_skylight_dir(is_skylight && (n&1)); // alternate between sky ambient and sun/moon directional
+			unsigned const job_ix(std::upper_bound(ray_start.begin(), ray_start.end(), r) - ray_start.begin() - 1);
+			assert(job_ix < num_lights);
+			cast_light_ray(b, jobs[job_ix], (r - ray_start[job_ix]), bcolors, *light_lmgrs[job_ix]);
+		}
+		if (!kill_thread) { // reduce per-light results into lmgr
+			for (unsigned i = 0; i < num_lights; ++i) {lmgr.add_lighting_from(*light_lmgrs[i], LIGHTING_LOCAL);}
+		}
+		for (unsigned i = 0; i < num_lights; ++i) {light_lmgrs[i]->reset_all();} // free bricks
+		is_running = 0; // flag as done
+	}
+	void cast_light_ray(building_t const &b, light_job_t const &job, int n, building_colors_t const &bcolors, lmap_manager_t &dest) const {
+		vector3d const &ray_scale(job.ray_scale), &llc_shift(job.llc_shift);
+		float const tolerance(job.tolerance);
+		rand_gen_t rgen;
+		rgen.set_state(n+1, job.light_id); // should be deterministic, though add_path_to_lmcs() is not (due to thread races)
+		vector3d pri_dir;
+		colorRGBA ray_lcolor(job.lcolor), ccolor(WHITE);
+		bool const is_skylight_dir(job.is_skylight && (n&1)); // alternate between sky ambient and sun/moon directional
 			
-			if (is_skylight_dir) { // skylight directional diffuse
-				pri_dir    = light_dir;
-				ray_lcolor = pri_lcolor;
+		if (is_skylight_dir) { // skylight directional diffuse
+			pri_dir    = job.light_dir;
+			ray_lcolor = job.pri_lcolor;
+		}
+		else { // omidirectional or sky ambient from windows
+			pri_dir = rgen.signed_rand_vector_spherical().get_norm(); // should this be cosine weighted for windows?
+			if (job.is_window && ((pri_dir[job.dim] > 0.0) ^ bool(job.dir))) {pri_dir[job.dim] *= -1.0;} // reflect light if needed about window plane to ensure it enters the room
+			//if (!job.is_window && job.dim == 2 && job.dir == 2 && pri_dir.z > 0.0) {pri_dir.z = -pri_dir.z;} // must point down
+		}
+		float const lum_thresh(0.1*ray_lcolor.get_luminance());
+		point origin, init_cpos, cpos;
+		vector3d init_cnorm, cnorm;
+
+		// select a random point on the light cube
+		for (unsigned N = 0; N < 10; ++N) { // 10 attempts to find a point within the light shape
+			for (unsigned d = 0; d < 3; ++d) {
+				float const lo(job.light_cube.d[d][0]), hi(job.light_cube.d[d][1]);
+				origin[d] = ((lo == hi) ? lo : rgen.rand_uniform(lo, hi));
 			}
-			else { // omidirectional or sky ambient from windows
-				pri_dir = rgen.signed_rand_vector_spherical().get_norm(); // should this be cosine weighted for windows?
-				if (is_window && ((pri_dir[dim] > 0.0) ^ dir)) {pri_dir[dim] *= -1.0;} // reflect light if needed about window plane to ensure it enters the room
-				//if (!is_window && dim == 2 && dir == 2 && pri_dir.z > 0.0) {pri_dir.z = -pri_dir.z;} // must point down
-			}
-			float const lum_thresh(0.1*ray_lcolor.get_luminance());
-			point origin, init_cpos, cpos;
-			vector3d init_cnorm, cnorm;
-
-			// select a random point on the light cube
-			for (unsigned N = 0; N < 10; ++N) { // 10 attempts to find a point within the light shape
-				for (unsigned d = 0; d < 3; ++d) {
-					float const lo(light_cube.d[d][0]), hi(light_cube.d[d][1]);
-					origin[d] = ((lo == hi) ? lo : rgen.rand_uniform(lo, hi));
+			if (job.light_radius == 0.0 || dist_xy_less_than(origin, job.light_center, job.light_radius)) break; // done/success
+		} // for N
+		init_cpos = origin; // init value
+		bool const hit(b.ray_cast_interior(origin, pri_dir, valid_area, bvh, job.in_attic, job.in_ext_basement, bcolors, init_cpos, init_cnorm, ccolor, &rgen));
+
+		// room lights already contribute direct lighting, so we skip this ray; however, windows don't, so we add their primary ray contribution
+		if (job.is_window && /*!is_skylight_dir*/!job.is_skylight && init_cpos != origin) {
+			point const p1(origin*ray_scale + llc_shift), p2(init_cpos*ray_scale + llc_shift); // transform building space to global scene space
+			add_path_to_lmcs(&dest, nullptr, p1, p2, job.weight, ray_lcolor*job.num_pri_splits, LIGHTING_LOCAL, 0); // local light, no bcube; scale color based on splits
+		}
+		if (!hit) return; // done
+		colorRGBA const init_color(ray_lcolor.modulate_with(ccolor));
+		if (init_color.get_luminance() < lum_thresh) return; // done (Note: get_weighted_luminance() will discard too much blue light)
+		vector3d const v_ref(get_reflect_dir(pri_dir, init_cnorm));
+
+		for (int splits = 0; splits < job.num_pri_splits; ++splits) {
+			point pos(origin);
+			vector3d dir(pri_dir);
+			colorRGBA cur_color(init_color);
+			calc_reflect_ray(pos, init_cpos, dir, init_cnorm, v_ref, rgen, tolerance);
+
+			for (unsigned bounce = 1; bounce < MAX_RAY_BOUNCES; ++bounce) { // allow up to MAX_RAY_BOUNCES bounces
+				cpos = pos; // init value
+				bool const hit(b.ray_cast_interior(pos, dir, valid_area, bvh, job.in_attic, job.in_ext_basement, bcolors, cpos, cnorm, ccolor, &rgen));
+
+				if (cpos != pos) { // accumulate light along the ray from pos to cpos (which is always valid) with color cur_color
+					point const p1(pos*ray_scale + llc_shift), p2(cpos*ray_scale + llc_shift); // transform building space to global scene space
+					add_path_to_lmcs(&dest, nullptr, p1, p2, job.weight, cur_color, LIGHTING_LOCAL, 0); // local light, no bcube
 				}
-				if (light_radius == 0.0 || dist_xy_less_than(origin, light_center, light_radius)) break; // done/success
-			} // for N
-			init_cpos = origin; // init value
-			bool const hit(b.ray_cast_interior(origin, pri_dir, valid_area, bvh, in_attic, in_ext_basement, bcolors, init_cpos, init_cnorm, ccolor, &rgen));
-
-			// room lights already contribute direct lighting, so we skip this ray; however, windows don't, so we add their primary ray contribution
-			if (is_window && /*!is_skylight_dir*/!is_skylight && init_cpos != origin) {
-				point const p1(origin*ray_scale + llc_shift), p2(init_cpos*ray_scale + llc_shift); // transform building space to global scene space
-				add_path_to_lmcs(&lmgr, nullptr, p1, p2, weight, ray_lcolor*NUM_PRI_SPLITS, LIGHTING_LOCAL, 0); // local light, no bcube; scale color based on splits
-			}
-			if (!hit) continue; // done
-			colorRGBA const init_color(ray_lcolor.modulate_with(ccolor));
-			if (init_color.get_luminance() < lum_thresh) continue; // done (Note: get_weighted_luminance() will discard too much blue light)
-			vector3d const v_ref(get_reflect_dir(pri_dir, init_cnorm));
-
-			for (unsigned splits = 0; splits < NUM_PRI_SPLITS; ++splits) {
-				point pos(origin);
-				vector3d dir(pri_dir);
-				colorRGBA cur_color(init_color);
-				calc_reflect_ray(pos, init_cpos, dir, init_cnorm, v_ref, rgen, tolerance);
-
-				for (unsigned bounce = 1; bounce < MAX_RAY_BOUNCES; ++bounce) { // allow up to MAX_RAY_BOUNCES bounces
-					cpos = pos; // init value
-					bool const hit(b.ray_cast_interior(pos, dir, valid_area, bvh, in_attic, in_ext_basement, bcolors, cpos, cnorm, ccolor, &rgen));
-
-					if (cpos != pos) { // accumulate light along the ray from pos to cpos (which is always valid) with color cur_color
-						point const p1(pos*ray_scale + llc_shift), p2(cpos*ray_scale + llc_shift); // transform building space to global scene space
-						add_path_to_lmcs(&lmgr, nullptr, p1, p2, weight, cur_color, LIGHTING_LOCAL, 0); // local light, no bcube
-					}
-					if (!hit) break; // done
-					cur_color = cur_color.modulate_with(ccolor);
-					if (cur_color.get_luminance() < lum_thresh) break; // done
-					calc_reflect_ray(pos, cpos, dir, cnorm, get_reflect_dir(dir, cnorm), rgen, tolerance);
-				} // for bounce
-			} // for splits
-		} // for n
-		is_running = 0; // flag as done
+				if (!hit) break; // done
+				cur_color = cur_color.modulate_with(ccolor);
+				if (cur_color.get_luminance() < lum_thresh) break; // done
+				calc_reflect_ray(pos, cpos, dir, cnorm, get_reflect_dir(dir, cnorm), rgen, tolerance);
+			} // for bounce
+		} // for splits
 	}
 	void wait_for_finish(bool force_kill) {
 		// Note: for now the time taken to process a light should be pretty fast so we just block until finished; set kill_thread=1 to be faster
@@ -678,17 +716,17 @@ class building_indir_light_mgr_t {
 	}
 public:
 	building_indir_light_mgr_t() : is_running(0), kill_thread(0), lighting_updated(0), needs_to_join(0), need_bvh_rebuild(0),
-		update_windows(0), is_negative_light(0), in_ext_basement(0), cur_bix(-1), cur_light(-1), cur_floor(-1), cur_tid(0) {}
+		update_windows(0), is_negative_light(0), in_ext_basement(0), cur_bix(-1), cur_floor(-1), cur_tid(0) {}
 
 	cube_t get_light_bounds() const {return light_bounds;}
 
 	void invalidate_lighting() {
+		end_rt_job(); // must join the ray trace thread before clearing the lights it's iterating over
 		is_negative_light = in_ext_basement = 0;
-		cur_light = -1;
+		cur_lights.clear();
 		remove_queue.clear();
 		lights_complete.clear();
 		lights_seen.clear();
-		end_rt_job();
 		lmgr.reset_all(); // clear lighting values back to 0
 	}
 	void clear() {
@@ -756,13 +794,14 @@ public:
 		if (!need_rebuild) {need_bvh_rebuild |= floor_change;} // rebuild on player floor change if not rebuilt above
 		if (need_bvh_rebuild) {build_bvh(b, target);}
 		
-		if (cur_light >= 0) {
-			if (!is_negative_light) {lights_complete.insert(cur_light);} // mark the most recent light as complete if not a light removal
-			cur_light = -1;
-		}
-		if (!remove_queue.empty()) { // remove an existing light; must run even when player_in_elevator>=2 (doors closed/moving) to remove elevator light at old pos
-			cur_light = remove_queue.front();
-			remove_queue.pop_front();
+		if (!is_negative_light) {lights_complete.insert(cur_lights.begin(), cur_lights.end());} // mark the most recent lights as complete if not a light removal
+		cur_lights.clear();
+
+		if (!remove_queue.empty()) { // remove existing lights; must run even when player_in_elevator>=2 (doors closed/moving) to remove elevator light at old pos
+			while (!remove_queue.empty() && cur_lights.size() < MAX_LIGHTS_PER_BATCH) {
+				cur_lights.push_back(remove_queue.front());
+				remove_queue.pop_front();
+			}
 			is_negative_light = 1;
 		}
 		else { // find a new light to add
@@ -774,10 +813,11 @@ public:
 
 			for (auto i = light_ids.begin(); i != light_ids.end(); ++i) {
 				lights_seen.insert(*i); // must track lights across all floors seen for correct progress update
-				if (cur_light < 0 && lights_complete.find(*i) == lights_complete.end()) {cur_light = *i;} // find an incomplete light
+				// find the highest priority incomplete lights
+				if (cur_lights.size() < MAX_LIGHTS_PER_BATCH && lights_complete.find(*i) == lights_complete.end()) {cur_lights.push_back(*i);}
 			}
 		}
-		if (cur_light >= 0) {start_lighting_compute(b);} // this light is next
+		if (!cur_lights.empty()) {start_lighting_compute(b);} // these lights are next
 		tid = cur_tid;
 	}
 	void register_light_state_change(unsigned light_ix, bool light_is_on, bool in_elevator, bool geom_changed) {
@@ -786,8 +826,8 @@ public:
 			return;
 		}
 		unsigned const num_erased(lights_complete.erase(light_ix)); // light is no longer completed; erase its state
-		bool const is_cur_light((int)light_ix == cur_light && is_running);
-		// Note: we can't just stop in the middle, because that will leave cur_light in an invalid/incomplete state
+		bool const is_cur_light(is_running && std::find(cur_lights.begin(), cur_lights.end(), light_ix) != cur_lights.end());
+		// Note: we can't just stop in the middle, because that will leave cur_lights in an invalid/incomplete state
 		// Note: if door state changed since this light was turned on, removing it may leave some light
 		if ((geom_changed || !light_is_on || (in_elevator && num_erased)) && (num_erased || is_cur_light)) {add_to_remove_queue(light_ix);} // must remove the light instead
 	}
@@ -1083,7 +1123,7 @@ void building_t::refine_light_bcube(point const &lpos, float light_radius, room_
 	//highres_timer_t timer("refine_light_bcube"); // 0.035ms average
 	assert(has_room_geom());
 	cube_t tight_bcube, part;
-	static vect_cube_t other_parts, walls[2];
+	thread_local vect_cube_t other_parts, walls[2]; // see building_t::gen_room_geom()
 	other_parts.clear();
 
 	// first determine the union of all intersections with parts; ignore zvals here so that we get the same result for every floor
@@ -4,6 +4,7 @@
 #include "function_registry.h"
 #include "buildings.h"
 #include "city_objects.h" // for sign_t
+#include <mutex>
 
 using std::string;
 
@@ -84,8 +85,10 @@ void gen_text_verts(vector<vert_tc_t> &verts, point const &pos, string const &te
 class sign_helper_t {
 	map<string, unsigned> txt_to_id;
 	vector<string> text;
+	mutable std::mutex mtx; // text is registered by the background room geom thread while the main thread registers and reads it
 public:
 	unsigned register_text(string const &t) {
+		std::lock_guard<std::mutex> lock(mtx);
 		auto it(txt_to_id.find(t));
 		if (it != txt_to_id.end()) return it->second; // found
 		unsigned const id(text.size());
@@ -94,7 +97,8 @@ public:
 		assert(text.size() == txt_to_id.size());
 		return id;
 	}
-	string const &get_text(unsigned id) const {
+	string get_text(unsigned id) const { // returned by value since text may be reallocated by another thread
+		std::lock_guard<std::mutex> lock(mtx);
 		assert(id < text.size());
 		return text[id];
 	}
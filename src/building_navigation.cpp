@@ -551,6 +551,31 @@ public:
 		if (maybe_shorten_path(p2, p1, p, keepout)) return 1;
 		return 0;
 	}
+	building_cube_nav_grid const &get_nav_grid(building_t const &building, cube_t const &walk_area, vect_cube_t const &avoid,
+		unsigned floor_ix, unsigned num_floors, float floor_spacing) const
+	{
+		if (nav_grids.empty()) {nav_grids.resize(num_floors);} else {assert(nav_grids.size() == num_floors);}
+		building_cube_nav_grid &nav_grid(nav_grids[floor_ix]);
+		if (nav_grid.is_valid()) return nav_grid; // already built and cached
+		//highres_timer_t timer("Build Nav Grid");
+		// Note: built once, so must use avoid rather than keepout; this means that our path finding will likely fail even when p1 or p2 coll is disabled
+		// since walk_area is room area shrunk by the person radius, it can vary slightly depending on the size of the person to first get here
+		cube_t walk_area_this_floor(walk_area);
+		float const floor_zval(walk_area.z1() + floor_ix*floor_spacing + building.get_fc_thickness());
+		set_cube_zvals(walk_area_this_floor, floor_zval, (floor_zval + building.get_floor_ceil_gap())); // limit to floor-ceil space for this floor
+		vect_cube_t blockers;
+		blockers.reserve(avoid.size());
+
+		for (cube_t const &c : avoid) {
+			if (c.intersects(walk_area_this_floor)) {blockers.push_back(c);}
+		}
+		// Note: doorway width is 2.38x coll radius
+		float const grid_radius(get_ped_coll_radius()); // use conservative person radius so that we can reuse across people
+		nav_grid.build_for_building(walk_area_this_floor, blockers, building.interior->door_stacks, building.interior->stairwells, stairs_extend, grid_radius);
+		//nav_grid.create_debug_objs(building.interior->room_geom->objs); // for debugging; modifies building, which should be const
+		//building.interior->room_geom->invalidate_small_geom();
+		return nav_grid;
+	}
 	// add any necessary points to <path> that are required to get from <p1> to <p2> inside <walk_area> without intersecting <avoid>
 	// return: 0=failed, 1=regular path, 2=nav grid path
 	int connect_room_endpoints(vect_cube_t const &avoid, building_t const &building, cube_t const &walk_area, unsigned room_ix, point const &p1, point const &p2,
@@ -646,29 +671,11 @@ public:
 			float const floor_spacing(building.get_window_vspace());
 			unsigned const num_floors(round_fp(walk_area.dz()/floor_spacing)), floor_ix(floor((p1.z - walk_area.z1())/floor_spacing));
 			assert(num_floors > 0 && floor_ix < num_floors);
-			if (nav_grids.empty()) {nav_grids.resize(num_floors);} else {assert(nav_grids.size() == num_floors);}
-			building_cube_nav_grid &nav_grid(nav_grids[floor_ix]);
-
-			if (!nav_grid.is_valid()) { // build once and cache
-				//highres_timer_t timer("Build Nav Grid");
-				// Note: built once, so must use avoid rather than keepout; this means that our path finding will likely fail even when p1 or p2 coll is disabled
-				// since walk_area is room area shrunk by the person radius, it can vary slightly depending on the size of the person to first get here
-				cube_t walk_area_this_floor(walk_area);
-				float const floor_zval(walk_area.z1() + floor_ix*floor_spacing + building.get_fc_thickness());
-				set_cube_zvals(walk_area_this_floor, floor_zval, (floor_zval + building.get_floor_ceil_gap())); // limit to floor-ceil space for this floor
-				vect_cube_t blockers;
-				blockers.reserve(avoid.size());
-
-				for (cube_t const &c : avoid) {
-					if (c.intersects(walk_area_this_floor)) {blockers.push_back(c);}
-				}
-				// Note: doorway width is 2.38x coll radius
-				float const grid_radius(get_ped_coll_radius()); // use conservative person radius so that we can reuse across people
-				nav_grid.build_for_building(walk_area_this_floor, blockers, building.interior->door_stacks, building.interior->stairwells, stairs_extend, grid_radius);
-				//nav_grid.create_debug_objs(building.interior->room_geom->objs); // for debugging; modifies building, which should be const
-				//building.interior->room_geom->invalidate_small_geom();
-			}
-			if (nav_grid.find_path(p1, p2, path)) {path.uses_nav_grid = 1; return 2;}
+			building_cube_nav_grid const *nav_grid(nullptr);
+			// path queries for different people may be run in parallel, so only one thread at a time can check and build the cached grid
+#pragma omp critical(build_nav_grid)
+			nav_grid = &get_nav_grid(building, walk_area, avoid, floor_ix, num_floors, floor_spacing);
+			if (nav_grid->find_path(p1, p2, path)) {path.uses_nav_grid = 1; return 2;}
 		}
 		// else, what about parking garages and retail areas?
 		return 0; // failed
@@ -981,8 +988,8 @@ bool building_t::are_rooms_connected_without_using_room_or_door(unsigned room1,
 	assert(room_exclude != room1 && room_exclude != room2);
 	if (room1 == room2) return 1;
 	bool const use_bit_mask(num_rooms <= 64); // almost always true
-	static vector<unsigned> pend; // reused across calls
-	static vector<uint8_t> seen; // reused across calls
+	thread_local vector<unsigned> pend; // reused across calls; thread_local: see building_t::gen_room_geom()
+	thread_local vector<uint8_t> seen; // reused across calls
 	uint64_t seen_mask(0);
 	pend.clear();
 	pend.push_back(room1);
@@ -1543,7 +1550,7 @@ bool building_t::find_route_to_point(person_t &person, float radius, bool is_fir
 	assert((unsigned)loc1.part_ix < parts.size() && (unsigned)loc2.part_ix < parts.size());
 	assert((unsigned)loc1.room_ix < interior->rooms.size() && (unsigned)loc2.room_ix < interior->rooms.size());
 	float const floor_spacing(get_window_vspace()), height(0.7*floor_spacing), z2_add(height - radius); // approximate, since we're not tracking actual heights
-	static vect_cube_t avoid; // reuse across frames/people
+	thread_local vect_cube_t avoid; // reuse across frames/people; thread_local because path queries may be run in parallel
 	get_avoid_cubes(from.z, height, radius, avoid, following_player, &get_room(loc1.room_ix)); // include fires in the current room
 
 	if (loc1.same_room_floor(loc2)) { // same room/floor (not checking stairs_ix)
@@ -1939,6 +1946,7 @@ void building_t::all_ai_room_update(rand_gen_t &rgen, float delta_dir) {
 
 	for (unsigned i = 0; i < interior->people.size(); ) { // Note: no increment
 		person_t &person(interior->people[i]);
+		assert(!person.path_query_pending); // should have been resolved last frame
 		person.ai_state = ai_room_update(person, delta_dir, i, rgen);
 		if (person.ai_state == AI_TO_REMOVE) {interior->people.erase(interior->people.begin() + i);} // remove this person
 		else {++i;}
@@ -2175,6 +2183,39 @@ bool zombie_in_attack_range(person_t &person) {
 	return (fabs(feet_pos.z - player_feet_pos.z) < 0.5*player_height && dist_less_than(feet_pos, player_feet_pos, 1.2f*(person.radius + building_t::get_scaled_player_radius())));
 }
 
+void building_t::get_pending_ai_path_queries(vector<ai_path_query_t> &queries) {
+	assert(interior);
+
+	for (unsigned i = 0; i < interior->people.size(); ++i) {
+		if (interior->people[i].path_query_pending) {queries.emplace_back(this, i);}
+	}
+}
+bool building_t::run_ai_path_query(unsigned person_ix) const { // may be called for different people in parallel; only modifies this person
+	assert(interior && person_ix < interior->people.size());
+	person_t &person(interior->people[person_ix]);
+	assert(person.path_query_pending);
+	return find_route_to_point(person, COLL_RADIUS_SCALE*person.radius, person.is_first_path, 0, person.path); // following_player=0
+}
+void building_t::finish_ai_path_query(unsigned person_ix, bool found_route) {
+	assert(interior && person_ix < interior->people.size());
+	person_t &person(interior->people[person_ix]);
+	assert(person.path_query_pending);
+	person.path_query_pending = 0;
+	person.ai_state = finish_ai_path(person, found_route);
+}
+int building_t::finish_ai_path(person_t &person, bool found_route) {
+	if (!found_route) {
+		float const wait_time(is_single_large_room(person.cur_room) ? 0.1 : 1.0);
+		person.wait_for(wait_time); // stop for 1 second (0.1s for parking garage/backrooms/retail), then try again
+		return AI_WAITING;
+	}
+	if (has_room_geom()) {person.is_first_path = 0;} // treat the path as the first path until room geom is generated
+	if      (person.target_pos.z < person.pos.z) {person.prev_walked_down = 1;}
+	else if (person.target_pos.z > person.pos.z) {person.prev_walked_down = 0;}
+	person.next_path_pt(1);
+	return AI_BEGIN_PATH;
+}
+
 // Note: non-const because this updates room light and door state
 int building_t::ai_room_update(person_t &person, float delta_dir, unsigned person_ix, rand_gen_t &rgen) {
 
@@ -2317,16 +2358,11 @@ int building_t::ai_room_update(person_t &person, float delta_dir, unsigned perso
 			}
 			return AI_STOP;
 		}
-		if (!find_route_to_point(person, coll_dist, person.is_first_path, 0, person.path)) { // following_player=0
-			float const wait_time(is_single_large_room(person.cur_room) ? 0.1 : 1.0);
-			person.wait_for(wait_time); // stop for 1 second (0.1s for parking garage/backrooms/retail), then try again
+		if (global_building_params.ai_batch_path_queries) { // find the route later, in parallel with other people
+			person.path_query_pending = 1;
 			return AI_WAITING;
 		}
-		if (has_rgeom) {person.is_first_path = 0;} // treat the path as the first path until room geom is generated
-		if      (person.target_pos.z < person.pos.z) {person.prev_walked_down = 1;}
-		else if (person.target_pos.z > person.pos.z) {person.prev_walked_down = 0;}
-		person.next_path_pt(1);
-		return AI_BEGIN_PATH;
+		return finish_ai_path(person, find_route_to_point(person, coll_dist, person.is_first_path, 0, person.path)); // following_player=0
 	}
 	float const max_dist(get_person_max_move_dist(person, speed_mult));
 	float goal_dist(1.1f*max_dist);
@@ -2609,10 +2645,24 @@ void building_t::move_person_to_not_collide(person_t &person, person_t const &ot
 void vect_building_t::ai_room_update(float delta_dir, float dmax, point const &camera_bs, rand_gen_t &rgen) {
 	//timer_t timer("Building People Update"); // 0.25ms, mostly iteration overhead, for sparse update with 2-6 people per building (avg for 2 calls city + secondary)
 
+	static vector<ai_path_query_t> path_queries; // reused across frames
+	path_queries.clear();
+
 	for (iterator b = begin(); b != end(); ++b) {
 		if (!b->has_people() || !b->bcube.closest_dist_less_than(camera_bs, dmax)) continue; // no people or too far away, no updates
+		if (is_room_geom_gen_pending(*b)) continue; // rooms are being modified on the background thread; skip updates until it's done
 		b->all_ai_room_update(rgen, delta_dir);
+		b->get_pending_ai_path_queries(path_queries);
+	}
+	if (path_queries.empty()) return;
+	// resolve all deferred route finding for this frame in parallel across people and buildings;
+	// path finding only reads building state and writes to its own person, and results are applied serially in the same order as before
+#pragma omp parallel for schedule(dynamic, 1) if (path_queries.size() > 1)
+	for (int i = 0; i < (int)path_queries.size(); ++i) {
+		ai_path_query_t &q(path_queries[i]);
+		q.success = q.building->run_ai_path_query(q.person_ix);
 	}
+	for (ai_path_query_t const &q : path_queries) {q.building->finish_ai_path_query(q.person_ix, q.success);}
 }
 
 int building_t::get_room_containing_pt(point const &pt) const {
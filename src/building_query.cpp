@@ -4,6 +4,9 @@
 #include "3DWorld.h"
 #include "function_registry.h"
 #include "buildings.h"
+#include "profiler.h"
+
+bool const BENCHMARK_ROOM_OBJ_INDEX = 0; // compare linear scan vs. index query times the first time the index is built for each building
 
 
 extern bool draw_building_interiors, camera_in_building, player_near_toilet, player_in_unlit_room, building_has_open_ext_door, ctrl_key_pressed;
@@ -1289,23 +1292,168 @@ bool building_interior_t::check_sphere_coll(building_t const &building, point &p
 	had_coll |= check_sphere_coll_room_objects(building, pos, p_last, radius, self, cnorm, hardness, obj_ix, is_ball);
 	return had_coll;
 }
+unsigned const ROOM_OBJ_INDEX_MIN_OBJS  = 256; // buildings with fewer objects use a linear scan
+unsigned const ROOM_OBJ_INDEX_MAX_CELLS = (1<<16);
+unsigned const MAX_INDEXED_OBJ_CELLS    = 64; // objects spanning more cells than this are added to always_check
+
+cube_t get_room_obj_index_bcube(room_object_t const &c) {
+	cube_t bc(get_true_room_obj_bcube(c));
+	bc.union_with_cube(c); // line_coll() uses the object cube rather than the true bcube
+	return bc;
+}
+bool is_moving_room_obj(room_object_t const &c) { // dynamic objects, and elevator lights and buttons that move with the elevator car without invalidating the index
+	return (c.is_dynamic() || ((c.type == TYPE_LIGHT || c.type == TYPE_BUTTON) && c.in_elevator()));
+}
+void room_obj_index_t::get_cell_range(cube_t const &c, unsigned lo[3], unsigned hi[3]) const {
+	for (unsigned d = 0; d < 3; ++d) {
+		lo[d] = min(ncells[d]-1U, unsigned(max(0.0f, (c.d[d][0] - bcube.d[d][0])*cell_inv[d])));
+		hi[d] = min(ncells[d]-1U, unsigned(max(0.0f, (c.d[d][1] - bcube.d[d][0])*cell_inv[d])));
+	}
+}
+void room_obj_index_t::build(vect_room_object_t const &objs, float cell_size) {
+	assert(cell_size > 0.0);
+	valid    = 1; // set first so that an invalidate() from another thread during the build isn't lost
+	num_objs = objs.size();
+	cell_start.clear();
+	obj_ixs.clear();
+	always_check.clear();
+	vect_cube_t bcubes;
+	bcubes.reserve(num_objs);
+
+	for (room_object_t const &obj : objs) {
+		bcubes.push_back(get_room_obj_index_bcube(obj));
+		if (bcubes.size() == 1) {bcube = bcubes.back();} else {bcube.union_with_cube(bcubes.back());}
+	}
+	unsigned tot_cells(1);
+
+	for (unsigned n = 0; n < 2; ++n) { // second iteration is only needed if there are too many cells
+		tot_cells = 1;
+		for (unsigned d = 0; d < 3; ++d) {ncells[d] = max(1U, unsigned(ceil(bcube.get_sz_dim(d)/cell_size))); tot_cells *= ncells[d];}
+		if (tot_cells <= ROOM_OBJ_INDEX_MAX_CELLS) break;
+		cell_size *= 1.01*cbrt(float(tot_cells)/ROOM_OBJ_INDEX_MAX_CELLS); // increase cell size so that we have at most ROOM_OBJ_INDEX_MAX_CELLS
+	}
+	for (unsigned d = 0; d < 3; ++d) {
+		float const sz(bcube.get_sz_dim(d));
+		cell_inv[d] = ((sz > 0.0) ? ncells[d]/sz : 0.0);
+	}
+	vector<unsigned char> is_always(num_objs, 0);
+	cell_start.resize(tot_cells+1, 0);
+	unsigned lo[3], hi[3];
+
+	for (unsigned i = 0; i < num_objs; ++i) { // pass 1: count objects per cell
+		get_cell_range(bcubes[i], lo, hi);
+		unsigned const num_obj_cells((hi[0] - lo[0] + 1)*(hi[1] - lo[1] + 1)*(hi[2] - lo[2] + 1));
+		if (is_moving_room_obj(objs[i]) || num_obj_cells > MAX_INDEXED_OBJ_CELLS) {always_check.push_back(i); is_always[i] = 1; continue;}
+		
+		for (unsigned z = lo[2]; z <= hi[2]; ++z) {
+			for (unsigned y = lo[1]; y <= hi[1]; ++y) {
+				for (unsigned x = lo[0]; x <= hi[0]; ++x) {++cell_start[(z*ncells[1] + y)*ncells[0] + x + 1];}
+			}
+		}
+	}
+	for (unsigned c = 0; c < tot_cells; ++c) {cell_start[c+1] += cell_start[c];} // convert counts to start indices
+	obj_ixs.resize(cell_start.back());
+	vector<unsigned> cell_pos(cell_start.begin(), cell_start.end()-1);
+
+	for (unsigned i = 0; i < num_objs; ++i) { // pass 2: fill in object indices in increasing order
+		if (is_always[i]) continue;
+		get_cell_range(bcubes[i], lo, hi);
+
+		for (unsigned z = lo[2]; z <= hi[2]; ++z) {
+			for (unsigned y = lo[1]; y <= hi[1]; ++y) {
+				for (unsigned x = lo[0]; x <= hi[0]; ++x) {obj_ixs[cell_pos[(z*ncells[1] + y)*ncells[0] + x]++] = i;}
+			}
+		}
+	}
+}
+// returns sorted object indices that may intersect qcube; returns 0 if the query covers too much of the index to be worth using
+bool room_obj_index_t::query(cube_t const &qcube, vector<unsigned> &ixs) const {
+	assert(valid);
+	ixs.clear();
+
+	if (qcube.intersects(bcube)) {
+		unsigned lo[3], hi[3];
+		get_cell_range(qcube, lo, hi);
+		unsigned const num_qcells((hi[0] - lo[0] + 1)*(hi[1] - lo[1] + 1)*(hi[2] - lo[2] + 1));
+		if (4*num_qcells > cell_start.size()) return 0; // more than a quarter of the cells; a linear scan is likely faster
+
+		for (unsigned z = lo[2]; z <= hi[2]; ++z) {
+			for (unsigned y = lo[1]; y <= hi[1]; ++y) {
+				for (unsigned x = lo[0]; x <= hi[0]; ++x) {
+					unsigned const cix((z*ncells[1] + y)*ncells[0] + x);
+					ixs.insert(ixs.end(), (obj_ixs.begin() + cell_start[cix]), (obj_ixs.begin() + cell_start[cix+1]));
+				}
+			}
+		}
+	}
+	ixs.insert(ixs.end(), always_check.begin(), always_check.end());
+	sort(ixs.begin(), ixs.end());
+	ixs.erase(unique(ixs.begin(), ixs.end()), ixs.end());
+	return 1;
+}
+
+void benchmark_room_obj_index(building_t const &building, building_room_geom_t const &rgeom) {
+	unsigned const num_queries(100000);
+	float const radius(building.get_scaled_player_radius());
+	rand_gen_t rgen;
+	vector<cube_t> qcubes(num_queries);
+	vector<unsigned> cands;
+	unsigned num_linear(0), num_index(0);
+
+	for (cube_t &qcube : qcubes) {qcube.set_from_sphere(rgen.gen_rand_cube_point(building.bcube), radius);}
+	{
+		highres_timer_t timer("Room Obj Linear Queries");
+
+		for (cube_t const &qcube : qcubes) {
+			for (room_object_t const &obj : rgeom.objs) {num_linear += get_room_obj_index_bcube(obj).intersects(qcube);}
+		}
+	}
+	{
+		highres_timer_t timer("Room Obj Index Queries");
+
+		for (cube_t const &qcube : qcubes) {
+			bool const ret(rgeom.obj_index.query(qcube, cands));
+			assert(ret);
+			for (unsigned i : cands) {num_index += get_room_obj_index_bcube(rgeom.objs[i]).intersects(qcube);}
+		}
+	}
+	cout << TXT(rgeom.objs.size()) << TXT(rgeom.obj_index.obj_ixs.size()) << TXT(rgeom.obj_index.always_check.size()) << TXT(num_linear) << TXT(num_index) << endl;
+	assert(num_index == num_linear); // results must agree
+}
+
+vector<unsigned> room_obj_cands; // only used by the main thread
+
+// returns 1 and fills in cands if the room object index can be used for this query
+bool get_room_obj_index_cands(building_t const &building, building_room_geom_t &rgeom, cube_t const &qcube, vector<unsigned> &cands) {
+	unsigned const num_objs(rgeom.objs.size());
+	if (num_objs < ROOM_OBJ_INDEX_MIN_OBJS) return 0; // not enough objects to be worth indexing
+	// the index isn't thread safe, so only the main thread uses it; OpenMP thread 0 in a parallel region or a background thread may not be the main thread
+	if (!on_main_thread_3dw()) return 0;
+
+	if (!rgeom.obj_index.is_valid(num_objs)) {
+		bool const first_build(rgeom.obj_index.cell_start.empty());
+		rgeom.obj_index.build(rgeom.objs, building.get_window_vspace());
+		if (BENCHMARK_ROOM_OBJ_INDEX && first_build) {benchmark_room_obj_index(building, rgeom);}
+	}
+	return rgeom.obj_index.query(qcube, cands);
+}
+
 bool building_interior_t::check_sphere_coll_room_objects(building_t const &building, point &pos, point const &p_last, float radius,
 	vect_room_object_t::const_iterator self, vector3d &cnorm, float &hardness, int &obj_ix, bool is_ball) const
 {
 	if (!room_geom) return 0;
 	bool had_coll(0);
 
-	// Note: no collision check with expanded_objs
-	for (auto c = room_geom->objs.begin(); c != room_geom->objs.end(); ++c) { // check for other objects to collide with
+	auto check_obj_coll = [&](vect_room_object_t::const_iterator c) {
 		// ignore blockers and railings, but allow more than c->no_coll()
 		if (c == self || c->type == TYPE_BLOCKER || c->type == TYPE_PAPER || c->type == TYPE_PEN || c->type == TYPE_PENCIL ||
 			c->type == TYPE_BOTTLE || c->type == TYPE_FLOORING || c->type == TYPE_SIGN || c->type == TYPE_WBOARD || c->type == TYPE_WALL_TRIM ||
 			c->type == TYPE_DRAIN || c->type == TYPE_CRACK || c->type == TYPE_SWITCH || c->type == TYPE_BREAKER || c->type == TYPE_OUTLET || c->type == TYPE_VENT ||
-			c->type == TYPE_WIND_SILL || c->type == TYPE_TEESHIRT || c->type == TYPE_PANTS || c->type == TYPE_BLANKET || c->type == TYPE_FOLD_SHIRT) continue;
-		if (c->type == TYPE_RAILING && (!(c->flags & RO_FLAG_TOS) || !c->is_open())) continue; // only railings at the top of stairs (non-sloped) with balusters have collisions
-		if (c->type == TYPE_POOL_TILE && c->no_coll()) continue;
+			c->type == TYPE_WIND_SILL || c->type == TYPE_TEESHIRT || c->type == TYPE_PANTS || c->type == TYPE_BLANKET || c->type == TYPE_FOLD_SHIRT) return;
+		if (c->type == TYPE_RAILING && (!(c->flags & RO_FLAG_TOS) || !c->is_open())) return; // only railings at the top of stairs (non-sloped) with balusters have collisions
+		if (c->type == TYPE_POOL_TILE && c->no_coll()) return;
 		cube_t const bc(get_true_room_obj_bcube(*c));
-		if (!sphere_cube_intersect(pos, radius, bc)) continue; // no intersection (optimization)
+		if (!sphere_cube_intersect(pos, radius, bc)) return; // no intersection (optimization)
 		unsigned coll_ret(0);
 		// add special handling for things like elevators and cubicles? right now these are only in office buildings, where there are no dynamic objects
 
@@ -1322,7 +1470,7 @@ bool building_interior_t::check_sphere_coll_room_objects(building_t const &build
 		}
 		else if (c->shape == SHAPE_SPHERE) { // sphere
 			point const center(c->get_cube_center());
-			if (!dist_less_than(pos, center, (c->get_radius() + radius))) continue;
+			if (!dist_less_than(pos, center, (c->get_radius() + radius))) return;
 			cnorm = (pos - center).get_norm();
 			coll_ret |= 1;
 		}
@@ -1356,7 +1504,7 @@ bool building_interior_t::check_sphere_coll_room_objects(building_t const &build
 			else {coll_ret |= (unsigned)sphere_cube_int_update_pos(pos, radius, bc, p_last, 0, &cnorm);} // skip_z=0
 		}
 		if (coll_ret) { // collision with this object - set hardness
-			if      (c->type == TYPE_RUG && cnorm != plus_z) {cnorm = plus_z; continue;} // rug collision can only be +z
+			if      (c->type == TYPE_RUG && cnorm != plus_z) {cnorm = plus_z; return;} // rug collision can only be +z
 			if      (c->type == TYPE_COUCH    ) {hardness = 0.6;} // couches are soft
 			else if (c->type == TYPE_RUG      ) {hardness = 0.8;} // rug is somewhat soft, but placed on a hard floor
 			else if (c->type == TYPE_BLINDS   ) {hardness = 0.6;} // blinds are soft
@@ -1369,7 +1517,27 @@ bool building_interior_t::check_sphere_coll_room_objects(building_t const &build
 			obj_ix   = (c - room_geom->objs.begin()); // may be overwritten, will be the last collided object
 			had_coll = 1;
 		}
-	} // for c
+	};
+	// Note: no collision check with expanded_objs
+	vect_room_object_t const &objs(room_geom->objs);
+	cube_t qcube;
+	qcube.set_from_sphere(pos, 2.0*radius); // pos can move by up to radius per collision; if it moves further, we fall back to iterating over all objects below
+	vector<unsigned> &cands(room_obj_cands);
+	unsigned next_ix(0);
+
+	if (get_room_obj_index_cands(building, *room_geom, qcube, cands)) { // iterate over candidates in the same order as the full loop so that results are identical
+		bool pos_in_qcube(1);
+
+		for (unsigned i : cands) {
+			check_obj_coll(objs.begin() + i);
+			next_ix = i + 1;
+			cube_t sphere_bcube;
+			sphere_bcube.set_from_sphere(pos, radius);
+			if (!qcube.contains_cube(sphere_bcube)) {pos_in_qcube = 0; break;} // pos was moved outside the query cube; check the remaining objects below
+		}
+		if (pos_in_qcube) return had_coll;
+	}
+	for (auto c = objs.begin() + next_ix; c != objs.end(); ++c) {check_obj_coll(c);} // check for other objects to collide with
 	return had_coll;
 }
 
@@ -1486,7 +1654,13 @@ bool building_interior_t::line_coll(building_t const &building, point const &p1,
 		else {had_coll |= get_line_clip_update_t(p1, p2, *i, t);} // closed
 	}
 	if (room_geom) { // check room geometry
-		for (auto c = room_geom->objs.begin(); c != room_geom->objs.end(); ++c) { // check for other objects to collide with (including stairs)
+		vect_room_object_t const &objs(room_geom->objs);
+		vector<unsigned> &cands(room_obj_cands);
+		bool const use_index(get_room_obj_index_cands(building, *room_geom, cube_t(p1, p2), cands)); // results don't depend on object order
+		unsigned const num_iters(use_index ? cands.size() : objs.size());
+
+		for (unsigned n = 0; n < num_iters; ++n) { // check for other objects to collide with (including stairs)
+			auto const c(objs.begin() + (use_index ? cands[n] : n));
 			if (c->no_coll() || c->type == TYPE_BLOCKER || c->type == TYPE_ELEVATOR) continue; // skip blockers and elevators
 
 			if (c->type == TYPE_CLOSET) { // special case to handle closet interiors
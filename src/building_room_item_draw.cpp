@@ -37,6 +37,7 @@ int get_toilet_paper_nm_id();
 void setup_monitor_screen_draw(room_object_t const &monitor, rgeom_mat_t &mat, std::string &onscreen_text);
 void add_tv_or_monitor_screen(room_object_t const &c, rgeom_mat_t &mat, std::string const &onscreen_text, rgeom_mat_t *text_mat);
 bool check_clock_time();
+void setup_bldg_obj_types();
 bool have_fish_model();
 void register_fishtank(room_object_t const &obj, bool is_visible);
 void end_fish_draw(shader_t &s, bool inc_pools_and_fb);
@@ -375,43 +376,114 @@ void rgeom_mat_t::add_triangle_to_verts(point const v[3], colorRGBA const &color
 	} // for side
 }
 
+// pooled CPU-side storage for room geometry vertex and index vectors, shared across all buildings and materials;
+// freed vectors keep their capacity and are binned by power-of-two size class, and each material texture records how many verts/indices
+// it used last time, so that new materials take a vector that's already large enough rather than growing one from scratch
 class rgeom_alloc_t {
-	deque<rgeom_storage_t> free_list; // one per unique texture ID/material
+	typedef rgeom_storage_t::vertex_t vertex_t;
+	static unsigned const NUM_SIZE_CLASSES = 32;
+	static size_t   const MAX_POOL_BYTES   = (128ULL << 20); // 128MB; trimmed in bulk when exceeded
+
+	struct size_hint_t {
+		tid_nm_pair_t tex;
+		unsigned sz[3] = {}; // {quad_verts, itri_verts, indices}
+		size_hint_t(tid_nm_pair_t const &tex_) : tex(tex_) {}
+	};
+	vector<vector<vertex_t>> free_verts[NUM_SIZE_CLASSES];
+	vector<vector<unsigned>> free_ixs  [NUM_SIZE_CLASSES];
+	vector<size_hint_t> hints; // one per unique texture ID/material
+	size_t pool_bytes=0, peak_pool_bytes=0, bytes_handed_out=0, bytes_requested=0;
+	unsigned num_new=0, num_reuse=0, num_free=0, num_released=0;
+
+	static unsigned floor_log2(size_t v) {unsigned n(0); while (v > 1) {v >>= 1; ++n;} return n;}
+	static unsigned ceil_log2 (size_t v) {return ((v <= 1) ? 0 : (floor_log2(v - 1) + 1));}
+
+	size_hint_t &get_hint(tid_nm_pair_t const &tex) {
+		for (size_hint_t &h : hints) {
+			if (h.tex.is_compatible(tex)) return h;
+		}
+		hints.emplace_back(tex);
+		return hints.back();
+	}
+	template<typename T> void take_vector(vector<vector<T>> *free_lists, vector<T> &v, unsigned num) {
+		if (num == 0 || v.capacity() > 0) return; // no hint, or already has capacity
+		unsigned const cls(ceil_log2(num)); // every vector in this class or higher has a capacity of at least num
+		bytes_requested += num*sizeof(T);
+
+		for (unsigned c = cls; c < min(cls+2U, NUM_SIZE_CLASSES); ++c) { // allow at most 4x wasted capacity
+			if (free_lists[c].empty()) continue;
+			v.swap(free_lists[c].back()); // transfer existing capacity from the pool
+			free_lists[c].pop_back();
+			pool_bytes       -= v.capacity()*sizeof(T);
+			bytes_handed_out += v.capacity()*sizeof(T);
+			++num_reuse;
+			return; // done
+		}
+		v.reserve(num); // nothing suitable in the pool; allocate the expected size up front
+		bytes_handed_out += v.capacity()*sizeof(T);
+		++num_new;
+	}
+	template<typename T> void give_vector(vector<vector<T>> *free_lists, vector<T> &v) {
+		if (v.capacity() == 0) return; // no memory allocated, no point in adding to the pool
+		v.clear();
+		unsigned const cls(min(floor_log2(v.capacity()), NUM_SIZE_CLASSES-1));
+		pool_bytes += v.capacity()*sizeof(T);
+		max_eq(peak_pool_bytes, pool_bytes);
+		free_lists[cls].emplace_back();
+		free_lists[cls].back().swap(v); // transfer capacity to the pool; clear capacity from v
+		++num_free;
+	}
+	template<typename T> void release_class(vector<vector<T>> &free_list) {
+		for (vector<T> const &v : free_list) {pool_bytes -= v.capacity()*sizeof(T);}
+		num_released += free_list.size();
+		clear_container(free_list);
+	}
 public:
 	void alloc_safe(rgeom_storage_t &s) {
 #pragma omp critical(rgeom_alloc)
 		alloc(s);
 	}
-	void alloc(rgeom_storage_t &s) { // attempt to use free_list entry to reuse existing capacity
-		if (free_list.empty()) return; // no pre-alloc
-		//cout << TXT(free_list.size()) << TXT(free_list.back().get_tot_vert_capacity()) << endl; // total mem usage is 913/1045
-
-		// try to find a free list element with the same tex so that we balance out material memory usage/capacity better
-		for (unsigned i = 0; i < free_list.size(); ++i) {
-			if (!free_list[i].tex.is_compatible(s.tex)) continue;
-			s.swap_vectors(free_list[i]); // transfer existing capacity from free list
-			free_list[i].swap(free_list.back());
-			free_list.pop_back();
-			return; // done
-		}
+	void free_safe(rgeom_storage_t &s) {
+#pragma omp critical(rgeom_alloc)
+		free(s);
 	}
-	void free(rgeom_storage_t &s) {
-		s.clear(); // in case the caller didn't clear it
-		if (s.get_mem_usage() == 0) return; // no memory allocated, no point in adding to the free list
-		free_list.push_back(rgeom_storage_t(s.tex)); // record tex of incoming element
-		s.swap_vectors(free_list.back()); // transfer existing capacity to free list; clear capacity from s
+	void alloc(rgeom_storage_t &s) { // attempt to use pooled vectors sized for what this material used last time
+		size_hint_t const &h(get_hint(s.tex));
+		take_vector(free_verts, s.quad_verts, h.sz[0]);
+		take_vector(free_verts, s.itri_verts, h.sz[1]);
+		take_vector(free_ixs,   s.indices,    h.sz[2]);
 	}
-	unsigned get_mem_usage() const {
-		unsigned mem(free_list.size()*sizeof(rgeom_storage_t));
-		for (auto i = free_list.begin(); i != free_list.end(); ++i) {
-			//cout << i->tex.tid << "\t" << i->tex.shadowed << "\t" << (i->quad_verts.capacity() + i->itri_verts.capacity()) << "\t" << i->get_mem_usage() << endl; // TESTING
-			mem += i->get_mem_usage();
+	void free(rgeom_storage_t &s) {
+		if (s.get_tot_vert_capacity() == 0 && s.indices.capacity() == 0) return; // nothing to free
+		size_hint_t &h(get_hint(s.tex));
+		unsigned const sizes[3] = {(unsigned)s.quad_verts.size(), (unsigned)s.itri_verts.size(), (unsigned)s.indices.size()};
+		for (unsigned n = 0; n < 3; ++n) {if (sizes[n] > 0) {h.sz[n] = sizes[n];}} // keep the previous hint if the caller already cleared the vectors
+		give_vector(free_verts, s.quad_verts);
+		give_vector(free_verts, s.itri_verts);
+		give_vector(free_ixs,   s.indices);
+		if (pool_bytes > MAX_POOL_BYTES) {trim(MAX_POOL_BYTES/2);}
+	}
+	void trim(size_t target_bytes) { // release pooled memory in bulk, largest size classes first
+		for (unsigned c = NUM_SIZE_CLASSES; c-- > 0 && pool_bytes > target_bytes;) {
+			release_class(free_verts[c]);
+			release_class(free_ixs  [c]);
 		}
-		return mem;
 	}
-	unsigned size() const {return free_list.size();}
+	void release_all() {trim(0);}
+	size_t get_mem_usage() const {return pool_bytes;}
+	unsigned size() const {
+		unsigned num(0);
+		for (unsigned c = 0; c < NUM_SIZE_CLASSES; ++c) {num += free_verts[c].size() + free_ixs[c].size();}
+		return num;
+	}
+	void print_stats() const {
+		// unused capacity is the fraction of handed out vector memory beyond what the size hints asked for
+		float const unused_pct((bytes_handed_out == 0) ? 0.0 : 100.0*(1.0 - double(bytes_requested)/double(bytes_handed_out)));
+		cout << "Room geom verts: N " << num_new << " R " << num_reuse << " F " << num_free << " X " << num_released << " P " << size()
+			 << "  SZ: P " << (pool_bytes>>20) << " Peak " << (peak_pool_bytes>>20) << " unused " << unused_pct << "%" << endl; // in MB
+	}
 };
-rgeom_alloc_t rgeom_alloc; // static allocator with free list, shared across all buildings; not thread safe
+rgeom_alloc_t rgeom_alloc; // static allocator with size class free lists, shared across all buildings; use the *_safe() functions from multiple threads
 
 
 vbo_cache_t::vbo_cache_entry_t vbo_cache_t::alloc(unsigned size, bool is_index) {
@@ -465,6 +537,16 @@ void vbo_cache_t::print_stats() const {
 
 /*static*/ vbo_cache_t rgeom_mat_t::vbo_cache;
 
+/*static*/ void rgeom_mat_t::print_alloc_stats() {
+	vbo_cache.print_stats();
+	rgeom_alloc.print_stats();
+}
+void print_room_geom_alloc_stats() {rgeom_mat_t::print_alloc_stats();}
+void release_room_geom_alloc_pool() { // frees all pooled vectors, for use after all room geom has been cleared
+#pragma omp critical(rgeom_alloc)
+	rgeom_alloc.release_all();
+}
+
 void rgeom_storage_t::clear(bool free_memory) {
 	if (free_memory) {clear_container(quad_verts);} else {quad_verts.clear();}
 	if (free_memory) {clear_container(itri_verts);} else {itri_verts.clear();}
@@ -700,7 +782,10 @@ void rgeom_mat_t::upload_draw_and_clear(tid_nm_pair_dstate_t &state) { // Note:
 
 void building_materials_t::clear() {
 	invalidate();
-	for (iterator m = begin(); m != end(); ++m) {m->clear();}
+	for (iterator m = begin(); m != end(); ++m) {
+		rgeom_alloc.free_safe(*m); // return vertex and index memory to the shared pool for reuse by other buildings
+		m->clear();
+	}
 	vector<rgeom_mat_t>::clear();
 }
 unsigned building_materials_t::count_all_verts() const {
@@ -749,6 +834,7 @@ void building_room_geom_t::clear() {
 	clear_materials();
 	objs.clear();
 	light_bcubes.clear();
+	obj_index.invalidate();
 	has_elevators = 0;
 }
 void building_room_geom_t::clear_materials() { // clears all materials
@@ -1435,6 +1521,7 @@ void building_t::gen_and_draw_room_geom(brg_batch_draw_t *bbd, shader_t &s, shad
 {
 	if (!interior) return;
 	if (!global_building_params.enable_rotated_room_geom && is_rotated()) return; // rotated buildings: need to fix texture coords, room object collisions, mirrors, etc.
+	if (is_room_geom_gen_pending(*this)) return; // room geom is being generated on the background thread; draw it once it's done
 
 	if (!shadow_only && !player_in_building && !camera_pdu.point_visible_test(bcube.get_cube_center() + xlate)) {
 		// skip if none of the building parts are visible to the camera; this is rare, so it may not help
@@ -1453,20 +1540,40 @@ void building_t::gen_and_draw_room_geom(brg_batch_draw_t *bbd, shader_t &s, shad
 			return;
 		}
 	}
-	if (!has_room_geom()) {
-		interior->room_geom.reset(new building_room_geom_t(bcube.get_llc()));
-		// capture state before generating backrooms, which may add more doors
-		interior->room_geom->init_num_doors   = interior->doors      .size();
-		interior->room_geom->init_num_dstacks = interior->door_stacks.size();
-		rand_gen_t rgen;
-		rgen.set_state(building_ix, parts.size()); // set to something canonical per building
-		gen_room_details(rgen, building_ix); // generate so that we can draw it
-		assert(has_room_geom());
-	}
+	gen_room_geom(building_ix); // generate so that we can draw it
 	if (has_room_geom() && (inc_small == 2 || inc_small == 3)) {add_wall_and_door_trim_if_needed();} // gen trim (exterior and interior) when close to the player
 	draw_room_geom(bbd, s, amask_shader, oc, xlate, building_ix, shadow_only, reflection_pass, inc_small, player_in_building);
 }
+// Note: may be called on the background thread for buildings flagged by is_room_geom_gen_pending();
+// any static scratch buffers reached from room object placement must be thread_local for this reason
+void building_t::gen_room_geom(unsigned building_ix) {
+	if (!interior || has_room_geom()) return;
+	interior->room_geom.reset(new building_room_geom_t(bcube.get_llc()));
+	// capture state before generating backrooms, which may add more doors
+	interior->room_geom->init_num_doors   = interior->doors      .size();
+	interior->room_geom->init_num_dstacks = interior->door_stacks.size();
+	rand_gen_t rgen;
+	rgen.set_state(building_ix, parts.size()); // set to something canonical per building
+	gen_room_details(rgen, building_ix);
+	assert(has_room_geom());
+}
+bool setup_bg_room_geom_gen() { // called on the main thread once per frame; returns true when background room geom generation can be used
+	static bool was_setup(0);
+	static unsigned next_model_id(0);
+	
+	if (!was_setup) {
+		setup_bldg_obj_types();
+		get_concrete_tid(); // textures looked up by room object placement must be loaded here, since loading isn't thread safe and requires the GL context
+		was_setup = 1;
+	}
+	// object models are loaded on first use, which isn't thread safe, so load them one per frame up front to avoid a long stall;
+	// city models aren't used by room object placement, but city objects may load them on demand while the worker is reading the shared model list
+	unsigned const num_models(have_cities() ? (unsigned)NUM_OBJ_MODELS : (unsigned)OBJ_MODEL_FHYDRANT);
+	if (next_model_id < num_models) {building_obj_model_loader.is_model_valid(next_model_id++);}
+	return (next_model_id == num_models);
+}
 void building_t::clear_room_geom() {
+	if (is_room_geom_gen_pending(*this)) return; // can't delete it while it's being generated; must check this before accessing room_geom
 	if (!has_room_geom()) return;
 	if (interior->room_geom->modified_by_player) return; // keep the player's modifications and don't delete the room geom
 	// restore pre-room_geom door state by removing any doors added to backrooms
@@ -189,8 +189,8 @@ void building_t::get_doorways_for_room(cube_t const &room, float zval, vect_door
 		if (ds.intersects_no_adj(room_exp)) {doorways.push_back(ds);} // Note: can't use ds.get_conn_room() because this is called before it's filled in
 	}
 }
-vect_door_stack_t &building_t::get_doorways_for_room(cube_t const &room, float zval, bool all_floors) const { // interior doorways; not thread safe
-	static vect_door_stack_t doorways; // reuse across rooms
+vect_door_stack_t &building_t::get_doorways_for_room(cube_t const &room, float zval, bool all_floors) const { // interior doorways; returns a per-thread buffer
+	thread_local vect_door_stack_t doorways; // reuse across rooms
 	get_doorways_for_room(room, zval, doorways, all_floors);
 	return doorways;
 }
@@ -1920,7 +1920,7 @@ bool building_t::add_kitchen_objs(rand_gen_t rgen, room_t const &room, float zva
 		cube_t c;
 		set_cube_zvals(c, zval, zval+height);
 		set_cube_zvals(cabinet_area, zval, (zval + vspace - floor_thickness));
-		static vect_cube_t blockers;
+		thread_local vect_cube_t blockers; // see building_t::gen_room_geom()
 		int const table_blocker_ix(gather_room_placement_blockers(cabinet_area, objs_start, blockers, 1, 1)); // inc_open_doors=1, ignore_chairs=1
 		bool const have_toaster(building_obj_model_loader.is_model_valid(OBJ_MODEL_TOASTER));
 		vector3d const toaster_sz(have_toaster ? building_obj_model_loader.get_model_world_space_size(OBJ_MODEL_TOASTER) : zero_vector); // L, D, H
@@ -4247,7 +4247,7 @@ void building_t::place_objects_onto_surfaces(rand_gen_t rgen, room_t const &room
 		bool const is_eating_table(is_table && (room.get_room_type(floor) == RTYPE_KITCHEN || room.get_room_type(floor) == RTYPE_DINING) && rgen.rand_bool());
 		if (is_eating_table && place_eating_items_on_table(rgen, i)) continue; // no other items to place
 		float book_prob(0.0), bottle_prob(0.0), cup_prob(0.0), plant_prob(0.0), laptop_prob(0.0), pizza_prob(0.0), toy_prob(0.0), banana_prob(0.0);
-		static vect_cube_t avoid; // reuse across buildings
+		thread_local vect_cube_t avoid; // reuse across buildings
 		avoid.clear();
 
 		if (obj.type == TYPE_TABLE && i == objs_start) { // only first table (not TV table)
@@ -4474,7 +4474,7 @@ bool building_t::add_padlock_to_door(unsigned door_ix, unsigned lock_color_mask,
 	if (door.is_padlocked()) {color_ix = door.get_padlock_color_ix();} // already has a padlock (from a previous room geom gen), use the same color
 	else { // select a lock from the colors available from keys found in this building
 		assert(door.obj_ix < 0); // not yet assigned
-		static vector<unsigned> avail_colors;
+		thread_local vector<unsigned> avail_colors;
 		avail_colors.clear();
 
 		for (unsigned n = 0; n < NUM_LOCK_COLORS; ++n) {
@@ -59,7 +59,7 @@ bool building_t::can_be_bedroom_or_bathroom(room_t const &room, unsigned floor_i
 			// okay, that's not easy/fast to do, so determine if there is any path from the exterior door to the stairs that doesn't go through this room;
 			// this won't work when there are two paths from the door to the stairs and this room is only on one of the paths, so we could put a BR/BR on both paths
 			int cur_room(-1);
-			static vector<unsigned> door_rooms, stairs_rooms;
+			thread_local vector<unsigned> door_rooms, stairs_rooms; // see building_t::gen_room_geom()
 			door_rooms.clear();
 			stairs_rooms.clear();
 
@@ -10,6 +10,7 @@
 #include "file_utils.h" // for kw_to_val_map_t
 #include "pedestrians.h"
 #include "building_animals.h"
+#include <atomic>
 
 bool const EXACT_MULT_FLOOR_HEIGHT = 1;
 bool const ENABLE_MIRROR_REFLECTIONS = 1;
@@ -93,6 +94,7 @@ class brg_batch_draw_t;
 typedef vector<vert_norm_comp_tc_color> vect_vnctcc_t;
 struct sign_t;
 struct city_flag_t;
+struct ai_path_query_t;
 typedef vector<point> vect_point;
 
 struct bottle_params_t {
@@ -142,8 +144,45 @@ public:
 	unsigned get_ix_for_light(cube_t const &c, bool walls_not_shared=0);
 };
 
+// low resolution CPU depth buffer of building occluders that's rasterized once per frame and queried through a max depth pyramid;
+// each pixel stores the nearest depth and the building it came from, plus the nearest depth of any other building, so that one building can be excluded
+class occlusion_zbuffer_t {
+public:
+	static unsigned const WIDTH = 256, HEIGHT = 128;
+private:
+	point pos; // camera pos in building space
+	vector3d dir, upv, right, up;
+	float near_z=0.0, x_scale=0.0, y_scale=0.0;
+	double aspect=0.0;
+	int frame=-1;
+	unsigned update_id=0;
+	bool valid=0;
+	vector<float> depth[2]; // {nearest, nearest from a different building}
+	vector<int> depth_bix; // building index of depth[0]
+	vector<float> max_depth[2]; // max depth pyramid levels 1+ for each depth layer, packed; level 0 is depth[]
+	vector<unsigned> level_start, raster_bixs;
+	mutable unsigned num_queries=0, num_zbuf_culled=0, num_line_culled=0; // stats
+
+	bool project(point const &p, float &sx, float &sy, float &z) const;
+	void raster_quad(float const sx[4], float const sy[4], float dval, int bix);
+	float get_max_depth(unsigned layer, unsigned level, unsigned x, unsigned y) const;
+public:
+	bool is_valid     () const {return valid;}
+	unsigned get_update_id() const {return update_id;}
+	bool is_current(pos_dir_up const &pdu_bs) const;
+	void begin_frame(pos_dir_up const &pdu_bs);
+	bool add_occluder(cube_t const &c, unsigned bix);
+	void mark_rasterized(unsigned bix) {raster_bixs.push_back(bix);}
+	void finalize();
+	bool was_rasterized(unsigned bix) const {return binary_search(raster_bixs.begin(), raster_bixs.end(), bix);}
+	bool is_occluded(cube_t const &c, int exclude_bix) const;
+	void register_query(bool zbuf_culled, bool line_culled) const;
+	void print_stats() const;
+};
+
 struct building_occlusion_state_t {
 	int exclude_bix=-1;
+	unsigned zbuf_id=0; // update_id of the occlusion_zbuffer_t this state was set up with, if any
 	bool skip_cont_camera=0;
 	point pos;
 	vector3d xlate;
@@ -152,6 +191,7 @@ struct building_occlusion_state_t {
 	void init(point const &pos_, vector3d const &xlate_) {
 		pos   = pos_;
 		xlate = xlate_;
+		zbuf_id = 0;
 		building_ids.clear();
 	}
 };
@@ -296,7 +336,7 @@ struct building_params_t {
 
 	bool flatten_mesh=0, has_normal_map=0, tex_mirror=0, tex_inv_y=0, tt_only=0, infinite_buildings=0, dome_roof=0, onion_roof=0;
 	bool gen_building_interiors=1, add_city_interiors=0, enable_rotated_room_geom=0, add_secondary_buildings=0, add_office_basements=0, add_office_br_basements=0;
-	bool put_doors_in_corners=0, cities_all_bldg_mats=0, small_city_buildings=0;
+	bool put_doors_in_corners=0, cities_all_bldg_mats=0, small_city_buildings=0, gen_room_geom_ahead=1;
 	unsigned num_place=0, num_tries=10, cur_prob=1, max_shadow_maps=32, buildings_rand_seed=0, max_ext_basement_hall_branches=4, max_ext_basement_room_depth=4;
 	unsigned max_room_geom_gen_per_frame=1;
 	float ao_factor=0.0, sec_extra_spacing=0.0, player_coll_radius_scale=1.0, interior_view_dist_scale=1.0;
@@ -309,6 +349,7 @@ struct building_params_t {
 	float office_same_mat_prob=0.0, office_same_size_prob=0.0, office_same_geom_prob=0.0, office_same_per_city_prob=0.0;
 	// building people/AI params
 	bool enable_people_ai=0, ai_target_player=1, ai_follow_player=0, allow_elevator_line=1, no_coll_enter_exit_elevator=1, show_player_model=0;
+	bool ai_batch_path_queries=1; // find routes to newly chosen destinations for all people in parallel after the serial AI update
 	unsigned ai_opens_doors=1; // 0=don't open doors, 1=only open if player closed door after path selection; 2=always open doors
 	unsigned ai_player_vis_test=0; // 0=no test, 1=LOS, 2=LOS+FOV, 3=LOS+FOV+lit
 	unsigned ai_sees_player_hide=2; // 0=doesn't see the player, 1=sees the player and waits outside the hiding spot, 2=opens the door and comes in
@@ -747,6 +788,7 @@ public:
 	void clear();
 	void clear_vbos();
 	void clear_vectors(bool free_memory=0) {rgeom_storage_t::clear(free_memory);}
+	static void print_alloc_stats();
 	void add_cube_to_verts(cube_t const &c, colorRGBA const &color, point const &tex_origin=all_zeros,
 		unsigned skip_faces=0, bool swap_tex_st=0, bool mirror_x=0, bool mirror_y=0, bool inverted=0, bool z_dim_uses_ty=0);
 	void add_cube_to_verts_untextured(cube_t const &c, colorRGBA const &color, unsigned skip_faces=0);
@@ -921,6 +963,22 @@ struct courtyard_t : public cube_t {
 	int16_t room_ix=-1, door_ix=-1; // starts as <unset>
 };
 
+// uniform grid over room objects for collision queries in buildings with many objects; only built and used by the main thread
+struct room_obj_index_t {
+	std::atomic<bool> valid{0};
+	unsigned num_objs=0, ncells[3]={};
+	float cell_inv[3]={};
+	cube_t bcube;
+	vector<unsigned> cell_start, obj_ixs, always_check; // cell_start/obj_ixs is CSR format; always_check is moving and very large objects
+
+	void invalidate() {valid = 0;} // may be called from other threads; the index is rebuilt by the main thread on the next query
+	bool is_valid(unsigned num) const {return (valid && num == num_objs);}
+	void build(vect_room_object_t const &objs, float cell_size);
+	bool query(cube_t const &qcube, vector<unsigned> &ixs) const;
+private:
+	void get_cell_range(cube_t const &c, unsigned lo[3], unsigned hi[3]) const;
+};
+
 struct building_room_geom_t {
 
 	bool has_elevators=0, has_pictures=0, has_garage_car=0, modified_by_player=0, have_clock=0;
@@ -948,17 +1006,18 @@ struct building_room_geom_t {
 	building_decal_manager_t decal_manager;
 	particle_manager_t particle_manager;
 	fire_manager_t fire_manager;
+	room_obj_index_t obj_index;
 
 	building_room_geom_t(point const &tex_origin_=all_zeros) : tex_origin(tex_origin_), wood_color(WHITE) {}
 	bool empty() const {return objs.empty();}
 	void clear();
 	void clear_materials();
-	void invalidate_static_geom  () {invalidate_mats_mask |= (1 << MAT_TYPE_STATIC );}
+	void invalidate_static_geom  () {invalidate_mats_mask |= (1 << MAT_TYPE_STATIC ); obj_index.invalidate();}
 	void invalidate_model_geom   () {invalidate_static_geom();}
-	void invalidate_small_geom   () {invalidate_mats_mask |= (1 << MAT_TYPE_SMALL  );}
+	void invalidate_small_geom   () {invalidate_mats_mask |= (1 << MAT_TYPE_SMALL  ); obj_index.invalidate();}
 	void update_text_draw_data   () {invalidate_mats_mask |= (1 << MAT_TYPE_TEXT   );}
 	void invalidate_lights_geom  () {invalidate_mats_mask |= (1 << MAT_TYPE_LIGHTS );} // cache state and apply change later in case this is called from a different thread
-	void invalidate_detail_geom  () {invalidate_mats_mask |= (1 << MAT_TYPE_DETAIL );}
+	void invalidate_detail_geom  () {invalidate_mats_mask |= (1 << MAT_TYPE_DETAIL ); obj_index.invalidate();}
 	void update_dynamic_draw_data() {invalidate_mats_mask |= (1 << MAT_TYPE_DYNAMIC);}
 	void check_invalid_draw_data();
 	void invalidate_draw_data_for_obj(room_object_t const &obj, bool was_taken=0);
@@ -1819,6 +1878,7 @@ struct building_t : public building_geom_t {
 		unsigned building_ix, bool shadow_only, bool reflection_pass, unsigned inc_small, bool player_in_building);
 	void gen_and_draw_room_geom(brg_batch_draw_t *bbd, shader_t &s, shader_t &amask_shader, occlusion_checker_noncity_t &oc, vector3d const &xlate,
 		unsigned building_ix, bool shadow_only, bool reflection_pass, unsigned inc_small, bool player_in_building, bool ext_basement_conn_visible);
+	void gen_room_geom(unsigned building_ix);
 	bool has_cars_to_draw(bool player_in_building) const;
 	void draw_cars_in_building(shader_t &s, vector3d const &xlate, bool player_in_building, bool shadow_only) const;
 	bool check_for_water_splash(point const &pos_bs, float size=1.0, bool full_room_height=0, bool draw_splash=0, bool alert_zombies=1) const;
@@ -1846,6 +1906,10 @@ struct building_t : public building_geom_t {
 	void all_ai_room_update(rand_gen_t &rgen, float delta_dir);
 	int ai_room_update(person_t &person, float delta_dir, unsigned person_ix, rand_gen_t &rgen);
 	int run_ai_elevator_logic(person_t &person, float delta_dir, rand_gen_t &rgen);
+	void get_pending_ai_path_queries(vector<ai_path_query_t> &queries);
+	bool run_ai_path_query(unsigned person_ix) const;
+	void finish_ai_path_query(unsigned person_ix, bool found_route);
+	int finish_ai_path(person_t &person, bool found_route);
 	bool run_ai_pool_logic(person_t &person, float &speed_mult) const;
 	bool maybe_zombie_retreat(unsigned person_ix, point const &hit_pos);
 	void register_person_hit(unsigned person_ix, room_object_t const &obj, vector3d const &velocity);
@@ -2249,6 +2313,13 @@ public:
 	bool is_sphere_lit(point const &center, float radius) const;
 };
 
+struct ai_path_query_t { // deferred route finding for one building person; queries for different people can be run in parallel
+	building_t *building;
+	unsigned person_ix;
+	bool success=0;
+	ai_path_query_t(building_t *b, unsigned pix) : building(b), person_ix(pix) {}
+};
+
 struct vect_building_t : public vector<building_t> {
 	void ai_room_update(float delta_dir, float dmax, point const &camera_bs, rand_gen_t &rgen);
 };
@@ -2372,7 +2443,7 @@ inline point cube_top_center(cube_t const &c) {return point(c.xc(), c.yc(), c.z2
 
 void get_city_plot_zones(vect_city_zone_t &zones);
 void get_city_building_occluders(pos_dir_up const &pdu, building_occlusion_state_t &state);
-bool check_city_pts_occluded(point const *const pts, unsigned npts, building_occlusion_state_t const &state);
+bool check_city_cube_occluded(cube_t const &c, building_occlusion_state_t const &state);
 bool city_single_cube_visible_check(point const &pos, cube_t const &c);
 void add_city_building_signs(cube_t const &region_bcube, vector<sign_t     > &signs);
 void add_city_building_flags(cube_t const &region_bcube, vector<city_flag_t> &flags);
@@ -2444,6 +2515,8 @@ void draw_buildings_ext_paint(shader_t &s);
 void subtract_cube_xy(cube_t const &c, cube_t const &r, cube_t *out);
 void accumulate_shared_xy_area(cube_t const &c, cube_t const &sc, float &area);
 bool have_secondary_buildings();
+bool is_room_geom_gen_pending(building_t const &b);
+bool setup_bg_room_geom_gen();
 bool get_building_door_pos_closest_to(unsigned building_id, point const &target_pos, point &door_pos, bool inc_garage_door=0);
 cube_t register_deck_and_get_part_bounds(unsigned building_id, cube_t const &deck);
 bool register_achievement(std::string const &str);
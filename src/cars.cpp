@@ -483,9 +483,9 @@ void occlusion_checker_t::set_camera(pos_dir_up const &pdu) {
 }
 bool occlusion_checker_t::is_occluded(cube_t const &c) const {
 	if (state.building_ids.empty() && occluders.empty()) return 0;
+	if (check_city_cube_occluded(c, state)) return 1;
 	float const z(c.z2()); // top edge
 	point const corners[4] = {point(c.x1(), c.y1(), z), point(c.x2(), c.y1(), z), point(c.x2(), c.y2(), z), point(c.x1(), c.y2(), z)};
-	if (check_city_pts_occluded(corners, 4, state)) return 1;
 
 	for (auto c = occluders.begin(); c != occluders.end(); ++c) {
 		bool occluded(1);
@@ -957,6 +957,7 @@ void car_manager_t::finalize_cars() {
 	if (empty()) return;
 	for (auto i = cars.begin(); i != cars.end(); ++i) {assign_car_model_size_color(*i, rgen, 0);} // is_in_garage=0
 	cout << "Total Cars: " << cars.size() << endl; // 4000 on the road + 4372 parked = 8372
+	publish_car_snapshot(); // make car data available to pedestrians on their first frame
 }
 
 vector3d car_manager_t::get_helicopter_size(unsigned model_id) { // Note: non-const because this call may load the model
@@ -1000,7 +1001,7 @@ void car_city_vect_t::clear_cars() {
 void car_manager_t::extract_car_data(vector<car_city_vect_t> &cars_by_city) const {
 	if (cars.empty()) return;
 	//timer_t timer("Extract Car Data");
-	// create parked cars vectors on first call; this is used for pedestrian navigation within parking lots;
+	// create parked cars vectors on first call for this snapshot buffer; this is used for pedestrian navigation within parking lots;
 	// it won't be rebuilt on car destruction, but that should be okay
 	bool const add_parked_cars(cars_by_city.empty());
 	for (auto i = cars_by_city.begin(); i != cars_by_city.end(); ++i) {i->clear_cars();} // clear prev frame's state
@@ -1196,8 +1197,9 @@ int car_manager_t::find_next_car_after_turn(car_t &car) {
 
 bool car_manager_t::check_car_for_ped_colls(car_t &car) const {
 	if (car.turn_val != 0.0 || car.turn_dir != TURN_NONE) return 0; // for now, don't check for cars when turning as this causes problems with blocked intersections
-	if (car.cur_city >= peds_crossing_roads.peds.size())  return 0; // no peds in this city (includes connector road network); ignores player
-	auto const &peds_by_road(peds_crossing_roads.peds[car.cur_city]);
+	auto const &peds_crossing_roads(ped_snapshot->crossing_roads.peds);
+	if (car.cur_city >= peds_crossing_roads.size())  return 0; // no peds in this city (includes connector road network); ignores player
+	auto const &peds_by_road(peds_crossing_roads[car.cur_city]);
 	if (car.cur_road >= peds_by_road.size()) return 0; // no peds in this road; ignores player
 	point const player_pos(camera_pdu.pos - dstate.xlate);
 	bool const check_player(camera_surf_collide && !camera_in_building && dist_less_than(car.get_center(), player_pos, (X_SCENE_SIZE + Y_SCENE_SIZE)));
@@ -1227,15 +1229,12 @@ void car_manager_t::next_frame(ped_manager_t const &ped_manager, float car_speed
 	if (!animate2) return;
 	helicopters_next_frame(car_speed);
 	if (cars.empty()) return;
-	// Warning: not really thread safe, but should be okay; the ped state should valid at all points (thought maybe inconsistent) and we don't need it to be exact every frame
-	ped_manager.get_peds_crossing_roads(peds_crossing_roads);
+	// use the most recent ped state published by ped update, which may be from the previous frame; the ped thread never writes to this snapshot
+	ped_snapshot = ped_manager.get_ped_snapshot();
 	//timer_t timer("Update Cars"); // 4K cars = 0.7ms / 2.1ms with destinations + navigation
 	comp_car_road_then_pos const sort_func(camera_pdu.pos - dstate.xlate);
-#pragma omp critical(modify_car_data)
-	{
-		if (car_destroyed) {remove_destroyed_cars();} // at least one car was destroyed in the previous frame - remove it/them
-		sort(cars.begin(), cars.end(), sort_func); // sort by city/road/position for intersection tests and tile shadow map binds
-	}
+	if (car_destroyed) {remove_destroyed_cars();} // at least one car was destroyed in the previous frame - remove it/them
+	sort(cars.begin(), cars.end(), sort_func); // sort by city/road/position for intersection tests and tile shadow map binds
 	entering_city.clear();
 	car_blocks.clear();
 	float const speed(CAR_SPEED_SCALE*car_speed*get_clamped_fticks());
@@ -1286,7 +1285,7 @@ void car_manager_t::next_frame(ped_manager_t const &ped_manager, float car_speed
 			int const next_car(find_next_car_after_turn(*i)); // Note: calculates in i->car_in_front
 			if (next_car >= 0) {check_collision(*i, cars[next_car]);} // make sure we collide with the correct car
 		}
-		if (!peds_crossing_roads.peds.empty()) {check_car_for_ped_colls(*i);}
+		if (!ped_snapshot->crossing_roads.peds.empty()) {check_car_for_ped_colls(*i);}
 	} // for i
 	update_cars(); // run update logic
 
@@ -1320,6 +1319,7 @@ void car_manager_t::next_frame(ped_manager_t const &ped_manager, float car_speed
 		car_blocks_by_road.emplace_back(cars_by_road.size(), 0); // add terminator
 		cars_by_road.emplace_back(cube_t(), cars.size()); // add terminator
 	}
+	publish_car_snapshot(); // after cars have moved; ped update can read this while we start the next frame
 	//cout << TXT(cars.size()) << TXT(entering_city.size()) << TXT(in_isects.size()) << endl; // TESTING
 }
 
@@ -79,7 +79,7 @@ struct city_params_t {
 	// pedestrians
 	unsigned num_peds=0;
 	float ped_speed=0.0;
-	bool ped_respawn_at_dest=0, use_animated_people=0;
+	bool ped_respawn_at_dest=0, use_animated_people=0, ped_update_mt=0, ped_update_timing=0;
 	bool any_model_has_animations=0; // calculated, not specified in the config file
 	string default_anim_name;
 	// buildings; maybe should be building params, but we have the model loading code here
@@ -193,6 +193,28 @@ struct car_t : public car_base_t, public waiting_obj_t { // size = 100
 	float get_sum_len_space_for_cars_in_front(cube_t const &range) const;
 };
 
+// snapshot of simulation state that's exchanged between threads without locking: the simulation thread fills a back buffer and publishes it
+// with an atomic swap, and readers get a reference to the latest published version without blocking; buffers held by readers are never reused
+template<typename T> class snapshot_buffer_t {
+	typedef std::shared_ptr<T> ptr_t;
+	ptr_t bufs[3]; // owned by the writer thread; two are normally enough, the third is for readers that hold a snapshot across a publish
+	ptr_t latest; // shared with readers; only accessed through atomic_load()/atomic_store()
+	unsigned back_ix=0;
+public:
+	snapshot_buffer_t() : latest(std::make_shared<T>()) {}
+	T &get_back_buffer() { // writer only; contents are left over from a previous publish so that vector capacity can be reused
+		for (unsigned n = 0; n < 3; ++n) {
+			if (!bufs[n]) {bufs[n] = std::make_shared<T>();}
+			if (bufs[n].use_count() == 1) {back_ix = n; return *bufs[n];} // not published and not held by any reader
+		}
+		back_ix = (back_ix + 1) % 3; // all buffers in use; replace one, and the old buffer will be freed when the reader releases it
+		bufs[back_ix] = std::make_shared<T>();
+		return *bufs[back_ix];
+	}
+	void publish() {std::atomic_store(&latest, bufs[back_ix]);} // writer only
+	std::shared_ptr<T const> get_latest() const {return std::atomic_load(&latest);} // never returns null
+};
+
 struct car_city_vect_t {
 	vector<car_base_t> cars[2][2]; // {dim x dir}
 	vect_cube_with_ix_t parked_car_bcubes, sleeping_car_bcubes; // stores car bcube + plot_ix
@@ -724,9 +746,9 @@ struct pedestrian_t : public person_base_t { // city pedestrian
 	bool is_possibly_valid_dest_pos(point const &dpos, vect_cube_t const &colliders) const;
 	bool try_place_in_plot(cube_t const &plot_cube, vect_cube_t const &colliders, unsigned plot_id, rand_gen_t &rgen);
 	point get_dest_pos(cube_t const &plot_bcube, cube_t const &next_plot_bcube, ped_manager_t const &ped_mgr, int &debug_state) const;
-	bool choose_alt_next_plot(ped_manager_t const &ped_mgr);
+	bool choose_alt_next_plot(ped_manager_t &ped_mgr);
 	void get_avoid_cubes(ped_manager_t const &ped_mgr, vect_cube_t const &colliders, cube_t const &plot_bcube, cube_t const &next_plot_bcube,
-		point &dest_pos, vect_cube_t &avoid, bool &in_illegal_area, bool &avoid_entire_plot) const;
+		point &dest_pos, vect_cube_t &avoid, vect_cube_t &car_bcubes, bool &in_illegal_area, bool &avoid_entire_plot) const;
 	bool check_path_blocked(ped_manager_t &ped_mgr, point const &dest, bool check_buildings);
 	void next_frame(ped_manager_t &ped_mgr, vector<pedestrian_t> &peds, unsigned pid, rand_gen_t &rgen, float delta_dir);
 	void register_at_dest();
@@ -743,6 +765,19 @@ struct ped_city_vect_t {
 	void clear();
 };
 
+struct ped_snapshot_t { // ped state published by ped update each frame for use by car update and building drawing threads
+	struct ped_t {
+		point pos;
+		unsigned dest_bldg;
+		ped_t(point const &p, unsigned db) : pos(p), dest_bldg(db) {}
+	};
+	vector<ped_t> peds; // sorted by city and plot
+	vector<unsigned> city_plot_ix, by_plot; // first plot index for each city, first ped index for each plot; both include a terminator
+	ped_city_vect_t crossing_roads; // peds crossing roads by city and road, for car collision avoidance
+};
+typedef std::shared_ptr<vector<car_city_vect_t> const> car_snapshot_ptr_t;
+typedef std::shared_ptr<ped_snapshot_t const> ped_snapshot_ptr_t;
+
 class car_manager_t { // and trucks and helicopters
 
 	car_model_loader_t car_model_loader;
@@ -764,7 +799,8 @@ class car_manager_t { // and trucks and helicopters
 	vector<cube_with_ix_t> cars_by_road;
 	vector<helicopter_t> helicopters;
 	vector<helipad_t> helipads;
-	ped_city_vect_t peds_crossing_roads;
+	snapshot_buffer_t<vector<car_city_vect_t>> car_snapshot; // published for ped update
+	ped_snapshot_ptr_t ped_snapshot; // latest ped state, acquired at the beginning of each update
 	car_draw_state_t dstate;
 	rand_gen_t rgen;
 	vector<unsigned> entering_city;
@@ -798,6 +834,8 @@ public:
 	void assign_car_model_size_color(car_t &car, rand_gen_t &local_rgen, bool is_in_garage);
 	void add_helicopters(vect_cube_t const &hp_locs);
 	void extract_car_data(vector<car_city_vect_t> &cars_by_city) const;
+	void publish_car_snapshot() {extract_car_data(car_snapshot.get_back_buffer()); car_snapshot.publish();}
+	car_snapshot_ptr_t get_car_snapshot() const {return car_snapshot.get_latest();} // thread safe, non-blocking
 	bool proc_sphere_coll(point &pos, point const &p_last, float radius, vector3d *cnorm) const;
 	void destroy_cars_in_radius(point const &pos_in, float radius);
 	bool get_color_at_xy(point const &pos, colorRGBA &color, int int_ret) const;
@@ -857,6 +895,22 @@ class city_cube_nav_grid_manager;
 
 class ped_manager_t { // pedestrians
 
+	struct crosswalk_mark_t {
+		point pos;
+		unsigned city;
+		bool dim, dir;
+		crosswalk_mark_t(point const &p, unsigned c, bool dim_, bool dir_) : pos(p), city(c), dim(dim_), dir(dir_) {}
+	};
+	// per-thread scratch state used during ped update so that cities can be updated in parallel;
+	// plot re-registration and crosswalk marking are deferred and committed serially after the update
+	struct thread_state_t {
+		path_finder_t path_finder;
+		ai_path_t grid_path;
+		vect_cube_t car_bcubes; // reused across get_avoid_cubes() calls
+		rand_gen_t rgen; // reseeded per city per frame so that results don't depend on thread assignment
+		vector<unsigned> cities_to_sort;
+		vector<crosswalk_mark_t> crosswalks;
+	};
 	struct city_ixs_t {
 		unsigned ped_ix, plot_ix;
 		city_ixs_t() : ped_ix(0), plot_ix(0) {}
@@ -870,15 +924,19 @@ class ped_manager_t { // pedestrians
 	vector<unsigned> by_plot;
 	vector<unsigned char> need_to_sort_city;
 	car_city_vect_t empty_cars_vect;
-	vector<car_city_vect_t> cars_by_city;
+	car_snapshot_ptr_t cars_by_city; // latest car state, acquired at the beginning of each update
+	snapshot_buffer_t<ped_snapshot_t> ped_snapshot; // published for car update and building drawing
 	vector<point> bldg_ppl_pos;
 	vector<person_t const *> to_draw;
+	vector<thread_state_t> thread_state; // one per OpenMP thread
 	rand_gen_t rgen;
 	ao_draw_state_t dstate;
 	unique_ptr<city_cube_nav_grid_manager> nav_grid_mgr;
+	double update_time[2]={}; // {serial, parallel} in ms, for ped_update_timing
+	unsigned num_timed_updates[2]={};
 	int selected_ped_ssn=-1;
 	unsigned animation_id=ANIM_ID_WALK, tot_num_plots=0;
-	bool ped_destroyed=0, need_to_sort_peds=0, prev_choose_zombie=0;
+	bool ped_destroyed=0, need_to_sort_peds=0, prev_choose_zombie=0, in_mt_update=0;
 
 	void assign_ped_model(person_base_t &ped);
 	void maybe_reassign_ped_model(person_base_t &ped);
@@ -886,23 +944,28 @@ class ped_manager_t { // pedestrians
 	void expand_cube_for_ped(cube_t &cube) const;
 	void remove_destroyed_peds();
 	void sort_by_city_and_plot();
+	void update_city_peds(unsigned city, float delta_dir);
+	void commit_deferred_ped_updates();
+	void get_peds_crossing_roads(ped_city_vect_t &pcv) const;
+	void publish_ped_snapshot();
 	road_isec_t const &get_car_isec(car_base_t const &car) const;
 	int get_road_ix_for_ped_crossing(pedestrian_t const &ped, bool road_dim) const;
 	void setup_occluders();
 	bool draw_ped(person_base_t const &ped, shader_t &s, pos_dir_up const &pdu, vector3d const &xlate, float def_draw_dist, float draw_dist_sq,
 		bool &in_sphere_draw, bool shadow_only, bool is_dlight_shadows, animation_state_t *anim_state, bool is_in_building);
-	car_city_vect_t const &get_cars_for_city(unsigned city) const {return ((city < cars_by_city.size()) ? cars_by_city[city] : empty_cars_vect);}
+	car_city_vect_t const &get_cars_for_city(unsigned city) const {return (has_cars_in_city(city) ? (*cars_by_city)[city] : empty_cars_vect);}
 public:
 	friend class city_spectate_manager_t;
-	// for use in pedestrian_t, mostly for collisions and path finding
-	path_finder_t path_finder;
-	ai_path_t grid_path;
 
 	ped_manager_t(city_road_gen_t const &road_gen_, car_manager_t const &car_manager_);
 	ped_manager_t (ped_manager_t const &) = delete; // forbidden
 	void operator=(ped_manager_t const &) = delete; // forbidden
 	~ped_manager_t();
 	city_cube_nav_grid_manager &get_nav_grid_mgr();
+	// for use in pedestrian_t, mostly for collisions and path finding
+	thread_state_t &get_thread_state();
+	path_finder_t &get_path_finder() {return get_thread_state().path_finder;}
+	ai_path_t     &get_grid_path  () {return get_thread_state().grid_path;}
 	vect_cube_t const &get_colliders_for_plot(unsigned city_ix, unsigned plot_ix) const;
 	road_plot_t const &get_city_plot_for_peds(unsigned city_ix, unsigned plot_ix) const;
 	int get_global_plot_id_for_pos(unsigned city_ix, point const &pos) const;
@@ -917,13 +980,13 @@ public:
 	void choose_new_ped_plot_pos(pedestrian_t &ped);
 	bool check_isec_sphere_coll       (pedestrian_t const &ped, cube_t &coll_cube) const;
 	bool check_streetlight_sphere_coll(pedestrian_t const &ped, cube_t &coll_cube) const;
-	bool mark_crosswalk_in_use(pedestrian_t const &ped);
+	void mark_crosswalk_in_use(pedestrian_t const &ped);
 	bool choose_dest_building_or_parked_car(pedestrian_t &ped);
 	unsigned get_tot_num_plots() const {return tot_num_plots;}
-	unsigned get_next_plot(pedestrian_t &ped, int exclude_plot=-1) const;
+	unsigned get_next_plot(pedestrian_t &ped, int exclude_plot=-1);
 	void move_ped_to_next_plot(pedestrian_t &ped);
 	// cars
-	bool has_cars_in_city(unsigned city_ix) const {return (city_ix < cars_by_city.size());}
+	bool has_cars_in_city(unsigned city_ix) const {return (cars_by_city && city_ix < cars_by_city->size());}
 	bool has_nearby_car(pedestrian_t const &ped, bool road_dim, float delta_time, vect_cube_t *dbg_cubes=nullptr) const;
 	bool has_nearby_car_on_road(pedestrian_t const &ped, bool dim, unsigned road_ix, float delta_time, vect_cube_t *dbg_cubes) const;
 	bool has_car_at_pt(point const &pos, unsigned city, bool is_parked) const;
@@ -944,7 +1007,7 @@ public:
 	void next_frame();
 	pedestrian_t const *get_ped_at(point const &p1, point const &p2) const;
 	unsigned get_first_ped_at_plot(unsigned plot) const {assert(plot < by_plot.size()); return by_plot[plot];}
-	void get_peds_crossing_roads(ped_city_vect_t &pcv) const;
+	ped_snapshot_ptr_t get_ped_snapshot() const {return ped_snapshot.get_latest();} // thread safe, non-blocking
 	void get_pedestrians_in_area(cube_t const &area, int building_ix, vector<point> &pts) const;
 	void draw(vector3d const &xlate, bool use_dlights, bool shadow_only, bool is_dlight_shadows);
 	void gen_and_draw_people_in_building(ped_draw_vars_t const &pdv);
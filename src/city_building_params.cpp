@@ -51,6 +51,8 @@ void city_params_t::init_kw_maps() {
 	// pedestrians
 	kwmu.add("num_peds", num_peds);
 	kwmb.add("ped_respawn_at_dest", ped_respawn_at_dest);
+	kwmb.add("ped_update_mt",       ped_update_mt);
+	kwmb.add("ped_update_timing",   ped_update_timing);
 	kwmb.add("use_animated_people", use_animated_people);
 	kwmr.add("ped_speed",           ped_speed, FP_CHECK_NONNEG);
 	// parking lots / trees / detail objects
@@ -176,6 +178,7 @@ void building_params_t::init_kw_maps() {
 	kwmu.add("max_ext_basement_hall_branches", max_ext_basement_hall_branches);
 	kwmu.add("max_ext_basement_room_depth",    max_ext_basement_room_depth);
 	kwmu.add("max_room_geom_gen_per_frame",    max_room_geom_gen_per_frame);
+	kwmb.add("gen_room_geom_ahead",            gen_room_geom_ahead);
 	kwmb.add("add_office_backroom_basements",  add_office_br_basements);
 	kwmf.add("ao_factor", ao_factor);
 	kwmf.add("sec_extra_spacing", sec_extra_spacing);
@@ -257,6 +260,7 @@ void building_params_t::init_kw_maps() {
 	kwmu.add("ai_opens_doors",      ai_opens_doors); // 0=don't open doors, 1=only open if player closed door after path selection; 2=always open doors
 	kwmb.add("ai_target_player",    ai_target_player);
 	kwmb.add("ai_follow_player",    ai_follow_player);
+	kwmb.add("ai_batch_path_queries", ai_batch_path_queries);
 	kwmu.add("ai_player_vis_test",  ai_player_vis_test); // 0=no test, 1=LOS, 2=LOS+FOV, 3=LOS+FOV+lit
 	kwmu.add("ai_sees_player_hide", ai_sees_player_hide); // 0=doesn't see the player, 1=sees the player and waits outside the hiding spot, 2=opens the door and comes in
 	kwmu.add("people_per_office_min", people_per_office_min);
@@ -1475,7 +1475,7 @@ public:
 		return -1; // not found
 	}
 	// plot = current plot, dest_plot = final destination plot; returns next plot adj to cur plot on path to dest_plot
-	unsigned get_next_plot(unsigned global_plot, unsigned global_dest_plot, int exclude_plot) const {
+	unsigned get_next_plot(unsigned global_plot, unsigned global_dest_plot, int exclude_plot, rand_gen_t &rgen) const {
 		if (global_plot == global_dest_plot) {return global_plot;} // identity, at destination, no change
 		unsigned const plot(decode_plot_id(global_plot)), dest_plot(decode_plot_id(global_dest_plot)); // convert to local space
 		assert(plot < plots.size() && dest_plot < plots.size());
@@ -1498,7 +1498,6 @@ public:
 				dir = (move_dir ? ((dx < 0) ? 0 : 1) : ((dy < 0) ? 2 : 3));	
 			}
 			else { // take a detour in a random direction
-				static rand_gen_t rgen;
 				bool rand_dir(rgen.rand_bool());
 				dir = (move_dir ? (rand_dir ? 0 : 1) : (rand_dir ? 2 : 3));
 					
@@ -2772,7 +2771,9 @@ public:
 	bool is_city_residential(unsigned city_id) const {return get_city(city_id).get_is_residential();}
 	road_plot_t const &get_plot_from_global_id(unsigned city_id, unsigned global_plot_id) const {return get_city(city_id).get_plot_from_global_id(global_plot_id);}
 	int get_global_plot_id_for_pos(unsigned city_id, point const &pos) const {return get_city(city_id).get_global_plot_id_for_pos(pos);}
-	unsigned get_next_plot(unsigned city_id, unsigned plot, unsigned dest_plot, int exclude_plot) const {return get_city(city_id).get_next_plot(plot, dest_plot, exclude_plot);}
+	unsigned get_next_plot(unsigned city_id, unsigned plot, unsigned dest_plot, int exclude_plot, rand_gen_t &rgen) const {
+		return get_city(city_id).get_next_plot(plot, dest_plot, exclude_plot, rgen);
+	}
 	bool choose_dest_building(unsigned city_id, unsigned &plot, unsigned &building, rand_gen_t &rgen) const {return get_city(city_id).choose_dest_building(plot, building, rgen);}
 	
 	bool update_car_dest(car_t &car) const {
@@ -2900,9 +2901,21 @@ cube_t ped_manager_t::get_expanded_city_plot_bcube_for_peds(unsigned city_ix, un
 vect_cube_t const &ped_manager_t::get_colliders_for_plot(unsigned city_ix, unsigned plot_ix) const {return road_gen.get_colliders_for_plot(city_ix, plot_ix);}
 bool ped_manager_t::gen_ped_pos(pedestrian_t &ped) {return road_gen.gen_ped_pos(ped, rgen);} // Note: non-const because rgen is modified
 
-bool ped_manager_t::mark_crosswalk_in_use(pedestrian_t const &ped) {
+void ped_manager_t::mark_crosswalk_in_use(pedestrian_t const &ped) { // deferred until commit_deferred_ped_updates()
 	bool const dim(fabs(ped.dir.y) > fabs(ped.dir.x)), dir(ped.dir[dim] > 0); // something like this?
-	return road_gen.get_city(ped.city).mark_crosswalk_in_use(ped.pos, dim, dir);
+	get_thread_state().crosswalks.emplace_back(ped.pos, ped.city, dim, dir);
+}
+void ped_manager_t::commit_deferred_ped_updates() { // must be called serially after all cities have been updated
+	for (thread_state_t &ts : thread_state) {
+		for (crosswalk_mark_t const &cw : ts.crosswalks) {road_gen.get_city(cw.city).mark_crosswalk_in_use(cw.pos, cw.dim, cw.dir);}
+
+		for (unsigned city : ts.cities_to_sort) {
+			if (!need_to_sort_city.empty()) {need_to_sort_city[city] = 1;}
+			need_to_sort_peds = 1;
+		}
+		ts.crosswalks.clear();
+		ts.cities_to_sort.clear();
+	}
 }
 bool ped_manager_t::check_isec_sphere_coll(pedestrian_t const &ped, cube_t &coll_cube) const {
 	return road_gen.get_city(ped.city).check_isec_sphere_coll(ped.pos, 0.6*ped.radius, coll_cube); // Note: no xlate is required since peds and city are in the same coord space
@@ -2921,6 +2934,7 @@ void ped_manager_t::setup_occluders() {
 // path finding
 bool ped_manager_t::choose_dest_building_or_parked_car(pedestrian_t &ped) { // modifies rgen, non-const
 	unsigned const prev_dest_plot(ped.dest_plot);
+	rand_gen_t &rgen(get_thread_state().rgen);
 	ped.clear_current_dest(); // will choose a new dest
 
 	if (city_params.num_cars == 0 || (rgen.rand() & 3) != 0) { // choose a dest building 75% of the time, 100% of the time if there are no cars
@@ -2937,6 +2951,8 @@ bool ped_manager_t::choose_dest_building_or_parked_car(pedestrian_t &ped) { // m
 }
 void ped_manager_t::choose_new_ped_plot_pos(pedestrian_t &ped) {
 	if (city_params.ped_respawn_at_dest) { // respawn
+		rand_gen_t &rgen(get_thread_state().rgen);
+
 		for (unsigned n = 0; n < 100; ++n) { // keep respawning until it's not visible by the camera
 			float const prev_zval(ped.pos.z);
 			bool const ret(road_gen.get_city(ped.city).gen_ped_pos(ped, rgen));
@@ -2949,7 +2965,9 @@ void ped_manager_t::choose_new_ped_plot_pos(pedestrian_t &ped) {
 	}
 	choose_dest_building_or_parked_car(ped);
 }
-unsigned ped_manager_t::get_next_plot(pedestrian_t &ped, int exclude_plot) const {return road_gen.get_next_plot(ped.city, ped.plot, ped.dest_plot, exclude_plot);}
+unsigned ped_manager_t::get_next_plot(pedestrian_t &ped, int exclude_plot) { // uses the per-city rand state so that detours don't depend on thread scheduling
+	return road_gen.get_next_plot(ped.city, ped.plot, ped.dest_plot, exclude_plot, get_thread_state().rgen);
+}
 
 
 void city_lights_manager_t::add_player_flashlight(float radius_scale) {
@@ -127,7 +127,10 @@ bool city_model_loader_t::model_filename_contains(unsigned id, string const &str
 }
 bool city_model_loader_t::is_model_valid(unsigned id) {
 	city_model_t &model(get_model(id));
-	if (!model.tried_to_load) {load_model_id(id);} // load the model if needed
+	if (!model.tried_to_load) { // load the model if needed
+		assert(on_main_thread_3dw()); // loading isn't thread safe; models used by background room geom gen must be preloaded in setup_bg_room_geom_gen()
+		load_model_id(id);
+	}
 	return model.is_loaded();
 }
 
@@ -4,14 +4,19 @@
 
 #include "3DWorld.h"
 #include "cobj_bsp_tree.h"
+#include "profiler.h"
 
 
-unsigned const MAX_LEAF_SIZE = 2;
-float const POLY_TOLER       = 1.0E-6;
-float const OVERLAP_AMT      = 0.02;
+unsigned const MAX_LEAF_SIZE     = 2;
+unsigned const MAX_SAH_LEAF_SIZE = 8;
+unsigned const NUM_SAH_BINS      = 16;
+float const POLY_TOLER           = 1.0E-6;
+float const OVERLAP_AMT          = 0.02;
+float const SAH_TRAV_COST        = 1.0; // relative to the cost of one cobj intersection test
+float const MAX_REFIT_COST_RATIO = 2.0; // rebuild rather than refit once the SAH cost has grown by this much since the last build
 
 
-extern bool mt_cobj_tree_build, begin_motion;
+extern bool mt_cobj_tree_build, sah_cobj_tree_build, cobj_tree_timing, begin_motion;
 extern int display_mode, frame_counter, cobj_counter;
 extern coll_obj_group coll_objects;
 extern vector<unsigned> falling_cobjs;
@@ -343,21 +348,21 @@ void cobj_tree_sphere_t::get_ids_int_sphere(point const &center, float radius, v
 // *** cobj_bvh_tree ***
 
 
-bool cobj_bvh_tree::create_cixs() {
+bool cobj_bvh_tree::create_cixs(vector<unsigned> &ids) const {
 
 	if (is_dynamic && !is_static) { // use dynamic_ids
 		for (cobj_id_set_t::const_iterator i = cobjs->dynamic_ids.begin(); i != cobjs->dynamic_ids.end(); ++i) {
 			assert(*i < cobjs->size());
 			assert((*cobjs)[*i].status == COLL_DYNAMIC);
-			add_cobj(*i);
+			add_cobj(ids, *i);
 		}
 	}
 	else {
-		if (is_static && !occluders_only && !cubes_only) {cixs.reserve(cobjs->size());} // normal static mode
-		for (unsigned i = 0; i < cobjs->size(); ++i) {add_cobj(i);}
+		if (is_static && !occluders_only && !cubes_only) {ids.reserve(cobjs->size());} // normal static mode
+		for (unsigned i = 0; i < cobjs->size(); ++i) {add_cobj(ids, i);}
 	}
-	assert(cixs.size() < (1 << 29));
-	return !cixs.empty();
+	assert(ids.size() < (1 << 29));
+	return !ids.empty();
 }
 
 
@@ -374,21 +379,36 @@ void cobj_bvh_tree::clear() {
 
 	cobj_tree_base::clear();
 	cixs.resize(0);
+	input_cids.resize(0);
 }
 
 
-void cobj_bvh_tree::add_cobjs(bool verbose) {
+// if allow_refit=1 and the set of cobjs is the same as the last call, the existing tree is refit rather than rebuilt
+void cobj_bvh_tree::add_cobjs(bool verbose, bool allow_refit) {
 
 	RESET_TIME;
-	clear();
-	if (!create_cixs()) return; // nothing to be done
+	use_sah = (sah_cobj_tree_build && is_static);
+
+	if (allow_refit) {
+		vector<unsigned> cids;
+		create_cixs(cids);
+		if (try_refit(cids)) return; // done
+		clear();
+		if (cids.empty()) return; // nothing to be done
+		cixs = cids;
+		input_cids.swap(cids);
+	}
+	else {
+		clear();
+		if (!create_cixs(cixs)) return; // nothing to be done
+	}
 	bool const do_mt_build(mt_cobj_tree_build && cixs.size() > 10000);
 	build_tree_from_cixs(do_mt_build);
 
 	if (verbose) {
 		PRINT_TIME(" Cobj Tree Create");
-		cout << "cobjs: " << cobjs->size() << ", leaves: " << cixs.size() << ", nodes: " << nodes.size()
-				<< ", depth: " << max_depth << ", max_leaves: " << max_leaf_count << ", leaf_nodes: " << num_leaf_nodes << endl;
+		cout << "cobjs: " << cobjs->size() << ", leaves: " << cixs.size() << ", nodes: " << nodes.size() << ", depth: " << max_depth
+			 << ", max_leaves: " << max_leaf_count << ", leaf_nodes: " << num_leaf_nodes << ", SAH cost: " << build_cost << endl;
 	}
 }
 
@@ -396,20 +416,63 @@ void cobj_bvh_tree::add_cobjs(bool verbose) {
 // to be called from within add_cobjs() or after a call to add_cobj_ids()
 void cobj_bvh_tree::build_tree_from_cixs(bool do_mt_build) {
 
+	highres_timer_t timer((std::string(name) + " Build"), cobj_tree_timing);
 	max_depth = max_leaf_count = num_leaf_nodes = 0;
-	nodes.resize(get_conservative_num_nodes(cixs.size()) + 64*do_mt_build); // add 8 extra nodes for each of 8 top level splits
+	nodes.resize(get_max_num_nodes(cixs.size()) + 64*do_mt_build); // add 8 extra nodes for each of 8 top level splits
 	unsigned const root(0);
 	nodes[root] = tree_node(0, (unsigned)cixs.size());
+	is_mt_built = do_mt_build;
 
 	if (do_mt_build) { // 2x faster build time, 10% slower traversal
 		build_tree_top_level_omp();
 	}
 	else {
 		per_thread_data ptd(1, nodes.size(), 1);
-		build_tree(root, 0, 0, ptd);
+		build_subtree(root, 0, 0, ptd);
 		nodes.resize(ptd.get_next_node_ix());
 	}
 	nodes[root].next_node_id = (unsigned)nodes.size();
+	build_cost = calc_sah_cost();
+}
+
+
+// expected relative cost of a ray query: node and leaf cobj tests weighted by the probability of hitting each node's bcube
+float cobj_bvh_tree::calc_sah_cost() const {
+
+	if (nodes.empty()) return 0.0;
+	float const root_area(nodes[0].get_area());
+	if (root_area == 0.0) return 0.0;
+	float cost(0.0);
+
+	for (auto i = nodes.begin(); i != nodes.end(); ++i) {
+		cost += i->get_area()*((i->start < i->end) ? float(i->end - i->start) : SAH_TRAV_COST);
+	}
+	return cost/root_area;
+}
+
+
+// returns 1 if the tree was refit for cids, 0 if it needs to be rebuilt
+bool cobj_bvh_tree::try_refit(vector<unsigned> const &cids) {
+
+	if (nodes.empty() || is_mt_built || cids.empty() || cids != input_cids) return 0; // mt builds have gaps in the node array, so can't be refit
+	highres_timer_t timer((std::string(name) + " Refit"), cobj_tree_timing);
+	refit();
+	return (calc_sah_cost() <= MAX_REFIT_COST_RATIO*build_cost); // rebuild if quality has degraded too much
+}
+
+
+// recompute node bcubes bottom-up with the same tree topology; O(n) in the number of nodes;
+// doesn't reallocate nodes, so it's safer for concurrent readers than a rebuild (though they may see a mix of old and new bcubes)
+void cobj_bvh_tree::refit() {
+
+	for (unsigned nix = (unsigned)nodes.size(); nix-- > 0;) { // children always come after their parents
+		tree_node &n(nodes[nix]);
+		if (n.start < n.end) {calc_node_bbox(n); continue;} // leaf
+		unsigned kid(nix+1);
+		assert(kid < n.next_node_id);
+		n.copy_from(nodes[kid]);
+		for (kid = nodes[kid].next_node_id; kid < n.next_node_id; kid = nodes[kid].next_node_id) {n.union_with_cube(nodes[kid]);}
+	}
 }
 
 
@@ -455,6 +518,75 @@ bool cobj_bvh_tree::check_coll_line(point const &p1, point const &p2, point &cpo
 }
 
 
+// exact intersection of a packet of lines, equivalent to calling check_coll_line() with exact=1 for each line (but without early termination);
+// each node bbox is tested against all active lines at once, which amortizes the node loads and lets the compiler vectorize the slab tests
+unsigned cobj_bvh_tree::check_coll_line_packet(coll_line_packet_t &packet, int ignore_cobj, int test_alpha, bool skip_non_drawn, bool skip_movable) const {
+
+	unsigned const num(packet.num), num_nodes((unsigned)nodes.size());
+	assert(num <= MAX_LINE_PACKET_SIZE);
+	if (num_nodes == 0 || num == 0) return 0;
+	// structure of arrays layout; tmax is in units of the original (unclipped) line length, so dinv never needs to be updated on a hit
+	float org[3][MAX_LINE_PACKET_SIZE], dinv[3][MAX_LINE_PACKET_SIZE], tmax[MAX_LINE_PACKET_SIZE], max_alpha[MAX_LINE_PACKET_SIZE];
+	unsigned char active[MAX_LINE_PACKET_SIZE];
+	unsigned num_hits(0);
+
+	for (unsigned r = 0; r < num; ++r) {
+		vector3d d(packet.p2[r] - packet.p1[r]);
+		d.invert();
+		UNROLL_3X(org[i_][r] = packet.p1[r][i_]; dinv[i_][r] = d[i_];)
+		tmax[r] = 1.0; max_alpha[r] = 0.0;
+	}
+	for (unsigned nix = 0; nix < num_nodes;) {
+		tree_node const &n(nodes[nix]);
+		unsigned any_active(0);
+
+		for (unsigned r = 0; r < num; ++r) { // branch-free slab test; any lines that miss this node also miss all of its children
+			float tn(0.0), tf(tmax[r]);
+
+			for (unsigned d = 0; d < 3; ++d) {
+				float const t1((n.d[d][0] - org[d][r])*dinv[d][r]), t2((n.d[d][1] - org[d][r])*dinv[d][r]);
+				tn = max(tn, min(t1, t2));
+				tf = min(tf, max(t1, t2));
+			}
+			active[r]   = (tn < tf);
+			any_active |= active[r];
+		}
+		if (!any_active) {
+			assert(n.next_node_id > nix);
+			nix = n.next_node_id; // all lines failed the bbox test
+			continue;
+		}
+		++nix;
+
+		for (unsigned i = n.start; i < n.end; ++i) { // check leaves
+			if ((int)cixs[i] == ignore_cobj) continue;
+			coll_obj const &c(get_cobj(i));
+			if (!obj_ok(c))                                             continue;
+			if (skip_non_drawn  && !c.cp.might_be_drawn())              continue;
+			if (skip_movable    && c.is_movable())                      continue;
+			if (test_alpha == 1 && c.is_semi_trans())                   continue;
+			if (test_alpha == 3 && c.cp.color.alpha < MIN_SHADOW_ALPHA) continue;
+
+			for (unsigned r = 0; r < num; ++r) {
+				if (!active[r]) continue;
+				if (test_alpha == 2 && c.cp.color.alpha <= max_alpha[r]) continue;
+				point const &p1(packet.p1[r]), &p2(packet.p2[r]);
+				if (packet.skip_init_colls[r] && c.contains_pt(p1) && c.contains_point(p1)) continue;
+				float t(0.0);
+				vector3d cnorm;
+				if (!c.line_int_exact(p1, p2, t, cnorm, 0.0, tmax[r])) continue;
+				if (packet.cindex[r] < 0) {++num_hits;}
+				packet.cindex[r] = cixs[i];
+				packet.cnorm [r] = cnorm;
+				packet.cpos  [r] = p1 + (p2 - p1)*t;
+				max_alpha    [r] = c.cp.color.alpha;
+				tmax         [r] = t;
+			}
+		}
+	}
+	return num_hits;
+}
+
 bool cobj_bvh_tree::check_point_contained(point const &p, int &cindex) const {
 
 	unsigned const num_nodes((unsigned)nodes.size());
@@ -629,7 +761,7 @@ void cobj_bvh_tree::build_tree_top_level_omp() { // single octtree level
 		curs[bix]     = cur;
 		cur_nixs[bix] = cur_nix;
 		cur     += count;
-		cur_nix += get_conservative_num_nodes(count);
+		cur_nix += get_max_num_nodes(count);
 		assert(cur_nix <= nodes.size());
 	}
 
@@ -637,10 +769,10 @@ void cobj_bvh_tree::build_tree_top_level_omp() { // single octtree level
 	for (int bix = 0; bix < 8; ++bix) {
 		unsigned const count(top_temp_bins[bix].size());
 		if (count == 0) continue; // empty bin
-		unsigned const kid(cur_nixs[bix]), alloc_sz(get_conservative_num_nodes(count)), end_nix(cur_nixs[bix] + alloc_sz);
+		unsigned const kid(cur_nixs[bix]), alloc_sz(get_max_num_nodes(count)), end_nix(cur_nixs[bix] + alloc_sz);
 		nodes[kid] = tree_node(curs[bix], curs[bix]+count);
 		per_thread_data ptd(cur_nixs[bix]+1, end_nix, 0);
-		build_tree(kid, ((count == num) ? 7 : 0), 1, ptd); // if all in one bin, make that bin a leaf
+		build_subtree(kid, ((count == num) ? 7 : 0), 1, ptd); // if all in one bin, make that bin a leaf
 		unsigned const next_kid(ptd.get_next_node_ix());
 		assert(next_kid <= end_nix);
 		if (next_kid < end_nix) {nodes[next_kid].next_node_id = end_nix;} // close the gap of unused nodes
@@ -652,6 +784,26 @@ void cobj_bvh_tree::build_tree_top_level_omp() { // single octtree level
 }
 
 
+void cobj_bvh_tree::build_subtree(unsigned nix, unsigned skip_dims, unsigned depth, per_thread_data &ptd) {
+	if (use_sah && skip_dims != 7) {build_tree_sah(nix, depth, ptd);} else {build_tree(nix, skip_dims, depth, ptd);}
+}
+
+unsigned cobj_bvh_tree::alloc_child_node(per_thread_data &ptd, unsigned start, unsigned end) {
+
+	unsigned const kid(ptd.get_next_node_ix());
+	ptd.increment_node_ix();
+
+	if (ptd.at_node_end()) {
+		assert(ptd.can_be_resized);
+		unsigned const old_nodes_size(nodes.size());
+		nodes.resize(5*old_nodes_size/4); // increase by 25% (will invalidate node references)
+		cout << "Warning: Resizing cobj_bvh_tree nodes from " << old_nodes_size << " to " << nodes.size() << endl;
+		ptd.advance_end_range(nodes.size());
+	}
+	nodes[kid] = tree_node(start, end);
+	return kid;
+}
+
 // BVH (left, right, mid) kids
 void cobj_bvh_tree::build_tree(unsigned nix, unsigned skip_dims, unsigned depth, per_thread_data &ptd) {
 	
@@ -708,17 +860,7 @@ void cobj_bvh_tree::build_tree(unsigned nix, unsigned skip_dims, unsigned depth,
 	for (unsigned bix = 0; bix < 3; ++bix) {
 		unsigned const count(bin_count[bix]);
 		if (count == 0) continue; // empty bin
-		unsigned const kid(ptd.get_next_node_ix());
-		ptd.increment_node_ix();
-
-		if (ptd.at_node_end()) {
-			assert(ptd.can_be_resized);
-			unsigned const old_nodes_size(nodes.size());
-			nodes.resize(5*old_nodes_size/4); // increase by 25% (will invalidate n reference)
-			cout << "Warning: Resizing cobj_bvh_tree nodes from " << old_nodes_size << " to " << nodes.size() << endl;
-			ptd.advance_end_range(nodes.size());
-		}
-		nodes[kid] = tree_node(cur, cur+count);
+		unsigned const kid(alloc_child_node(ptd, cur, cur+count));
 		build_tree(kid, skip_dims, depth+1, ptd);
 		nodes[kid].next_node_id = ptd.get_next_node_ix();
 		cur += count;
@@ -728,11 +870,81 @@ void cobj_bvh_tree::build_tree(unsigned nix, unsigned skip_dims, unsigned depth,
 }
 
 
+struct sah_bin_t {
+	unsigned count;
+	cube_t bcube;
+
+	sah_bin_t() : count(0) {}
+	void add(cube_t const &c) {if (count++ == 0) {bcube = c;} else {bcube.union_with_cube(c);}}
+	void add(sah_bin_t const &b) {if (b.count == 0) return; if (count == 0) {bcube = b.bcube;} else {bcube.union_with_cube(b.bcube);} count += b.count;}
+	float get_area() const {return (count ? bcube.get_area() : 0.0);}
+};
+
+inline unsigned get_sah_bin(cube_t const &c, unsigned dim, float lo, float scale) {
+	return min(NUM_SAH_BINS-1, unsigned(max(0.0f, (c.get_cube_center()[dim] - lo)*scale)));
+}
+
+// binary BVH split with a binned surface area heuristic: slower to build than build_tree(), but faster to query
+void cobj_bvh_tree::build_tree_sah(unsigned nix, unsigned depth, per_thread_data &ptd) {
+
+	assert(nix < nodes.size());
+	tree_node &n(nodes[nix]);
+	calc_node_bbox(n);
+	unsigned const start(n.start), end(n.end), num(end - start);
+	max_depth = max(max_depth, depth);
+	if (check_for_leaf(num, 0)) return; // base case
+	cube_t cbounds; // bounds of cobj centers, which determine bins
+	cbounds.set_from_point(get_cobj(start).get_cube_center());
+	for (unsigned i = start+1; i < end; ++i) {cbounds.union_with_pt(get_cobj(i).get_cube_center());}
+	float best_cost(0.0);
+	unsigned best_dim(3), best_split(0); // best_dim=3 => no valid split
+
+	for (unsigned dim = 0; dim < 3; ++dim) {
+		float const extent(cbounds.get_sz_dim(dim));
+		if (extent <= 0.0) continue; // all centers are the same in this dim
+		float const lo(cbounds.d[dim][0]), scale(NUM_SAH_BINS/extent);
+		sah_bin_t bins[NUM_SAH_BINS], acc;
+		float right_area[NUM_SAH_BINS] = {0};
+		unsigned right_count[NUM_SAH_BINS] = {0};
+		for (unsigned i = start; i < end; ++i) {bins[get_sah_bin(get_cobj(i), dim, lo, scale)].add(get_cobj(i));}
+
+		for (unsigned b = NUM_SAH_BINS-1; b > 0; --b) { // sweep from the right; split b puts bins [b, NUM_SAH_BINS) on the right
+			acc.add(bins[b]);
+			right_area [b] = acc.get_area();
+			right_count[b] = acc.count;
+		}
+		acc = sah_bin_t();
+
+		for (unsigned b = 1; b < NUM_SAH_BINS; ++b) { // sweep from the left
+			acc.add(bins[b-1]);
+			if (acc.count == 0 || right_count[b] == 0) continue; // not a split
+			float const cost(acc.count*acc.get_area() + right_count[b]*right_area[b]);
+			if (best_dim == 3 || cost < best_cost) {best_cost = cost; best_dim = dim; best_split = b;}
+		}
+	} // for dim
+	if (best_dim == 3) {register_leaf(num); return;} // can't split
+	float const node_area(n.get_area());
+	if (num <= MAX_SAH_LEAF_SIZE && num*node_area <= SAH_TRAV_COST*node_area + best_cost) {register_leaf(num); return;} // leaf is cheaper
+	float const lo(cbounds.d[best_dim][0]), scale(NUM_SAH_BINS/cbounds.get_sz_dim(best_dim));
+	auto const mid(std::partition((cixs.begin() + start), (cixs.begin() + end),
+		[&](unsigned cix) {return (get_sah_bin((*cobjs)[cix], best_dim, lo, scale) < best_split);}));
+	unsigned const bounds[3] = {start, unsigned(mid - cixs.begin()), end};
+	assert(bounds[1] > start && bounds[1] < end);
+
+	for (unsigned k = 0; k < 2; ++k) { // create child nodes and call recursively; Note: may invalidate n
+		unsigned const kid(alloc_child_node(ptd, bounds[k], bounds[k+1]));
+		build_tree_sah(kid, depth+1, ptd);
+		nodes[kid].next_node_id = ptd.get_next_node_ix();
+	}
+	nodes[nix].start = nodes[nix].end = 0; // branch node has no leaves
+}
+
+
 // is_static is_dynamic occluders_only cubes_only inc_voxel_cobjs
-cobj_bvh_tree cobj_tree_static (&coll_objects, 1, 0, 0, 0, 0); // does not include voxels
-cobj_bvh_tree cobj_tree_dynamic(&coll_objects, 0, 1, 0, 0, 0);
-cobj_bvh_tree cobj_tree_occlude(&coll_objects, 1, 0, 1, 0, 0);
-cobj_bvh_tree cobj_tree_static_moving(&coll_objects, 1, 0, 0, 0, 0);
+cobj_bvh_tree cobj_tree_static (&coll_objects, 1, 0, 0, 0, 0, "Static Cobj BVH"); // does not include voxels
+cobj_bvh_tree cobj_tree_dynamic(&coll_objects, 0, 1, 0, 0, 0, "Dynamic Cobj BVH");
+cobj_bvh_tree cobj_tree_occlude(&coll_objects, 1, 0, 1, 0, 0, "Occluder Cobj BVH");
+cobj_bvh_tree cobj_tree_static_moving(&coll_objects, 1, 0, 0, 0, 0, "Static Moving Cobj BVH");
 //cobj_tree_tquads_t cobj_tree_triangles;
 
 
@@ -742,7 +954,6 @@ cobj_bvh_tree &get_tree(bool dynamic) {
 
 void build_static_moving_cobj_tree() {
 
-	cobj_tree_static_moving.clear();
 	vector<unsigned> moving_cids(falling_cobjs);
 		
 	for (auto i = moving_cobjs.begin(); i != moving_cobjs.end(); ++i) {
@@ -751,6 +962,9 @@ void build_static_moving_cobj_tree() {
 	for (platform_cont::const_iterator i = platforms.begin(); i != platforms.end(); ++i) {
 		copy(i->cobjs.begin(), i->cobjs.end(), back_inserter(moving_cids));
 	}
+	if (cobj_tree_static_moving.try_refit(moving_cids)) return; // same cobjs as last frame, only their positions have changed
+	cobj_tree_static_moving.clear();
+
 	if (!moving_cids.empty()) {
 		cobj_tree_static_moving.add_cobj_ids(moving_cids);
 		cobj_tree_static_moving.build_tree_from_cixs(0);
@@ -766,7 +980,7 @@ void build_cobj_tree(bool dynamic, bool verbose) {
 		//cobj_tree_triangles.add_cobjs(coll_objects, verbose);
 	}
 	else { // dynamic
-		if (begin_motion) {get_tree(1).add_cobjs(verbose);}
+		if (begin_motion) {get_tree(1).add_cobjs(verbose, 1);} // allow_refit=1
 		//build_static_moving_cobj_tree();
 	}
 }
@@ -783,6 +997,22 @@ bool check_coll_line_exact_tree(point const &p1, point const &p2, point &cpos, v
 	return ret;
 }
 
+// packet version of check_coll_line_exact_tree() for static cobjs, used with coherent ray trace lighting rays
+void check_coll_line_exact_tree_packet(coll_line_packet_t &packet, int ignore_cobj, bool include_voxels, bool skip_movable, bool no_stat_moving) {
+
+	for (unsigned r = 0; r < packet.num; ++r) {packet.cindex[r] = -1; packet.cpos[r] = packet.p2[r];}
+	get_tree(0).check_coll_line_packet(packet, ignore_cobj, 0, 0, skip_movable);
+	if (no_stat_moving && !include_voxels) return; // no per-line tests
+	
+	for (unsigned r = 0; r < packet.num; ++r) { // these are generally small/empty, so test lines individually
+		point const &p1(packet.p1[r]);
+		point &cpos(packet.cpos[r]); // starts as p2 if there was no hit
+		int &cindex(packet.cindex[r]);
+		if (!no_stat_moving) {cobj_tree_static_moving.check_coll_line(p1, point(cpos), cpos, packet.cnorm[r], cindex, ignore_cobj, 1, 0, 0, packet.skip_init_colls[r], skip_movable);}
+		if (include_voxels)  {check_voxel_coll_line(p1, point(cpos), cpos, packet.cnorm[r], cindex, ignore_cobj, 1);}
+	}
+}
+
 // can use with snow shadows, grass shadows, tree leaf shadows
 bool check_coll_line_tree(point const &p1, point const &p2, int &cindex, int ignore_cobj, bool dynamic,
 	int test_alpha, bool skip_non_drawn, bool include_voxels, bool skip_init_colls, bool skip_movable)
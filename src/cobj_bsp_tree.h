@@ -104,11 +104,35 @@ public:
 };
 
 
+unsigned const MAX_LINE_PACKET_SIZE = 16;
+
+struct coll_line_packet_t { // batch of coherent line segments for cobj_bvh_tree::check_coll_line_packet()
+	unsigned num;
+	point p1[MAX_LINE_PACKET_SIZE], p2[MAX_LINE_PACKET_SIZE]; // inputs
+	bool skip_init_colls[MAX_LINE_PACKET_SIZE]; // input
+	point cpos[MAX_LINE_PACKET_SIZE]; // output
+	vector3d cnorm[MAX_LINE_PACKET_SIZE]; // output
+	int cindex[MAX_LINE_PACKET_SIZE]; // output, -1 if no hit
+
+	coll_line_packet_t() : num(0) {}
+	bool empty() const {return (num == 0);}
+	void clear() {num = 0;}
+
+	unsigned add(point const &p1_, point const &p2_, bool skip_init_colls_) {
+		assert(num < MAX_LINE_PACKET_SIZE);
+		p1[num] = p1_; p2[num] = cpos[num] = p2_; skip_init_colls[num] = skip_init_colls_; cindex[num] = -1;
+		return num++;
+	}
+};
+
+
 class cobj_bvh_tree : public cobj_tree_base {
 
 	coll_obj_group const *cobjs;
-	vector<unsigned> cixs;
-	bool is_static, is_dynamic, occluders_only, cubes_only, inc_voxel_cobjs;
+	char const *name; // for timing/stats
+	vector<unsigned> cixs, input_cids; // input_cids is the unpermuted set of cobjs, only filled in for refittable trees
+	bool is_static, is_dynamic, occluders_only, cubes_only, inc_voxel_cobjs, use_sah, is_mt_built;
+	float build_cost; // SAH cost at build time, for detecting refit quality degradation
 
 	struct per_thread_data {
 		vector<unsigned> temp_bins[3];
@@ -122,12 +146,18 @@ class cobj_bvh_tree : public cobj_tree_base {
 		void increment_node_ix() {assert(cur_nix >= start_nix); cur_nix++;}
 	};
 
-	void add_cobj(unsigned ix) {if (obj_ok((*cobjs)[ix])) {cixs.push_back(ix);}}
+	void add_cobj(vector<unsigned> &ids, unsigned ix) const {if (obj_ok((*cobjs)[ix])) {ids.push_back(ix);}}
 	coll_obj const &get_cobj(unsigned ix) const {return (*cobjs)[cixs[ix]];}
-	bool create_cixs();
+	bool create_cixs(vector<unsigned> &ids) const;
 	void calc_node_bbox(tree_node &n) const;
 	void build_tree_top_level_omp();
+	void build_subtree(unsigned nix, unsigned skip_dims, unsigned depth, per_thread_data &ptd);
 	void build_tree(unsigned nix, unsigned skip_dims, unsigned depth, per_thread_data &ptd);
+	void build_tree_sah(unsigned nix, unsigned depth, per_thread_data &ptd);
+	unsigned alloc_child_node(per_thread_data &ptd, unsigned start, unsigned end);
+	float calc_sah_cost() const;
+	unsigned get_max_num_nodes(unsigned num) const {return (use_sah ? 2*num : get_conservative_num_nodes(num));} // SAH tree is binary with >= 1 cobj per leaf
+	void refit();
 
 	bool obj_ok(coll_obj const &c) const {
 		return (((is_static && c.status == COLL_STATIC) || (is_dynamic && c.status == COLL_DYNAMIC) || (!is_static && !is_dynamic)) &&
@@ -136,16 +166,18 @@ class cobj_bvh_tree : public cobj_tree_base {
 	}
 
 public:
-	cobj_bvh_tree(coll_obj_group const *cobjs_, bool s, bool d, bool o, bool c, bool v)
-		: cobjs(cobjs_), is_static(s), is_dynamic(d), occluders_only(o), cubes_only(c), inc_voxel_cobjs(v) {assert(cobjs);}
+	cobj_bvh_tree(coll_obj_group const *cobjs_, bool s, bool d, bool o, bool c, bool v, char const *const name_="Cobj BVH")
+		: cobjs(cobjs_), name(name_), is_static(s), is_dynamic(d), occluders_only(o), cubes_only(c), inc_voxel_cobjs(v), use_sah(0), is_mt_built(0), build_cost(0.0) {assert(cobjs);}
 
 	unsigned get_num_objs() const {return cixs.size();}
 	void clear();
-	void add_cobj_ids(vector<unsigned> const &cids) {assert(cixs.empty() && !cids.empty()); cixs = cids;}
-	void add_cobjs(bool verbose);
+	void add_cobj_ids(vector<unsigned> const &cids) {assert(cixs.empty() && !cids.empty()); cixs = input_cids = cids;}
+	void add_cobjs(bool verbose, bool allow_refit=0);
 	void build_tree_from_cixs(bool do_mt_build);
+	bool try_refit(vector<unsigned> const &cids);
 	bool check_coll_line(point const &p1, point const &p2, point &cpos, vector3d &cnorm, int &cindex, int ignore_cobj,
 		bool exact, int test_alpha, bool skip_non_drawn, bool skip_init_colls, bool skip_movable) const;
+	unsigned check_coll_line_packet(coll_line_packet_t &packet, int ignore_cobj, int test_alpha, bool skip_non_drawn, bool skip_movable) const;
 	bool check_point_contained(point const &p, int &cindex) const;
 	void get_intersecting_cobjs(cube_t const &cube, vector<unsigned> &cobjs, int ignore_cobj, float toler, bool check_ccounter, int id_for_cobj_int) const;
 	bool is_cobj_contained(point const &viewer, point const *const pts, unsigned npts, int ignore_cobj, int &cobj) const;
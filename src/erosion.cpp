@@ -4,37 +4,55 @@
 
 #include "3DWorld.h"
 #include "mesh.h"
+#include "profiler.h"
 #include <cfloat> // for FLT_EPSILON
 
+unsigned const EROSION_ROUNDS = 8; // tiled mode: droplets are split into this many rounds, each of which processes all tiles
 
+extern unsigned erosion_tile_size;
 extern float erode_amount, water_plane_z;
 
 
 // see http://ranmantaru.com/blog/2011/10/08/water-erosion-on-heightmap-terrain/
-void apply_erosion(float *heightmap, int xsize, int ysize, float min_zval, unsigned num_iters) {
-
-	if (num_iters == 0 || erode_amount <= 0.0) return; // erosion disabled
-	RESET_TIME;
-	// Kq and minSlope are for soil carry capacity.
-	// Kw is water evaporation speed.
-	// Kr is erosion speed (how fast the soil is removed).
-	// Kd is deposition speed (how fast the extra sediment is dropped).
-	// Ki is direction inertia. Higher values make channel turns smoother.
-	// g is gravity that accelerates the flows.
-	float const Kq=10, Kw=0.001f, Kr=0.9f, Kd=0.02f, Ki=0.1f, minSlope=0.05f, g=20, Kg=g*2;
-	int const PAD(4), NX(xsize+2*PAD), NY(ysize+2*PAD);
-	unsigned const MAX_PATH_LEN(4*NX*NY);
-	vector<vector2d> erosion(NX*NY, vector2d(0.0, 0.0));
-	vector<float> mh_padded(NX*NY);
-
-	// pad mesh by 1 unit on each side to create a buffer of trash around the edges that can be discarded
-	for (int y = 0; y < NY; ++y) {
-		int const offset(max(min(y-PAD, ysize-1), 0)*xsize);
-
-		for (int x = 0; x < NX; ++x) {
-			mh_padded[y*NX + x] = heightmap[max(min(x-PAD, xsize-1), 0) + offset];
+class erosion_sim_t {
+	static int const PAD = 4;
+	int xsize, ysize, NX, NY;
+	vector<vector2d> erosion;
+	vector<float> mh_padded;
+
+public:
+	erosion_sim_t(float const *heightmap, int xsize_, int ysize_) : xsize(xsize_), ysize(ysize_), NX(xsize+2*PAD), NY(ysize+2*PAD) {
+		erosion.resize(NX*NY, vector2d(0.0, 0.0));
+		mh_padded.resize(NX*NY);
+
+		// pad mesh by 1 unit on each side to create a buffer of trash around the edges that can be discarded
+		for (int y = 0; y < NY; ++y) {
+			int const offset(max(min(y-PAD, ysize-1), 0)*xsize);
+
+			for (int x = 0; x < NX; ++x) {
+				mh_padded[y*NX + x] = heightmap[max(min(x-PAD, xsize-1), 0) + offset];
+			}
 		}
 	}
+	int get_nx() const {return NX;}
+	int get_ny() const {return NY;}
+
+	void get_start_pos(unsigned iter, rand_gen_t &rgen, int &xi, int &zi) const {
+		rgen.set_state(iter+11, 79*iter+121);
+		xi = PAD + (rgen.rand()%xsize);
+		zi = PAD + (rgen.rand()%ysize);
+	}
+	// droplets stop and deposit their sediment when they leave the padded mesh or the {bx1,by1}-{bx2,by2} bounds (exclusive);
+	// all heightmap reads and writes are within these bounds, so droplets with non-overlapping bounds can run concurrently
+	void run_droplet(unsigned iter, int bx1, int by1, int bx2, int by2) {
+		// Kq and minSlope are for soil carry capacity.
+		// Kw is water evaporation speed.
+		// Kr is erosion speed (how fast the soil is removed).
+		// Kd is deposition speed (how fast the extra sediment is dropped).
+		// Ki is direction inertia. Higher values make channel turns smoother.
+		// g is gravity that accelerates the flows.
+		float const Kq=10, Kw=0.001f, Kr=0.9f, Kd=0.02f, Ki=0.1f, minSlope=0.05f, g=20, Kg=g*2;
+		unsigned const MAX_PATH_LEN(4*NX*NY);
 
 #define HMAP_INDEX(x, y) (NX*max(min(y, NY-1), 0) + max(min(x, NX-1), 0))
 #define HMAP(x, y) mh_padded[HMAP_INDEX(x, y)]
@@ -62,13 +80,9 @@ void apply_erosion(float *heightmap, int xsize, int ysize, float min_zval, unsig
 	if (delta<=d) {d-=delta;} else {r+=delta-d; d=0;} \
 	e.x=r; e.y=d; \
 }
-
-#pragma omp parallel for schedule(dynamic,1)
-	for (int iter=0; iter < (int)num_iters; ++iter) {
 		rand_gen_t rgen;
-		rgen.set_state(iter+11, 79*iter+121);
-		int xi = PAD + (rgen.rand()%xsize);
-		int zi = PAD + (rgen.rand()%ysize);
+		int xi(0), zi(0);
+		get_start_pos(iter, rgen, xi, zi);
 		float xp=xi, zp=zi, xf=0, zf=0, s=0, v=0, w=1, dx=0, dz=0;
 		float h=HMAP(xi, zi), h00=h, h10=HMAP(xi+1, zi), h01=HMAP(xi, zi+1), h11=HMAP(xi+1, zi+1);
 
@@ -98,7 +112,8 @@ void apply_erosion(float *heightmap, int xsize, int ysize, float min_zval, unsig
 			if (max(max(nh00, nh10), max(nh01, nh11)) < water_plane_z - HALF_DXY) break; // reached ocean water, stop and ignore sediment
 
 			// if higher than current, try to deposit sediment up to neighbour height
-			bool const outside(xi < 0 || zi < 0 || xi >= NX || zi >= NY);
+			// Note: erosion at the next pos touches [nxi-1, nxi+2], so stop before that reaches the bounds
+			bool const outside(xi < 0 || zi < 0 || xi >= NX || zi >= NY || nxi <= bx1 || nzi <= by1 || nxi+2 >= bx2 || nzi+2 >= by2);
 			if (nh>=h || outside) {
 				float ds=(nh-h)+0.001f;
 
@@ -152,14 +167,82 @@ void apply_erosion(float *heightmap, int xsize, int ysize, float min_zval, unsig
 			h=nh; h00=nh00; h10=nh10; h01=nh01; h11=nh11;
 		} // for numMoves
 		if (numMoves>=MAX_PATH_LEN) {cout << "droplet path is too long: " << iter << endl;}
-	} // for iter
-
-	// remove padding and clamp to min_zval
-	for (int y = 0; y < ysize; ++y) {
-		for (int x = 0; x < xsize; ++x) {
-			heightmap[y*xsize + x] = max(min_zval, mh_padded[(y+PAD)*NX + x+PAD]);
+#undef HMAP_INDEX
+#undef HMAP
+#undef DEPOSIT_AT
+#undef DEPOSIT
+#undef ERODE
+	}
+	void write_back(float *heightmap, float min_zval) const {
+		// remove padding and clamp to min_zval
+		for (int y = 0; y < ysize; ++y) {
+			for (int x = 0; x < xsize; ++x) {
+				heightmap[y*xsize + x] = max(min_zval, mh_padded[(y+PAD)*NX + x+PAD]);
+			}
 		}
 	}
+};
+
+
+// Droplets are binned by the tile containing their start pos and constrained to that tile plus a halo of half a tile on each side.
+// Tiles are processed in four phases of a 2x2 checkerboard so that concurrently processed tiles + halos never overlap.
+// Droplets within a tile run in iteration order, so the results only depend on the heightmap, iteration count, and tile size - not on thread count.
+// Returns the summed per-tile run time, for computing parallel scaling.
+double apply_erosion_tiled(erosion_sim_t &sim, unsigned num_iters, int tile_sz) {
+
+	int const halo(tile_sz/2), ntx((sim.get_nx() + tile_sz - 1)/tile_sz), nty((sim.get_ny() + tile_sz - 1)/tile_sz), num_tiles(ntx*nty);
+	vector<vector<unsigned>> tile_iters(EROSION_ROUNDS*num_tiles); // {round, tile} => droplet iterations
+	vector<double> tile_time(num_tiles, 0.0);
+	rand_gen_t rgen;
+
+	for (unsigned iter = 0; iter < num_iters; ++iter) {
+		int xi(0), zi(0);
+		sim.get_start_pos(iter, rgen, xi, zi);
+		unsigned const round((uint64_t(iter)*EROSION_ROUNDS)/num_iters);
+		tile_iters[round*num_tiles + (zi/tile_sz)*ntx + (xi/tile_sz)].push_back(iter);
+	}
+	for (unsigned round = 0; round < EROSION_ROUNDS; ++round) {
+		for (unsigned phase = 0; phase < 4; ++phase) {
+			int const px(phase&1), py(phase>>1), nphase_x((ntx - px + 1)/2), nphase_y((nty - py + 1)/2);
+
+#pragma omp parallel for schedule(dynamic,1)
+			for (int i = 0; i < nphase_x*nphase_y; ++i) {
+				int const tx(2*(i%nphase_x) + px), ty(2*(i/nphase_x) + py), tile_ix(ty*ntx + tx);
+				vector<unsigned> const &iters(tile_iters[round*num_tiles + tile_ix]);
+				if (iters.empty()) continue;
+				int const bx1(tx*tile_sz - halo), by1(ty*tile_sz - halo), bx2((tx+1)*tile_sz + halo), by2((ty+1)*tile_sz + halo);
+				high_resolution_clock::time_point const start_time(high_resolution_clock::now());
+				for (unsigned iter : iters) {sim.run_droplet(iter, bx1, by1, bx2, by2);}
+				tile_time[tile_ix] += duration_cast<duration<double>>(high_resolution_clock::now() - start_time).count(); // in seconds
+			} // for i
+		} // for phase
+	} // for round
+	double tot_time(0.0);
+	for (double t : tile_time) {tot_time += t;}
+	return tot_time;
+}
+
+void apply_erosion(float *heightmap, int xsize, int ysize, float min_zval, unsigned num_iters) {
+
+	if (num_iters == 0 || erode_amount <= 0.0) return; // erosion disabled
+	RESET_TIME;
+	erosion_sim_t sim(heightmap, xsize, ysize);
+	int const tile_sz(max(erosion_tile_size, 16U)); // must be large enough for the halo to contain the erosion kernel
+
+	if (erosion_tile_size > 0 && xsize >= 4*tile_sz && ysize >= 4*tile_sz) { // large enough for at least 4 tiles per phase
+		high_resolution_clock::time_point const start_time(high_resolution_clock::now());
+		double const tile_time(apply_erosion_tiled(sim, num_iters, tile_sz));
+		double const wall_time(duration_cast<duration<double>>(high_resolution_clock::now() - start_time).count());
+		cout << "Tiled erosion: " << num_iters << " iters in " << 1000.0*wall_time << " ms (" << unsigned(num_iters/max(wall_time, 1.0E-6)) << " iters/s) with "
+			 << omp_get_max_threads_3dw() << " threads, parallel speedup: " << tile_time/max(wall_time, 1.0E-6) << "x" << endl;
+	}
+	else { // small mesh; droplets may write to the same location concurrently, so results are nondeterministic
+		int const big_val(1 << 30); // no droplet bounds
+
+#pragma omp parallel for schedule(dynamic,1)
+		for (int iter=0; iter < (int)num_iters; ++iter) {sim.run_droplet(iter, -big_val, -big_val, big_val, big_val);}
+	}
+	sim.write_back(heightmap, min_zval);
 	PRINT_TIME("Erosion");
 }
 
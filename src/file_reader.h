@@ -18,11 +18,12 @@ protected:
 	bool verbose;
 	char buffer[MAX_CHARS] = {0};
 	char *file_buf; // size FILE_BUF_SZ, allocated on the heap to avoid a large stack size
-	unsigned file_buf_pos, file_buf_end;
+	size_t file_buf_pos, file_buf_end;
+	bool reading_from_mem=0; // file_buf points to an externally owned in-memory copy of the file
 
 	bool open_file(bool binary=0);
 	void close_file();
-	char get_next_char() {assert(fp); return get_char(fp);}
+	char get_next_char() {assert(fp || reading_from_mem); return get_char(fp);}
 	static bool fast_isspace(char c) {return (c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r');}
 	static bool fast_isdigit(char c) {return (c >= '0' && c <= '9');}
 
@@ -35,6 +36,7 @@ protected:
 	char get_char(FILE *fp_) {
 		//if (FILE_BUF_SZ == 0) {return _getc_nolock(fp_);}
 		if (file_buf_pos == file_buf_end) { // fill file buffer
+			if (reading_from_mem) return EOF; // end of in-memory data
 			file_buf_pos = 0;
 			file_buf_end = fread(file_buf, 1, FILE_BUF_SZ, fp);
 			if (file_buf_end == 0) return EOF; // end of file
@@ -78,12 +80,20 @@ protected:
 		strip_trailing_ws(str);
 		return;
 	}
+	void read_from_memory(char *data, size_t start_pos, size_t data_len) { // read from data[start_pos, data_len) rather than the file
+		assert(!fp && !reading_from_mem && start_pos <= data_len);
+		delete [] file_buf;
+		file_buf     = data;
+		file_buf_pos = start_pos;
+		file_buf_end = data_len;
+		reading_from_mem = 1;
+	}
 	bool read_int(int &v);
 	bool read_uint(unsigned &v);
 	bool read_string(char *s, unsigned max_len);
 
 public:
 	base_file_reader(std::string const &fn) : filename(fn), fp(NULL), verbose(0), file_buf(new char [FILE_BUF_SZ]), file_buf_pos(0), file_buf_end(0) {assert(!fn.empty());}
-	~base_file_reader() {close_file(); delete [] file_buf;}
+	~base_file_reader() {close_file(); if (!reading_from_mem) {delete [] file_buf;}}
 };
 
@@ -38,7 +38,7 @@ vector3d const upv0(0.0, 1.0, 0.0);
 
 
 extern bool univ_stencil_shadows, begin_motion;
-extern int iticks, display_mode;
+extern int iticks, display_mode, frame_counter;
 extern float fticks;
 extern point player_death_pos;
 extern pos_dir_up player_pdu;
@@ -973,7 +973,7 @@ void uparticle_cloud::draw_obj(uobj_draw_data &ddata) const { // Note: assumes G
 // ************ US_PROJECTILE ************
 
 
-us_projectile::us_projectile(unsigned type) : tup_time(0), alloc_block(NULL) {
+us_projectile::us_projectile(unsigned type) : tup_time(0), seek_plan_frame(-1), seek_plan_dist(0.0), seek_plan_targ(NULL), alloc_block(NULL) {
 
 	flags = (OBJ_FLAGS_TARG | OBJ_FLAGS_PROJ);
 	set_type(type);
@@ -1017,6 +1017,31 @@ inline unsigned us_projectile::get_eflags() const {
 }
 
 
+// runs the seeking target query in parallel across projectiles before any ai_action() calls; must not modify other objects
+void us_projectile::plan_ai_action() {
+
+	seek_plan_frame = -1;
+	if (!is_ok() || !specs().seeking || time < PROJ_ARM_T || !begin_motion) return;
+	float const max_dist(specs().seek_dist), target_dist((target_obj == NULL) ? 0.0 : p2p_dist(pos, target_obj->get_pos()));
+	free_obj const *const ptarg((parent == NULL || !target_valid(parent->get_target())) ? NULL : parent->get_target());
+	if (ptarg != NULL && (target_obj == NULL || target_obj == ptarg || ptarg->is_decoy()) && dist_less_than(pos, ptarg->get_pos(), max_dist)) return; // using parent's target
+	free_obj const *const targ((target_obj != NULL && target_dist > 2.0*max_dist) ? NULL : target_obj);
+	if (targ != NULL && (targ->is_decoy() || time <= (tup_time + SEEK_CTIME)) && target_dist <= max_dist) return; // keeping current target
+	seek_plan_dist  = ((targ == NULL) ? max_dist : min(max_dist, 0.7f*target_dist));
+	seek_plan_targ  = get_closest_ship(pos, 0.0, seek_plan_dist, 1, 0, 0, 1);
+	seek_plan_frame = frame_counter;
+}
+
+
+free_obj const *us_projectile::get_seek_target(float seek_dist) const {
+
+	if (seek_plan_frame == frame_counter && seek_plan_dist == seek_dist && (seek_plan_targ == NULL || !seek_plan_targ->invalid())) {
+		return seek_plan_targ; // computed this frame by plan_ai_action()
+	}
+	return get_closest_ship(pos, 0.0, seek_dist, 1, 0, 0, 1);
+}
+
+
 void us_projectile::ai_action() {
 
 	if (!is_ok() || !specs().seeking || time < PROJ_ARM_T || !begin_motion) return;
@@ -1037,7 +1062,7 @@ void us_projectile::ai_action() {
 			float seek_dist(max_dist);
 			if (target_obj != NULL) {seek_dist = min(seek_dist, 0.7f*target_dist);} // hysteresis to keep current target
 			tup_time   = time;
-			target_obj = get_closest_ship(pos, 0.0, seek_dist, 1, 0, 0, 1);
+			target_obj = get_seek_target(seek_dist);
 			if (target_obj != NULL) {missile_lock = 1;}
 			bool const decoy(target_obj != NULL && target_obj->is_decoy()); // Note: Decoy will only work if fighting enemy teams
 
@@ -7,6 +7,7 @@
 
 struct xform_matrix;
 class tree_cont_t;
+struct coll_line_packet_t;
 
 // glGetError wrappers
 bool get_gl_error(unsigned loc_id=0, const char* stmt=nullptr, const char* fname=nullptr);
@@ -19,6 +20,10 @@ bool check_gl_error(unsigned loc_id);
 #endif
 
 int omp_get_thread_num_3dw();
+int omp_get_max_threads_3dw();
+void omp_enable_nested_3dw();
+void omp_set_num_threads_3dw(int num);
+bool on_main_thread_3dw();
 
 // function prototypes - main (3DWorld.cpp, etc.)
 void enable_blend();
@@ -337,6 +342,7 @@ float do_glaciate_exp(float value);
 float get_rel_wpz();
 void init_terrain_mesh();
 float eval_mesh_sin_terms(float xv, float yv);
+void get_mesh_gen_state(vector<uint8_t> &state);
 float get_exact_zval(float xval, float yval);
 void reset_offsets();
 float get_median_height(float distribution_pos);
@@ -460,6 +466,7 @@ void build_static_moving_cobj_tree();
 void build_cobj_tree(bool dynamic=0, bool verbose=1);
 bool check_coll_line_exact_tree(point const &p1, point const &p2, point &cpos, vector3d &cnorm, int &cindex, int ignore_cobj,
 	bool dynamic=0, int test_alpha=0, bool skip_non_drawn=0, bool include_voxels=1, bool skip_init_colls=0, bool skip_movable=0, bool no_stat_moving=0);
+void check_coll_line_exact_tree_packet(coll_line_packet_t &packet, int ignore_cobj, bool include_voxels=1, bool skip_movable=0, bool no_stat_moving=0);
 bool check_coll_line_tree(point const &p1, point const &p2, int &cindex, int ignore_cobj, bool dynamic=0, int test_alpha=0,
 	bool skip_non_drawn=0, bool include_voxels=1, bool skip_init_colls=0, bool skip_movable=0);
 bool cobj_contained_tree(point const &viewer, point const *const pts, unsigned npts, int ignore_cobj, int &cobj);
@@ -12,12 +12,21 @@
 #include "tree_3dw.h" // for tree_placer_t
 #include "profiler.h"
 #include "lightmap.h" // for light_source
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cfloat> // for FLT_MAX
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#endif
 
 using std::string;
 
 bool const ADD_ROOM_SHADOWS        = 1; // for room lights
 bool const DRAW_EXT_REFLECTIONS    = 1; // draw building exteriors in mirror reflections; slower, but looks better; not shadowed
 bool const DRAW_WALKWAY_INTERIORS  = 1;
+bool const USE_OCCLUSION_ZBUFFER   = 1; // rasterize nearby building occluders into a CPU depth buffer once per frame
+bool const PRINT_OCCLUSION_STATS   = 0; // print per-frame occlusion query and cull counts
 float const WIND_LIGHT_ON_RAND     = 0.08;
 unsigned const NO_SHADOW_WHITE_TEX = BLACK_TEX; // alias to differentiate shadowed    vs. unshadowed untextured objects
 unsigned const SHADOW_ONLY_TEX     = RED_TEX;   // alias to differentiate shadow only vs. other      untextured objects
@@ -37,7 +46,7 @@ building_t const *player_building(nullptr);
 extern bool start_in_inf_terrain, draw_building_interiors, flashlight_on, enable_use_temp_vbo, toggle_room_light;
 extern bool teleport_to_screenshot, enable_dlight_bcubes, can_do_building_action, mirror_in_ext_basement;
 extern unsigned room_mirror_ref_tid;
-extern int rand_gen_index, display_mode, window_width, window_height, camera_surf_collide, animate2, building_action_key, player_in_elevator;
+extern int rand_gen_index, display_mode, window_width, window_height, camera_surf_collide, animate2, building_action_key, player_in_elevator, frame_counter;
 extern float CAMERA_RADIUS, fticks, NEAR_CLIP, FAR_CLIP;
 extern colorRGB cur_ambient, cur_diffuse;
 extern point pre_smap_player_pos, actual_player_pos;
@@ -59,6 +68,7 @@ void try_join_house_ext_basements(vect_building_t &buildings);
 void add_sign_text_verts_both_sides(string const &text, cube_t const &sign, bool dim, bool dir, vect_vnctcc_t &verts);
 void draw_candle_flames();
 void update_security_camera_image();
+void release_room_geom_alloc_pool();
 void get_pedestrians_in_area(cube_t const &area, int building_ix, vector<point> &pts);
 
 float get_door_open_dist   () {return 3.5*CAMERA_RADIUS;}
@@ -163,6 +173,7 @@ class building_texture_mgr_t {
 		solarp_tex=-1, concrete_tex=-1, met_plate_tex=-1, mplate_nm_tex=-1, met_roof_tex=-1, tile_floor_tex=-1, tile_floor_nm_tex=-1, duct_tid=-1, vent_tid=-1;
 
 	int ensure_tid(int &tid, const char *name, bool is_normal_map=0) {
+		if (tid < 0) {assert(on_main_thread_3dw());} // background room geom gen can only use textures preloaded in setup_bg_room_geom_gen()
 		if (tid < 0) {tid = get_texture_by_name(name, is_normal_map);}
 		if (tid < 0) {tid = (is_normal_map ? FLAT_NMAP_TEX : WHITE_TEX);} // failed to load texture - use a simple white texture/flat normal map
 		return tid;
@@ -2531,6 +2542,95 @@ void building_t::write_basement_entrance_depth_pass(shader_t &s) const {
 }
 
 
+// generates room objects for buildings the player is moving toward on a background thread so that gen_room_details() doesn't stall the draw loop;
+// the main thread must not access the rooms or room geom of a building while is_room_geom_gen_pending() returns true for it
+class room_geom_gen_queue_t {
+	struct job_t {
+		building_t *building=nullptr;
+		void const *owner=nullptr; // building_creator_t; used to cancel jobs before its buildings are deleted
+		unsigned building_ix=0;
+	};
+	unsigned const MAX_PENDING = 4;
+	std::deque<job_t> pending, done; // shared with the worker thread
+	job_t cur; // job the worker thread is running
+	set<building_t const *> busy; // main thread only; includes pending, running, and finished jobs that haven't been collected yet
+	std::mutex mtx;
+	std::condition_variable cv;
+	std::thread worker;
+	bool stop_req=0;
+
+	void run() {
+		while (1) {
+			job_t job;
+			{
+				std::unique_lock<std::mutex> lock(mtx);
+				cv.wait(lock, [this]{return (stop_req || !pending.empty());});
+				if (stop_req) return;
+				job = cur = pending.front();
+				pending.pop_front();
+			}
+			job.building->gen_room_geom(job.building_ix);
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				cur = job_t();
+				done.push_back(job);
+			}
+			cv.notify_all(); // wake up cancel() if it's waiting on this job
+		} // while
+	}
+public:
+	~room_geom_gen_queue_t() {stop();}
+
+	void stop() {
+		if (!worker.joinable()) return;
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			stop_req = 1;
+		}
+		cv.notify_all();
+		worker.join();
+	}
+	bool can_add() const {return (busy.size() < MAX_PENDING);}
+	bool is_pending(building_t const &b) const {return (!busy.empty() && busy.find(&b) != busy.end());}
+
+	void add(building_t &b, void const *owner, unsigned building_ix) {
+		if (!can_add() || is_pending(b)) return;
+		busy.insert(&b);
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			job_t job;
+			job.building    = &b;
+			job.owner       = owner;
+			job.building_ix = building_ix;
+			pending.push_back(job);
+		}
+		if (!worker.joinable()) {worker = std::thread(&room_geom_gen_queue_t::run, this);}
+		cv.notify_all();
+	}
+	void collect_finished() { // called on the main thread once per frame
+		if (busy.empty()) return;
+		std::lock_guard<std::mutex> lock(mtx);
+		for (job_t const &j : done) {busy.erase(j.building);}
+		done.clear();
+	}
+	void cancel(void const *owner) { // blocks until the worker thread is no longer using any of owner's buildings
+		if (busy.empty()) return;
+		std::unique_lock<std::mutex> lock(mtx);
+		cv.wait(lock, [this, owner]{return (cur.owner != owner);});
+
+		for (std::deque<job_t> *q : {&pending, &done}) {
+			for (auto j = q->begin(); j != q->end();) {
+				if (j->owner == owner) {busy.erase(j->building); j = q->erase(j);} else {++j;}
+			}
+		}
+	}
+};
+
+room_geom_gen_queue_t room_geom_gen_queue;
+
+bool is_room_geom_gen_pending(building_t const &b) {return room_geom_gen_queue.is_pending(b);}
+
+
 class building_creator_t {
 
 	bool use_smap_this_frame=0, has_interior_geom=0, is_city=0, vbos_created=0;
@@ -2545,6 +2645,7 @@ class building_creator_t {
 	building_draw_t building_draw, building_draw_vbo, building_draw_windows, building_draw_wind_lights, building_draw_interior, building_draw_int_ext_walls;
 	point_sprite_drawer_sized building_lights;
 	vector<point> points; // reused temporary
+	mutable occlusion_zbuffer_t occ_zbuf; // updated in get_occluders()
 
 	struct grid_elem_t {
 		vector<cube_with_ix_t> bc_ixs;
@@ -2608,6 +2709,49 @@ class building_creator_t {
 			if (expand_by_one && ixr[1][d]+1 < grid_sz) {++ixr[1][d];}
 		}
 	}
+	// assign buildings to levels such that buildings within a level don't see each other during gen_geometry(), so each level can be generated in parallel;
+	// the only interaction is extended basement placement, which checks nearby buildings (through the grid) and is limited to the grid bcube containing the building;
+	// each building depends on earlier buildings it reads or that read it, so generating levels in order gives the same result as a serial loop over buildings
+	unsigned calc_gen_geometry_levels(bool may_read_neighbors, vector<vector<unsigned>> &bixs_by_level) const {
+		vector<int> max_write(grid.size(), -1), max_read(grid.size(), -1); // per grid cell, max level of buildings that are visible in/read from this cell
+		bixs_by_level.clear();
+
+		for (unsigned i = 0; i < buildings.size(); ++i) {
+			building_t const &b(buildings[i]);
+			unsigned level(0);
+
+			if (may_read_neighbors && b.is_valid() && !grid.empty()) {
+				unsigned wr[2][2], rr[2][2]; // write/read cell ranges: {lo,hi}x{x,y}
+				get_grid_range(b.bcube, wr); // the grid cells this building was added to, which is how other buildings see it
+				cube_t read_area;
+
+				for (unsigned y = wr[0][1]; y <= wr[1][1]; ++y) {
+					for (unsigned x = wr[0][0]; x <= wr[1][0]; ++x) {read_area.assign_or_union_with_cube(get_grid_elem(x, y).bcube);}
+				}
+				get_grid_range(read_area, rr, 1); // expand_by_one=1, as in check_cube_coll()
+
+				for (unsigned d = 0; d < 2; ++d) { // expand by one more cell in case the building center moves to an adjacent cell during generation
+					if (rr[0][d]   > 0      ) {--rr[0][d];}
+					if (rr[1][d]+1 < grid_sz) {++rr[1][d];}
+				}
+				for (unsigned y = rr[0][1]; y <= rr[1][1]; ++y) {
+					for (unsigned x = rr[0][0]; x <= rr[1][0]; ++x) {max_eq(level, unsigned(max_write[y*grid_sz + x] + 1));}
+				}
+				for (unsigned y = wr[0][1]; y <= wr[1][1]; ++y) {
+					for (unsigned x = wr[0][0]; x <= wr[1][0]; ++x) {max_eq(level, unsigned(max_read[y*grid_sz + x] + 1));}
+				}
+				for (unsigned y = rr[0][1]; y <= rr[1][1]; ++y) {
+					for (unsigned x = rr[0][0]; x <= rr[1][0]; ++x) {max_eq(max_read[y*grid_sz + x], int(level));}
+				}
+				for (unsigned y = wr[0][1]; y <= wr[1][1]; ++y) {
+					for (unsigned x = wr[0][0]; x <= wr[1][0]; ++x) {max_eq(max_write[y*grid_sz + x], int(level));}
+				}
+			}
+			if (level >= bixs_by_level.size()) {bixs_by_level.resize(level+1);}
+			bixs_by_level[level].push_back(i);
+		} // for i
+		return bixs_by_level.size();
+	}
 	void add_to_grid(cube_t const &bcube, unsigned bix, bool is_road_seg) {
 		unsigned ixr[2][2];
 		get_grid_range(bcube, ixr);
@@ -2716,11 +2860,13 @@ class building_creator_t {
 
 public:
 	building_creator_t(bool is_city_=0) : is_city(is_city_), max_extent(zero_vector), building_draw(is_city), building_draw_vbo(is_city) {}
+	~building_creator_t() {room_geom_gen_queue.cancel(this);}
 	bool empty() const {return buildings.empty();}
 	bool get_is_city() const {return is_city;}
 	bool has_interior_to_draw() const {return (has_interior_geom && !building_draw_interior.empty());}
 
 	void clear() {
+		room_geom_gen_queue.cancel(this);
 		buildings.clear();
 		grid.clear();
 		grid_by_tile.clear();
@@ -3046,23 +3192,30 @@ public:
 				for (auto i = grid.begin(); i != grid.end(); ++i) {i->bcube.z1() = def_water_level;}
 			}
 		} // if flatten_mesh
+		bool const gen_interiors(global_building_params.gen_building_interiors);
 		{ // open a scope
 			timer_t timer2("Gen Building Geometry", !is_tile); // 120ms/700ms => 160ms/900ms
-			bool const gen_interiors(global_building_params.gen_building_interiors);
 			bool const use_mt(!is_tile || gen_interiors); // only single threaded for tiles with no interiors, which is a fast case anyway
-			// house extended basement logic isn't thread safe because two houses being generated on different threads could have overlapping basement rooms;
-			// however, office buildings don't have extended basements, so it should be okay to process them in parallel to houses; this is just a bit slower
-#pragma omp parallel for schedule(static) num_threads(2) if (use_mt)
-			for (int is_house=0; is_house < 2; ++is_house) {
-				for (unsigned i = 0; i < buildings.size(); ++i) {
-					building_t &b(buildings[i]);
-					if (b.is_house != bool(is_house)) continue; // wrong pass
-					unsigned const rs_ix(city_prob.get(i).same_geom_per_mat[b.is_house] ? b.mat_ix : i); // same material, maybe from same block/city; could also use city_ix
+			// extended basement placement isn't thread safe because two buildings being generated on different threads could have overlapping basement rooms,
+			// so buildings that may interact are split into different levels; buildings within a level are independent and can be generated in parallel
+			vector<vector<unsigned>> bixs_by_level;
+			unsigned const num_levels(calc_gen_geometry_levels((gen_interiors && global_building_params.max_ext_basement_room_depth > 0), bixs_by_level));
+
+			for (vector<unsigned> const &bixs : bixs_by_level) {
+#pragma omp parallel for schedule(dynamic,1) if (use_mt && bixs.size() > 1)
+				for (int i = 0; i < (int)bixs.size(); ++i) {
+					unsigned const bix(bixs[i]);
+					building_t &b(buildings[bix]);
+					unsigned const rs_ix(city_prob.get(bix).same_geom_per_mat[b.is_house] ? b.mat_ix : bix); // same material, maybe from same block/city; could also use city_ix
 					b.gen_geometry(rs_ix, 1337*rs_ix+rseed);
 				}
-			} // for is_house
-			if (city_only && gen_interiors && global_building_params.max_ext_basement_room_depth > 0) {try_join_house_ext_basements(buildings);}
+			} // for bixs
+			if (!is_tile) {cout << "Building geometry generated in " << num_levels << " parallel levels" << endl;}
 		} // close the scope
+		if (city_only && gen_interiors && global_building_params.max_ext_basement_room_depth > 0) {
+			timer_t timer3("Join House Ext Basements", !is_tile);
+			try_join_house_ext_basements(buildings);
+		}
 		if (0 && non_city_only) { // perform room graph analysis
 			timer_t timer3("Building Room Graph Analysis");
 			for (auto b = buildings.begin(); b != buildings.end(); ++b) {
@@ -3207,7 +3360,7 @@ public:
 
 					for (auto bi = g->bc_ixs.begin(); bi != g->bc_ixs.end(); ++bi) {
 						building_t &b((*i)->get_building(bi->ix));
-						if (!b.interior) continue; // no interior
+						if (!b.interior || is_room_geom_gen_pending(b)) continue; // no interior, or room geom not yet generated
 						point lpos_clamped(lpos);
 						// include skylight light sources, which are above the building; buildings can't stack vertically, so the light can't belong to a different building
 						if (!b.skylights.empty()) {min_eq(lpos_clamped.z, b.bcube.z2());}
@@ -3296,7 +3449,7 @@ public:
 
 			for (auto bi = g->bc_ixs.begin(); bi != g->bc_ixs.end(); ++bi) {
 				building_t &b(get_building(bi->ix));
-				if (!b.has_room_geom()) continue; // no interior room geom, skip
+				if (is_room_geom_gen_pending(b) || !b.has_room_geom()) continue; // room geom not finished (check first), or no interior room geom, skip
 				if (!lights_bcube.intersects_xy(b.bcube)) continue; // not within light volume (too far from camera)
 				bool const camera_in_this_building(b.check_point_or_cylin_contained(camera_bs, 0.0, points, 1, 1, 0)); // inc_attic=1, inc_ext_basement=1, inc_roof_acc=0
 				if (sec_camera_mode && !camera_in_this_building) continue; // security cameras only show lights in their building
@@ -3356,6 +3509,46 @@ public:
 
 	// reflection_pass: 0 = not reflection pass, 1 = reflection for room with exterior wall,
 	// 2 = reflection for room no exterior wall (can't see outside windows), 3 = reflection from mirror in a house (windows and doors need to be drawn)
+	// predict where the player will be from camera motion and queue background room geom generation for buildings that will soon be within
+	// the draw distance; only buildings that are within the clear distance are considered so that the results aren't immediately freed
+	static void queue_room_geom_gen_ahead(vector<building_creator_t *> const &bcs, point const &camera_bs, float draw_dist, float clear_dist) {
+		float const lookahead_frames = 60.0; // ~1s at 60 FPS
+		static point last_camera_bs(all_zeros);
+		vector3d pred_move(camera_bs - last_camera_bs);
+		last_camera_bs = camera_bs;
+		if (!setup_bg_room_geom_gen()) return; // still loading object models
+		float const move_dist(pred_move.mag());
+		if (move_dist == 0.0 || move_dist > 0.25*draw_dist) return; // not moving, or teleported
+		pred_move *= min(lookahead_frames, draw_dist/move_dist); // limit to one draw distance
+		point const pred_pos(camera_bs + pred_move);
+
+		for (building_creator_t *bc : bcs) {
+			if (!room_geom_gen_queue.can_add()) return;
+			// use the same distance scale as multi_draw() for buildings without windows
+			float const ddist_scale(bc->building_draw_windows.empty() ? (camera_surf_collide ? 0.1 : 0.05) : 1.0);
+			float const rgeom_draw_dist_sq(ddist_scale*ddist_scale*draw_dist*draw_dist), rgeom_clear_dist(ddist_scale*clear_dist);
+
+			for (auto g = bc->grid_by_tile.begin(); g != bc->grid_by_tile.end(); ++g) {
+				cube_t const &grid_bcube(g->get_vis_bcube());
+				if (!grid_bcube.closest_dist_less_than(camera_bs, rgeom_clear_dist)) continue; // too far away
+				if (p2p_dist_sq(pred_pos, grid_bcube.closest_pt(pred_pos)) > rgeom_draw_dist_sq) continue; // not moving toward this tile
+
+				for (auto bi = g->bc_ixs.begin(); bi != g->bc_ixs.end(); ++bi) {
+					building_t &b(bc->get_building(bi->ix));
+					// check pending first, since room_geom may be written by the worker thread
+					if (!b.interior || room_geom_gen_queue.is_pending(b) || b.has_room_geom()) continue; // no interior, or already generated
+					if (!global_building_params.enable_rotated_room_geom && b.is_rotated()) continue; // room geom not drawn
+					// buildings connected to other buildings by walkways or extended basements update the other building during generation
+					if (!b.walkways.empty() || b.has_conn_info()) continue;
+					if (p2p_dist_sq(camera_bs, b.bcube.closest_pt(camera_bs)) <= rgeom_draw_dist_sq) continue; // already in range; generated when drawn
+					if (p2p_dist_sq(pred_pos,  b.bcube.closest_pt(pred_pos )) >  rgeom_draw_dist_sq) continue; // not predicted to be in range
+					room_geom_gen_queue.add(b, bc, bi->ix);
+					g->has_room_geom = 1; // so that it's cleared when the player moves away
+					if (!room_geom_gen_queue.can_add()) return;
+				} // for bi
+			} // for g
+		} // for bc
+	}
 	static void multi_draw(int shadow_only, int reflection_pass, vector3d const &xlate, vector<building_creator_t *> const &bcs) {
 		if (bcs.empty()) return;
 
@@ -3424,6 +3617,11 @@ public:
 			float const interior_draw_dist(global_building_params.interior_view_dist_scale*2.0f*(X_SCENE_SIZE + Y_SCENE_SIZE));
 			float const room_geom_draw_dist(0.4*interior_draw_dist), room_geom_clear_dist(1.05*room_geom_draw_dist), room_geom_sm_draw_dist(0.14*interior_draw_dist);
 			float const room_geom_int_detail_draw_dist(0.045*interior_draw_dist), room_geom_ext_detail_draw_dist(0.08*interior_draw_dist), z_prepass_dist(0.25*interior_draw_dist);
+
+			if (!reflection_pass) {
+				room_geom_gen_queue.collect_finished();
+				if (global_building_params.gen_room_geom_ahead) {queue_room_geom_gen_ahead(bcs, camera_bs, room_geom_draw_dist, room_geom_clear_dist);}
+			}
 			glEnable(GL_CULL_FACE); // back face culling optimization, helps with expensive lighting shaders
 			glCullFace(swap_front_back ? GL_FRONT : GL_BACK);
 
@@ -3496,8 +3694,13 @@ public:
 
 					if (!reflection_pass && gdist_sq > rgeom_clear_dist_sq && g->has_room_geom) { // need to clear room geom
 						//highres_timer_t timer("Clear Room Geom");
-						for (auto bi = g->bc_ixs.begin(); bi != g->bc_ixs.end(); ++bi) {(*i)->get_building(bi->ix).clear_room_geom();}
-						g->has_room_geom = 0;
+						bool any_pending(0);
+
+						for (auto bi = g->bc_ixs.begin(); bi != g->bc_ixs.end(); ++bi) {
+							building_t &b((*i)->get_building(bi->ix));
+							if (is_room_geom_gen_pending(b)) {any_pending = 1;} else {b.clear_room_geom();} // pending buildings are cleared later
+						}
+						g->has_room_geom = any_pending;
 					}
 					if (gdist_sq > int_draw_dist_sq)               continue; // too far
 					if (!building_grid_visible(xlate, grid_bcube)) continue; // VFC
@@ -3512,6 +3715,7 @@ public:
 					for (auto bi = g->bc_ixs.begin(); bi != g->bc_ixs.end(); ++bi) {
 						building_t &b((*i)->get_building(bi->ix));
 						if (!b.interior) continue; // no interior, skip
+						if (is_room_geom_gen_pending(b)) continue; // room geom is still being generated on the background thread; skip for now
 						float const bdist_sq(p2p_dist_sq(camera_bs, b.bcube.closest_pt(camera_bs)));
 						//if (bdist_sq > rgeom_clear_dist_sq) {b.clear_room_geom(); continue;} // too far away - is this useful?
 						if (bdist_sq > rgeom_draw_dist_sq) continue; // too far away
@@ -3558,7 +3762,7 @@ public:
 							pts.clear();
 							cube_t door_test_cube(b.bcube);
 							door_test_cube.expand_by_xy(ped_od);
-							get_pedestrians_in_area(door_test_cube, bi->ix, pts); // is this thread safe?
+							get_pedestrians_in_area(door_test_cube, bi->ix, pts); // thread safe; uses the published ped snapshot
 							b.get_all_nearby_ext_door_verts(ext_door_draw, s, pts, ped_od);
 						}
 						// check the bcube rather than check_point_or_cylin_contained() so that it works with roof doors that are outside any part?
@@ -4096,6 +4300,7 @@ public:
 		building_draw_wind_lights.upload_to_vbos();
 	}
 	void clear_vbos() {
+		room_geom_gen_queue.cancel(this); // must finish any room geom generation before clearing it
 		building_draw.clear_vbos();
 		building_draw_vbo.clear_vbos();
 		building_draw_windows.clear_vbos();
@@ -4334,7 +4539,7 @@ public:
 		return buildings[building_id].check_sphere_coll(pos, radius, xy_only);
 	}
 	bool check_building_point_or_cylin_contained(point const &pos, float radius, bool inc_details, unsigned building_id) const {
-		static vector<point> points; // reused across calls
+		thread_local vector<point> points; // reused across calls; thread_local because city peds may be updated in parallel
 		assert(building_id < buildings.size());
 		return buildings[building_id].check_point_or_cylin_contained(pos, radius, points, 0, 0, 0, inc_details); // attic=0, extb=0, roof=0
 	}
@@ -4356,7 +4561,6 @@ public:
 		return grid[get_grid_ix(b.bcube.get_cube_center())].bcube;
 	}
 
-	// Note: not thread safe due to static points
 	// return value: 0=no cont, 1=part, 2=attic, 3=ext basement, 4=roof access, 5=detail
 	int check_ped_coll(point const &pos, float bcube_radius, float detail_radius, unsigned plot_id, unsigned &building_id, cube_t *coll_cube) const {
 		if (empty()) return 0;
@@ -4364,7 +4568,7 @@ public:
 		vector<unsigned> const &bixes(bix_by_plot[plot_id]); // should be populated in gen()
 		if (bixes.empty()) return 0;
 		cube_t bcube; bcube.set_from_sphere(pos, bcube_radius);
-		static vector<point> points; // reused across calls
+		thread_local vector<point> points; // reused across calls; thread_local because city peds may be updated in parallel
 
 		// Note: assumes buildings are separated so that only one ped collision can occur
 		for (auto b = bixes.begin(); b != bixes.end(); ++b) {
@@ -4712,12 +4916,53 @@ public:
 				if (dist_less_than(pdu.pos, c.closest_pt(pdu.pos), pdu.far_) && pdu.cube_visible(c)) {state.building_ids.push_back(*b);}
 			} // for b
 		} // for g
+		update_occlusion_zbuffer(pdu, state);
 	}
-	bool check_pts_occluded(point const *const pts, unsigned npts, building_occlusion_state_t const &state) const { // pts are in building space
+	void update_occlusion_zbuffer(pos_dir_up const &pdu, building_occlusion_state_t &state) const {
+		if (!USE_OCCLUSION_ZBUFFER || state.building_ids.empty()) return;
+		pos_dir_up pdu_bs(pdu);
+		pdu_bs.translate(-state.xlate);
+
+		if (!occ_zbuf.is_current(pdu_bs)) { // rasterize once per frame; later calls with the same camera reuse it
+			//highres_timer_t timer("Rasterize Occluders");
+			occ_zbuf.begin_frame(pdu_bs);
+
+			for (cube_with_ix_t const &b : state.building_ids) {
+				if (b.contains_pt(pdu_bs.pos)) continue; // camera in this building's bcube; use line tests, which handle windows and doors
+				building_t const &building(get_building(b.ix));
+				if (building.is_rotated() || !building.is_cube()) continue; // only axis aligned cube parts are rasterized
+				bool complete(1);
+
+				for (auto p = building.parts.begin(); p != building.get_real_parts_end_inc_sec(); ++p) {
+					complete &= occ_zbuf.add_occluder(*p, b.ix);
+				}
+				if (complete) {occ_zbuf.mark_rasterized(b.ix);} // line tests can skip this building
+			} // for b
+			occ_zbuf.finalize();
+		}
+		state.zbuf_id = occ_zbuf.get_update_id();
+	}
+	bool check_cube_occluded(cube_t const &c, building_occlusion_state_t const &state) const { // c is in building space
+		if (state.building_ids.empty()) return 0;
+		bool const use_zbuf(occ_zbuf.is_valid() && state.zbuf_id == occ_zbuf.get_update_id());
+		
+		if (use_zbuf && occ_zbuf.is_occluded(c, state.exclude_bix)) {
+			occ_zbuf.register_query(1, 0); // zbuf_culled=1
+			return 1;
+		}
+		float const z(c.z2()); // top edge
+		point const corners[4] = {point(c.x1(), c.y1(), z), point(c.x2(), c.y1(), z), point(c.x2(), c.y2(), z), point(c.x1(), c.y2(), z)};
+		bool const occluded(check_pts_occluded(corners, 4, state, (use_zbuf ? &occ_zbuf : nullptr)));
+		if (use_zbuf) {occ_zbuf.register_query(0, occluded);}
+		return occluded;
+	}
+	// pts are in building space; buildings already rasterized into zbuf are skipped
+	bool check_pts_occluded(point const *const pts, unsigned npts, building_occlusion_state_t const &state, occlusion_zbuffer_t const *zbuf=nullptr) const {
 		point const pos_bs(state.pos - state.xlate);
 
 		for (auto b = state.building_ids.begin(); b != state.building_ids.end(); ++b) {
 			if ((int)b->ix == state.exclude_bix) continue;
+			if (zbuf && zbuf->was_rasterized(b->ix)) continue; // already handled by the zbuffer query
 			if (get_region(pos_bs, b->d) & get_region(pts[0], b->d)) continue; // line outside - early reject optimization
 			if (!b->line_intersects(pos_bs, pts[0])) continue; // early reject optimization
 			building_t const &building(get_building(b->ix));
@@ -4919,6 +5164,239 @@ public:
 }; // end building_tiles_t
 
 
+bool occlusion_zbuffer_t::is_current(pos_dir_up const &pdu_bs) const {
+	return (valid && frame == frame_counter && pos == pdu_bs.pos && dir == pdu_bs.dir.get_norm() && upv == pdu_bs.upv && aspect == pdu_bs.A && y_scale == 0.5f/pdu_bs.tterm);
+}
+void occlusion_zbuffer_t::begin_frame(pos_dir_up const &pdu_bs) {
+	if (PRINT_OCCLUSION_STATS && num_queries > 0) {print_stats();} // print stats for the previous frame
+	num_queries = num_zbuf_culled = num_line_culled = 0;
+	pos     = pdu_bs.pos;
+	dir     = pdu_bs.dir.get_norm();
+	upv     = pdu_bs.upv;
+	aspect  = pdu_bs.A;
+	frame   = frame_counter;
+	right   = cross_product(dir, upv).get_norm();
+	up      = cross_product(right, dir).get_norm();
+	near_z  = max(pdu_bs.near_, 1.0E-6f);
+	x_scale = 0.5/(pdu_bs.A*pdu_bs.tterm);
+	y_scale = 0.5f/pdu_bs.tterm;
+	unsigned const num_pixels(WIDTH*HEIGHT);
+	for (unsigned d = 0; d < 2; ++d) {depth[d].assign(num_pixels, FLT_MAX);}
+	depth_bix.assign(num_pixels, -1);
+	raster_bixs.clear();
+	valid = 0;
+	++update_id;
+}
+bool occlusion_zbuffer_t::project(point const &p, float &sx, float &sy, float &z) const {
+	vector3d const v(p - pos);
+	z = dot_product(v, dir);
+	if (z < near_z) return 0; // behind or too close to the camera
+	float const z_inv(1.0/z);
+	sx = WIDTH *(0.5 + x_scale*dot_product(v, right)*z_inv);
+	sy = HEIGHT*(0.5 + y_scale*dot_product(v, up   )*z_inv);
+	return 1;
+}
+// rasterizes the camera facing sides of c; each side is split into smaller quads so that the per-quad max depth is close to the true depth;
+// returns 1 if c was fully rasterized, 0 if some part of it was skipped because it crossed the near plane
+bool occlusion_zbuffer_t::add_occluder(cube_t const &c, unsigned bix) {
+	if (c.contains_pt(pos)) return 0; // camera inside occluder
+	bool complete(1);
+
+	for (unsigned d = 0; d < 3; ++d) {
+		bool side(0);
+		if      (pos[d] < c.d[d][0]) {side = 0;}
+		else if (pos[d] > c.d[d][1]) {side = 1;}
+		else {continue;} // side in this dim isn't visible
+		unsigned const d1((d+1)%3), d2((d+2)%3);
+		float zvals[3] = {}; // {lo-lo, hi-lo, lo-hi}
+
+		for (unsigned n = 0; n < 3; ++n) {
+			point p;
+			p[d ] = c.d[d][side];
+			p[d1] = c.d[d1][n == 1];
+			p[d2] = c.d[d2][n == 2];
+			zvals[n] = dot_product((p - pos), dir);
+		}
+		float const zmin(max(near_z, min(zvals[0], min(zvals[1], zvals[2]))));
+		unsigned const n1(min(8U, 1U + unsigned(4.0*fabs(zvals[1] - zvals[0])/zmin))), n2(min(8U, 1U + unsigned(4.0*fabs(zvals[2] - zvals[0])/zmin)));
+		float const step1(c.get_sz_dim(d1)/n1), step2(c.get_sz_dim(d2)/n2);
+
+		for (unsigned i2 = 0; i2 < n2; ++i2) {
+			for (unsigned i1 = 0; i1 < n1; ++i1) {
+				float sx[4], sy[4], dmax(0.0);
+				bool behind(0);
+
+				for (unsigned k = 0; k < 4; ++k) { // CCW order
+					point p;
+					p[d ] = c.d[d][side];
+					p[d1] = c.d[d1][0] + (i1 + ((k == 1 || k == 2) ? 1 : 0))*step1;
+					p[d2] = c.d[d2][0] + (i2 + ((k >= 2) ? 1 : 0))*step2;
+					float z(0.0);
+					if (!project(p, sx[k], sy[k], z)) {behind = 1; break;}
+					max_eq(dmax, z);
+				}
+				if (behind) {complete = 0; continue;} // conservative: skip quads that cross the near plane
+				raster_quad(sx, sy, dmax, bix);
+			} // for i1
+		} // for i2
+	} // for d
+	return complete;
+}
+// writes dval to the pixels that are fully covered by the convex quad {sx, sy}
+void occlusion_zbuffer_t::raster_quad(float const sx[4], float const sy[4], float dval, int bix) {
+	float area(0.0), xmin(FLT_MAX), xmax(-FLT_MAX), ymin(FLT_MAX), ymax(-FLT_MAX);
+
+	for (unsigned i = 0; i < 4; ++i) {
+		unsigned const j((i+1)&3);
+		area += sx[i]*sy[j] - sx[j]*sy[i];
+		min_eq(xmin, sx[i]); max_eq(xmax, sx[i]);
+		min_eq(ymin, sy[i]); max_eq(ymax, sy[i]);
+	}
+	if (fabs(area) < 2.0) return; // too small to fully cover any pixels (area is doubled)
+	max_eq(xmin, 0.0f); min_eq(xmax, float(WIDTH -1));
+	max_eq(ymin, 0.0f); min_eq(ymax, float(HEIGHT-1));
+	if (xmin > xmax || ymin > ymax) return; // off screen
+	float ea[4], eb[4], ec[4]; // edge functions: a*x + b*y + c >= 0 for pixels fully inside the edge
+
+	for (unsigned i = 0; i < 4; ++i) {
+		unsigned const j((i+1)&3);
+		float const sign((area > 0.0) ? 1.0 : -1.0), a(-sign*(sy[j] - sy[i])), b(sign*(sx[j] - sx[i]));
+		ea[i] = a;
+		eb[i] = b;
+		ec[i] = -(a*sx[i] + b*sy[i]) + 0.5*(a + b) - 0.5*(fabs(a) + fabs(b)); // min value over the pixel area, for conservative coverage
+	}
+	unsigned const x0(unsigned(xmin) & ~3U), x1(xmax), y0(ymin), y1(ymax); // x0 is aligned to a multiple of 4 for SIMD
+	float *const d0(depth[0].data()), *const d1(depth[1].data());
+	int *const ids(depth_bix.data());
+
+	for (unsigned y = y0; y <= y1; ++y) {
+		unsigned const row_off(y*WIDTH);
+		float row[4];
+		for (unsigned i = 0; i < 4; ++i) {row[i] = eb[i]*y + ec[i];}
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+		__m128 const xoff(_mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f)), zero(_mm_setzero_ps()), dv(_mm_set1_ps(dval));
+		__m128i const bixv(_mm_set1_epi32(bix));
+		__m128 eav[4], rowv[4];
+		for (unsigned i = 0; i < 4; ++i) {eav[i] = _mm_set1_ps(ea[i]); rowv[i] = _mm_set1_ps(row[i]);}
+
+		for (unsigned x = x0; x <= x1; x += 4) { // 4 pixels at a time; WIDTH is a multiple of 4, so this never crosses the end of the row
+			__m128 const xv(_mm_add_ps(_mm_set1_ps(float(x)), xoff));
+			__m128 cov(_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(eav[0], xv), rowv[0]), zero));
+			for (unsigned i = 1; i < 4; ++i) {cov = _mm_and_ps(cov, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(eav[i], xv), rowv[i]), zero));}
+			if (_mm_movemask_ps(cov) == 0) continue; // no pixels covered
+			unsigned const ix(row_off + x);
+			__m128  const cd0(_mm_loadu_ps(d0 + ix)), cd1(_mm_loadu_ps(d1 + ix));
+			__m128i const cids(_mm_loadu_si128((__m128i const *)(ids + ix)));
+			__m128  const other(_mm_andnot_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(cids, bixv)), cov)); // covered, and the nearest depth is from a different building
+			__m128  const closer(_mm_cmplt_ps(dv, cd0)), replace(_mm_and_ps(other, closer));
+			// other building: if closer, the old nearest depth becomes the second depth; otherwise the second depth is updated
+			__m128  const od1(_mm_or_ps(_mm_and_ps(closer, cd0), _mm_andnot_ps(closer, _mm_min_ps(cd1, dv))));
+			__m128  const nd1(_mm_or_ps(_mm_and_ps(other, od1), _mm_andnot_ps(other, cd1)));
+			__m128  const nd0(_mm_or_ps(_mm_and_ps(cov, _mm_min_ps(cd0, dv)), _mm_andnot_ps(cov, cd0)));
+			__m128i const rmask(_mm_castps_si128(replace));
+			__m128i const nids(_mm_or_si128(_mm_and_si128(rmask, bixv), _mm_andnot_si128(rmask, cids)));
+			_mm_storeu_ps(d0 + ix, nd0);
+			_mm_storeu_ps(d1 + ix, nd1);
+			_mm_storeu_si128((__m128i *)(ids + ix), nids);
+		} // for x
+#else
+		for (unsigned x = x0; x <= x1; ++x) {
+			if (ea[0]*x + row[0] < 0.0 || ea[1]*x + row[1] < 0.0 || ea[2]*x + row[2] < 0.0 || ea[3]*x + row[3] < 0.0) continue; // not fully covered
+			unsigned const ix(row_off + x);
+			if (ids[ix] == bix) {min_eq(d0[ix], dval); continue;} // same building
+			if (dval < d0[ix]) {d1[ix] = d0[ix]; d0[ix] = dval; ids[ix] = bix;} // new nearest building
+			else {min_eq(d1[ix], dval);}
+		} // for x
+#endif
+	} // for y
+}
+float occlusion_zbuffer_t::get_max_depth(unsigned layer, unsigned level, unsigned x, unsigned y) const {
+	if (level == 0) return depth[layer][y*WIDTH + x];
+	return max_depth[layer][level_start[level] + y*(WIDTH >> level) + x];
+}
+void occlusion_zbuffer_t::finalize() { // sort rasterized buildings and build the max depth pyramid
+	sort(raster_bixs.begin(), raster_bixs.end());
+	raster_bixs.erase(unique(raster_bixs.begin(), raster_bixs.end()), raster_bixs.end());
+	level_start.assign(1, 0); // level 0 is stored in depth[]
+	for (unsigned d = 0; d < 2; ++d) {max_depth[d].clear();}
+
+	for (unsigned level = 1; (HEIGHT >> level) > 0; ++level) {
+		unsigned const w(WIDTH >> level), h(HEIGHT >> level), start(max_depth[0].size());
+		level_start.push_back(start);
+
+		for (unsigned d = 0; d < 2; ++d) {
+			max_depth[d].resize(start + w*h);
+
+			for (unsigned y = 0; y < h; ++y) {
+				for (unsigned x = 0; x < w; ++x) {
+					float const v(max(max(get_max_depth(d, level-1, 2*x, 2*y  ), get_max_depth(d, level-1, 2*x+1, 2*y  )),
+						              max(get_max_depth(d, level-1, 2*x, 2*y+1), get_max_depth(d, level-1, 2*x+1, 2*y+1))));
+					max_depth[d][start + y*w + x] = v;
+				}
+			}
+		} // for d
+	} // for level
+	valid = 1;
+}
+// returns 1 if c (in building space) is behind the rasterized occluders; occluders from building exclude_bix are ignored if >= 0
+bool occlusion_zbuffer_t::is_occluded(cube_t const &c, int exclude_bix) const {
+	if (!valid) return 0;
+	float xmin(FLT_MAX), xmax(-FLT_MAX), ymin(FLT_MAX), ymax(-FLT_MAX), zmin(FLT_MAX);
+
+	for (unsigned i = 0; i < 8; ++i) {
+		point const p(c.d[0][i&1], c.d[1][(i>>1)&1], c.d[2][i>>2]);
+		float sx(0.0), sy(0.0), z(0.0);
+		if (!project(p, sx, sy, z)) return 0; // crosses the near plane
+		min_eq(xmin, sx); max_eq(xmax, sx);
+		min_eq(ymin, sy); max_eq(ymax, sy);
+		min_eq(zmin, z);
+	}
+	if (xmax < 0.0 || ymax < 0.0 || xmin >= WIDTH || ymin >= HEIGHT) return 0; // off screen; leave this to view frustum culling
+	unsigned const x0(max(0.0f, xmin)), x1(min(float(WIDTH-1), xmax)), y0(max(0.0f, ymin)), y1(min(float(HEIGHT-1), ymax));
+	unsigned const layer(exclude_bix >= 0); // the second depth layer is always at least as far as the depth with exclude_bix removed
+	unsigned level(0);
+
+	while (level+1 < level_start.size() && ((x1 >> level) - (x0 >> level) + 1)*((y1 >> level) - (y0 >> level) + 1) > 16) {++level;} // select a level with at most 16 texels
+	auto region_occluded([&](unsigned lev) {
+		for (unsigned y = (y0 >> lev); y <= (y1 >> lev); ++y) {
+			for (unsigned x = (x0 >> lev); x <= (x1 >> lev); ++x) {
+				if (!(get_max_depth(layer, lev, x, y) < zmin)) return 0;
+			}
+		}
+		return 1;
+	});
+	if (region_occluded(level)) return 1;
+	if (level == 0 && layer == 0) return 0; // already tested exactly
+	if ((x1 - x0 + 1)*(y1 - y0 + 1) > 1024) return 0; // too many pixels to test individually
+
+	for (unsigned y = y0; y <= y1; ++y) { // test individual pixels, removing depths from exclude_bix
+		for (unsigned x = x0; x <= x1; ++x) {
+			unsigned const ix(y*WIDTH + x);
+			float const d((exclude_bix >= 0 && depth_bix[ix] == exclude_bix) ? depth[1][ix] : depth[0][ix]);
+			if (!(d < zmin)) return 0;
+		}
+	}
+	return 1;
+}
+void occlusion_zbuffer_t::register_query(bool zbuf_culled, bool line_culled) const {
+	if (!PRINT_OCCLUSION_STATS) return;
+#pragma omp atomic
+	++num_queries;
+	if (zbuf_culled) {
+#pragma omp atomic
+		++num_zbuf_culled;
+	}
+	if (line_culled) {
+#pragma omp atomic
+		++num_line_culled;
+	}
+}
+void occlusion_zbuffer_t::print_stats() const {
+	float const mult(100.0/max(num_queries, 1U));
+	cout << "Occlusion queries: " << num_queries << ", zbuffer culled: " << mult*num_zbuf_culled << "%, line test culled: " << mult*num_line_culled
+		 << "%, rasterized buildings: " << raster_bixs.size() << endl;
+}
+
 void occlusion_checker_noncity_t::set_camera(pos_dir_up const &pdu, bool cur_building_only) {
 	if ((display_mode & 0x08) == 0) {state.building_ids.clear(); return;} // occlusion culling disabled
 	pos_dir_up near_pdu(pdu);
@@ -4927,10 +5405,7 @@ void occlusion_checker_noncity_t::set_camera(pos_dir_up const &pdu, bool cur_bui
 	//cout << "buildings: " << bc.get_num_buildings() << ", occluders: " << state.building_ids.size() << endl;
 }
 bool occlusion_checker_noncity_t::is_occluded(cube_t const &c) const {
-	if (state.building_ids.empty()) return 0;
-	float const z(c.z2()); // top edge
-	point const corners[4] = {point(c.x1(), c.y1(), z), point(c.x2(), c.y1(), z), point(c.x2(), c.y2(), z), point(c.x1(), c.y2(), z)};
-	return bc.check_pts_occluded(corners, 4, state);
+	return bc.check_cube_occluded(c, state);
 }
 
 
@@ -5057,6 +5532,7 @@ void clear_building_vbos() {
 	building_creator     .clear_vbos();
 	building_creator_city.clear_vbos();
 	building_tiles       .clear_vbos();
+	release_room_geom_alloc_pool(); // room geom has been freed, so the vectors in the pool are unlikely to be reused soon
 }
 
 // city interface
@@ -5082,7 +5558,7 @@ void add_building_interior_lights(point const &xlate, cube_t &lights_bcube, bool
 }
 // cars + peds
 void get_city_building_occluders(pos_dir_up const &pdu, building_occlusion_state_t &state) {building_creator_city.get_occluders(pdu, state);}
-bool check_city_pts_occluded(point const *const pts, unsigned npts, building_occlusion_state_t const &state) {return building_creator_city.check_pts_occluded(pts, npts, state);}
+bool check_city_cube_occluded(cube_t const &c, building_occlusion_state_t const &state) {return building_creator_city.check_cube_occluded(c, state);}
 bool city_single_cube_visible_check(point const &pos, cube_t const &c) {return building_creator_city.single_cube_visible_check(pos, c);}
 cube_t get_building_lights_bcube() {return building_lights_manager.get_lights_bcube();}
 // used for pedestrians in cities
@@ -92,7 +92,7 @@ float heightmap_t::get_heightmap_value(unsigned x, unsigned y) const { // return
 }
 
 
-void heightmap_t::modify_heightmap_value(unsigned x, unsigned y, int val, bool val_is_delta) {
+int heightmap_t::modify_heightmap_value(unsigned x, unsigned y, int val, bool val_is_delta) { // returns the applied delta after clamping
 
 	assert(is_allocated());
 	assert(ncolors == 1 || ncolors == 2); // one or two byte grayscale
@@ -100,13 +100,17 @@ void heightmap_t::modify_heightmap_value(unsigned x, unsigned y, int val, bool v
 	unsigned const ix(width*y + x);
 
 	if (ncolors == 1) {
-		if (val_is_delta) {val += data[ix];}
+		int const prev(data[ix]);
+		if (val_is_delta) {val += prev;}
 		data[ix] = max(0, min(255, val)); // clamp
+		return (int(data[ix]) - prev);
 	}
 	else { // ncolors == 2
 		unsigned short *ptr((unsigned short *)(data + (ix<<1)));
-		if (val_is_delta) {val += *ptr;}
+		int const prev(*ptr);
+		if (val_is_delta) {val += prev;}
 		*ptr = max(0, min(65535, val)); // clamp
+		return (int(*ptr) - prev);
 	}
 }
 
@@ -216,8 +220,40 @@ void tex_mod_map_manager_t::add_mod(tex_mod_vect_t const &mod) { // vector (coul
 	for (tex_mod_vect_t::const_iterator i = mod.begin(); i != mod.end(); ++i) {add_mod(*i);}
 }
 
-void tex_mod_map_manager_t::add_mod(tex_mod_map_t const &mod) { // map (could use a template function)
-	for (tex_mod_map_t::const_iterator i = mod.begin(); i != mod.end(); ++i) {add_mod(mod_elem_t(*i));}
+void tex_mod_map_manager_t::add_mod(tex_mod_map_t const &mod) { // map
+	mod.for_each([this](mod_elem_t const &elem) {add_mod(elem);});
+}
+
+void tex_mod_map_manager_t::apply_brush(hmap_brush_t const &brush, int step_sz, unsigned num_steps) {
+	pending_mods.resize(max(pending_mods.size(), (size_t)omp_get_max_threads_3dw()));
+	brush.apply(this, step_sz, num_steps);
+	merge_pending_mods();
+}
+
+void tex_mod_map_manager_t::record_mod(mod_elem_t const &elem) {
+	unsigned const thread_id(omp_get_thread_num_3dw());
+	assert(thread_id < pending_mods.size());
+	pending_mods[thread_id].push_back(elem);
+}
+
+void tex_mod_map_manager_t::merge_pending_mods() { // sums are order independent, so the result doesn't depend on thread scheduling
+	for (tex_mod_vect_t &mods : pending_mods) {
+		add_mod(mods);
+		mods.clear(); // keep the capacity for the next brush
+	}
+}
+
+void tex_mod_map_manager_t::tex_mod_map_t::add_block(tex_xy_t const &bxy, block_t const &block) {
+
+	assert(block.deltas.size() == BLOCK_SZ*BLOCK_SZ);
+	unsigned const x0(bxy.x << BLOCK_BITS), y0(bxy.y << BLOCK_BITS);
+
+	for (unsigned y = 0; y < BLOCK_SZ; ++y) {
+		for (unsigned x = 0; x < BLOCK_SZ; ++x) {
+			hmap_val_t const delta(block.deltas[(y << BLOCK_BITS) + x]);
+			if (delta != 0) {add(mod_elem_t((x0 + x), (y0 + y), delta));}
+		}
+	}
 }
 
 bool tex_mod_map_manager_t::pop_last_brush(hmap_brush_t &last_brush) {
@@ -237,7 +273,8 @@ bool tex_mod_map_manager_t::undo_last_brush() {
 	return 1;
 }
 
-unsigned const header_sig  = 0xdeadbeef;
+unsigned const header_sig  = 0xdeadbeef; // legacy format: one element per modified texel, and brushes are reapplied on load
+unsigned const header_sig_blocks = 0xdeadbee2; // block format: dense blocks of net deltas, and brushes are only stored for undo
 unsigned const trailer_sig = 0xbeefdead;
 
 bool tex_mod_map_manager_t::read_mod(string const &fn) {
@@ -250,17 +287,33 @@ bool tex_mod_map_manager_t::read_mod(string const &fn) {
 		cerr << "Error opening terrain height mod map " << fn << " for read" << endl;
 		return 0;
 	}
-	if (read_binary_uint(fp) != header_sig) {
+	unsigned const header(read_binary_uint(fp));
+	brushes_in_mod_map = (header == header_sig_blocks);
+
+	if (header != header_sig && !brushes_in_mod_map) {
 		cerr << "Error: incorrect header found in terrain height mod map " << fn << "." << endl;
 		return 0;
 	}
 	unsigned const sz(read_binary_uint(fp));
 
-	for (unsigned i = 0; i < sz; ++i) {
-		mod_elem_t elem;
-		unsigned const elem_read(fread(&elem, sizeof(mod_elem_t), 1, fp)); // use a larger block?
-		assert(elem_read == 1); // add error checking?
-		mod_map.add(elem);
+	if (brushes_in_mod_map) { // block format
+		tex_mod_map_t::block_t block;
+
+		for (unsigned i = 0; i < sz; ++i) {
+			tex_xy_t bxy;
+			unsigned const xy_read(fread(&bxy, sizeof(tex_xy_t), 1, fp));
+			unsigned const elem_read(fread(block.deltas.data(), sizeof(hmap_val_t), block.deltas.size(), fp));
+			assert(xy_read == 1 && elem_read == block.deltas.size()); // add error checking?
+			mod_map.add_block(bxy, block);
+		}
+	}
+	else {
+		for (unsigned i = 0; i < sz; ++i) {
+			mod_elem_t elem;
+			unsigned const elem_read(fread(&elem, sizeof(mod_elem_t), 1, fp)); // use a larger block?
+			assert(elem_read == 1); // add error checking?
+			mod_map.add(elem);
+		}
 	}
 	unsigned const bsz(read_binary_uint(fp));
 	brush_vect.resize(bsz);
@@ -285,13 +338,18 @@ bool tex_mod_map_manager_t::write_mod(string const &fn) const {
 		cerr << "Error opening terrain height mod map " << fn << " for write" << endl;
 		return 0;
 	}
-	write_binary_uint(fp, header_sig);
-	write_binary_uint(fp, mod_map.size());
-
-	for (tex_mod_map_t::const_iterator i = mod_map.begin(); i != mod_map.end(); ++i) {
-		mod_elem_t const elem(*i); // could use *i directly?
-		unsigned const elem_write(fwrite(&elem, sizeof(mod_elem_t), 1, fp)); // use a larger block?
-		assert(elem_write == 1); // add error checking?
+	// Note: mod_map includes the effects of all brushes because they're recorded as they're applied, so we always write the block format
+	tex_mod_map_t::block_map_t const &blocks(mod_map.get_blocks());
+	unsigned num_blocks(0);
+	for (auto const &b : blocks) {num_blocks += (b.second.num_nonzero > 0);}
+	write_binary_uint(fp, header_sig_blocks);
+	write_binary_uint(fp, num_blocks);
+
+	for (auto const &b : blocks) {
+		if (b.second.num_nonzero == 0) continue; // edits to this block have cancelled out
+		unsigned const xy_write(fwrite(&b.first, sizeof(tex_xy_t), 1, fp));
+		unsigned const elem_write(fwrite(b.second.deltas.data(), sizeof(hmap_val_t), b.second.deltas.size(), fp));
+		assert(xy_write == 1 && elem_write == b.second.deltas.size()); // add error checking?
 	}
 	write_binary_uint(fp, brush_vect.size());
 
@@ -408,9 +466,9 @@ vector3d terrain_hmap_manager_t::get_norm(int x, int y) const {
 	return vector3d(DY_VAL*(h0 - get_clamped_height(x+1, y)), DX_VAL*(h0 - get_clamped_height(x, y+1)), dxdy).get_norm();
 }
 
-void terrain_hmap_manager_t::modify_height(mod_elem_t const &elem, bool is_delta) {
+tex_mod_map_manager_t::hmap_val_t terrain_hmap_manager_t::modify_height(mod_elem_t const &elem, bool is_delta) {
 	assert((unsigned)max(hmap.width, hmap.height) <= max_tex_ix());
-	hmap.modify_heightmap_value(elem.x, elem.y, elem.delta, is_delta);
+	return hmap.modify_heightmap_value(elem.x, elem.y, elem.delta, is_delta);
 }
 
 tex_mod_map_manager_t::hmap_val_t terrain_hmap_manager_t::scale_delta(float delta) const {
@@ -421,15 +479,15 @@ tex_mod_map_manager_t::hmap_val_t terrain_hmap_manager_t::scale_delta(float delt
 bool terrain_hmap_manager_t::read_and_apply_mod(string const &fn) {
 	if (!tex_mod_map_manager_t::read_mod(fn)) return 0;
 	apply_cur_mod_map();
-	apply_cur_brushes();
+	if (!brushes_in_mod_map) {apply_cur_brushes();} // legacy format
 	return 1;
 }
 
 void terrain_hmap_manager_t::apply_cur_mod_map() {
-	for (tex_mod_map_t::const_iterator i = mod_map.begin(); i != mod_map.end(); ++i) { // apply the mod to the current texture
-		assert(i->first.x < hmap.width && i->first.y < hmap.height); // ensure the mod values fit within the texture
-		hmap.modify_heightmap_value(i->first.x, i->first.y, i->second.val, 1); // no clamping
-	}
+	mod_map.for_each([this](mod_elem_t const &elem) { // apply the mod to the current texture
+		assert(elem.x < hmap.width && elem.y < hmap.height); // ensure the mod values fit within the texture
+		hmap.modify_heightmap_value(elem.x, elem.y, elem.delta, 1); // no clamping
+	});
 }
 
 void terrain_hmap_manager_t::apply_cur_brushes() { // apply the brushes to the current texture
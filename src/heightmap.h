@@ -29,7 +29,7 @@ public:
 	texture_t(t, f, w, h, 0, 1, 0, n, inv) {}
 	unsigned get_pixel_value (unsigned x, unsigned y) const;
 	float get_heightmap_value(unsigned x, unsigned y) const;
-	void modify_heightmap_value(unsigned x, unsigned y, int val, bool val_is_delta);
+	int modify_heightmap_value(unsigned x, unsigned y, int val, bool val_is_delta);
 	void postprocess_height();
 	void proc_gen();
 };
@@ -51,21 +51,51 @@ public:
 		bool operator< (tex_xy_t const &t) const {return ((x == t.x) ? (y < t.y) : (x < t.x));}
 	};
 
-	struct mod_map_val_t {
-		hmap_val_t val;
-		mod_map_val_t(hmap_val_t v=0) : val(v) {} // init to zero
-	};
-
 	struct mod_elem_t : public tex_xy_t {
 		hmap_val_t delta;
 		mod_elem_t() : delta(0) {}
 		mod_elem_t(tex_ix_t x_, tex_ix_t y_, hmap_val_t d) : tex_xy_t(x_, y_), delta(d) {}
-		mod_elem_t(pair<tex_xy_t, mod_map_val_t> const &v) : tex_xy_t(v.first), delta(v.second.val) {}
 	};
 
-	struct tex_mod_map_t : public map<tex_xy_t, mod_map_val_t> { // for uniquing/combining modifications to the same xy point
-		// Note: this isn't entirely correct due to the clamping in the height texture update
-		void add(mod_elem_t const &elem) {operator[](elem).val += elem.delta;}
+	// block-sparse map of height deltas for uniquing/combining modifications to the same xy point;
+	// dense blocks of BLOCK_SZ x BLOCK_SZ texels are allocated on first write, which is much smaller and faster than a node per texel for large edits
+	class tex_mod_map_t {
+	public:
+		static unsigned const BLOCK_BITS = 6, BLOCK_SZ = (1 << BLOCK_BITS), BLOCK_MASK = (BLOCK_SZ - 1);
+
+		struct block_t {
+			vector<hmap_val_t> deltas; // BLOCK_SZ*BLOCK_SZ, indexed by y*BLOCK_SZ + x
+			unsigned num_nonzero=0;
+			block_t() : deltas(BLOCK_SZ*BLOCK_SZ, 0) {}
+		};
+		typedef map<tex_xy_t, block_t> block_map_t; // keyed by block xy; ordered so that written files are deterministic
+	private:
+		block_map_t blocks;
+		unsigned num_nonzero=0;
+	public:
+		void add(mod_elem_t const &elem) {
+			block_t &block(blocks[tex_xy_t((elem.x >> BLOCK_BITS), (elem.y >> BLOCK_BITS))]);
+			hmap_val_t &val(block.deltas[((elem.y & BLOCK_MASK) << BLOCK_BITS) + (elem.x & BLOCK_MASK)]);
+			int const nz_delta(int(val + elem.delta != 0) - int(val != 0));
+			val += elem.delta;
+			block.num_nonzero += nz_delta;
+			num_nonzero       += nz_delta;
+		}
+		template<typename F> void for_each(F func) const { // calls func(mod_elem_t) for each nonzero delta
+			for (auto const &b : blocks) {
+				for (unsigned y = 0; y < BLOCK_SZ; ++y) {
+					for (unsigned x = 0; x < BLOCK_SZ; ++x) {
+						hmap_val_t const delta(b.second.deltas[(y << BLOCK_BITS) + x]);
+						if (delta != 0) {func(mod_elem_t(((b.first.x << BLOCK_BITS) + x), ((b.first.y << BLOCK_BITS) + y), delta));}
+					}
+				}
+			}
+		}
+		block_map_t const &get_blocks() const {return blocks;}
+		void add_block(tex_xy_t const &bxy, block_t const &block);
+		unsigned size () const {return num_nonzero;}
+		bool     empty() const {return (num_nonzero == 0);}
+		void clear() {blocks.clear(); num_nonzero = 0;}
 	};
 
 	struct hmap_brush_t {
@@ -84,14 +114,19 @@ public:
 	typedef vector<hmap_brush_t> brush_vect_t;
 
 protected:
-	tex_mod_map_t mod_map;
+	tex_mod_map_t mod_map; // net height deltas; in block format files these include the effects of all brushes
 	brush_vect_t brush_vect;
+	bool brushes_in_mod_map=0; // set when reading a block format file, where brushes are only stored for undo
+	vector<tex_mod_vect_t> pending_mods; // per-thread applied deltas, merged into mod_map after each brush is applied
+
+	void record_mod(mod_elem_t const &elem); // may be called from modify_height_value() on multiple threads during a brush application
+	void merge_pending_mods();
 
 public:
 	void add_mod(mod_elem_t const &elem) {mod_map.add(elem);}
 	void add_mod(tex_mod_vect_t const &mod);
 	void add_mod(tex_mod_map_t const &mod);
-	void apply_brush(hmap_brush_t const &brush, int step_sz=1, unsigned num_steps=1) {brush.apply(this, step_sz, num_steps);}
+	void apply_brush(hmap_brush_t const &brush, int step_sz=1, unsigned num_steps=1);
 	void add_brush(hmap_brush_t const &brush) {brush_vect.push_back(brush);}
 
 	void apply_and_cache_brush(hmap_brush_t const &brush, int step_sz=1, unsigned num_steps=1) {
@@ -132,7 +167,7 @@ public:
 		modify_height(mod_elem_t(x, y, val), is_delta);
 		return 1;
 	}
-	void modify_height(mod_elem_t const &elem, bool is_delta);
+	hmap_val_t modify_height(mod_elem_t const &elem, bool is_delta); // returns the applied delta after clamping
 	void modify_and_cache_height(mod_elem_t const &elem, bool is_delta) {modify_height(elem, is_delta); add_mod(elem);} // unused
 	hmap_val_t scale_delta(float delta) const;
 	bool read_and_apply_mod(std::string const &fn);
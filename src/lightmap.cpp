@@ -9,6 +9,7 @@
 #include "binary_file_io.h"
 #include "profiler.h"
 #include <functional>
+#include <glm/gtc/packing.hpp>
 
 using std::cerr;
 
@@ -21,7 +22,7 @@ colorRGBA const flashlight_colors[2] = {colorRGBA(1.0, 0.8, 0.5, 1.0), colorRGBA
 
 
 bool using_lightmap(0), lm_alloc(0), has_dl_sources(0), has_spotlights(0), has_line_lights(0), use_dense_voxels(0), has_indir_lighting(0);
-bool dl_smap_enabled(0), flashlight_on(0), enable_dlight_bcubes(0);
+bool dl_smap_enabled(0), flashlight_on(0), enable_dlight_bcubes(0), sparse_lighting_files(0), pack_lighting_file_colors(0);
 unsigned dl_tid(0), elem_tid(0), gb_tid(0), dl_bc_tid(0), DL_GRID_BS(0), flashlight_color_id(0);
 float DZ_VAL2(0.0), DZ_VAL_INV2(0.0);
 float czmin0(0.0), lm_dz_adj(0.0);
@@ -205,23 +206,77 @@ void lmcell::set_outside_colors() {
 }
 
 
+// RGB9E5 shared exponent packing of lighting colors; negative values are clamped to zero
+unsigned pack_lmap_color(float const c[3]) {return glm::packF3x9_E1x5(glm::vec3(c[0], c[1], c[2]));}
+
+void unpack_lmap_color(unsigned v, float c[3]) {
+	glm::vec3 const color(glm::unpackF3x9_E1x5(v));
+	UNROLL_3X(c[i_] = color[i_];)
+}
+
+
 inline bool is_inside_lmap(int x, int y, int z) {return (z >= 0 && z < MESH_SIZE[2] && !point_outside_mesh(x, y));}
-bool lmap_manager_t::is_valid_cell(int x, int y, int z) const {return (is_inside_lmap(x, y, z) && vlmap[y][x] != NULL);}
+bool lmap_manager_t::is_valid_cell(int x, int y, int z) const {return (is_inside_lmap(x, y, z) && (is_sparse() || vlmap[y][x] != NULL));}
 
 // Note: only intended to work in ground mode where sizes are MESH_X_SIZE and MESH_Y_SIZE
 lmcell *lmap_manager_t::get_lmcell_round_down(point const &p) { // round down
 	int const x(get_xpos_round_down(p.x)), y(get_ypos_round_down(p.y)), z(get_zpos(p.z));
-	return (is_valid_cell(x, y, z) ? &vlmap[y][x][z] : NULL);
+	if (!is_valid_cell(x, y, z)) return NULL;
+	return (is_sparse() ? get_sparse_lmcell(x, y, z) : &vlmap[y][x][z]);
 }
 lmcell *lmap_manager_t::get_lmcell(point const &p) { // round to center
 	int const x(get_xpos(p.x)), y(get_ypos(p.y)), z(get_zpos(p.z));
-	return (is_valid_cell(x, y, z) ? &vlmap[y][x][z] : NULL);
+	if (!is_valid_cell(x, y, z)) return NULL;
+	return (is_sparse() ? get_sparse_lmcell(x, y, z) : &vlmap[y][x][z]);
 }
 
 void lmap_manager_t::reset_all(lmcell const &init_lmcell) {
+	if (is_sparse()) { // untouched cells are implicitly init_lmcell, so drop all bricks; not thread safe
+		free_bricks();
+		sparse_init_lmcell = init_lmcell;
+		return;
+	}
 	for (auto i = vldata_alloc.begin(); i != vldata_alloc.end(); ++i) {*i = init_lmcell;}
 }
 
+void lmap_manager_t::alloc_sparse(unsigned xsize, unsigned ysize, unsigned zsize, lmcell const &init_lmcell) {
+
+	assert(!is_allocated());
+	lm_xsize = xsize; lm_ysize = ysize; lm_zsize = zsize;
+	nbx = (xsize + LMAP_BRICK_SZ - 1)/LMAP_BRICK_SZ; // round up
+	nby = (ysize + LMAP_BRICK_SZ - 1)/LMAP_BRICK_SZ;
+	nbz = (zsize + LMAP_BRICK_SZ - 1)/LMAP_BRICK_SZ;
+	unsigned const tot_bricks(nbx*nby*nbz);
+	bricks.reset(new std::atomic<lmap_brick_t *>[tot_bricks]);
+	for (unsigned i = 0; i < tot_bricks; ++i) {bricks[i] = nullptr;}
+	num_bricks = 0;
+	sparse_init_lmcell = init_lmcell;
+}
+
+// thread safe; if two threads allocate the same brick, the loser frees its copy
+lmap_brick_t *lmap_manager_t::get_or_alloc_brick(unsigned bix) {
+
+	assert(bix < nbx*nby*nbz);
+	lmap_brick_t *brick(bricks[bix].load(std::memory_order_acquire));
+	if (brick != nullptr) return brick;
+	lmap_brick_t *const new_brick(new lmap_brick_t(sparse_init_lmcell));
+	
+	if (bricks[bix].compare_exchange_strong(brick, new_brick, std::memory_order_acq_rel)) {
+		++num_bricks;
+		return new_brick;
+	}
+	delete new_brick;
+	return brick; // set by compare_exchange_strong() to the other thread's brick
+}
+
+void lmap_manager_t::free_bricks() {
+
+	if (!is_sparse()) return;
+	unsigned const tot_bricks(nbx*nby*nbz);
+	for (unsigned i = 0; i < tot_bricks; ++i) {delete bricks[i].exchange(nullptr);}
+	num_bricks = 0;
+}
+
 template<typename T> void lmap_manager_t::alloc(unsigned nbins, unsigned xsize, unsigned ysize, unsigned zsize, T **nonempty_bins, lmcell const &init_lmcell) {
 
 	lm_xsize = xsize; lm_ysize = ysize; lm_zsize = zsize;
@@ -251,6 +306,7 @@ void lmap_manager_t::init_from(lmap_manager_t const &src) {
 
 	//assert(!is_allocated());
 	//clear_cells(); // probably unnecessary
+	assert(!is_sparse() && !src.is_sparse()); // not supported
 	alloc(src.vldata_alloc.size(), src.lm_xsize, src.lm_ysize, src.lm_zsize, src.vlmap, lmcell());
 	copy_data(src);
 }
@@ -259,7 +315,7 @@ void lmap_manager_t::init_from(lmap_manager_t const &src) {
 // *this = blend_weight*dest + (1.0 - blend_weight)*(*this)
 void lmap_manager_t::copy_data(lmap_manager_t const &src, float blend_weight) {
 
-	assert(vlmap && src.vlmap);
+	assert(vlmap && src.vlmap); // dense mode only
 	assert(src.lm_xsize == lm_xsize && src.lm_ysize == lm_ysize && src.lm_zsize == lm_zsize);
 	assert(src.vldata_alloc.size() == vldata_alloc.size());
 	assert(blend_weight >= 0.0);
@@ -282,6 +338,45 @@ void lmap_manager_t::copy_data(lmap_manager_t const &src, float blend_weight) {
 }
 
 
+// copy the values of a single lighting type from src, multiplied by scale; used for publishing partial ray trace results
+void lmap_manager_t::copy_ltype_data(lmap_manager_t const &src, int ltype, float scale) {
+
+	assert(!is_sparse() && !src.is_sparse());
+	assert(src.vldata_alloc.size() == vldata_alloc.size());
+	assert(ltype < NUM_LIGHTING_TYPES && scale >= 0.0);
+	unsigned const num(lmcell::get_dsz(ltype));
+
+	for (unsigned i = 0; i < vldata_alloc.size(); ++i) {
+		float const *const s(src.vldata_alloc[i].get_offset(ltype));
+		float *const d(vldata_alloc[i].get_offset(ltype));
+		for (unsigned j = 0; j < num; ++j) {d[j] = scale*s[j];}
+	}
+}
+
+// *this += src for a single lighting type; used to reduce per-light results; sparse mode only, and not thread safe with writes to *this
+void lmap_manager_t::add_lighting_from(lmap_manager_t const &src, int ltype) {
+
+	assert(is_sparse() && src.is_sparse());
+	assert(src.nbx == nbx && src.nby == nby && src.nbz == nbz);
+	assert(ltype < NUM_LIGHTING_TYPES);
+	if (src.num_bricks == 0) return; // nothing to add
+	unsigned const num(lmcell::get_dsz(ltype)), tot_bricks(nbx*nby*nbz);
+
+#pragma omp parallel for schedule(dynamic, 64)
+	for (int b = 0; b < (int)tot_bricks; ++b) {
+		lmap_brick_t const *const sbrick(src.bricks[b].load(std::memory_order_acquire));
+		if (sbrick == nullptr) continue; // untouched in src
+		lmap_brick_t *const dbrick(get_or_alloc_brick(b));
+
+		for (unsigned c = 0; c < LMAP_BRICK_CELLS; ++c) {
+			float const *const s(sbrick->cells[c].get_offset(ltype));
+			float *const d(dbrick->cells[c].get_offset(ltype));
+			for (unsigned j = 0; j < num; ++j) {d[j] += s[j];}
+		}
+	}
+}
+
+
 // *this = val*lmc + (1.0 - val)*(*this)
 void lmcell::mix_lighting_with(lmcell const &lmc, float val) {
 
@@ -327,20 +422,25 @@ void light_volume_local::add_lighting(colorRGB &color, int x, int y, int z) cons
 	UNROLL_3X(color[i_] = min(1.0f, color[i_]+data[ix].lc[i_]*scale);)
 }
 
+int const LLVOL_SPARSE_FILE_TAG = -2; // written in place of bounds[0][0], which is never negative
+
 bool light_volume_local::read(string const &filename) {
 
 	assert(!is_allocated());
 	binary_file_reader reader;
 	if (!reader.open(filename)) return 0;
+	int tag(0);
+	bool const sparse(reader.read(&tag, sizeof(int), 1) && tag == LLVOL_SPARSE_FILE_TAG);
+	if (!sparse) {bounds[0][0] = tag;}
 
-	if (!reader.read(bounds, sizeof(int), 6)) {
+	if (!reader.read((sparse ? &bounds[0][0] : &bounds[0][1]), sizeof(int), (sparse ? 6 : 5))) {
 		cerr << "Error: Failed to read header from light volume file '" << filename << "'." << endl;
 		return 0;
 	}
 	data.resize(get_num_data());
 	assert(is_allocated());
 
-	if (!reader.read(&data.front(), sizeof(lmcell_local), data.size())) {
+	if (!(sparse ? read_sparse_data(reader) : reader.read(&data.front(), sizeof(lmcell_local), data.size()))) {
 		cerr << "Error: Failed to read data from light volume file '" << filename << "'." << endl;
 		return 0;
 	}
@@ -357,11 +457,11 @@ bool light_volume_local::write(string const &filename) const {
 	binary_file_writer writer;
 	if (!writer.open(filename)) return 0;
 
-	if (!writer.write(bounds, sizeof(int), 6)) {
+	if ((sparse_lighting_files && !writer.write(&LLVOL_SPARSE_FILE_TAG, sizeof(int), 1)) || !writer.write(bounds, sizeof(int), 6)) {
 		cerr << "Error: Failed to write header to light volume file '" << filename << "'." << endl;
 		return 0;
 	}
-	if (!writer.write(&data.front(), sizeof(lmcell_local), data.size())) {
+	if (!(sparse_lighting_files ? write_sparse_data(writer) : writer.write(&data.front(), sizeof(lmcell_local), data.size()))) {
 		cerr << "Error: Failed to write data to light volume file '" << filename << "'." << endl;
 		return 0;
 	}
@@ -369,6 +469,75 @@ bool light_volume_local::write(string const &filename) const {
 	return 1;
 }
 
+// sparse form: {flags, num_bricks, {brick_ix, cells[LMAP_BRICK_CELLS]}...}, where bricks are 8x8x8 blocks of the bounds and
+// all-zero bricks are omitted; cells are stored as RGB9E5 if pack_lighting_file_colors was set when written
+unsigned light_volume_local::get_brick_grid_size(unsigned d) const {return (bounds[d][1] - bounds[d][0] + LMAP_BRICK_SZ - 1)/LMAP_BRICK_SZ;}
+
+template<typename F> void light_volume_local::iter_brick_cells(unsigned brick_ix, F func) const {
+	unsigned const nbz(get_brick_grid_size(2)), nbx(get_brick_grid_size(0));
+	int const bx(bounds[0][0] + LMAP_BRICK_SZ*((brick_ix/nbz)%nbx)), by(bounds[1][0] + LMAP_BRICK_SZ*(brick_ix/(nbz*nbx))), bz(bounds[2][0] + LMAP_BRICK_SZ*(brick_ix%nbz));
+	int const dx(bounds[0][1] - bounds[0][0]), dz(bounds[2][1] - bounds[2][0]);
+
+	for (int y = by; y < min(by+(int)LMAP_BRICK_SZ, bounds[1][1]); ++y) {
+		for (int x = bx; x < min(bx+(int)LMAP_BRICK_SZ, bounds[0][1]); ++x) {
+			for (int z = bz; z < min(bz+(int)LMAP_BRICK_SZ, bounds[2][1]); ++z) {
+				func(lmap_brick_t::get_ix(x-bx, y-by, z-bz), (((y - bounds[1][0])*dx + (x - bounds[0][0]))*dz + (z - bounds[2][0])));
+			}
+		}
+	}
+}
+
+bool light_volume_local::write_sparse_data(binary_file_writer &writer) const {
+
+	float const toler(1.0/(256.0 * max(0.001f, scale)));
+	unsigned const flags(pack_lighting_file_colors ? 1 : 0), tot_bricks(get_brick_grid_size(0)*get_brick_grid_size(1)*get_brick_grid_size(2));
+	vector<unsigned> brick_ixs;
+
+	for (unsigned b = 0; b < tot_bricks; ++b) {
+		bool nonempty(0);
+		iter_brick_cells(b, [&](unsigned, unsigned ix) {nonempty |= !data[ix].is_near_zero(toler);});
+		if (nonempty) {brick_ixs.push_back(b);}
+	}
+	unsigned const num_bricks(brick_ixs.size());
+	if (!writer.write(&flags, sizeof(unsigned), 1) || !writer.write(&num_bricks, sizeof(unsigned), 1)) return 0;
+	vector<lmcell_local> cells(LMAP_BRICK_CELLS);
+	vector<unsigned> packed(LMAP_BRICK_CELLS);
+
+	for (unsigned b : brick_ixs) {
+		for (auto &c : cells) {c = lmcell_local();} // cells outside the bounds are zero
+		iter_brick_cells(b, [&](unsigned bix, unsigned ix) {cells[bix] = data[ix];});
+		if (!writer.write(&b, sizeof(unsigned), 1)) return 0;
+
+		if (flags & 1) {
+			for (unsigned i = 0; i < LMAP_BRICK_CELLS; ++i) {packed[i] = pack_lmap_color(cells[i].lc);}
+			if (!writer.write(packed.data(), sizeof(unsigned), packed.size())) return 0;
+		}
+		else if (!writer.write(cells.data(), sizeof(lmcell_local), cells.size())) return 0;
+	}
+	return 1;
+}
+
+bool light_volume_local::read_sparse_data(binary_file_reader &reader) { // data must be allocated and zeroed
+
+	unsigned flags(0), num_bricks(0), brick_ix(0);
+	unsigned const tot_bricks(get_brick_grid_size(0)*get_brick_grid_size(1)*get_brick_grid_size(2));
+	if (!reader.read(&flags, sizeof(unsigned), 1) || !reader.read(&num_bricks, sizeof(unsigned), 1) || num_bricks > tot_bricks) return 0;
+	vector<lmcell_local> cells(LMAP_BRICK_CELLS);
+	vector<unsigned> packed(LMAP_BRICK_CELLS);
+
+	for (unsigned b = 0; b < num_bricks; ++b) {
+		if (!reader.read(&brick_ix, sizeof(unsigned), 1) || brick_ix >= tot_bricks) return 0;
+
+		if (flags & 1) {
+			if (!reader.read(packed.data(), sizeof(unsigned), packed.size())) return 0;
+			for (unsigned i = 0; i < LMAP_BRICK_CELLS; ++i) {unpack_lmap_color(packed[i], cells[i].lc);}
+		}
+		else if (!reader.read(cells.data(), sizeof(lmcell_local), cells.size())) return 0;
+		iter_brick_cells(brick_ix, [&](unsigned bix, unsigned ix) {data[ix] = cells[bix];});
+	}
+	return 1;
+}
+
 void light_volume_local::set_bounds(int x1, int x2, int y1, int y2, int z1, int z2) {
 	bounds[0][0] = x1; bounds[0][1] = x2; bounds[1][0] = y1; bounds[1][1] = y2; bounds[2][0] = z1; bounds[2][1] = z2;
 }
@@ -818,19 +987,27 @@ void update_indir_light_tex_range(lmap_manager_t const &lmap, vector<unsigned ch
 	unsigned xsize, unsigned y1, unsigned y2, unsigned zsize, float lighting_exponent, bool local_only, bool mt)
 {
 	bool const apply_sqrt(lighting_exponent > 0.49 && lighting_exponent < 0.51), apply_exp(!apply_sqrt && lighting_exponent != 1.0);
+	bool const sparse(lmap.is_sparse());
 	assert(lmap.is_allocated());
+	assert(local_only || !sparse); // sparse lmaps are only used for local lighting, where untouched cells are zero
 
 #pragma omp parallel for schedule(static) if (mt)
 	for (int y = y1; y < (int)y2; ++y) {
 		for (unsigned x = 0; x < xsize; ++x) {
 			unsigned const off(zsize*(y*xsize + x));
-			lmcell const *const vlm(lmap.get_column(x, y));
-			assert(vlm != nullptr); // not supported in this flow
+			lmcell const *const vlm(sparse ? nullptr : lmap.get_column(x, y));
+			assert(sparse || vlm != nullptr); // not supported in this flow
 			colorRGB color;
 
 			for (unsigned z = 0; z < zsize; ++z) {
 				unsigned const off2(4*(off + z));
-				lmcell const &lmc(vlm[z]);
+				lmcell const *const lmc_ptr(sparse ? lmap.get_sparse_lmcell(x, y, z) : (vlm + z));
+
+				if (lmc_ptr == nullptr) { // untouched sparse cell
+					tex_data[off2+0] = tex_data[off2+1] = tex_data[off2+2] = 0;
+					continue;
+				}
+				lmcell const &lmc(*lmc_ptr);
 				
 				if (local_only) { // optimization
 					if (lmc.lc[0] == 0.0 && lmc.lc[1] == 0.0 && lmc.lc[2] == 0.0) { // special case for all zeros
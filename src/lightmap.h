@@ -6,9 +6,13 @@
 
 #include "3DWorld.h"
 #include "trigger.h"
+#include <atomic>
 
 extern int MESH_X_SIZE, MESH_Y_SIZE, MESH_SIZE[3];
 
+struct binary_file_reader;
+struct binary_file_writer;
+
 #define ADD_LIGHT_CONTRIB(c, C) {C[0] += c[0]; C[1] += c[1]; C[2] += c[2];}
 
 unsigned const FLASHLIGHT_LIGHT_ID = 0;
@@ -44,36 +48,80 @@ struct lmcell { // size = 52
 };
 
 
+unsigned pack_lmap_color(float const c[3]);
+void unpack_lmap_color(unsigned v, float c[3]);
+
+
+unsigned const LMAP_BRICK_BITS  = 3;
+unsigned const LMAP_BRICK_SZ    = (1 << LMAP_BRICK_BITS); // 8x8x8 cells
+unsigned const LMAP_BRICK_CELLS = LMAP_BRICK_SZ*LMAP_BRICK_SZ*LMAP_BRICK_SZ;
+
+struct lmap_brick_t {
+	lmcell cells[LMAP_BRICK_CELLS]; // y, x, z order to match vlmap
+
+	lmap_brick_t(lmcell const &init_lmcell) {for (unsigned i = 0; i < LMAP_BRICK_CELLS; ++i) {cells[i] = init_lmcell;}}
+	static unsigned get_ix(unsigned x, unsigned y, unsigned z) { // x, y, z are the full lmap indices
+		unsigned const mask(LMAP_BRICK_SZ - 1);
+		return ((((y & mask) << LMAP_BRICK_BITS) + (x & mask)) << LMAP_BRICK_BITS) + (z & mask);
+	}
+};
+
+
 class lmap_manager_t {
 
 	vector<lmcell> vldata_alloc;
 	unsigned lm_xsize, lm_ysize, lm_zsize;
 	lmcell ***vlmap; // y, x, z (size is determined by {MESH_Y_SIZE, MESH_X_SIZE, MESH_Z_SIZE}
+	// sparse mode: bricks are allocated on first write, so memory scales with the lit volume rather than the scene size
+	unsigned nbx, nby, nbz; // brick grid size; zero in dense mode
+	std::unique_ptr<std::atomic<lmap_brick_t *>[]> bricks;
+	std::atomic<unsigned> num_bricks;
+	lmcell sparse_init_lmcell;
 
 	lmap_manager_t(lmap_manager_t const &) = delete; // forbidden
 	void operator=(lmap_manager_t const &) = delete; // forbidden
+	unsigned get_brick_ix(unsigned x, unsigned y, unsigned z) const {
+		return ((y >> LMAP_BRICK_BITS)*nbx + (x >> LMAP_BRICK_BITS))*nbz + (z >> LMAP_BRICK_BITS);
+	}
+	lmap_brick_t *get_or_alloc_brick(unsigned bix);
+	void free_bricks();
 
 public:
 	bool was_updated;
 	cube_t update_bcube;
 
-	lmap_manager_t() : lm_xsize(0), lm_ysize(0), lm_zsize(0), vlmap(NULL), was_updated(0) {update_bcube.set_to_zeros();}
+	lmap_manager_t() : lm_xsize(0), lm_ysize(0), lm_zsize(0), vlmap(NULL), nbx(0), nby(0), nbz(0), num_bricks(0), was_updated(0) {update_bcube.set_to_zeros();}
+	~lmap_manager_t() {free_bricks();}
 	void clear_cells() {vldata_alloc.clear();} // vlmap matrix headers are not cleared
-	bool is_allocated() const {return (vlmap != NULL && !vldata_alloc.empty());}
-	size_t size() const {return vldata_alloc.size();}
+	bool is_sparse() const {return (bricks != nullptr);}
+	bool is_allocated() const {return (is_sparse() || (vlmap != NULL && !vldata_alloc.empty()));}
+	size_t size() const {return (is_sparse() ? size_t(num_bricks)*LMAP_BRICK_CELLS : vldata_alloc.size());}
+	size_t get_mem_usage() const {return (size()*sizeof(lmcell) + size_t(nbx)*nby*nbz*sizeof(lmap_brick_t *));}
 	bool read_data_from_file(char const *const fn, int ltype);
 	bool write_data_to_file(char const *const fn, int ltype) const;
+	bool read_data(binary_file_reader &reader, char const *const fn, int ltype);
+	bool write_data(binary_file_writer &writer, char const *const fn, int ltype) const;
+	bool read_sparse_data(binary_file_reader &reader, char const *const fn, int ltype);
+	bool write_sparse_data(binary_file_writer &writer, char const *const fn, int ltype) const;
 	void clear_lighting_values(int ltype);
 	bool is_valid_cell(int x, int y, int z) const;
-	lmcell const *get_column(int x, int y) const {return vlmap[y][x];} // Note: no bounds checking
-	lmcell *get_column(int x, int y) {return vlmap[y][x];} // Note: no bounds checking
-	lmcell &get_lmcell(int x, int y, int z) {return get_column(x, y)[z];} // Note: no bounds checking
+	lmcell const *get_column(int x, int y) const {return vlmap[y][x];} // Note: no bounds checking; dense mode only
+	lmcell *get_column(int x, int y) {return vlmap[y][x];} // Note: no bounds checking; dense mode only
+	lmcell &get_lmcell(int x, int y, int z) {return get_column(x, y)[z];} // Note: no bounds checking; dense mode only
+	lmcell *get_sparse_lmcell(int x, int y, int z) {return &get_or_alloc_brick(get_brick_ix(x, y, z))->cells[lmap_brick_t::get_ix(x, y, z)];} // no bounds checking
+	lmcell const *get_sparse_lmcell(int x, int y, int z) const { // returns nullptr for untouched cells; no bounds checking
+		lmap_brick_t const *const brick(bricks[get_brick_ix(x, y, z)].load(std::memory_order_acquire));
+		return (brick ? &brick->cells[lmap_brick_t::get_ix(x, y, z)] : nullptr);
+	}
 	lmcell *get_lmcell_round_down(point const &p);
 	lmcell *get_lmcell(point const &p);
 	void reset_all(lmcell const &init_lmcell=lmcell());
 	template<typename T> void alloc(unsigned nbins, unsigned xsize, unsigned ysize, unsigned zsize, T **nonempty_bins, lmcell const &init_lmcell);
+	void alloc_sparse(unsigned xsize, unsigned ysize, unsigned zsize, lmcell const &init_lmcell);
 	void init_from(lmap_manager_t const &src);
 	void copy_data(lmap_manager_t const &src, float blend_weight=1.0);
+	void copy_ltype_data(lmap_manager_t const &src, int ltype, float scale);
+	void add_lighting_from(lmap_manager_t const &src, int ltype);
 };
 
 
@@ -92,8 +140,12 @@ class light_volume_local : public light_grid_base {
 	vector<lmcell_local> data;
 
 	unsigned get_num_data() const {return (bounds[0][1] - bounds[0][0])*(bounds[1][1] - bounds[1][0])*(bounds[2][1] - bounds[2][0]);}
+	unsigned get_brick_grid_size(unsigned d) const;
+	template<typename F> void iter_brick_cells(unsigned brick_ix, F func) const;
 	bool read(std::string const &filename);
 	bool write(std::string const &filename) const;
+	bool read_sparse_data(binary_file_reader &reader);
+	bool write_sparse_data(binary_file_writer &writer) const;
 	void compress(bool verbose);
 public:
 
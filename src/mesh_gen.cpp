@@ -10,6 +10,11 @@
 #include "shaders.h"
 #include "gl_ext_arb.h"
 #include <glm/gtc/noise.hpp>
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 
 int      const NUM_FREQ_COMP      = 9;
@@ -37,6 +42,8 @@ int cache_counter(1), start_eval_sin(0), GLACIATE(DEF_GLACIATE), mesh_gen_mode(M
 float zmax, zmin, zmax_est, zcenter(0.0), zbottom(0.0), ztop(0.0), h_sum(0.0), alt_temp(DEF_TEMPERATURE);
 float mesh_scale(1.0), tree_scale(1.0), mesh_scale_z(1.0), mesh_scale_z_inv(1.0), glaciate_exp(1.0), glaciate_exp_inv(1.0);
 float mesh_height_scale(1.0), zmax_est2(1.0), zmax_est2_inv(1.0);
+bool simd_mesh_noise_gen(1), mesh_gen_gpu_modes_on_cpu(0), mesh_noise_benchmark(0);
+thread_local bool mesh_noise_cpu_only(0); // set on worker threads that have no GL context
 vector<float> sin_table;
 float sinTable[F_TABLE_SIZE][5];
 
@@ -65,6 +72,7 @@ void estimate_zminmax(bool using_eq);
 void set_zvals();
 void update_temperature(bool verbose);
 void compute_scale();
+float get_noise_zval(float xval, float yval, int mode, int shape);
 
 bool using_hmap_with_detail();
 
@@ -385,6 +393,22 @@ void apply_glaciate(float &zval) {
 	}
 }
 
+// appends all global state that procedural mesh heights depend on; used to key cached terrain data
+void get_mesh_gen_state(vector<uint8_t> &state) {
+	append_pod_bytes(state, mesh_gen_mode);
+	append_pod_bytes(state, mesh_gen_shape);
+	append_pod_bytes(state, start_eval_sin);
+	append_pod_bytes(state, GLACIATE);
+	append_pod_bytes(state, glaciate_exp);
+	append_pod_bytes(state, zmax_est);
+	append_pod_bytes(state, zmax_est2);
+	append_pod_bytes(state, mesh_scale);
+	append_pod_bytes(state, mesh_scale_z);
+	append_pod_bytes(state, mesh_height_scale);
+	append_pod_bytes(state, hmap_params); // all floats, no padding
+	append_pod_bytes(state, jenkins_one_at_a_time_hash((uint8_t const *)sinTable, sizeof(sinTable)));
+}
+
 
 void glaciate() {
 
@@ -587,6 +611,262 @@ void gen_rx_ry(float &rx, float &ry) {
 	ry = rgen.rand_float() + 1.0;
 }
 
+
+// SIMD CPU noise generation: evaluates the same simplex/perlin math as glm::simplex()/glm::perlin() for N samples at a time;
+// uses AVX2 when enabled in the compiler, otherwise SSE2 or NEON, with a scalar fallback
+#if defined(__AVX2__)
+struct vfloat_t {
+	static unsigned const N = 8;
+	__m256 v;
+	vfloat_t() {}
+	vfloat_t(__m256 v_) : v(v_) {}
+	vfloat_t(float f) : v(_mm256_set1_ps(f)) {}
+	static vfloat_t load(float const *p) {return _mm256_loadu_ps(p);}
+	void store(float *p) const {_mm256_storeu_ps(p, v);}
+	vfloat_t operator+(vfloat_t const &b) const {return _mm256_add_ps(v, b.v);}
+	vfloat_t operator-(vfloat_t const &b) const {return _mm256_sub_ps(v, b.v);}
+	vfloat_t operator*(vfloat_t const &b) const {return _mm256_mul_ps(v, b.v);}
+	vfloat_t operator/(vfloat_t const &b) const {return _mm256_div_ps(v, b.v);}
+};
+inline vfloat_t vfloor(vfloat_t const &a) {return _mm256_floor_ps(a.v);}
+inline vfloat_t vabs  (vfloat_t const &a) {return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v);}
+inline vfloat_t vmax  (vfloat_t const &a, vfloat_t const &b) {return _mm256_max_ps(a.v, b.v);}
+inline vfloat_t vsel_gt(vfloat_t const &a, vfloat_t const &b, vfloat_t const &t, vfloat_t const &f) {return _mm256_blendv_ps(f.v, t.v, _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ));} // a > b ? t : f
+
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+struct vfloat_t {
+	static unsigned const N = 4;
+	__m128 v;
+	vfloat_t() {}
+	vfloat_t(__m128 v_) : v(v_) {}
+	vfloat_t(float f) : v(_mm_set1_ps(f)) {}
+	static vfloat_t load(float const *p) {return _mm_loadu_ps(p);}
+	void store(float *p) const {_mm_storeu_ps(p, v);}
+	vfloat_t operator+(vfloat_t const &b) const {return _mm_add_ps(v, b.v);}
+	vfloat_t operator-(vfloat_t const &b) const {return _mm_sub_ps(v, b.v);}
+	vfloat_t operator*(vfloat_t const &b) const {return _mm_mul_ps(v, b.v);}
+	vfloat_t operator/(vfloat_t const &b) const {return _mm_div_ps(v, b.v);}
+};
+inline vfloat_t vfloor(vfloat_t const &a) { // no SSE4.1 round; truncate and correct negative values (inputs are well within int range)
+	__m128 const t(_mm_cvtepi32_ps(_mm_cvttps_epi32(a.v)));
+	return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a.v), _mm_set1_ps(1.0f)));
+}
+inline vfloat_t vabs  (vfloat_t const &a) {return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v);}
+inline vfloat_t vmax  (vfloat_t const &a, vfloat_t const &b) {return _mm_max_ps(a.v, b.v);}
+inline vfloat_t vsel_gt(vfloat_t const &a, vfloat_t const &b, vfloat_t const &t, vfloat_t const &f) {
+	__m128 const mask(_mm_cmpgt_ps(a.v, b.v));
+	return _mm_or_ps(_mm_and_ps(mask, t.v), _mm_andnot_ps(mask, f.v));
+}
+
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+struct vfloat_t {
+	static unsigned const N = 4;
+	float32x4_t v;
+	vfloat_t() {}
+	vfloat_t(float32x4_t v_) : v(v_) {}
+	vfloat_t(float f) : v(vdupq_n_f32(f)) {}
+	static vfloat_t load(float const *p) {return vld1q_f32(p);}
+	void store(float *p) const {vst1q_f32(p, v);}
+	vfloat_t operator+(vfloat_t const &b) const {return vaddq_f32(v, b.v);}
+	vfloat_t operator-(vfloat_t const &b) const {return vsubq_f32(v, b.v);}
+	vfloat_t operator*(vfloat_t const &b) const {return vmulq_f32(v, b.v);}
+	vfloat_t operator/(vfloat_t const &b) const {return vdivq_f32(v, b.v);}
+};
+inline vfloat_t vfloor(vfloat_t const &a) {return vrndmq_f32(a.v);}
+inline vfloat_t vabs  (vfloat_t const &a) {return vabsq_f32(a.v);}
+inline vfloat_t vmax  (vfloat_t const &a, vfloat_t const &b) {return vmaxq_f32(a.v, b.v);}
+inline vfloat_t vsel_gt(vfloat_t const &a, vfloat_t const &b, vfloat_t const &t, vfloat_t const &f) {return vbslq_f32(vcgtq_f32(a.v, b.v), t.v, f.v);}
+
+#else // scalar fallback
+struct vfloat_t {
+	static unsigned const N = 1;
+	float v;
+	vfloat_t() {}
+	vfloat_t(float f) : v(f) {}
+	static vfloat_t load(float const *p) {return *p;}
+	void store(float *p) const {*p = v;}
+	vfloat_t operator+(vfloat_t const &b) const {return v + b.v;}
+	vfloat_t operator-(vfloat_t const &b) const {return v - b.v;}
+	vfloat_t operator*(vfloat_t const &b) const {return v * b.v;}
+	vfloat_t operator/(vfloat_t const &b) const {return v / b.v;}
+};
+inline vfloat_t vfloor(vfloat_t const &a) {return floorf(a.v);}
+inline vfloat_t vabs  (vfloat_t const &a) {return fabsf(a.v);}
+inline vfloat_t vmax  (vfloat_t const &a, vfloat_t const &b) {return max(a.v, b.v);}
+inline vfloat_t vsel_gt(vfloat_t const &a, vfloat_t const &b, vfloat_t const &t, vfloat_t const &f) {return ((a.v > b.v) ? t : f);}
+#endif
+
+inline vfloat_t vfract (vfloat_t const &a) {return a - vfloor(a);}
+inline vfloat_t vmod289(vfloat_t const &a) {return a - vfloor(a*vfloat_t(1.0f/289.0f))*vfloat_t(289.0f);} // matches glm::detail::mod289()
+inline vfloat_t vmod289_div(vfloat_t const &a) {return a - vfloat_t(289.0f)*vfloor(a/vfloat_t(289.0f));} // matches glm::mod(x, 289)
+inline vfloat_t vpermute(vfloat_t const &a) {return vmod289(((a*vfloat_t(34.0f)) + vfloat_t(1.0f))*a);}
+
+// per-lane version of glm::simplex(vec2); operations are kept in the same order so that results match to within rounding
+vfloat_t simplex_simd(vfloat_t const &vx, vfloat_t const &vy) {
+
+	vfloat_t const C0(0.211324865405187f), C1(0.366025403784439f), C2(-0.577350269189626f), C3(0.024390243902439f), zero(0.0f), one(1.0f), half(0.5f);
+	// first corner
+	vfloat_t const s(vx*C1 + vy*C1);
+	vfloat_t ix(vfloor(vx + s)), iy(vfloor(vy + s));
+	vfloat_t const t(ix*C0 + iy*C0);
+	vfloat_t const x0x(vx - ix + t), x0y(vy - iy + t);
+	// other corners
+	vfloat_t const i1x(vsel_gt(x0x, x0y, one, zero)), i1y(vsel_gt(x0x, x0y, zero, one));
+	vfloat_t const x1x((x0x + C0) - i1x), x1y((x0y + C0) - i1y), x2x(x0x + C2), x2y(x0y + C2);
+	// permutations
+	ix = vmod289_div(ix);
+	iy = vmod289_div(iy);
+	vfloat_t const p0(vpermute(vpermute(iy       ) + ix       ));
+	vfloat_t const p1(vpermute(vpermute(iy + i1y) + ix + i1x));
+	vfloat_t const p2(vpermute(vpermute(iy + one) + ix + one));
+	vfloat_t const p[3] = {p0, p1, p2}, xx[3] = {x0x, x1x, x2x}, xy[3] = {x0y, x1y, x2y};
+	vfloat_t sum[3];
+
+	for (unsigned n = 0; n < 3; ++n) {
+		vfloat_t m(vmax(half - (xx[n]*xx[n] + xy[n]*xy[n]), zero));
+		m = m*m;
+		m = m*m;
+		// gradients: 41 points uniformly over a line, mapped onto a diamond
+		vfloat_t const x(vfloat_t(2.0f)*vfract(p[n]*C3) - one), h(vabs(x) - half), ox(vfloor(x + half)), a0(x - ox);
+		m = m*(vfloat_t(1.79284291400159f) - vfloat_t(0.85373472095314f)*(a0*a0 + h*h)); // normalize gradients implicitly by scaling m
+		sum[n] = m*(a0*xx[n] + h*xy[n]);
+	}
+	return vfloat_t(130.0f)*(sum[0] + sum[1] + sum[2]);
+}
+
+// per-lane version of glm::perlin(vec2)
+vfloat_t perlin_simd(vfloat_t const &px, vfloat_t const &py) {
+
+	vfloat_t const one(1.0f), half(0.5f);
+	vfloat_t const pix0(vfloor(px)), piy0(vfloor(py));
+	vfloat_t const fx0(vfract(px)), fy0(vfract(py));
+	vfloat_t const ix[2] = {vmod289_div(pix0), vmod289_div(pix0 + one)}, iy[2] = {vmod289_div(piy0), vmod289_div(piy0 + one)};
+	vfloat_t const fx[2] = {fx0, fx0 - one}, fy[2] = {fy0, fy0 - one};
+	vfloat_t n[2][2]; // {y}{x}
+
+	for (unsigned y = 0; y < 2; ++y) {
+		for (unsigned x = 0; x < 2; ++x) {
+			vfloat_t const i(vpermute(vpermute(ix[x]) + iy[y]));
+			vfloat_t gx(vfloat_t(2.0f)*vfract(i/vfloat_t(41.0f)) - one);
+			vfloat_t gy(vabs(gx) - half);
+			gx = gx - vfloor(gx + half);
+			vfloat_t const norm(vfloat_t(1.79284291400159f) - vfloat_t(0.85373472095314f)*(gx*gx + gy*gy));
+			n[y][x] = (gx*norm)*fx[x] + (gy*norm)*fy[y];
+		}
+	}
+	vfloat_t const fade_x(fx0*fx0*fx0*(fx0*(fx0*vfloat_t(6.0f) - vfloat_t(15.0f)) + vfloat_t(10.0f)));
+	vfloat_t const fade_y(fy0*fy0*fy0*(fy0*(fy0*vfloat_t(6.0f) - vfloat_t(15.0f)) + vfloat_t(10.0f)));
+	vfloat_t const nx0(n[0][0] + fade_x*(n[0][1] - n[0][0])), nx1(n[1][0] + fade_x*(n[1][1] - n[1][0]));
+	return vfloat_t(2.3f)*(nx0 + fade_y*(nx1 - nx0));
+}
+
+// multi-octave SIMD version of gen_noise() for n arbitrary (xv, yv) positions
+void gen_noise_simd(float const *xv, float const *yv, float *out, unsigned n, int mode, int shape) {
+
+	unsigned const end_octave(NUM_FREQ_COMP - start_eval_sin/N_RAND_SIN2);
+	assert(end_octave <= NUM_FREQ_COMP);
+	float mags[NUM_FREQ_COMP], freqs[NUM_FREQ_COMP], rxs[NUM_FREQ_COMP], rys[NUM_FREQ_COMP];
+	float mag(1.0), freq(1.0), rx, ry;
+	float const lacunarity(1.92), gain(0.5);
+	bool const is_simplex(mode == MGEN_SIMPLEX || mode == MGEN_SIMPLEX_GPU || mode == MGEN_DWARP_GPU);
+	gen_rx_ry(rx, ry);
+
+	for (unsigned i = 0; i < end_octave; ++i) { // same sequence of octave params as gen_noise()
+		mags[i] = mag; freqs[i] = freq; rxs[i] = rx; rys[i] = ry;
+		mag *= gain; freq *= lacunarity; rx *= 1.5; ry *= 1.5;
+	}
+	unsigned const N(vfloat_t::N);
+
+	for (unsigned i = 0; i < n; i += N) {
+		unsigned const num(min(N, n - i));
+		float xbuf[N], ybuf[N], zbuf[N];
+		float const *xp(xv + i), *yp(yv + i);
+
+		if (num < N) { // partial vector at the end - pad with the last value
+			for (unsigned j = 0; j < N; ++j) {xbuf[j] = xv[i + min(j, num-1)]; ybuf[j] = yv[i + min(j, num-1)];}
+			xp = xbuf; yp = ybuf;
+		}
+		vfloat_t const x(vfloat_t::load(xp)), y(vfloat_t::load(yp));
+		vfloat_t zval(0.0f);
+
+		for (unsigned o = 0; o < end_octave; ++o) {
+			vfloat_t const px(vfloat_t(freqs[o])*x + vfloat_t(rxs[o])), py(vfloat_t(freqs[o])*y + vfloat_t(rys[o]));
+			vfloat_t noise(is_simplex ? simplex_simd(px, py) : perlin_simd(px, py));
+
+			switch (shape) {
+			case 0: break; // linear - do nothing
+			case 1: noise = vabs(noise) - vfloat_t(0.40f); break; // billowy
+			case 2: noise = vfloat_t(0.45f) - vabs(noise); break; // ridged
+			}
+			zval = zval + vfloat_t(mags[o])*noise;
+		}
+		if (num < N) {zval.store(zbuf); for (unsigned j = 0; j < num; ++j) {out[i+j] = zbuf[j];}}
+		else {zval.store(out + i);}
+	}
+}
+
+// SIMD version of get_noise_zval() for n samples; xval and yval are in mesh index space
+void get_noise_zvals_simd(float const *xval, float const *yval, float *zvals, unsigned n, int mode, int shape) {
+
+	assert(mode != MGEN_SINE);
+	float const xy_scale(MESH_SCALE_FACTOR*mesh_scale), zscale(get_hmap_scale(mode));
+	thread_local vector<float> xv, yv, tx, ty, dx1, dy1, dx2, dy2;
+	xv.resize(n); yv.resize(n);
+	for (unsigned i = 0; i < n; ++i) {xv[i] = xy_scale*xval[i]; yv[i] = xy_scale*yval[i];}
+
+	if (mode == MGEN_DWARP_GPU) { // domain warping; offsets are computed in the same precision as get_noise_zval()
+		float const scale(0.2);
+		tx.resize(n); ty.resize(n); dx1.resize(n); dy1.resize(n); dx2.resize(n); dy2.resize(n);
+		gen_noise_simd(xv.data(), yv.data(), dx1.data(), n, mode, shape);
+		for (unsigned i = 0; i < n; ++i) {tx[i] = xv[i]+5.2; ty[i] = yv[i]+1.3;}
+		gen_noise_simd(tx.data(), ty.data(), dy1.data(), n, mode, shape);
+		for (unsigned i = 0; i < n; ++i) {tx[i] = (xv[i] + scale*dx1[i] + 1.7); ty[i] = (yv[i] + scale*dy1[i] + 9.2);}
+		gen_noise_simd(tx.data(), ty.data(), dx2.data(), n, mode, shape);
+		for (unsigned i = 0; i < n; ++i) {tx[i] = (xv[i] + scale*dx1[i] + 8.3); ty[i] = (yv[i] + scale*dy1[i] + 2.8);}
+		gen_noise_simd(tx.data(), ty.data(), dy2.data(), n, mode, shape);
+		for (unsigned i = 0; i < n; ++i) {xv[i] += scale*dx2[i]; yv[i] += scale*dy2[i];}
+	}
+	gen_noise_simd(xv.data(), yv.data(), zvals, n, mode, shape);
+	bool const need_postproc(hmap_params.need_postproc());
+
+	for (unsigned i = 0; i < n; ++i) {
+		if (need_postproc) {postproc_noise_zval(zvals[i]);}
+		zvals[i] *= zscale;
+	}
+}
+
+// compares the SIMD noise against the scalar get_noise_zval() reference and reports samples/sec for each noise mode
+void run_mesh_noise_benchmark() {
+
+	unsigned const size(512), num(size*size);
+	vector<float> xvals(num), yvals(num), ref(num), vals(num);
+	cout << "Mesh noise benchmark: " << vfloat_t::N << " lanes, " << size << "x" << size << " samples, shape " << mesh_gen_shape << endl;
+
+	for (unsigned y = 0; y < size; ++y) {
+		for (unsigned x = 0; x < size; ++x) {xvals[y*size + x] = 3.7f*x - 200.0f; yvals[y*size + x] = 3.7f*y - 150.0f;}
+	}
+	int const modes[3] = {MGEN_SIMPLEX, MGEN_PERLIN, MGEN_DWARP_GPU};
+	char const *const mode_names[3] = {"simplex", "perlin", "domain warp"};
+
+	for (unsigned m = 0; m < 3; ++m) {
+		int const mode(modes[m]);
+		int const t1(GET_TIME_MS());
+#pragma omp parallel for schedule(static,1)
+		for (int i = 0; i < (int)num; ++i) {ref[i] = get_noise_zval(xvals[i], yvals[i], mode, mesh_gen_shape);}
+		int const t2(GET_TIME_MS());
+#pragma omp parallel for schedule(static,1)
+		for (int y = 0; y < (int)size; ++y) {get_noise_zvals_simd(&xvals[y*size], &yvals[y*size], &vals[y*size], size, mode, mesh_gen_shape);}
+		int const t3(GET_TIME_MS());
+		float const zscale(get_hmap_scale(mode));
+		float max_err(0.0);
+		for (unsigned i = 0; i < num; ++i) {max_eq(max_err, fabs(vals[i] - ref[i])/zscale);}
+		bool const passed(max_err < 1.0E-3); // domain warp amplifies rounding differences
+		cout << mode_names[m] << ": scalar " << 1000.0f*num/max(1, (t2 - t1)) << " samples/s, SIMD " << 1000.0f*num/max(1, (t3 - t2))
+			 << " samples/s, max error " << max_err << (passed ? " (passed)" : " (FAILED)") << endl;
+	}
+}
+
+
 bool mesh_xy_grid_cache_t::build_arrays(float x0, float y0, float dx, float dy,
 	unsigned nx, unsigned ny, bool cache_values, bool force_sine_mode, bool no_wait)
 {
@@ -597,14 +877,28 @@ bool mesh_xy_grid_cache_t::build_arrays(float x0, float y0, float dx, float dy,
 	gen_shape = (force_sine_mode ? 0 : mesh_gen_shape);
 	do_glaciate = 0; // must set enable_glaciate() after this call if needed
 	cached_vals.clear();
+	if (mesh_noise_benchmark) {mesh_noise_benchmark = 0; run_mesh_noise_benchmark();} // run once
 
-	if (gen_mode >= MGEN_SIMPLEX_GPU) { // GPU simplex noise - always cache values
+	if (gen_mode >= MGEN_SIMPLEX_GPU && !mesh_gen_gpu_modes_on_cpu && !mesh_noise_cpu_only) { // GPU simplex noise - always cache values
 		bool const is_running(cshader && cshader->get_is_running());
 		if (!is_running) {run_gpu_simplex();} // launch the job
 		if (no_wait && !is_running) return 0; // just started, results not yet available
 		cache_gpu_simplex_vals();
 		return 1; // results are available
 	}
+	if (gen_mode != MGEN_SINE && simd_mesh_noise_gen) { // CPU simplex/perlin noise - always cache values, generated one row at a time
+		cached_vals.resize(nx*ny);
+
+#pragma omp parallel for schedule(static,1)
+		for (int y = 0; y < (int)ny; ++y) {
+			thread_local vector<float> xvals, yvals;
+			xvals.resize(nx);
+			yvals.assign(nx, (y*dy + y0)*DY_VAL_INV);
+			for (unsigned x = 0; x < nx; ++x) {xvals[x] = (x*dx + x0)*DX_VAL_INV;}
+			get_noise_zvals_simd(xvals.data(), yvals.data(), &cached_vals[y*nx], nx, gen_mode, gen_shape);
+		}
+		return 1; // results are available
+	}
 	yterms_start = nx*F_TABLE_SIZE;
 	xyterms.resize((nx + ny)*F_TABLE_SIZE, 0.0);
 	float const msx(mesh_scale*DX_VAL_INV), msy(mesh_scale*DY_VAL_INV), ms2(0.5*mesh_scale);
@@ -627,14 +921,15 @@ bool mesh_xy_grid_cache_t::build_arrays(float x0, float y0, float dx, float dy,
 		}
 	}
 	if (cache_values) {
-		cached_vals.resize(cur_nx*cur_ny);
+		vector<float> vals(cur_nx*cur_ny); // filled before being moved into cached_vals so that eval_index() doesn't read from the cache
 		
 #pragma omp parallel for schedule(static,1)
 		for (int y = 0; y < (int)cur_ny; ++y) {
 			for (unsigned x = 0; x < cur_nx; ++x) {
-				cached_vals[y*cur_nx + x] = eval_index(x, y, 0, 0); // Note: no glaciate, min_start_sin=0, use_cache=0
+				vals[y*cur_nx + x] = eval_index(x, y, 0, 0); // Note: no glaciate, min_start_sin=0, use_cache=0
 			}
 		}
+		cached_vals.swap(vals);
 	}
 	return 1; // results are available
 }
@@ -759,7 +1054,7 @@ float mesh_xy_grid_cache_t::eval_index(unsigned x, unsigned y, int min_start_sin
 	assert(x < cur_nx && y < cur_ny);
 	float zval(0.0);
 
-	if ((use_cache || gen_mode >= MGEN_SIMPLEX_GPU) && !cached_vals.empty()) {
+	if ((use_cache || gen_mode != MGEN_SINE) && !cached_vals.empty()) { // noise modes always use cached values when available
 		zval += cached_vals[y*cur_nx + x];
 	}
 	else if (gen_mode != MGEN_SINE) { // perlin/simplex
@@ -17,6 +17,15 @@
 
 #include <glm/gtc/matrix_transform.hpp>
 
+#ifdef _WIN32
+#include <windows.h> // for memory mapped files
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 bool const ENABLE_BUMP_MAPS  = 1;
 bool const ENABLE_SPEC_MAPS  = 1;
 bool const ENABLE_INTER_REFLECTIONS = 1;
@@ -24,11 +33,15 @@ bool const SHOW_MODEL_BCUBE_CENTER  = 0;
 bool const ENABLE_ANIMATION_SHADOWS = 1;
 bool const USE_ANIM_MODEL_TANGENTS  = 1;
 unsigned const MAGIC_NUMBER  = 42987143; // arbitrary file signature
+unsigned const MAGIC_NUMBER_V2 = 42987144; // model3d v2 file signature
+unsigned const MODEL3D_V2_VERSION = 3; // incremented when the v2 table of contents changes; 3 adds cached geometry stats
+unsigned const MODEL3D_V2_ALIGN = 64; // file offset alignment of each section in v2 files
 unsigned const BLOCK_SIZE    = 32768; // in vertex indices
 unsigned const BONE_IDS_LOC     = 4;
 unsigned const BONE_WEIGHTS_LOC = 5;
 
 bool model_calc_tan_vect(1); // slower and more memory but sometimes better quality/smoother transitions
+bool write_model3d_v2(0), model3d_lazy_load(0); // v2 files can't be read by older builds, so it's opt-in
 
 extern bool group_back_face_cull, enable_model3d_tex_comp, disable_shader_effects, texture_alpha_in_red_comp, use_model3d_tex_mipmaps, enable_model3d_bump_maps;
 extern bool two_sided_lighting, have_indir_smoke_tex, use_core_context, model3d_wn_normal, invert_model_nmap_bscale, use_z_prepass, all_model3d_ref_update;
@@ -207,6 +220,72 @@ template<typename V> void read_vector(istream &in, V &v) {
 }
 
 
+// read-only memory mapped file; the OS only pages in the parts that are accessed
+struct mapped_file_t {
+	char const *data=nullptr;
+	size_t size=0;
+#ifdef _WIN32
+	HANDLE file=INVALID_HANDLE_VALUE, mapping=nullptr;
+#endif
+
+	bool open(string const &fn) {
+		assert(data == nullptr);
+#ifdef _WIN32
+		file = CreateFileA(fn.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE) return 0;
+		LARGE_INTEGER fsize;
+		if (!GetFileSizeEx(file, &fsize) || fsize.QuadPart == 0) return 0;
+		size    = (size_t)fsize.QuadPart;
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping == nullptr) return 0;
+		data = (char const *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+		int const fd(::open(fn.c_str(), O_RDONLY));
+		if (fd < 0) return 0;
+		struct stat sb;
+		
+		if (fstat(fd, &sb) == 0 && sb.st_size > 0) {
+			size = (size_t)sb.st_size;
+			void *const ptr(mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0));
+			if (ptr != MAP_FAILED) {data = (char const *)ptr;}
+		}
+		close(fd); // the mapping stays valid after the file is closed
+#endif
+		return (data != nullptr);
+	}
+	~mapped_file_t() {
+#ifdef _WIN32
+		if (data) {UnmapViewOfFile(data);}
+		if (mapping) {CloseHandle(mapping);}
+		if (file != INVALID_HANDLE_VALUE) {CloseHandle(file);}
+#else
+		if (data) {munmap((void *)data, size);}
+#endif
+	}
+};
+
+// allows the istream read() functions to read directly from a mapped file range without another copy
+struct mem_streambuf_t : public std::streambuf {
+	mem_streambuf_t(char const *data, size_t size) {
+		char *const ptr(const_cast<char *>(data)); // read only
+		setg(ptr, ptr, ptr+size);
+	}
+};
+
+// model3d v2 file format: header, then sections starting at MODEL3D_V2_ALIGN byte offsets for the unbound geometry
+// and each material's header and geometry, then a table of contents of section offsets at toc_offset
+struct model3d_v2_header_t {
+	unsigned magic=MAGIC_NUMBER_V2, version=MODEL3D_V2_VERSION, num_mats=0, pad=0;
+	cube_t bcube;
+	uint64_t unbound_offset=0, unbound_size=0, toc_offset=0;
+};
+struct model3d_v2_mat_entry_t {
+	uint64_t hdr_offset=0, hdr_size=0, geom_offset=0, geom_size=0;
+	float avg_area_per_tri=0.0, tot_tri_area=0.0; // cached so that LOD culling doesn't need to load the geometry
+	unsigned verts=0, tris=0, quads=0, blocks=0; // cached so that model stats don't need to load the geometry
+};
+
+
 // ************ vntc_vect_t/indexed_vntc_vect_t ************
 
 // explicit template instantiations of vert_norm case, used for voxel_model, where tc=0.0
@@ -1270,6 +1349,7 @@ template<typename T> void update_score(vntc_vect_block_t<T> const &v, float &sco
 void material_t::compute_area_per_tri() {
 
 	if (avg_area_per_tri > 0) return; // already computed
+	if (!is_geom_loaded()) return; // lazily loaded, and the value wasn't cached in the file; leave at zero, which disables LOD culling
 	unsigned tris(0);
 	tot_tri_area = 0;
 	geom    .calc_area(tot_tri_area, tris);
@@ -1279,11 +1359,13 @@ void material_t::compute_area_per_tri() {
 }
 
 void material_t::simplify_indices(float reduce_target) {
+	ensure_geom_loaded();
 	geom    .simplify_indices(reduce_target);
 	geom_tan.simplify_indices(reduce_target);
 }
 
 void material_t::reverse_winding_order() {
+	ensure_geom_loaded();
 	geom    .reverse_winding_order();
 	geom_tan.reverse_winding_order();
 }
@@ -1351,8 +1433,9 @@ void texture_manager::bind_texture_tu_or_white_tex(int tid, unsigned tu_id) cons
 void material_t::render(shader_t &shader, texture_manager const &tmgr, int default_tid, bool is_shadow_pass,
 	bool is_z_prepass, int enable_alpha_mask, bool is_bmap_pass, point const *const xlate, bool no_set_min_alpha)
 {
-	if (empty() || skip || alpha == 0.0) return; // empty or transparent
+	if (skip || alpha == 0.0) return; // transparent
 	if (is_shadow_pass && alpha < MIN_SHADOW_ALPHA) return;
+	if (!is_geom_loaded() || empty()) return; // lazily loaded geometry is paged in by model3d::bind_all_used_tids()
 
 	if (draw_order_score == 0) {
 		unsigned num_nonempty(0);
@@ -1484,18 +1567,56 @@ bool material_t::add_poly(polygon_t const &poly, vntc_map_t vmap[2], vntct_map_t
 }
 
 
-bool material_t::write(ostream &out) const {
+void material_t::write_header(ostream &out) const {
 	out.write((char const *)this, sizeof(material_params_t));
 	write_vector(out, name);
 	write_vector(out, filename);
-	return (geom.write(out) && geom_tan.write(out));
 }
 
-bool material_t::read(istream &in) {
+void material_t::read_header(istream &in) {
 	in.read((char *)this, sizeof(material_params_t));
 	read_vector(in, name);
 	read_vector(in, filename);
-	return (geom.read(in) && geom_tan.read(in));
+}
+
+bool material_t::write(ostream &out) const {
+	write_header(out);
+	return write_geom(out);
+}
+
+bool material_t::read(istream &in) {
+	read_header(in);
+	return read_geom(in);
+}
+
+bool material_t::ensure_geom_loaded() {
+	if (is_geom_loaded()) return 1;
+	if (lazy_geom_error) return 0; // already reported
+	assert(lazy_geom_offset + lazy_geom_size <= lazy_geom_src->size);
+	mem_streambuf_t buf((lazy_geom_src->data + lazy_geom_offset), lazy_geom_size);
+	istream in(&buf);
+
+	if (!read_geom(in) || !in.good()) {
+		cerr << "Error reading geometry for model3d material " << name << endl;
+		geom.clear();
+		geom_tan.clear();
+		lazy_geom_error = 1; // keep lazy_geom_src so that the material is still treated as unloaded
+		return 0;
+	}
+	lazy_geom_src.reset(); // the file is unmapped once all materials have been loaded
+	return 1;
+}
+
+void material_t::get_geom_stats(model3d_stats_t &stats) const {
+	if (!is_geom_loaded()) { // use the cached values
+		stats.verts  += lazy_geom_stats.verts;
+		stats.tris   += lazy_geom_stats.tris;
+		stats.quads  += lazy_geom_stats.quads;
+		stats.blocks += lazy_geom_stats.blocks;
+		return;
+	}
+	geom    .get_stats(stats);
+	geom_tan.get_stats(stats);
 }
 
 bool material_t::write_to_obj_file(ostream &out, unsigned &cur_vert_ix) const {
@@ -1596,6 +1717,7 @@ void model3d::get_transformed_bcubes(vector<cube_t> &bcubes) const {
 
 void model3d::get_polygons(vector<coll_tquad> &polygons, bool quads_only, bool apply_transforms, unsigned lod_level) const {
 
+	load_all_lazy_geom();
 	unsigned const start_pix(polygons.size());
 
 	if (start_pix == 0) { // Note: we count quads as 1.5 polygons because some of them may be split into triangles
@@ -1691,6 +1813,7 @@ template<typename T> unsigned add_polygons_to_voxel_grid(vector<coll_tquad> &pol
 // Note: ignores model transforms, which is why xf is passed in
 void model3d::get_cubes(vector<cube_t> &cubes, model3d_xform_t const &xf) const {
 
+	load_all_lazy_geom();
 	RESET_TIME;
 	float const spacing(xf.voxel_spacing);
 	assert(spacing > 0.0);
@@ -1855,6 +1978,7 @@ void model3d::mark_mat_as_used(int mat_id) {
 
 void model3d::finalize() {
 
+	load_all_lazy_geom();
 #pragma omp parallel for schedule(dynamic)
 	for (int i = 0; i < (int)materials.size(); ++i) {materials[i].finalize();}
 	unbound_geom.finalize();
@@ -1918,6 +2042,7 @@ void model3d::bind_all_used_tids() {
 		
 	for (deque<material_t>::iterator m = materials.begin(); m != materials.end(); ++m) {
 		if (!m->mat_is_used()) continue;
+		m->ensure_geom_loaded(); // page in lazily loaded geometry here rather than in the draw call, and before checking for tangents below
 		m->check_for_tc_invert_y(tmgr);
 		tmgr.ensure_tid_bound(m->get_render_texture()); // only one tid for now
 		
@@ -2526,8 +2651,7 @@ void model3d::get_stats(model3d_stats_t &stats) const {
 	unbound_geom.get_stats(stats);
 	
 	for (deque<material_t>::const_iterator m = materials.begin(); m != materials.end(); ++m) {
-		m->geom.get_stats(stats);
-		m->geom_tan.get_stats(stats);
+		m->get_geom_stats(stats);
 		++stats.mats;
 	}
 }
@@ -2550,6 +2674,7 @@ void model3d::show_stats() const {
 
 bool model3d::write_to_disk(string const &fn) const { // as model3d file; Note: transforms not written
 
+	if (!load_all_lazy_geom()) return 0; // error already reported
 	ofstream out(fn, ios::out | ios::binary);
 	
 	if (!out.good()) {
@@ -2557,6 +2682,11 @@ bool model3d::write_to_disk(string const &fn) const { // as model3d file; Note:
 		return 0;
 	}
 	cout << "Writing model3d file " << fn << endl;
+	return (write_model3d_v2 ? write_to_disk_v2(out) : write_to_disk_v1(out));
+}
+
+bool model3d::write_to_disk_v1(ostream &out) const {
+
 	write_uint(out, MAGIC_NUMBER);
 	out.write((char const *)&bcube, sizeof(cube_t));
 	if (!unbound_geom.write(out)) return 0;
@@ -2571,6 +2701,53 @@ bool model3d::write_to_disk(string const &fn) const { // as model3d file; Note:
 	return out.good();
 }
 
+static uint64_t align_file_pos(ostream &out) { // pad to the next section boundary and return the new position
+	uint64_t const pos(out.tellp()), aligned_pos(MODEL3D_V2_ALIGN*((pos + MODEL3D_V2_ALIGN - 1)/MODEL3D_V2_ALIGN));
+	char const zeros[MODEL3D_V2_ALIGN] = {};
+	out.write(zeros, (std::streamsize)(aligned_pos - pos));
+	return aligned_pos;
+}
+
+bool model3d::write_to_disk_v2(ostream &out) const {
+
+	model3d_v2_header_t header;
+	vector<model3d_v2_mat_entry_t> toc(materials.size());
+	header.num_mats = materials.size();
+	header.bcube    = bcube;
+	out.write((char const *)&header, sizeof(header)); // placeholder, rewritten at the end
+	header.unbound_offset = align_file_pos(out);
+	if (!unbound_geom.write(out)) return 0;
+	header.unbound_size = uint64_t(out.tellp()) - header.unbound_offset;
+
+	for (unsigned i = 0; i < materials.size(); ++i) {
+		material_t const &m(materials[i]);
+		model3d_v2_mat_entry_t &e(toc[i]);
+		e.hdr_offset = align_file_pos(out);
+		m.write_header(out);
+		e.hdr_size    = uint64_t(out.tellp()) - e.hdr_offset;
+		e.geom_offset = align_file_pos(out);
+
+		if (!m.write_geom(out)) {
+			cerr << "Error writing material " << m.name << endl;
+			return 0;
+		}
+		e.geom_size        = uint64_t(out.tellp()) - e.geom_offset;
+		e.avg_area_per_tri = m.avg_area_per_tri;
+		e.tot_tri_area     = m.tot_tri_area;
+		model3d_stats_t stats;
+		m.get_geom_stats(stats);
+		e.verts  = stats.verts;
+		e.tris   = stats.tris;
+		e.quads  = stats.quads;
+		e.blocks = stats.blocks;
+	} // for i
+	header.toc_offset = align_file_pos(out);
+	if (!toc.empty()) {out.write((char const *)toc.data(), toc.size()*sizeof(model3d_v2_mat_entry_t));}
+	out.seekp(0);
+	out.write((char const *)&header, sizeof(header));
+	return out.good();
+}
+
 
 bool model3d::read_from_disk(string const &fn) { // as model3d file; Note: transforms not read
 
@@ -2583,6 +2760,10 @@ bool model3d::read_from_disk(string const &fn) { // as model3d file; Note: trans
 	clear(); // may not be needed
 	unsigned const magic_number_comp(read_uint(in));
 
+	if (magic_number_comp == MAGIC_NUMBER_V2) {
+		in.close();
+		return read_from_disk_v2(fn);
+	}
 	if (magic_number_comp != MAGIC_NUMBER) {
 		cerr << "Error reading model3d file " << fn << ": Invalid file format (magic number check failed)." << endl;
 		return 0;
@@ -2604,8 +2785,71 @@ bool model3d::read_from_disk(string const &fn) { // as model3d file; Note: trans
 	return in.good();
 }
 
+// reads from a memory mapped file; if model3d_lazy_load=1, material geometry is left in the file until first drawn or otherwise needed
+bool model3d::read_from_disk_v2(string const &fn) {
+
+	std::shared_ptr<mapped_file_t> file(new mapped_file_t);
+	
+	if (!file->open(fn) || file->size < sizeof(model3d_v2_header_t)) {
+		cerr << "Error mapping model3d file for read: " << fn << endl;
+		return 0;
+	}
+	model3d_v2_header_t header;
+	memcpy(&header, file->data, sizeof(header));
+	uint64_t const toc_end(header.toc_offset + uint64_t(header.num_mats)*sizeof(model3d_v2_mat_entry_t));
+
+	if (header.version != MODEL3D_V2_VERSION || toc_end > file->size || header.unbound_offset + header.unbound_size > file->size) {
+		cerr << "Error reading model3d file " << fn << ": Invalid v2 file header or table of contents." << endl;
+		return 0;
+	}
+	cout << "Reading model3d file " << fn << (model3d_lazy_load ? " (lazy)" : "") << endl;
+	from_model3d_file = 1;
+	bcube = header.bcube;
+	vector<model3d_v2_mat_entry_t> toc(header.num_mats);
+	if (!toc.empty()) {memcpy(toc.data(), (file->data + header.toc_offset), toc.size()*sizeof(model3d_v2_mat_entry_t));}
+	{
+		mem_streambuf_t buf((file->data + header.unbound_offset), header.unbound_size);
+		istream in(&buf);
+		if (!unbound_geom.read(in) || !in.good()) return 0;
+	}
+	materials.resize(header.num_mats);
+
+	for (unsigned i = 0; i < materials.size(); ++i) {
+		material_t &m(materials[i]);
+		model3d_v2_mat_entry_t const &e(toc[i]);
+
+		if (e.hdr_offset + e.hdr_size > file->size || e.geom_offset + e.geom_size > file->size) {
+			cerr << "Error reading model3d file " << fn << ": Invalid material section offset." << endl;
+			return 0;
+		}
+		mem_streambuf_t buf((file->data + e.hdr_offset), e.hdr_size);
+		istream in(&buf);
+		m.read_header(in);
+		if (!in.good()) {cerr << "Error reading material" << endl; return 0;}
+		m.avg_area_per_tri = e.avg_area_per_tri;
+		m.tot_tri_area     = e.tot_tri_area;
+		m.lazy_geom_stats.verts  = e.verts;
+		m.lazy_geom_stats.tris   = e.tris;
+		m.lazy_geom_stats.quads  = e.quads;
+		m.lazy_geom_stats.blocks = e.blocks;
+		m.lazy_geom_src    = file;
+		m.lazy_geom_offset = e.geom_offset;
+		m.lazy_geom_size   = e.geom_size;
+		if (!model3d_lazy_load && !m.ensure_geom_loaded()) return 0;
+		mat_map[m.name] = i;
+	} // for i
+	return 1;
+}
+
+bool model3d::load_all_lazy_geom() const { // logically const, since geometry is only moved from the mapped file into memory
+	bool ret(1);
+	for (material_t const &m : materials) {ret &= const_cast<material_t &>(m).ensure_geom_loaded();}
+	return ret;
+}
+
 bool model3d::write_as_obj_file(string const &fn) {
 
+	if (!load_all_lazy_geom()) return 0; // error already reported
 	ofstream out(fn, ios::out);
 
 	if (!out.good()) {
@@ -17,6 +17,7 @@
 using namespace std;
 
 typedef map<string, unsigned> string_map_t;
+struct mapped_file_t; // forward declaration
 
 unsigned const MAX_VMAP_SIZE     = (1 << 18); // 256K
 unsigned const BUILTIN_TID_START = (1 << 16); // 65K
@@ -493,9 +494,17 @@ struct material_t : public material_params_t {
 
 	geometry_t<vert_norm_tc> geom;
 	geometry_t<vert_norm_tc_tan> geom_tan;
+	// for lazily loaded model3d v2 files: the mapped file and location of this material's geometry; cleared once the geometry is read
+	std::shared_ptr<mapped_file_t> lazy_geom_src;
+	uint64_t lazy_geom_offset=0, lazy_geom_size=0;
+	model3d_stats_t lazy_geom_stats; // geometry stats from the file, used until the geometry is loaded
+	bool lazy_geom_error=0; // set if reading the geometry failed; the source is kept so that the material is never drawn
 
 	material_t(string const &name_="", string const &fn="") : name(name_), filename(fn) {}
-	bool empty() const {return (geom.empty() && geom_tan.empty());}
+	bool empty() const {return (geom.empty() && geom_tan.empty());} // Note: true for materials that haven't been lazily loaded yet
+	bool is_geom_loaded() const {return (lazy_geom_src == nullptr);}
+	bool ensure_geom_loaded();
+	void get_geom_stats(model3d_stats_t &stats) const;
 	mesh_bone_data_t &get_bone_data_for_last_added_tri_mesh();
 	unsigned add_triangles(vector<vert_norm_tc> const &verts, vector<unsigned> const &indices, bool add_new_block); // Note: no quads or tangents
 	bool add_poly(polygon_t const &poly, vntc_map_t vmap[2], vntct_map_t vmap_tan[2], unsigned obj_id=0);
@@ -522,6 +531,10 @@ struct material_t : public material_params_t {
 	colorRGBA get_avg_color(texture_manager const &tmgr, int default_tid=-1) const;
 	bool write(ostream &out) const;
 	bool read(istream &in);
+	void write_header(ostream &out) const;
+	void read_header(istream &in);
+	bool write_geom(ostream &out) const {return (geom.write(out) && geom_tan.write(out));}
+	bool read_geom (istream &in) {return (geom.read(in) && geom_tan.read(in));}
 	bool write_to_obj_file(ostream &out, unsigned &cur_vert_ix) const;
 	void write_mtllib_entry(ostream &out, texture_manager const &tmgr) const;
 };
@@ -580,6 +593,10 @@ class model3d {
 
 	void update_bbox(polygon_t const &poly);
 	void create_indir_texture();
+	bool load_all_lazy_geom() const;
+	bool write_to_disk_v1(ostream &out) const;
+	bool write_to_disk_v2(ostream &out) const;
+	bool read_from_disk_v2(string const &fn);
 public:
 	texture_manager &tmgr; // stores all textures
 	model_anim_t model_anim_data;
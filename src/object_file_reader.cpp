@@ -12,6 +12,8 @@
 #include "fast_atof.h"
 
 
+bool parallel_obj_file_parse(1); // parse object files in parallel chunks
+
 extern bool use_obj_file_bump_grayscale, model_calc_tan_vect, enable_model_animations;
 extern float model_auto_tc_scale, model_mat_lod_thresh;
 extern model3ds all_models;
@@ -193,6 +195,142 @@ public:
 };
 
 
+// parsed records of one line-aligned chunk of an object file; filled in by parallel threads, then applied to the model in file order
+struct obj_face_vert_t {
+	int vix=0, tix=0, nix=0; // raw indices from the file, normalized later when the number of preceding verts/tcs/normals is known
+	bool has_tix=0, has_nix=0;
+};
+struct obj_record_t {
+	uint8_t type=0, sub=0; // sub is the color_ret for vertices and the error type for errors
+	unsigned num=0; // number of face verts or smoothing group
+	obj_record_t(uint8_t type_, unsigned num_=0, uint8_t sub_=0) : type(type_), sub(sub_), num(num_) {}
+};
+enum {OBJ_REC_V=0, OBJ_REC_VT, OBJ_REC_VN, OBJ_REC_F, OBJ_REC_O, OBJ_REC_G, OBJ_REC_S, OBJ_REC_USEMTL, OBJ_REC_MTLLIB, OBJ_REC_UNDEF, OBJ_REC_IGNORE, OBJ_REC_EMPTY, OBJ_REC_ERROR, OBJ_REC_END};
+enum {OBJ_ERR_V=0, OBJ_ERR_VCOLOR, OBJ_ERR_VT, OBJ_ERR_VN, OBJ_ERR_SGROUP};
+
+struct obj_file_chunk_t {
+	size_t start=0, end=0; // range of file offsets where records in this chunk can start
+	size_t first_tok=0, stop_pos=0; // offset of the first record, and the offset where parsing stopped
+	bool ended=0; // parsing of the file stopped in this chunk, due to an error or unreadable data
+	vector<obj_record_t> recs;
+	vector<point> pts; // v, vt, and vn values, in record order
+	vector<colorRGB> colors; // vertex colors, for vertices where they were specified
+	vector<obj_face_vert_t> face_verts;
+	vector<string> strs; // o, g, usemtl, mtllib, and undefined entry names
+};
+
+class object_file_chunk_reader : public object_file_reader {
+
+	void skip_whitespace() {
+		while (file_buf_pos < file_buf_end && fast_isspace(file_buf[file_buf_pos])) {++file_buf_pos;}
+	}
+	bool add_error(obj_file_chunk_t &chunk, uint8_t err_type) {
+		chunk.recs.emplace_back(OBJ_REC_ERROR, 0, err_type);
+		chunk.ended = 1;
+		return 0;
+	}
+	// parses one record; this must consume the same characters as the serial reader did for the record so that chunks agree on their boundaries
+	bool parse_record(char const *s, obj_file_chunk_t &chunk, geom_xform_t const &xf, int recalc_normals) {
+		if (s[0] == 0) {chunk.recs.emplace_back(OBJ_REC_EMPTY);}
+		else if (s[0] == '#') { // comment
+			read_to_newline(fp); // ignore
+			chunk.recs.emplace_back(OBJ_REC_IGNORE);
+		}
+		else if (strcmp(s, "f") == 0) { // face
+			unsigned npts(0);
+			int vix(0), tix(0), nix(0);
+
+			while (read_int(vix)) { // read vertex index
+				obj_face_vert_t fv;
+				fv.vix = vix;
+				int const c(get_next_char());
+
+				if (c == '/') {
+					if (read_int(tix)) {fv.tix = tix; fv.has_tix = 1;} // read text coord index
+					int const c2(get_next_char());
+					if (c2 == '/') {if (read_int(nix)) {fv.nix = nix; fv.has_nix = 1;}} // read normal index
+					else {unget_last_char(c2);}
+				}
+				else {unget_last_char(c);}
+				chunk.face_verts.push_back(fv);
+				++npts;
+			} // end while vertex
+			chunk.recs.emplace_back(OBJ_REC_F, npts);
+		}
+		else if (strcmp(s, "v") == 0) { // vertex
+			point pos;
+			if (!read_point(pos)) return add_error(chunk, OBJ_ERR_V);
+			colorRGB color;
+			int const color_ret(read_optional_color_RGB(color));
+			if (color_ret == 2) return add_error(chunk, OBJ_ERR_VCOLOR);
+			if (color_ret == 1) {chunk.colors.push_back(color);}
+			xf.xform_pos(pos);
+			chunk.pts.push_back(pos);
+			chunk.recs.emplace_back(OBJ_REC_V, 0, color_ret);
+		}
+		else if (strcmp(s, "vt") == 0) { // tex coord
+			point tc3d;
+			if (!read_point(tc3d, 2)) return add_error(chunk, OBJ_ERR_VT);
+			chunk.pts.push_back(tc3d);
+			chunk.recs.emplace_back(OBJ_REC_VT);
+		}
+		else if (strcmp(s, "vn") == 0) { // normal
+			vector3d normal;
+			if (!read_point(normal)) return add_error(chunk, OBJ_ERR_VN);
+
+			if (recalc_normals) {chunk.recs.emplace_back(OBJ_REC_IGNORE);} // normal is unused
+			else {
+				xf.xform_pos_rm(normal);
+				chunk.pts.push_back(normal);
+				chunk.recs.emplace_back(OBJ_REC_VN);
+			}
+		}
+		else if (strcmp(s, "l") == 0) { // line
+			read_to_newline(fp); // ignore
+			chunk.recs.emplace_back(OBJ_REC_IGNORE);
+		}
+		else if (strcmp(s, "o") == 0 || strcmp(s, "g") == 0 || strcmp(s, "usemtl") == 0 || strcmp(s, "mtllib") == 0) {
+			chunk.strs.emplace_back();
+			read_str_to_newline(fp, chunk.strs.back());
+			chunk.recs.emplace_back((s[0] == 'o') ? OBJ_REC_O : ((s[0] == 'g') ? OBJ_REC_G : ((s[0] == 'u') ? OBJ_REC_USEMTL : OBJ_REC_MTLLIB)));
+		}
+		else if (strcmp(s, "s") == 0) { // smoothing/shading (off/on or 0/1)
+			unsigned smoothing_group(0);
+
+			if (!read_uint(smoothing_group)) {
+				char off_str[MAX_CHARS];
+				if (!read_string(off_str, MAX_CHARS) || strcmp(off_str, "off") != 0) return add_error(chunk, OBJ_ERR_SGROUP);
+				smoothing_group = 0;
+			}
+			chunk.recs.emplace_back(OBJ_REC_S, smoothing_group);
+		}
+		else {
+			chunk.strs.push_back(s);
+			read_to_newline(fp); // ignore this line
+			chunk.recs.emplace_back(OBJ_REC_UNDEF);
+		}
+		return 1;
+	}
+public:
+	object_file_chunk_reader(string const &fn) : object_file_reader(fn) {}
+
+	void parse(char *data, size_t data_len, obj_file_chunk_t &chunk, geom_xform_t const &xf, int recalc_normals) {
+		read_from_memory(data, chunk.start, data_len); // records that start in this chunk may read past its end
+		char s[MAX_CHARS];
+		skip_whitespace();
+		chunk.first_tok = file_buf_pos;
+
+		while (1) {
+			skip_whitespace(); // read_string() would skip this anyway
+			if (file_buf_pos >= chunk.end) break; // next record belongs to the next chunk
+			if (!read_string(s, MAX_CHARS)) {chunk.recs.emplace_back(OBJ_REC_END); chunk.ended = 1; break;} // the serial reader stops here
+			if (!parse_record(s, chunk, xf, recalc_normals)) break; // error
+		}
+		chunk.stop_pos = file_buf_pos;
+	}
+};
+
+
 // ************************************************
 
 
@@ -493,10 +631,66 @@ public:
 		return 1;
 	}
 
-	bool read(geom_xform_t const &xf, int recalc_normals, bool verbose) {
+	bool read_file_to_memory(vector<char> &data) {
 		if (!open_file(1)) return 0; // binary mode is faster
+		size_t const block_size(1 << 24); // 16MB
+
+		while (1) { // read in blocks, since the file size isn't known
+			size_t const pos(data.size());
+			data.resize(pos + block_size);
+			size_t const num_read(fread((data.data() + pos), 1, block_size, fp));
+			data.resize(pos + num_read);
+			if (num_read < block_size) break; // end of file
+		}
+		close_file();
+		return 1;
+	}
+
+	// split the file into line-aligned chunks and parse them in parallel
+	void parse_file_chunks(vector<char> &data, geom_xform_t const &xf, int recalc_normals, vector<obj_file_chunk_t> &chunks) const {
+		size_t const min_chunk_size(1 << 22); // 4MB
+		unsigned num_chunks(1);
+		if (parallel_obj_file_parse) {num_chunks = max(1U, (unsigned)min(data.size()/min_chunk_size, size_t(4*omp_get_max_threads_3dw())));}
+		chunks.clear();
+		chunks.resize(num_chunks);
+		size_t pos(0);
+
+		for (unsigned i = 0; i < num_chunks; ++i) {
+			chunks[i].start = pos;
+
+			if (i+1 == num_chunks) {pos = data.size();}
+			else {
+				pos = max(pos, (i+1)*data.size()/num_chunks);
+				while (pos < data.size() && data[pos-1] != '\n') {++pos;} // end at a line boundary
+			}
+			chunks[i].end = pos;
+		} // for i
+#pragma omp parallel for schedule(dynamic, 1) if (num_chunks > 1)
+		for (int i = 0; i < (int)num_chunks; ++i) {
+			object_file_chunk_reader(filename).parse(data.data(), data.size(), chunks[i], xf, recalc_normals);
+		}
+		for (unsigned i = 0; i+1 < num_chunks; ++i) {
+			if (chunks[i].ended) break; // no records past this point are used
+			if (chunks[i].stop_pos == chunks[i+1].first_tok) continue; // chunks agree on their boundary
+			// a record spans multiple lines and crossed into the next chunk; reparse serially to get the same results as a single thread
+			cout << "Warning: Object file " << filename << " has records spanning multiple lines; parsing serially" << endl;
+			chunks.clear();
+			chunks.resize(1);
+			chunks[0].end = data.size();
+			object_file_chunk_reader(filename).parse(data.data(), data.size(), chunks[0], xf, recalc_normals);
+			break;
+		} // for i
+	}
+
+	bool read(geom_xform_t const &xf, int recalc_normals, bool verbose) {
+		RESET_TIME; // includes file reading time for the load rate
+		vector<char> file_data;
+		if (!read_file_to_memory(file_data)) return 0;
 		cout << "Reading object file " << filename << endl;
-		RESET_TIME;
+		double const file_size_mb(file_data.size()/double(1 << 20));
+		vector<obj_file_chunk_t> chunks;
+		parse_file_chunks(file_data, xf, recalc_normals, chunks);
+		vector<char>().swap(file_data); // free the memory
 		unsigned const block_size = (1 << 18); // 256K
 		int cur_mat_id(-1);
 		unsigned smoothing_group(0), prev_smoothing_group(0), num_faces(0), num_objects(0), num_groups(0), obj_group_id(0);
@@ -508,200 +702,171 @@ public:
 		vector<colorRGB> colors; // vertex colors
 		deque<poly_data_block> pblocks;
 		set<string> loaded_mat_libs;
-		char s[MAX_CHARS];
 		string material_name, mat_lib, group_name, object_name;
 		tc.push_back(point2d<float>(0.0, 0.0)); // default tex coords
 		n.push_back(zero_vector); // default normal
 		unsigned approx_line(0);
-		bool is_textured(0), had_npts_error(0);
-
-		while (read_string(s, MAX_CHARS)) {
-			++approx_line;
+		bool is_textured(0), had_npts_error(0), done(0);
 
-			if (s[0] == 0) {
-				cout << "empty/unparseable line?" << endl;
-				continue;
-			}
-			else if (s[0] == '#') { // comment
-				read_to_newline(fp); // ignore
-			}
-			else if (strcmp(s, "f") == 0) { // face
-				model.mark_mat_as_used(cur_mat_id);
+		for (auto ch = chunks.begin(); ch != chunks.end() && !done; ++ch) { // apply records in file order
+			unsigned pt_ix(0), color_ix(0), fv_ix(0), str_ix(0); // current index into chunk pts, colors, face_verts, and strs
+			
+			for (obj_record_t const &rec : ch->recs) {
+				if (rec.type == OBJ_REC_END) {done = 1; break;}
+				++approx_line;
 
-				if (pblocks.empty() || pblocks.back().pts.size() >= block_size || smoothing_group != prev_smoothing_group) { // create a new block
-					if (!pblocks.empty()) {
-						remove_excess_cap(pblocks.back().polys);
-						remove_excess_cap(pblocks.back().pts);
-					}
-					pblocks.push_back(poly_data_block());
-					prev_smoothing_group = smoothing_group;
+				if (rec.type == OBJ_REC_EMPTY) {
+					cout << "empty/unparseable line?" << endl;
+					continue;
 				}
-				poly_data_block &pb(pblocks.back());
-				pb.polys.push_back(poly_header_t(cur_mat_id, obj_group_id));
-				unsigned &npts(pb.polys.back().npts);
-				unsigned const pix((unsigned)pb.pts.size()), pts_start(pb.pts.size());
-				int vix(0), tix(0), nix(0);
-
-				while (read_int(vix)) { // read vertex index
-					normalize_index(vix, (unsigned)v.size());
-					vntc_ix_t vntc_ix(vix, 0, 0);
-					int const c(get_next_char());
+				else if (rec.type == OBJ_REC_IGNORE) {} // comment, line, or unused normal
+				else if (rec.type == OBJ_REC_ERROR) {
+					char const *const names[5] = {"vertex", "vertex color", "texture coord", "normal", "smoothing group"};
+					assert(rec.sub < 5);
+					cerr << "Error reading " << names[rec.sub] << " from object file " << filename << " near line " << approx_line << endl;
+					return 0;
+				}
+				else if (rec.type == OBJ_REC_F) { // face
+					model.mark_mat_as_used(cur_mat_id);
 
-					if (c == '/') {
-						if (read_int(tix)) { // read text coord index
+					if (pblocks.empty() || pblocks.back().pts.size() >= block_size || smoothing_group != prev_smoothing_group) { // create a new block
+						if (!pblocks.empty()) {
+							remove_excess_cap(pblocks.back().polys);
+							remove_excess_cap(pblocks.back().pts);
+						}
+						pblocks.push_back(poly_data_block());
+						prev_smoothing_group = smoothing_group;
+					}
+					poly_data_block &pb(pblocks.back());
+					pb.polys.push_back(poly_header_t(cur_mat_id, obj_group_id));
+					unsigned &npts(pb.polys.back().npts);
+					unsigned const pix((unsigned)pb.pts.size()), pts_start(pb.pts.size());
+
+					for (unsigned i = 0; i < rec.num; ++i) {
+						obj_face_vert_t const &fv(ch->face_verts[fv_ix++]);
+						int vix(fv.vix), tix(fv.tix), nix(fv.nix);
+						normalize_index(vix, (unsigned)v.size());
+						vntc_ix_t vntc_ix(vix, 0, 0);
+
+						if (fv.has_tix) { // read text coord index
 							normalize_index(tix, (unsigned)tc.size()-1); // account for tc[0]
 							vntc_ix.tix = tix+1; // account for tc[0]
 						}
-						int const c2(get_next_char());
-
-						if (c2 == '/') {
-							if (read_int(nix) && !recalc_normals) { // read normal index
-								normalize_index(nix, (unsigned)n.size()-1); // account for n[0]
-								vntc_ix.nix = nix+1; // account for n[0]
-							} // else the normal will be recalculated later
-						}
-						else {unget_last_char(c2);}
+						if (fv.has_nix && !recalc_normals) { // read normal index
+							normalize_index(nix, (unsigned)n.size()-1); // account for n[0]
+							vntc_ix.nix = nix+1; // account for n[0]
+						} // else the normal will be recalculated later
+						pb.pts.push_back(vntc_ix);
+						++npts;
+					} // for i
+					if (npts < 3) {
+						if (!had_npts_error) {cerr << "Error near line " << approx_line << ": face has only " << npts << " vertices." << endl; had_npts_error = 1;}
+						pb.pts.resize(pts_start);
+						pb.polys.pop_back(); // remove pts and polygon
+						continue; // skip it
 					}
-					else {unget_last_char(c);}
-					pb.pts.push_back(vntc_ix);
-					++npts;
-				} // end while vertex
-				if (npts < 3) {
-					if (!had_npts_error) {cerr << "Error near line " << approx_line << ": face has only " << npts << " vertices." << endl; had_npts_error = 1;}
-					pb.pts.resize(pts_start);
-					pb.polys.pop_back(); // remove pts and polygon
-					continue; // skip it
-				}
-				vector3d &normal(pb.polys.back().n);
+					vector3d &normal(pb.polys.back().n);
 				
-				for (unsigned i = pix; i < pix+npts-2; ++i) { // find a nonzero normal
-					normal = cross_product((v[pb.pts[i+1].vix] - v[pb.pts[i].vix]), (v[pb.pts[i+2].vix] - v[pb.pts[i].vix])); // backwards?
-					// if we disable this normalize() we will weight normal contributions by polygon area,
-					// but we have to change the code below and it causes problems with vertex uniquing
-					normal.normalize();
-					if (normal != zero_vector) break; // got a good normal
-				}
-				if (recalc_normals) {
-					bool const face_weight_avg(recalc_normals == 2 && (npts == 3 || npts == 4)); // only works for quads and triangles
-					float face_area(0.0);
-
-					if (face_weight_avg) {
-						point face_pts[4];
-						for (unsigned i = 0; i < npts; ++i) {face_pts[i] = v[pb.pts[i+pix].vix];}
-						face_area = polygon_area(face_pts, npts);
+					for (unsigned i = pix; i < pix+npts-2; ++i) { // find a nonzero normal
+						normal = cross_product((v[pb.pts[i+1].vix] - v[pb.pts[i].vix]), (v[pb.pts[i+2].vix] - v[pb.pts[i].vix])); // backwards?
+						// if we disable this normalize() we will weight normal contributions by polygon area,
+						// but we have to change the code below and it causes problems with vertex uniquing
+						normal.normalize();
+						if (normal != zero_vector) break; // got a good normal
 					}
-					for (unsigned i = pix; i < pix+npts; ++i) {
-						unsigned const vix(pb.pts[i].vix);
-						assert((unsigned)vix < vn.size());
-						bool const using_texgen(is_textured && model_auto_tc_scale > 0.0 && pb.pts[i].tix == 0);
+					if (recalc_normals) {
+						bool const face_weight_avg(recalc_normals == 2 && (npts == 3 || npts == 4)); // only works for quads and triangles
+						float face_area(0.0);
 
-						if (vn[vix].is_valid() && (using_texgen || dot_product(normal, vn[vix].get_norm()) < 0.25)) { // normals in disagreement (or using texgen)
-							vn[vix] = zero_vector; // zero it out so that it becomes invalid later
+						if (face_weight_avg) {
+							point face_pts[4];
+							for (unsigned i = 0; i < npts; ++i) {face_pts[i] = v[pb.pts[i+pix].vix];}
+							face_area = polygon_area(face_pts, npts);
+						}
+						for (unsigned i = pix; i < pix+npts; ++i) {
+							unsigned const vix(pb.pts[i].vix);
+							assert((unsigned)vix < vn.size());
+							bool const using_texgen(is_textured && model_auto_tc_scale > 0.0 && pb.pts[i].tix == 0);
+
+							if (vn[vix].is_valid() && (using_texgen || dot_product(normal, vn[vix].get_norm()) < 0.25)) { // normals in disagreement (or using texgen)
+								vn[vix] = zero_vector; // zero it out so that it becomes invalid later
+							}
+							else if (face_weight_avg) {vn[vix].add_normal(face_area*normal);} // face weighted average
+							else {vn[vix].add_normal(normal);} // unweighted average of normals
 						}
-						else if (face_weight_avg) {vn[vix].add_normal(face_area*normal);} // face weighted average
-						else {vn[vix].add_normal(normal);} // unweighted average of normals
 					}
 				}
-			}
-			else if (strcmp(s, "v") == 0) { // vertex
-				v.push_back(point());
-				if (recalc_normals) {vn.push_back(counted_normal());} // vertex normal
-			
-				if (!read_point(v.back())) {
-					cerr << "Error reading vertex from object file " << filename << " near line " << approx_line << endl;
-					return 0;
+				else if (rec.type == OBJ_REC_V) { // vertex
+					v.push_back(ch->pts[pt_ix++]); // already transformed
+					if (recalc_normals) {vn.push_back(counted_normal());} // vertex normal
+				
+					if (rec.sub == 1) { // color was specified
+						if (colors.empty()) {colors.resize(v.size()-1, WHITE);} // pad colors up to this point with white
+						colors.push_back(ch->colors[color_ix++]);
+					}
+					else if (!colors.empty()) {colors.push_back(WHITE);} // color not specified, and in colors mode, pad with white
 				}
-				colorRGB color;
-				int const color_ret(read_optional_color_RGB(color));
-				if (color_ret == 2) {cerr << "Error reading vertex color from object file " << filename << " near line " << approx_line << endl; return 0;}
-				else if (color_ret == 1) {
-					if (colors.empty()) {colors.resize(v.size()-1, WHITE);} // pad colors up to this point with white
-					colors.push_back(color);
+				else if (rec.type == OBJ_REC_VT) { // tex coord
+					point const &tc3d(ch->pts[pt_ix++]);
+					tc.push_back(point2d<float>(tc3d.x, tc3d.y)); // discard tc3d.z
 				}
-				else if (!colors.empty()) {colors.push_back(WHITE);} // color not specified, and in colors mode, pad with white
-				xf.xform_pos(v.back());
-			}
-			else if (strcmp(s, "vt") == 0) { // tex coord
-				point tc3d;
-			
-				if (!read_point(tc3d, 2)) {
-					cerr << "Error reading texture coord from object file " << filename << " near line " << approx_line << endl;
-					return 0;
+				else if (rec.type == OBJ_REC_VN) { // normal, already transformed
+					n.push_back(ch->pts[pt_ix++]);
 				}
-				tc.push_back(point2d<float>(tc3d.x, tc3d.y)); // discard tc3d.z
-			}
-			else if (strcmp(s, "vn") == 0) { // normal
-				vector3d normal;
-			
-				if (!read_point(normal)) {
-					cerr << "Error reading normal from object file " << filename << " near line " << approx_line << endl;
-					return 0;
+				else if (rec.type == OBJ_REC_O) { // object definition
+					object_name = ch->strs[str_ix++]; // can be empty?
+					++num_objects;
+					++obj_group_id;
 				}
-				if (!recalc_normals) {
-					xf.xform_pos_rm(normal);
-					n.push_back(normal);
+				else if (rec.type == OBJ_REC_G) { // group
+					group_name = ch->strs[str_ix++]; // can be empty
+					++num_groups;
+					++obj_group_id;
 				}
-			}
-			else if (strcmp(s, "l") == 0) { // line
-				read_to_newline(fp); // ignore
-			}
-			else if (strcmp(s, "o") == 0) { // object definition
-				read_str_to_newline(fp, object_name); // can be empty?
-				++num_objects;
-				++obj_group_id;
-			}
-			else if (strcmp(s, "g") == 0) { // group
-				read_str_to_newline(fp, group_name); // can be empty
-				++num_groups;
-				++obj_group_id;
-			}
-			else if (strcmp(s, "s") == 0) { // smoothing/shading (off/on or 0/1)
-				if (!read_uint(smoothing_group)) {
-					if (!read_string(s, MAX_CHARS) || strcmp(s, "off") != 0) {
-						cerr << "Error reading smoothing group from object file " << filename << " near line " << approx_line << endl;
-						return 0;
-					}
-					smoothing_group = 0;
+				else if (rec.type == OBJ_REC_S) { // smoothing/shading (off/on or 0/1)
+					smoothing_group = rec.num;
 				}
-			}
-			else if (strcmp(s, "usemtl") == 0) { // use material
-				read_str_to_newline(fp, material_name);
+				else if (rec.type == OBJ_REC_USEMTL) { // use material
+					material_name = ch->strs[str_ix++];
 
-				if (material_name.empty()) {
-					if (!had_empty_mat_error) {cerr << "Error reading material from object file " << filename << " near line " << approx_line << endl;}
-					had_empty_mat_error = 1;
-					return 0;
-				}
-				cur_mat_id = model.find_material(material_name);
+					if (material_name.empty()) {
+						if (!had_empty_mat_error) {cerr << "Error reading material from object file " << filename << " near line " << approx_line << endl;}
+						had_empty_mat_error = 1;
+						return 0;
+					}
+					cur_mat_id = model.find_material(material_name);
 				
-				if (cur_mat_id >= 0) { // material was valid
-					int const tid(model.get_material(cur_mat_id).d_tid);
-					is_textured = (tid >= 0 && model.tmgr.get_tex_avg_color(tid) != WHITE); // no texture, or all white texture
+					if (cur_mat_id >= 0) { // material was valid
+						int const tid(model.get_material(cur_mat_id).d_tid);
+						is_textured = (tid >= 0 && model.tmgr.get_tex_avg_color(tid) != WHITE); // no texture, or all white texture
+					}
 				}
-			}
-			else if (strcmp(s, "mtllib") == 0) { // material library
-				read_str_to_newline(fp, mat_lib);
+				else if (rec.type == OBJ_REC_MTLLIB) { // material library
+					mat_lib = ch->strs[str_ix++];
 
-				if (mat_lib.empty()) {
-					cerr << "Error reading material library from object file " << filename << " near line " << approx_line << endl;
-					return 0;
+					if (mat_lib.empty()) {
+						cerr << "Error reading material library from object file " << filename << " near line " << approx_line << endl;
+						return 0;
+					}
+					if (!try_load_mat_lib(mat_lib, loaded_mat_libs, approx_line)) {
+						//return 0; // nonfatal
+					}
 				}
-				if (!try_load_mat_lib(mat_lib, loaded_mat_libs, approx_line)) {
-					//return 0; // nonfatal
+				else if (rec.type == OBJ_REC_UNDEF) {
+					cerr << "Error: Undefined entry '" << ch->strs[str_ix++] << "' in object file " << filename << " near line " << approx_line << endl;
+					//return 0;
 				}
-			}
-			else {
-				cerr << "Error: Undefined entry '" << s << "' in object file " << filename << " near line " << approx_line << endl;
-				read_to_newline(fp); // ignore this line
-				//return 0;
-			}
-		} // while
+				else {assert(0);}
+			} // for rec
+			*ch = obj_file_chunk_t(); // free the memory
+		} // for ch
 		remove_excess_cap(v);
 		remove_excess_cap(n);
 		remove_excess_cap(tc);
 		remove_excess_cap(vn);
 		remove_excess_cap(colors);
 		PRINT_TIME("Object File Load");
+		cout << "Object file load rate: " << file_size_mb << " MB in " << chunks.size() << " chunk(s) at " << 1000.0*file_size_mb/max(GET_DELTA_TIME, 1) << " MB/s" << endl;
 		model.load_all_used_tids(); // need to load the textures here to get the colors
 		size_t const num_blocks(pblocks.size());
 		model3d::proc_model_normals(vn, recalc_normals); // if recalc_normals
@@ -775,6 +940,7 @@ bool write_model3d_file(string const &base_fn, model3d &cur_model) {
 	string out_fn(base_fn.begin(), base_fn.end()-4); // strip off the '.obj'
 	out_fn += ".model3d";
 	if (model_calc_tan_vect) {cur_model.calc_tangent_vectors();} // tangent vectors are needed for writing
+	cur_model.compute_area_per_tri(); // cached in the model3d file so that lazy loading doesn't need the geometry for LOD culling
 				
 	if (!cur_model.write_to_disk(out_fn)) {
 		cerr << "Error writing model3d file " << out_fn << endl;
@@ -213,24 +213,28 @@ class city_cube_nav_grid_manager {
 	vector<city_cube_nav_grid> plot_grids[2][2]; // {normal, with blocked interior} x {male, female}
 public:
 	// assumes a constant radius, even though the radius varies slightly between men and women
+	// grids are allocated up front rather than in find_path() so that they aren't resized by multiple threads
+	void alloc_grids(unsigned num_plots) {
+		for (unsigned g = 0; g < 4; ++g) {
+			vector<city_cube_nav_grid> &grids(plot_grids[g>>1][g&1]);
+			if (grids.size() != num_plots) {grids.clear(); grids.resize(num_plots);}
+		}
+	}
+	// Note: thread safe as long as no two threads use the same plot
 	bool find_path(cube_t const &plot_bcube, vect_cube_t const &blockers, float radius, bool is_female, unsigned plot_ix,
-		point const &p1, point const &p2, ped_manager_t &ped_mgr, int dest_building, shader_t *s=nullptr)
+		point const &p1, point const &p2, ai_path_t &path, int dest_building, shader_t *s=nullptr)
 	{
-		unsigned const num_plots(ped_mgr.get_tot_num_plots());
-		assert(plot_ix < num_plots);
 		assert(p1.z == p2.z); // must be horizontal
 		// assume the plot blocker is first and at least half the area of the plot
 		bool const has_blocked_interior(!blockers.empty() && blockers.front().get_area_xy() > 0.5*plot_bcube.get_area_xy());
 		vector<city_cube_nav_grid> &grids(plot_grids[has_blocked_interior][is_female]);
-		if (grids.empty()) {grids.resize(num_plots);}
-		assert(grids.size() == num_plots);
+		assert(plot_ix < grids.size());
 		city_cube_nav_grid &grid(grids[plot_ix]);
 		grid.check_if_valid(blockers);
 		if (!grid.is_valid()) {grid.build_for_city(plot_bcube, blockers, radius);}
 		if (s != nullptr) {grid.debug_draw(*s);} // debug visualization
 		point plot_dest(p2);
 		plot_bcube.clamp_pt_xy(plot_dest); // closest point to our destination within the current plot
-		ai_path_t &path(ped_mgr.grid_path);
 		path.clear();
 		path.push_back(p1); // add the starting point
 		bool const ret(grid.find_path(p1, plot_dest, path, dest_building));
@@ -251,9 +255,17 @@ ped_manager_t::ped_manager_t(city_road_gen_t const &road_gen_, car_manager_t con
 ped_manager_t::~ped_manager_t() {} // required for city_cube_nav_grid_manager
 
 city_cube_nav_grid_manager &ped_manager_t::get_nav_grid_mgr() {
-	if (!nav_grid_mgr) {nav_grid_mgr.reset(new city_cube_nav_grid_manager);}
+	if (!nav_grid_mgr) {
+		nav_grid_mgr.reset(new city_cube_nav_grid_manager);
+		nav_grid_mgr->alloc_grids(tot_num_plots);
+	}
 	return *nav_grid_mgr;
 }
+ped_manager_t::thread_state_t &ped_manager_t::get_thread_state() {
+	unsigned const tid(in_mt_update ? omp_get_thread_num_3dw() : 0); // thread 0's state is used for serial updates
+	assert(tid < thread_state.size());
+	return thread_state[tid];
+}
 
 string person_base_t::get_name() const {
 	return person_name_gen.gen_name(ssn, is_female, 1, 1); // use ssn as name rand gen seed; include both first and last name
@@ -491,11 +503,14 @@ bool pedestrian_t::check_ped_ped_coll(ped_manager_t const &ped_mgr, vector<pedes
 
 			if (overlaps_player_in_z(player_pos)) { // check height
 				if (dist_sq < 4.0*r_sum*r_sum && is_zombie && zombies_can_target_player()) { // near collision
-					maybe_play_zombie_sound(pos, ssn); // moan
+#pragma omp critical(ped_player_interact) // may be called from multiple ped update threads
+					{
+						maybe_play_zombie_sound(pos, ssn); // moan
 
-					if (dist_sq < r_sum*r_sum) { // collision
-						uint8_t has_key(0); // final valid is unused
-						register_ai_player_coll(has_key, get_height()); // has_key=0; return value: 0=no effect, 1=player is killed, 2=this person is killed
+						if (dist_sq < r_sum*r_sum) { // collision
+							uint8_t has_key(0); // final valid is unused
+							register_ai_player_coll(has_key, get_height()); // has_key=0; return value: 0=no effect, 1=player is killed, 2=this person is killed
+						}
 					}
 				}
 				if (dist_sq < r_sum*r_sum) { // collision
@@ -852,7 +867,7 @@ point pedestrian_t::get_dest_pos(cube_t const &plot_bcube, cube_t const &next_pl
 	return pos; // no dest
 }
 
-bool pedestrian_t::choose_alt_next_plot(ped_manager_t const &ped_mgr) {
+bool pedestrian_t::choose_alt_next_plot(ped_manager_t &ped_mgr) {
 	reset_waiting(); // reset waiting state regardless of outcome; we don't want to get here every frame if we fail to find another plot
 	if (plot == next_plot) return 0; // no next plot (error?)
 	//if (next_plot == dest_plot) return 0; // the next plot is our desination, should we still choose another plot?
@@ -874,7 +889,7 @@ cube_t get_plot_coll_region(cube_t const &plot_bcube) {
 }
 
 void pedestrian_t::get_avoid_cubes(ped_manager_t const &ped_mgr, vect_cube_t const &colliders, cube_t const &plot_bcube,
-	cube_t const &next_plot_bcube, point &dest_pos, vect_cube_t &avoid, bool &in_illegal_area, bool &avoid_entire_plot) const
+	cube_t const &next_plot_bcube, point &dest_pos, vect_cube_t &avoid, vect_cube_t &car_bcubes, bool &in_illegal_area, bool &avoid_entire_plot) const
 {
 	avoid.clear();
 	float const height(get_height()), expand(1.1*radius); // slightly larger than radius to leave some room for floating-point error
@@ -882,7 +897,6 @@ void pedestrian_t::get_avoid_cubes(ped_manager_t const &ped_mgr, vect_cube_t con
 	bool const is_home_plot(plot == dest_plot); // plot contains our destination
 	if (is_home_plot && !follow_player) {assert(plot_bcube == next_plot_bcube);} // doesn't hold when following the player?
 	cube_t const region(get_plot_coll_region(cur_plot));
-	static vect_cube_t car_bcubes; // reused across calls
 	car_bcubes.clear();
 	if (!in_the_road) {ped_mgr.get_parked_car_bcubes_for_plot(plot_bcube, city, car_bcubes);} // get collider bcubes for cars parked in house driveways
 	bool keep_cur_dest(0);
@@ -988,7 +1002,7 @@ void pedestrian_t::get_avoid_cubes(ped_manager_t const &ped_mgr, vect_cube_t con
 bool pedestrian_t::check_path_blocked(ped_manager_t &ped_mgr, point const &dest, bool check_buildings) { // Note: ped_mgr is non-const due to avoid
 	float const height(get_height()), expand(0.1*radius); // almost no expand
 	cube_t const check_area(pos, dest); // area between pos and dest
-	vect_cube_t &avoid(ped_mgr.path_finder.get_avoid_vector());
+	vect_cube_t &avoid(ped_mgr.get_path_finder().get_avoid_vector());
 	avoid.clear();
 	if (check_buildings) {get_building_bcubes(check_area, avoid);}
 	road_plot_t const &cur_plot(ped_mgr.get_city_plot_for_peds(city, plot));
@@ -1093,23 +1107,25 @@ void pedestrian_t::move(ped_manager_t const &ped_mgr, cube_t const &plot_bcube,
 
 void pedestrian_t::run_path_finding(ped_manager_t &ped_mgr, cube_t const &plot_bcube, cube_t const &next_plot_bcube, vect_cube_t const &colliders, vector3d &dest_pos) {
 	bool in_illegal_area(0), avoid_entire_plot(0), found_path(0), full_path(0);
-	vect_cube_t &avoid(ped_mgr.path_finder.get_avoid_vector());
-	get_avoid_cubes(ped_mgr, colliders, plot_bcube, next_plot_bcube, dest_pos, avoid, in_illegal_area, avoid_entire_plot);
+	path_finder_t &path_finder(ped_mgr.get_path_finder());
+	ai_path_t &grid_path(ped_mgr.get_grid_path());
+	vect_cube_t &avoid(path_finder.get_avoid_vector());
+	get_avoid_cubes(ped_mgr, colliders, plot_bcube, next_plot_bcube, dest_pos, avoid, ped_mgr.get_thread_state().car_bcubes, in_illegal_area, avoid_entire_plot);
 
 	for (unsigned attempt = 0; attempt < 2; ++attempt) { // make two attempts using two different path finding algorithms
 		if (using_nav_grid) { // use nav grid; partial paths are not possible
 			int const bix(has_dest_bldg ? (int)dest_bldg : -1);
 			city_cube_nav_grid_manager &nav_grid_mgr(ped_mgr.get_nav_grid_mgr());
-			found_path = full_path = nav_grid_mgr.find_path(plot_bcube, avoid, radius, is_female, plot, pos, dest_pos, ped_mgr, bix);
-			if (found_path) {assert(!ped_mgr.grid_path.empty()); dest_pos = ped_mgr.grid_path.front();}
+			found_path = full_path = nav_grid_mgr.find_path(plot_bcube, avoid, radius, is_female, plot, pos, dest_pos, grid_path, bix);
+			if (found_path) {assert(!grid_path.empty()); dest_pos = grid_path.front();}
 		}
 		else { // run path finding between pos and dest_pos using avoid cubes
 			cube_t union_plot_bcube(plot_bcube);
 			union_plot_bcube.union_with_cube(next_plot_bcube); // this is the area the ped is constrained to (both plots + road in between)
 			// return values: 0=failed, 1=valid path, 2=init contained, 3=straight path (no collisions)
-			unsigned const ret(ped_mgr.path_finder.run(pos, dest_pos, target_pos, union_plot_bcube, PATH_GAP_FACTOR*radius, dest_pos));
+			unsigned const ret(path_finder.run(pos, dest_pos, target_pos, union_plot_bcube, PATH_GAP_FACTOR*radius, dest_pos));
 			found_path = (ret > 0);
-			full_path  = (ret == 3 || ped_mgr.path_finder.found_complete_path());
+			full_path  = (ret == 3 || path_finder.found_complete_path());
 		}
 		if (full_path) break; // success
 		if (attempt == 0) {using_nav_grid ^= 1;} // switch path finding algorithm and try again
@@ -1203,7 +1219,10 @@ void pedestrian_t::next_frame(ped_manager_t &ped_mgr, vector<pedestrian_t> &peds
 					if (!check_path_blocked(ped_mgr, player_pos, check_buildings)) { // check fences, walls, hedges, trees, etc.
 						next_follow_player = 1;
 						dest_pos = point(player_pos.x, player_pos.y, pos.z);
-						if (!follow_player) {maybe_play_zombie_sound(pos, ssn);} // moan if newly following the player
+						if (!follow_player) { // moan if newly following the player
+#pragma omp critical(ped_player_interact)
+							maybe_play_zombie_sound(pos, ssn);
+						}
 					}
 				}
 			}
@@ -1426,6 +1445,10 @@ void ped_manager_t::init(unsigned num_city) {
 	} // for n
 	cout << "City Pedestrians: " << peds.size() << endl; // TESTING
 	sort_by_city_and_plot();
+	publish_ped_snapshot();
+	thread_state.resize(max(1, omp_get_max_threads_3dw()));
+	// ped update is run on one thread of the city update parallel section, so nested parallelism is required to use the other threads
+	if (city_params.ped_update_mt || city_params.ped_update_timing) {omp_enable_nested_3dw();}
 }
 
 void ped_manager_t::assign_ped_model(person_base_t &ped) { // Note: non-const, modifies rgen
@@ -1576,9 +1599,9 @@ void ped_manager_t::remove_destroyed_peds() {
 	ped_destroyed = 0;
 }
 
-void ped_manager_t::register_ped_new_plot(pedestrian_t const &ped) {
-	if (!need_to_sort_city.empty()) {need_to_sort_city[ped.city] = 1;}
-	need_to_sort_peds = 1;
+void ped_manager_t::register_ped_new_plot(pedestrian_t const &ped) { // deferred until commit_deferred_ped_updates()
+	vector<unsigned> &cities_to_sort(get_thread_state().cities_to_sort);
+	if (cities_to_sort.empty() || cities_to_sort.back() != ped.city) {cities_to_sort.push_back(ped.city);}
 }
 void ped_manager_t::move_ped_to_next_plot(pedestrian_t &ped) {
 	if (ped.next_plot == ped.plot) return; // already there (error?)
@@ -1586,18 +1609,26 @@ void ped_manager_t::move_ped_to_next_plot(pedestrian_t &ped) {
 	register_ped_new_plot(ped);
 }
 
+void ped_manager_t::update_city_peds(unsigned city, float delta_dir) {
+	unsigned const ped_start(by_city[city].ped_ix), ped_end(by_city[city+1].ped_ix);
+	assert(ped_start <= ped_end && ped_end <= peds.size());
+	rand_gen_t &city_rgen(get_thread_state().rgen);
+	city_rgen.set_state((city + 1), (frame_counter + 1)); // deterministic per city and frame, independent of which thread updates it
+	city_rgen.rand_mix();
+	// Note: ped-ped collisions only check peds in the same plot or the next plot, which are both in this city, so cities can be updated in parallel
+	for (unsigned i = ped_start; i < ped_end; ++i) {peds[i].next_frame(*this, peds, i, city_rgen, delta_dir);}
+}
+
 void ped_manager_t::next_frame() {
 	if (!animate2) return; // nothing to do (only applies to moving peds)
 	float const delta_dir(1.2*(1.0 - pow(0.7f, fticks))); // controls pedestrian turning rate
 	// Note: peds and peds_b can be processed in parallel, but that doesn't seem to make a significant difference in framerate
-	// update people in buildings first, so that it can overlap with car sort and spend less time in the modify_car_data critical section
 	update_building_ai_state(delta_dir);
 
 	if (!peds.empty()) {
 		//timer_t timer("Ped Update"); // ~4.2ms for 10K peds; 1ms for sparse per-city update
-		// Note: should make sure this is after sorting cars, so that road_ix values are actually in order; however, that makes things slower, and is unlikely to make a difference
-#pragma omp critical(modify_car_data)
-		car_manager.extract_car_data(cars_by_city);
+		// use the most recent car state published by car update; this doesn't wait for the current frame's car update to finish
+		cars_by_city = car_manager.get_car_snapshot();
 
 		if (ped_destroyed) {remove_destroyed_peds();} // at least one ped was destroyed in the previous frame - remove it/them
 		maybe_reassign_models();
@@ -1608,19 +1639,44 @@ void ped_manager_t::next_frame() {
 		if (first_frame) { // choose initial ped destinations (must be after building setup, etc.)
 			for (auto i = peds.begin(); i != peds.end(); ++i) {choose_dest_building_or_parked_car(*i);}
 		}
+		vector<unsigned> cities_to_update;
+
 		for (unsigned city = 0; city+1 < by_city.size(); ++city) {
-			if (!get_expanded_city_bcube_for_peds(city).closest_dist_less_than(camera_bs, enable_ai_dist)) continue; // too far from the player
-			unsigned const ped_start(by_city[city].ped_ix), ped_end(by_city[city+1].ped_ix);
-			assert(ped_start <= ped_end && ped_end <= peds.size());
-				
-			for (auto i = peds.begin()+ped_start; i != peds.begin()+ped_end; ++i) {
-				i->next_frame(*this, peds, (i - peds.begin()), rgen, delta_dir);
+			if (get_expanded_city_bcube_for_peds(city).closest_dist_less_than(camera_bs, enable_ai_dist)) {cities_to_update.push_back(city);} // near the player
+		}
+		// timing mode alternates between serial and parallel updates each frame
+		bool const use_mt(cities_to_update.size() > 1 && (city_params.ped_update_timing ? bool(frame_counter & 1) : city_params.ped_update_mt));
+		high_resolution_clock::time_point const start_time(high_resolution_clock::now());
+
+		if (use_mt) {
+			// process the cities with the most peds first for better load balancing
+			sort(cities_to_update.begin(), cities_to_update.end(), [this](unsigned a, unsigned b) {
+				return ((by_city[a+1].ped_ix - by_city[a].ped_ix) > (by_city[b+1].ped_ix - by_city[b].ped_ix));});
+			get_nav_grid_mgr(); // must be created serially
+			unsigned const num_threads(min(cities_to_update.size(), thread_state.size()));
+			in_mt_update = 1;
+#pragma omp parallel for schedule(dynamic,1) num_threads(num_threads)
+			for (int i = 0; i < (int)cities_to_update.size(); ++i) {update_city_peds(cities_to_update[i], delta_dir);}
+			in_mt_update = 0;
+		}
+		else {
+			for (unsigned city : cities_to_update) {update_city_peds(city, delta_dir);}
+		}
+		commit_deferred_ped_updates();
+
+		if (city_params.ped_update_timing) {
+			update_time[use_mt] += 1000.0*duration_cast<duration<double>>(high_resolution_clock::now() - start_time).count(); // in ms
+			++num_timed_updates[use_mt];
+
+			if (num_timed_updates[0] >= 256 && num_timed_updates[1] >= 256) {
+				cout << "Ped update time for " << cities_to_update.size() << " cities: serial " << update_time[0]/num_timed_updates[0]
+					 << "ms, parallel " << update_time[1]/num_timed_updates[1] << "ms (" << thread_state.size() << " threads)" << endl;
+				update_time[0] = update_time[1] = 0.0;
+				num_timed_updates[0] = num_timed_updates[1] = 0;
 			}
-		} // for city
-		if (need_to_sort_peds) {
-#pragma omp critical(access_pedestrian_data)
-			sort_by_city_and_plot();
 		}
+		if (need_to_sort_peds) {sort_by_city_and_plot();}
+		publish_ped_snapshot();
 		first_frame = 0;
 	}
 }
@@ -1654,19 +1710,33 @@ void ped_manager_t::get_peds_crossing_roads(ped_city_vect_t &pcv) const {
 	} // for i
 }
 
+void ped_manager_t::publish_ped_snapshot() { // called on the ped update thread after peds are sorted
+	ped_snapshot_t &snap(ped_snapshot.get_back_buffer());
+	snap.peds.clear();
+	snap.city_plot_ix.clear();
+	for (pedestrian_t const &ped : peds) {snap.peds.emplace_back(ped.pos, ped.dest_bldg);}
+	for (city_ixs_t const &c : by_city) {snap.city_plot_ix.push_back(c.plot_ix);}
+	snap.by_plot = by_plot;
+	get_peds_crossing_roads(snap.crossing_roads);
+	ped_snapshot.publish();
+}
+
 void ped_manager_t::get_pedestrians_in_area(cube_t const &area, int building_ix, vector<point> &pts) const {
-	// called by building drawing code, so must be thread safe
-#pragma omp critical(access_pedestrian_data)
-	for (unsigned city = 0; city+1 < by_city.size(); ++city) {
+	// called by building drawing code, so must be thread safe; reads the published snapshot rather than peds, which may be modified by ped update
+	ped_snapshot_ptr_t const snap(get_ped_snapshot());
+	vector<unsigned> const &plot_ix(snap->city_plot_ix), &by_plot(snap->by_plot);
+
+	for (unsigned city = 0; city+1 < plot_ix.size(); ++city) {
 		if (!get_city_bcube_for_peds(city).intersects_xy(area)) continue; // skip
 
-		for (unsigned plot = by_city[city].plot_ix; plot < by_city[city+1].plot_ix; ++plot) {
+		for (unsigned plot = plot_ix[city]; plot < plot_ix[city+1]; ++plot) {
 			if (!get_expanded_city_plot_bcube_for_peds(city, plot).intersects_xy(area)) continue; // skip
+			assert(plot+1 < by_plot.size());
 			unsigned const ped_start(by_plot[plot]), ped_end(by_plot[plot+1]);
 
 			for (unsigned i = ped_start; i < ped_end; ++i) { // peds iteration
-				assert(i < peds.size());
-				pedestrian_t const &ped(peds[i]);
+				assert(i < snap->peds.size());
+				ped_snapshot_t::ped_t const &ped(snap->peds[i]);
 				if (building_ix >= 0 && (int)ped.dest_bldg != building_ix) continue; // not targeting this building, skip
 				if (area.contains_pt_xy(ped.pos)) {pts.push_back(ped.pos);}
 			}
@@ -1681,9 +1751,9 @@ bool ped_manager_t::has_nearby_car(pedestrian_t const &ped, bool road_dim, float
 	return has_nearby_car_on_road(ped, road_dim, (unsigned)road_ix, delta_time, dbg_cubes);
 }
 car_base_t const *ped_manager_t::find_car_using_driveway(unsigned city_ix, dw_query_t const &dw) const {
-	if (city_ix >= cars_by_city.size()) return nullptr; // no cars in this city?
+	if (!has_cars_in_city(city_ix)) return nullptr; // no cars in this city?
 	assert(dw.driveway != nullptr);
-	car_city_vect_t const &cv(cars_by_city[city_ix]);
+	car_city_vect_t const &cv(get_cars_for_city(city_ix));
 	cube_t query_cube(dw.driveway->extend_across_road());
 
 	// this isn't very efficient because the driveway doesn't give us the car, the road, the dim, or the dir
@@ -1701,8 +1771,8 @@ car_base_t const *ped_manager_t::find_car_using_driveway(unsigned city_ix, dw_qu
 }
 
 bool ped_manager_t::has_nearby_car_on_road(pedestrian_t const &ped, bool dim, unsigned road_ix, float delta_time, vect_cube_t *dbg_cubes) const {
-	if (ped.city >= cars_by_city.size()) return 0; // no cars in this city? should be rare, unless cars aren't enabled
-	car_city_vect_t const &cv(cars_by_city[ped.city]);
+	if (!has_cars_in_city(ped.city)) return 0; // no cars in this city? should be rare, unless cars aren't enabled
+	car_city_vect_t const &cv(get_cars_for_city(ped.city));
 	point const &pos(ped.pos);
 
 	for (unsigned dir = 0; dir < 2; ++dir) { // look both ways before crossing
@@ -1804,7 +1874,7 @@ void ped_manager_t::get_parked_car_bcubes_for_plot(cube_t const &plot, unsigned
 bool ped_manager_t::choose_dest_parked_car(unsigned city_id, unsigned &plot_id, unsigned &car_ix, point &car_center) {
 	car_city_vect_t const &cv(get_cars_for_city(city_id));
 	if (cv.parked_car_bcubes.empty()) return 0; // no parked cars; excludes sleeping cars in driveways
-	car_ix     = rgen.rand() % cv.parked_car_bcubes.size(); // Note: car_ix is stored in ped dest_bldg and doesn't get used after that
+	car_ix     = get_thread_state().rgen.rand() % cv.parked_car_bcubes.size(); // Note: car_ix is stored in ped dest_bldg and doesn't get used after that
 	plot_id    = cv.parked_car_bcubes[car_ix].ix;
 	car_center = cv.parked_car_bcubes[car_ix].get_cube_center();
 	return 1;
@@ -1848,11 +1918,11 @@ void pedestrian_t::debug_draw(ped_manager_t &ped_mgr) const {
 	vect_cube_t const &colliders(ped_mgr.get_colliders_for_plot(city, plot));
 	vect_cube_t &avoid(path_finder.get_avoid_vector());
 	bool in_illegal_area(0), avoid_entire_plot(0);
-	get_avoid_cubes(ped_mgr, colliders, plot_bcube, next_plot_bcube, dest_pos, avoid, in_illegal_area, avoid_entire_plot);
+	vect_cube_t car_bcubes;
+	get_avoid_cubes(ped_mgr, colliders, plot_bcube, next_plot_bcube, dest_pos, avoid, car_bcubes, in_illegal_area, avoid_entire_plot);
 	cube_t union_plot_bcube(plot_bcube);
 	union_plot_bcube.union_with_cube(next_plot_bcube);
-	ai_path_t &path(ped_mgr.grid_path);
-	path.clear();
+	ai_path_t path;
 	// ret: 0=failed, 1=valid path, 2=init contained, 3=straight path (no coll)
 	unsigned const ret(path_finder.run(pos, dest_pos, target_pos, union_plot_bcube, PATH_GAP_FACTOR*radius, dest_pos));
 	bool const at_dest_plot(plot == dest_plot), complete(path_finder.found_complete_path());
@@ -1945,7 +2015,7 @@ void pedestrian_t::debug_draw(ped_manager_t &ped_mgr) const {
 	if (using_nav_grid) { // debugging of nav grid
 		int const bix(has_dest_bldg ? (int)dest_bldg : -1);
 		city_cube_nav_grid_manager &nav_grid_mgr(ped_mgr.get_nav_grid_mgr());
-		bool const success(nav_grid_mgr.find_path(plot_bcube, avoid, radius, is_female, plot, pos, orig_dest_pos, ped_mgr, bix, &s)); // with debug vis
+		bool const success(nav_grid_mgr.find_path(plot_bcube, avoid, radius, is_female, plot, pos, orig_dest_pos, path, bix, &s)); // with debug vis
 		colorRGBA const color(success ? PURPLE : BLACK);
 		for (point &p : path) {p.z += 0.1*radius;} // shift up slightly so that it's not overlapping the other path nodes/lines
 		set_fill_mode(); // reset
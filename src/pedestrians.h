@@ -70,6 +70,7 @@ struct person_t : public person_base_t { // building person
 	uint8_t goal_type=GOAL_TYPE_NONE, cur_elevator=0, dest_elevator_floor=0, ai_state=AI_STOP, has_key=0;
 	bool following_player=0, saw_player_hide=0, is_first_path=1, on_new_path_seg=0;
 	bool last_used_elevator=0, last_used_stairs=0, must_re_call_elevator=0, has_room_geom=0, in_pool=0, prev_walked_down=0, no_wait_at_dest=0;
+	bool path_query_pending=0; // route finding was deferred to the end of the frame's AI update, where it's run in parallel
 	ai_path_t path; // stored backwards, next point on path is path.back()
 
 	person_t(float radius_) : person_base_t(radius_) {in_building = 1;}
@@ -6,6 +6,7 @@
 #include "mesh.h"
 #include "model3d.h"
 #include "binary_file_io.h"
+#include "file_utils.h"
 #include <atomic>
 #include <thread>
 
@@ -20,16 +21,19 @@ float const ICE_ALBEDO    = 0.8;
 
 bool keep_beams(0); // debugging mode
 bool kill_raytrace(0);
-bool no_stat_moving(0); // generally not thread safe for dynamic lighting update, since BVH is rebuilt per-frame; also, wrong to cache lighting for moving cobjs
-unsigned NPTS(50000), NRAYS(40000), LOCAL_RAYS(1000000), GLOBAL_RAYS(1000000), DYNAMIC_RAYS(1000000), NUM_THREADS(1), MAX_RAY_BOUNCES(20);
+bool no_stat_moving(0); // generally not thread safe for dynamic lighting update, since BVH is rebuilt when the set of moving cobjs changes (otherwise refit in place); also, wrong to cache lighting for moving cobjs
+unsigned NPTS(50000), NRAYS(40000), LOCAL_RAYS(1000000), GLOBAL_RAYS(1000000), DYNAMIC_RAYS(1000000), NUM_THREADS(1), MAX_RAY_BOUNCES(20), RAY_PACKET_SIZE(8);
+unsigned progressive_lighting_passes(0); // 0 or 1 = disabled
+bool progressive_lighting_checkpoint(0);
 std::atomic<unsigned long long> tot_rays(0), num_hits(0), cells_touched(0);
 unsigned const NUM_RAY_SPLITS [NUM_LIGHTING_TYPES] = {1, 1, 1, 1, 1}; // sky, global, local, cobj_accum, dynamic
 unsigned const INIT_RAY_SPLITS[NUM_LIGHTING_TYPES] = {1, 4, 1, 1, 1}; // sky, global, local, cobj_accum, dynamic
 
-extern bool has_snow, combined_gu, global_lighting_update, lighting_update_offline, store_cobj_accum_lighting_as_blocked;
+extern bool has_snow, combined_gu, global_lighting_update, lighting_update_offline, store_cobj_accum_lighting_as_blocked, sparse_lighting_files, pack_lighting_file_colors;
 extern int read_light_files[], write_light_files[], display_mode, DISABLE_WATER;
 extern float water_plane_z, temperature, snow_depth, ray_step_size_mult, first_ray_weight[];
 extern char *lighting_file[];
+extern string lighting_update_text;
 extern point sun_pos, moon_pos;
 extern vector<light_source> light_sources_a;
 extern vector<light_source_trig> light_sources_d;
@@ -259,8 +263,14 @@ unsigned add_path_to_lmcs(lmap_manager_t *lmgr, cube_t *bcube, point p1, point c
 }
 
 
-void cast_light_ray(lmap_manager_t *lmgr, point p1, point p2, float weight, float weight0, colorRGBA color, float line_length,
-	int ignore_cobj, int ltype, unsigned depth, rand_gen_t &rgen, cobj_ray_accum_map_t *accum_map, cube_t *bcube=nullptr)
+bool clip_light_ray(point &p1, point &p2) {
+	if (!do_line_clip_scene(p1, p2, min(zbottom, czmin), max(ztop, czmax))) return 0;
+	return !((display_mode & 0x01) && is_under_mesh(p1));
+}
+
+// if packet is non-null, p1 and p2 have already been clipped and the cobj intersection has been computed for ray packet_ix
+void cast_light_ray(lmap_manager_t *lmgr, point p1, point p2, float weight, float weight0, colorRGBA color, float line_length, int ignore_cobj, int ltype,
+	unsigned depth, rand_gen_t &rgen, cobj_ray_accum_map_t *accum_map, cube_t *bcube=nullptr, coll_line_packet_t const *packet=nullptr, unsigned packet_ix=0)
 {
 	if (depth > MAX_RAY_BOUNCES) return;
 	if (ltype == LIGHTING_DYNAMIC && depth > 4) return; // use a sensible default since this is running during rendering
@@ -269,15 +279,23 @@ void cast_light_ray(lmap_manager_t *lmgr, point p1, point p2, float weight, floa
 
 	// find intersection point with scene cobjs
 	point orig_p1(p1);
-	if (!do_line_clip_scene(p1, p2, min(zbottom, czmin), max(ztop, czmax))) return;
-	if ((display_mode & 0x01) && is_under_mesh(p1)) return;
+	if (packet == nullptr && !clip_light_ray(p1, p2)) return;
 	int cindex(-1), xpos(0), ypos(0);
 	point cpos(p2);
 	vector3d cnorm;
 	float t(0.0), zval(0.0);
-	bool snow_coll(0), ice_coll(0), water_coll(0), mesh_coll(0);
+	bool coll(0), snow_coll(0), ice_coll(0), water_coll(0), mesh_coll(0);
 	vector3d const dir((p2 - p1).get_norm());
-	bool coll(check_coll_line_exact(p1, p2, cpos, cnorm, cindex, 0.0, ignore_cobj, 1, 0, 1, 1, (p1 == orig_p1), no_stat_moving)); // fast=1, exclude voxels, maybe skip init colls
+
+	if (packet) {
+		assert(packet_ix < packet->num);
+		cindex = packet->cindex[packet_ix];
+		coll   = (cindex >= 0);
+		if (coll) {cpos = packet->cpos[packet_ix]; cnorm = packet->cnorm[packet_ix];}
+	}
+	else {
+		coll = check_coll_line_exact(p1, p2, cpos, cnorm, cindex, 0.0, ignore_cobj, 1, 0, 1, 1, (p1 == orig_p1), no_stat_moving); // fast=1, exclude voxels, maybe skip init colls
+	}
 	assert(coll ? (cindex >= 0 && cindex < (int)coll_objects.size()) : (cindex == -1));
 
 	// find the intersection point with the model3ds
@@ -495,6 +513,49 @@ void cast_light_ray(lmap_manager_t *lmgr, point p1, point p2, float weight, floa
 }
 
 
+// batches primary light rays so that their static cobj intersections can be found with a single BVH traversal per packet;
+// rays should be added in a coherent order (similar origins and directions) for best performance
+class light_ray_packet_t {
+
+	lmap_manager_t *lmgr;
+	cobj_ray_accum_map_t *accum_map;
+	rand_gen_t &rgen;
+	float line_length;
+	int ltype;
+	unsigned max_rays;
+	coll_line_packet_t packet;
+	float weights[MAX_LINE_PACKET_SIZE];
+	colorRGBA colors[MAX_LINE_PACKET_SIZE];
+
+public:
+	light_ray_packet_t(lmap_manager_t *lmgr_, float line_length_, int ltype_, rand_gen_t &rgen_, cobj_ray_accum_map_t *accum_map_) :
+		lmgr(lmgr_), accum_map(accum_map_), rgen(rgen_), line_length(line_length_), ltype(ltype_), max_rays(min(RAY_PACKET_SIZE, MAX_LINE_PACKET_SIZE)) {}
+	~light_ray_packet_t() {assert(packet.empty());} // caller must flush()
+
+	void add_ray(point const &p1, point const &p2, float weight, colorRGBA const &color) {
+		if (max_rays <= 1) { // packets disabled
+			cast_light_ray(lmgr, p1, p2, weight, weight, color, line_length, -1, ltype, 0, rgen, accum_map);
+			return;
+		}
+		point c1(p1), c2(p2);
+		if (!clip_light_ray(c1, c2)) {++tot_rays; return;} // counted but not cast
+		unsigned const ix(packet.add(c1, c2, (c1 == p1)));
+		weights[ix] = weight;
+		colors [ix] = color;
+		if (packet.num >= max_rays) {flush();}
+	}
+	void flush() {
+		if (packet.empty()) return;
+		check_coll_line_exact_tree_packet(packet, -1, 1, 0, no_stat_moving); // include_voxels=1
+
+		for (unsigned i = 0; i < packet.num; ++i) {
+			cast_light_ray(lmgr, packet.p1[i], packet.p2[i], weights[i], weights[i], colors[i], line_length, -1, ltype, 0, rgen, accum_map, nullptr, &packet, i);
+		}
+		packet.clear();
+	}
+};
+
+
 struct rt_data {
 	unsigned ix, num, job_id, checksum;
 	int rseed, ltype;
@@ -523,15 +584,15 @@ struct rt_data {
 template<typename T> class thread_manager_t {
 
 	vector<std::thread> threads;
+	std::atomic<unsigned> num_done;
 public:
 	vector<T> data; // to be filled in by the caller
 
+	thread_manager_t() : num_done(0) {}
 	bool is_active() const {return (!threads.empty());}
-
-	bool any_threads_running() const {
-		for (auto i = data.begin(); i != data.end(); ++i) {if (i->is_running) return 1;}
-		return 0;
-	}
+	unsigned get_num_threads() const {return threads.size();}
+	unsigned get_num_done() const {return num_done;}
+	bool all_threads_done() const {return (num_done == threads.size());} // unlike is_running, this can't be read before a thread has started
 	void clear() {
 		data.clear();
 		threads.clear();
@@ -543,7 +604,8 @@ public:
 	}
 	void run(void (*func)(rt_data *)) {
 		assert(threads.size() == data.size());
-		for (unsigned t = 0; t < threads.size(); ++t) {threads[t] = std::thread(func, (rt_data *)(&data[t]));}
+		num_done = 0;
+		for (unsigned t = 0; t < threads.size(); ++t) {threads[t] = std::thread([this, func, t]() {func((rt_data *)(&data[t])); ++num_done;});}
 	}
 	void join() {
 		for (unsigned t = 0; t < threads.size(); ++t) {threads[t].join();}
@@ -557,7 +619,47 @@ lmap_manager_t thread_temp_lmap;
 bool indir_lighting_updated() {return (global_lighting_update && (lmap_manager.was_updated || thread_temp_lmap.was_updated));} // only for global updates
 
 
-void kill_current_raytrace_threads() {
+// progressive baking of startup lighting: each lighting type is traced in a series of non-blocking passes, where each pass uses its own
+// subset of the ray seeds; after each pass, the partial result scaled by (num_passes/passes_done) is copied to lmap_manager for display
+class progressive_lighting_baker_t {
+
+	struct checkpoint_header_t {
+		unsigned magic, ltype, pass, num_passes, num_threads, data_size, rays[5]; // rays: NPTS, NRAYS, LOCAL_RAYS, GLOBAL_RAYS, MAX_RAY_BOUNCES
+
+		bool same_job(checkpoint_header_t const &h) const { // everything but pass
+			return (h.magic == magic && h.ltype == ltype && h.num_passes == num_passes && h.num_threads == num_threads &&
+				h.data_size == data_size && memcmp(h.rays, rays, sizeof(rays)) == 0);
+		}
+	};
+	vector<unsigned> queue; // ltypes waiting to be baked
+	int cur_ltype, start_time;
+	unsigned pass, num_passes; // pass = number of completed passes
+	bool verbose, need_launch, job_running; // job_running: the active thread_manager job is one of our passes
+
+	static unsigned get_num_threads() {return max(1U, NUM_THREADS-1);} // reserve a thread for rendering
+	checkpoint_header_t get_header() const;
+	string get_checkpoint_fn() const;
+	bool read_checkpoint();
+	void write_checkpoint() const;
+	void start_next();
+	void publish();
+	void finish();
+public:
+	progressive_lighting_baker_t() : cur_ltype(-1), start_time(0), pass(0), num_passes(1), verbose(0), need_launch(0), job_running(0) {}
+	bool is_active() const {return (cur_ltype >= 0);}
+	bool is_job_running() const {return job_running;}
+	void add(unsigned ltype, bool verbose_);
+	void check_launch();
+	bool pass_finished();
+	void cancel();
+	string get_status() const;
+};
+
+progressive_lighting_baker_t progressive_baker;
+unsigned deferred_global_lights(0); // global lighting update requested during a bake, applied once baking is done
+
+
+void kill_raytrace_job() {
 
 	if (thread_manager.is_active()) { // can't have two running at once, so kill the existing one
 		// cancel thread?
@@ -568,6 +670,11 @@ void kill_current_raytrace_threads() {
 	}
 }
 
+void kill_current_raytrace_threads() {
+	kill_raytrace_job();
+	progressive_baker.cancel(); // partially traced lighting is lost
+}
+
 
 void update_lmap_from_temp_copy() {
 
@@ -581,28 +688,49 @@ void update_lmap_from_temp_copy() {
 
 void check_for_lighting_finished() { // to be called about once per frame
 
-	if (!thread_manager.is_active()) return; // inactive
-	if (thread_manager.any_threads_running()) return; // still running
-	thread_manager.join_and_clear(); // clear() or join_and_clear()?
-	update_lmap_from_temp_copy();
+	if (progressive_baker.is_active()) {lighting_update_text = progressive_baker.get_status();}
+
+	if (thread_manager.is_active()) {
+		if (!thread_manager.all_threads_done()) return; // still running
+		thread_manager.join_and_clear(); // clear() or join_and_clear()?
+		if (!progressive_baker.pass_finished()) {update_lmap_from_temp_copy();}
+	}
+	progressive_baker.check_launch(); // start the next pass, if needed
+
+	if (deferred_global_lights && !progressive_baker.is_active() && !thread_manager.is_active()) {
+		unsigned const lights(deferred_global_lights);
+		deferred_global_lights = 0;
+		check_update_global_lighting(lights);
+	}
 }
 
 
 // see https://computing.llnl.gov/tutorials/pthreads/ (for old pthread implementation - now using std::thread)
-void launch_threaded_job(unsigned num_threads, void (*start_func)(rt_data *), bool verbose, bool blocking, bool use_temp_lmap, bool randomized, int ltype, unsigned job_id=0) {
-
-	kill_current_raytrace_threads();
+// pass and num_passes are for progressive lighting, where each of the num_threads*num_passes work splits is traced once
+void launch_threaded_job(unsigned num_threads, void (*start_func)(rt_data *), bool verbose, bool blocking, bool use_temp_lmap, bool randomized, int ltype,
+	unsigned job_id=0, unsigned pass=0, unsigned num_passes=1)
+{
+	if (progressive_baker.is_job_running()) { // let the current bake pass finish rather than killing it
+		assert(thread_manager.is_active());
+		thread_manager.join_and_clear();
+		progressive_baker.pass_finished(); // the next pass will be launched from check_for_lighting_finished()
+	}
+	kill_raytrace_job();
+	assert(pass < num_passes);
 	assert(num_threads > 0 && num_threads < 100);
 	assert(!keep_beams || num_threads == 1); // could use a mutex instead to make this legal
 	bool const single_thread(num_threads == 1);
 	if (verbose) {cout << "Computing lighting on " << num_threads << " threads." << endl;}
+	unsigned long long const start_rays(tot_rays);
+	int const start_time(GET_TIME_MS());
 	thread_manager.create(num_threads);
 	vector<rt_data> &data(thread_manager.data);
-	if (use_temp_lmap) {thread_temp_lmap.init_from(lmap_manager);}
+	if (use_temp_lmap && pass == 0) {thread_temp_lmap.init_from(lmap_manager);} // later passes continue to accumulate into the temp lmap
 
 	for (unsigned t = 0; t < data.size(); ++t) {
 		// create a custom lmap_manager_t for each thread then merge them together?
-		data[t] = rt_data(t, num_threads, 234323*(t+1), !single_thread, (verbose && t == 0), randomized, ltype, job_id);
+		unsigned const split_ix(pass*num_threads + t);
+		data[t] = rt_data(split_ix, num_threads*num_passes, 234323*(split_ix+1), !single_thread, (verbose && t == 0), randomized, ltype, job_id);
 		data[t].lmgr = (use_temp_lmap ? &thread_temp_lmap : &lmap_manager);
 	}
 	if (single_thread && blocking) { // threads disabled
@@ -624,6 +752,12 @@ void launch_threaded_job(unsigned num_threads, void (*start_func)(rt_data *), bo
 			}
 		}
 		thread_manager.clear();
+
+		if (verbose) {
+			double const secs(0.001*max(1, (GET_TIME_MS() - start_time)));
+			unsigned long long const job_rays(tot_rays - start_rays);
+			cout << "Traced " << job_rays << " rays in " << secs << "s: " << job_rays/secs << " rays/sec (packet size " << RAY_PACKET_SIZE << ")" << endl;
+		}
 	}
 	//cout << "total rays: " << tot_rays << ", hits: " << num_hits << ", cells touched: " << cells_touched << endl;
 	//tot_rays = num_hits = cells_touched = 0;
@@ -641,12 +775,10 @@ bool cube_light_src_vect::ray_intersects_any(point const &start_pt, point const
 }
 
 
-void trace_one_global_ray(lmap_manager_t *lmgr, point const &pos, point const &pt, colorRGBA const &color, float ray_wt,
-	int ltype, bool is_scene_cube, rand_gen_t &rgen, cobj_ray_accum_map_t *accum_map, float line_length)
-{
+void trace_one_global_ray(light_ray_packet_t &packet, point const &pos, point const &pt, colorRGBA const &color, float ray_wt, bool is_scene_cube, float line_length) {
 	point const end_pt(pt + (pt - pos).get_norm()*line_length);
 	if (is_scene_cube && global_cube_lights.ray_intersects_any(pt, end_pt)) return; // don't double count
-	cast_light_ray(lmgr, pos, end_pt, ray_wt, ray_wt, color, line_length, -1, ltype, 0, rgen, accum_map);
+	packet.add_ray(pos, end_pt, ray_wt, color);
 }
 
 
@@ -655,6 +787,7 @@ void trace_ray_block_global_cube(lmap_manager_t *lmgr, cube_t const &bnds, point
 {
 	float const line_length(2.0*get_scene_radius());
 	vector3d const ldir((bnds.get_cube_center() - pos).get_norm());
+	light_ray_packet_t packet(lmgr, line_length, ltype, rgen, accum_map); // rays from the sun/moon are nearly parallel and adjacent rays are coherent
 	float proj_area[3] = {0}, tot_area(0.0);
 
 	for (unsigned i = 0; i < 3; ++i) { // adjust the number or weight of rays based on sun/moon position, or simply modify color scale?
@@ -681,7 +814,7 @@ void trace_ray_block_global_cube(lmap_manager_t *lmgr, cube_t const &bnds, point
 				if (verbose && ((s%1000) == 0)) {increment_printed_number(s/1000);}
 				pt[d0] = rgen.rand_uniform(bnds.d[d0][0], bnds.d[d0][1]);
 				pt[d1] = rgen.rand_uniform(bnds.d[d1][0], bnds.d[d1][1]);
-				trace_one_global_ray(lmgr, pos, pt, color, ray_wt, ltype, is_scene_cube, rgen, accum_map, line_length);
+				trace_one_global_ray(packet, pos, pt, color, ray_wt, is_scene_cube, line_length);
 			}
 		}
 		else {
@@ -698,10 +831,11 @@ void trace_ray_block_global_cube(lmap_manager_t *lmgr, cube_t const &bnds, point
 					if (kill_raytrace) break;
 					if (verbose && ((num%1000) == 0)) increment_printed_number(num/1000);
 					pt[d1] = bnds.d[d1][0] + (s1 + rgen.rand_uniform(0.0, 1.0))*len1/n1;
-					trace_one_global_ray(lmgr, pos, pt, color, ray_wt, ltype, is_scene_cube, rgen, accum_map, line_length);
+					trace_one_global_ray(packet, pos, pt, color, ray_wt, is_scene_cube, line_length);
 				}
 			}
 		}
+		packet.flush();
 		if (verbose) {cout << endl;}
 	} // for i
 }
@@ -763,6 +897,7 @@ void trace_ray_block_sky(rt_data *data) {
 		unsigned const block_npts(max(1U, NPTS/data->num));
 		vector<point> pts(block_npts);
 		vector<vector3d> dirs(NRAYS);
+		light_ray_packet_t packet(data->lmgr, line_length, LIGHTING_SKY, rgen, &data->accum_map); // sorted rays from a common start point are coherent
 
 		for (unsigned p = 0; p < block_npts; ++p) {
 			do {
@@ -789,9 +924,10 @@ void trace_ray_block_sky(rt_data *data) {
 				if (dot_product(dirs[r], pt) >= 0.0) continue; // can get here when (-Z_SCENE_SIZE, Z_SCENE_SIZE) does not contain (czmin, czmax)
 				point const end_pt(pt + dirs[r]*line_length);
 				if (sky_cube_lights.ray_intersects_any(pt, end_pt)) continue; // don't double count
-				cast_light_ray(data->lmgr, pt, end_pt, ray_wt, ray_wt, WHITE, line_length, -1, LIGHTING_SKY, 0, rgen, &data->accum_map);
+				packet.add_ray(pt, end_pt, ray_wt, WHITE);
 				++start_rays;
 			}
+			packet.flush();
 		}
 		if (data->verbose) {cout << endl;}
 	}
@@ -1045,6 +1181,143 @@ typedef void (*ray_trace_func)(rt_data *);
 ray_trace_func const rt_funcs[NUM_LIGHTING_TYPES] = {trace_ray_block_sky, trace_ray_block_global, trace_ray_block_local, trace_ray_block_cobj_accum, trace_ray_block_dynamic};
 
 
+string const lighting_type_names[NUM_LIGHTING_TYPES] = {"Sky", "Global", "Local", "Cobj Accum", "Dynamic"};
+
+progressive_lighting_baker_t::checkpoint_header_t progressive_lighting_baker_t::get_header() const {
+	checkpoint_header_t const h = {0xbeefdead, unsigned(cur_ltype), pass, num_passes, get_num_threads(), unsigned(lmap_manager.size()), {NPTS, NRAYS, LOCAL_RAYS, GLOBAL_RAYS, MAX_RAY_BOUNCES}};
+	return h;
+}
+
+string progressive_lighting_baker_t::get_checkpoint_fn() const {
+	char const *const fn(lighting_file[cur_ltype]);
+	if (fn == nullptr || fn[0] == 0 || strcmp(fn, "''") == 0 || strcmp(fn, "\"\"") == 0) return ""; // no lighting file, no checkpoint
+	return string(fn) + "." + std::to_string(cur_ltype) + ".ckpt"; // sky and global may share a lighting file
+}
+
+bool progressive_lighting_baker_t::read_checkpoint() { // Note: thread_temp_lmap must be initialized
+
+	string const fn(get_checkpoint_fn());
+	if (fn.empty()) return 0;
+	if (!check_file_exists(fn)) return 0; // no checkpoint (not an error)
+	binary_file_reader reader;
+	checkpoint_header_t header;
+	if (!reader.open(fn) || !reader.read(&header, sizeof(header), 1)) return 0;
+
+	if (!get_header().same_job(header) || header.pass == 0 || header.pass >= num_passes) {
+		cerr << "Ignoring lighting checkpoint " << fn << " from a different or finished job" << endl;
+		return 0;
+	}
+	if (!thread_temp_lmap.read_data(reader, fn.c_str(), cur_ltype)) return 0;
+	cout << "Resuming " << lighting_type_names[cur_ltype] << " lighting from checkpoint " << fn << " at pass " << header.pass << " of " << num_passes << endl;
+	pass = header.pass;
+	return 1;
+}
+
+void progressive_lighting_baker_t::write_checkpoint() const {
+
+	string const fn(get_checkpoint_fn());
+	if (fn.empty()) return;
+	checkpoint_header_t const header(get_header());
+	binary_file_writer writer;
+	if (!writer.open(fn) || !writer.write(&header, sizeof(header), 1) || !thread_temp_lmap.write_data(writer, fn.c_str(), cur_ltype)) {
+		cerr << "Error writing lighting checkpoint " << fn << endl;
+	}
+}
+
+void progressive_lighting_baker_t::add(unsigned ltype, bool verbose_) {
+
+	queue.push_back(ltype);
+	verbose |= verbose_;
+	if (!is_active()) {start_next(); check_launch();}
+}
+
+void progressive_lighting_baker_t::start_next() {
+
+	assert(!is_active());
+	if (queue.empty()) return; // done
+	cur_ltype   = queue.front();
+	queue.erase(queue.begin());
+	pass        = 0;
+	num_passes  = progressive_lighting_passes;
+	start_time  = GET_TIME_MS();
+	need_launch = 1;
+	assert(num_passes > 1);
+
+	if (progressive_lighting_checkpoint) {
+		thread_temp_lmap.init_from(lmap_manager);
+		if (read_checkpoint()) {publish();}
+	}
+}
+
+void progressive_lighting_baker_t::check_launch() {
+
+	if (!is_active() || !need_launch || thread_manager.is_active()) return;
+	launch_threaded_job(get_num_threads(), rt_funcs[cur_ltype], 0, 0, 1, 0, cur_ltype, 0, pass, num_passes); // non-blocking, use_temp_lmap=1
+	need_launch = 0;
+	job_running = 1;
+}
+
+bool progressive_lighting_baker_t::pass_finished() { // returns 1 if this was a progressive lighting pass
+
+	if (!job_running) return 0; // some other job, such as a global lighting update
+	assert(is_active());
+	job_running = 0;
+	++pass;
+	publish();
+
+	if (verbose) {
+		cout << lighting_type_names[cur_ltype] << " lighting pass " << pass << " of " << num_passes << ": " << tot_rays << " total rays, "
+			 << 0.001*(GET_TIME_MS() - start_time) << "s" << endl;
+	}
+	if (pass < num_passes) {
+		if (progressive_lighting_checkpoint) {write_checkpoint();}
+		need_launch = 1;
+	}
+	else {finish();}
+	return 1;
+}
+
+void progressive_lighting_baker_t::publish() {
+
+	assert(pass > 0 && pass <= num_passes);
+	lmap_manager.copy_ltype_data(thread_temp_lmap, cur_ltype, float(num_passes)/float(pass)); // normalize partial results to the full ray count
+	lmap_manager.was_updated = 1;
+}
+
+void progressive_lighting_baker_t::finish() {
+
+	if (write_light_files[cur_ltype]) {lmap_manager.write_data_to_file(lighting_file[cur_ltype], cur_ltype);}
+	string const ckpt_fn(get_checkpoint_fn());
+	if (progressive_lighting_checkpoint && !ckpt_fn.empty()) {remove(ckpt_fn.c_str());} // no longer needed
+	cout << lighting_type_names[cur_ltype] << " lighting baked in " << num_passes << " passes, " << 0.001*(GET_TIME_MS() - start_time) << "s" << endl;
+	cur_ltype = -1;
+	need_launch = 0;
+	start_next();
+}
+
+void progressive_lighting_baker_t::cancel() {
+	queue.clear();
+	cur_ltype   = -1;
+	need_launch = job_running = 0;
+}
+
+string progressive_lighting_baker_t::get_status() const {
+
+	if (!is_active()) return "";
+	unsigned const nthreads(thread_manager.get_num_threads());
+	float const pass_frac((thread_manager.is_active() && nthreads > 0) ? float(thread_manager.get_num_done())/nthreads : 0.0);
+	std::ostringstream oss;
+	oss << "Baking " << lighting_type_names[cur_ltype] << " Lighting: pass " << min(pass+1, num_passes) << " of " << num_passes << " ("
+		<< unsigned(100.0*(pass + pass_frac)/num_passes) << "%)";
+	return oss.str();
+}
+
+bool use_progressive_lighting(unsigned ltype) { // cobj accum lighting depends on the sky pass being complete, so it must be blocking
+	bool const cobj_accum(read_light_files[LIGHTING_COBJ_ACCUM] || write_light_files[LIGHTING_COBJ_ACCUM]);
+	return (progressive_lighting_passes > 1 && ltype <= LIGHTING_LOCAL && !cobj_accum && !keep_beams && !lighting_update_offline);
+}
+
+
 void compute_ray_trace_lighting(unsigned ltype, bool verbose) {
 
 	bool const dynamic(is_ltype_dynamic(ltype));
@@ -1066,6 +1339,11 @@ void compute_ray_trace_lighting(unsigned ltype, bool verbose) {
 	else {
 		if (c_ltype != LIGHTING_LOCAL && !dynamic) {cout << X_SCENE_SIZE << " " << Y_SCENE_SIZE << " " << Z_SCENE_SIZE << " " << czmin << " " << czmax << endl;}
 		all_models.build_cobj_trees(1);
+
+		if (!dynamic && use_progressive_lighting(c_ltype)) {
+			progressive_baker.add(c_ltype, verbose); // lighting file is written when the last pass completes
+			return;
+		}
 		if (enable_platform_lights(ltype)) {pre_rt_bvh_build_hook();}
 		launch_threaded_job(NUM_THREADS, rt_funcs[c_ltype], verbose, 1, 0, 0, ltype);
 		if (enable_platform_lights(ltype)) {post_rt_bvh_build_hook();}
@@ -1096,6 +1374,7 @@ void check_update_global_lighting(unsigned lights) {
 	if (!global_lighting_update || !(read_light_files[LIGHTING_GLOBAL] || write_light_files[LIGHTING_GLOBAL])) return;
 	if (!(lights & (SUN_SHADOW | MOON_SHADOW))) return;
 	if (GLOBAL_RAYS == 0 && global_cube_lights.empty()) return; // nothing to do
+	if (progressive_baker.is_active()) {deferred_global_lights |= lights; return;} // still baking the initial lighting; update when done
 	if (!pre_lighting_update()) return; // lmap is not yet allocated
 	// Note: we could check if the sun/moon is visible, but it might have been visible previously and now is not, and in that case we still need to update lighting
 	no_stat_moving = 1; // disable static moving cobjs for async updates, which aren't thread safe because the BVH is rebuilt every frame; no need to set back after first frame
@@ -1138,8 +1417,18 @@ bool lmap_manager_t::read_data_from_file(char const *const fn, int ltype) {
 	binary_file_reader reader;
 	if (!reader.open(fn)) return 0;
 	cout << "Reading lighting file from " << fn << endl;
+	return read_data(reader, fn, ltype);
+}
+
+unsigned const LMAP_SPARSE_FILE_FLAG = (1U << 31); // set in the data size field
+
+bool lmap_manager_t::read_data(binary_file_reader &reader, char const *const fn, int ltype) {
+
+	assert(!is_sparse()); // only dense lmaps are read and written
 	unsigned data_size(0);
 	if (!reader.read(&data_size, sizeof(unsigned), 1)) return 0;
+	bool const sparse_file(data_size & LMAP_SPARSE_FILE_FLAG);
+	data_size &= ~LMAP_SPARSE_FILE_FLAG;
 
 	if (data_size != vldata_alloc.size()) {
 		cerr << "Error: Lighting file " << fn << " data size of " << data_size
@@ -1147,6 +1436,7 @@ bool lmap_manager_t::read_data_from_file(char const *const fn, int ltype) {
 		return 0;
 	}
 	unsigned const sz = lmcell::get_dsz(ltype);
+	if (sparse_file) return read_sparse_data(reader, fn, ltype);
 	vector<float> data(data_size*sz);
 	unsigned pos(0);
 
@@ -1169,8 +1459,17 @@ bool lmap_manager_t::write_data_to_file(char const *const fn, int ltype) const {
 	binary_file_writer writer;
 	if (!writer.open(fn)) return 0;
 	cout << "Writing lighting file to " << fn << endl;
+	return write_data(writer, fn, ltype);
+}
+
+bool lmap_manager_t::write_data(binary_file_writer &writer, char const *const fn, int ltype) const {
+
+	assert(!is_sparse()); // only dense lmaps are read and written
 	unsigned const data_size((unsigned)vldata_alloc.size()); // should be size_t?
-	if (!writer.write(&data_size, sizeof(unsigned), 1)) return 0;
+	assert(!(data_size & LMAP_SPARSE_FILE_FLAG));
+	unsigned const size_field(data_size | (sparse_lighting_files ? LMAP_SPARSE_FILE_FLAG : 0));
+	if (!writer.write(&size_field, sizeof(unsigned), 1)) return 0;
+	if (sparse_lighting_files) return write_sparse_data(writer, fn, ltype);
 	unsigned const sz(lmcell::get_dsz(ltype));
 
 	for (vector<lmcell>::const_iterator i = vldata_alloc.begin(); i != vldata_alloc.end(); ++i) { // const_iterator?
@@ -1182,6 +1481,85 @@ bool lmap_manager_t::write_data_to_file(char const *const fn, int ltype) const {
 	return 1;
 }
 
+// sparse form: {flags, num_blocks, {block_ix, cells[LMAP_BRICK_CELLS]}...}, where blocks are runs of LMAP_BRICK_CELLS cells in
+// storage order and blocks that are all zero for this ltype are omitted; if flags&1, colors are RGB9E5 followed by the float weight
+bool lmap_manager_t::write_sparse_data(binary_file_writer &writer, char const *const fn, int ltype) const {
+
+	unsigned const sz(lmcell::get_dsz(ltype)), flags(pack_lighting_file_colors ? 1 : 0);
+	unsigned const num_cells(vldata_alloc.size()), num_blocks((num_cells + LMAP_BRICK_CELLS - 1)/LMAP_BRICK_CELLS);
+	vector<unsigned> block_ixs;
+
+	for (unsigned b = 0; b < num_blocks; ++b) {
+		for (unsigned i = b*LMAP_BRICK_CELLS; i < min(num_cells, (b+1)*LMAP_BRICK_CELLS); ++i) {
+			float const *const ptr(vldata_alloc[i].get_offset(ltype));
+			if (std::any_of(ptr, ptr+sz, [](float v) {return (v != 0.0f);})) {block_ixs.push_back(b); break;}
+		}
+	}
+	unsigned const num_nonzero(block_ixs.size());
+	if (!writer.write(&flags, sizeof(unsigned), 1) || !writer.write(&num_nonzero, sizeof(unsigned), 1)) return 0;
+	vector<float> data(LMAP_BRICK_CELLS*sz, 0.0);
+
+	for (unsigned b : block_ixs) {
+		unsigned pos(0);
+
+		for (unsigned i = b*LMAP_BRICK_CELLS; i < (b+1)*LMAP_BRICK_CELLS; ++i) { // last block is zero padded
+			float const *const ptr((i < num_cells) ? vldata_alloc[i].get_offset(ltype) : nullptr);
+
+			if (flags & 1) { // reuse the float storage for packed colors
+				unsigned const packed(ptr ? pack_lmap_color(ptr) : 0);
+				memcpy(&data[pos++], &packed, sizeof(unsigned));
+				if (sz == 4) {data[pos++] = (ptr ? ptr[3] : 0.0);}
+			}
+			else {
+				for (unsigned n = 0; n < sz; ++n) {data[pos++] = (ptr ? ptr[n] : 0.0);}
+			}
+		}
+		if (!writer.write(&b, sizeof(unsigned), 1) || !writer.write(data.data(), sizeof(float), pos)) {
+			cerr << "Error writing data to ligthing file " << fn << endl;
+			return 0;
+		}
+	}
+	return 1;
+}
+
+bool lmap_manager_t::read_sparse_data(binary_file_reader &reader, char const *const fn, int ltype) {
+
+	unsigned const sz(lmcell::get_dsz(ltype)), num_cells(vldata_alloc.size()), num_blocks((num_cells + LMAP_BRICK_CELLS - 1)/LMAP_BRICK_CELLS);
+	unsigned flags(0), num_nonzero(0), b(0);
+
+	if (!reader.read(&flags, sizeof(unsigned), 1) || !reader.read(&num_nonzero, sizeof(unsigned), 1) || num_nonzero > num_blocks) {
+		cerr << "Error reading header from sparse ligthing file " << fn << endl;
+		return 0;
+	}
+	bool const packed(flags & 1);
+	unsigned const cell_sz(packed ? ((sz == 4) ? 2 : 1) : sz);
+	vector<float> data(LMAP_BRICK_CELLS*cell_sz);
+	clear_lighting_values(ltype); // omitted blocks are zero
+
+	for (unsigned n = 0; n < num_nonzero; ++n) {
+		if (!reader.read(&b, sizeof(unsigned), 1) || b >= num_blocks || !reader.read(data.data(), sizeof(float), data.size())) {
+			cerr << "Error reading data from sparse ligthing file " << fn << endl;
+			return 0;
+		}
+		unsigned pos(0);
+
+		for (unsigned i = b*LMAP_BRICK_CELLS; i < min(num_cells, (b+1)*LMAP_BRICK_CELLS); ++i) {
+			float *const ptr(vldata_alloc[i].get_offset(ltype));
+
+			if (packed) {
+				unsigned packed_color(0);
+				memcpy(&packed_color, &data[pos++], sizeof(unsigned));
+				unpack_lmap_color(packed_color, ptr);
+				if (sz == 4) {ptr[3] = data[pos++];}
+			}
+			else {
+				for (unsigned k = 0; k < sz; ++k) {ptr[k] = data[pos++];}
+			}
+		}
+	}
+	return 1;
+}
+
 
 void lmap_manager_t::clear_lighting_values(int ltype) {
 
@@ -10,16 +10,18 @@
 #include "shaders.h"
 #include "draw_utils.h"
 #include "gl_ext_arb.h"
+#include "profiler.h"
 
 
 bool const TIMETEST          = (GLOBAL_TIMETEST || 0);
+bool const PARALLEL_AI_PLAN  = 1; // run AI target queries in parallel before the serial ai_action() pass
 unsigned const NUM_TIMESTEPS = 4;
 unsigned const NUM_EXTRA_DAM = 4;
 
 
 bool player_autopilot(0), player_auto_stop(0), hold_fighters(0), dock_fighters(0), ship_cube_map_reflection(0);
 int onscreen_display(0);
-unsigned univ_reflection_tid(0);
+unsigned univ_reflection_tid(0), univ_broadphase(1); // univ_broadphase: 0 = x-axis sweep, 1 = hashed uniform grid
 unsigned alloced_fobjs[3] = {0}; // testing
 float uobj_rmax(0.0), urm_ship(0.0), urm_static(0.0), urm_proj(0.0);
 point player_death_pos(all_zeros), universe_origin(all_zeros);
@@ -61,7 +63,7 @@ extern bool allow_shader_invariants;
 extern int show_framerate, frame_counter, display_mode, animate2, do_run, show_scores;
 extern float fticks, player_sensor_dist_mult;
 extern double tfticks;
-extern unsigned owner_counts[];
+extern unsigned owner_counts[], univ_bench_frames;
 extern float resource_counts[];
 extern exp_type_params et_params[];
 extern vector<us_class> sclasses;
@@ -497,8 +499,12 @@ void apply_univ_physics() {
 	RESET_TIME;
 	if (animate2) {trail_rays.clear(); beam_rays.clear();}
 	player_ship().fix_upv();
+	bool const bench_timing(univ_bench_frames > 0); // per-phase timing for the headless universe benchmark
+	highres_timer_t purge_timer("Univ Purge", bench_timing);
 	purge_old_objs();
+	purge_timer.end();
 	if (TIMETEST) PRINT_TIME("  Purge");
+	highres_timer_t cached_timer("Univ Cached Objs", bench_timing); // includes ship vector creation
 	get_cached_objs(uobjs, c_uobjs);
 	if (TIMETEST) PRINT_TIME("  Get Cached");
 	unsigned const nobjs((unsigned)c_uobjs.size());
@@ -555,25 +561,41 @@ void apply_univ_physics() {
 		if (!(flags & OBJ_FLAGS_PARC)) {uobj_rmax = max(uobj_rmax, radius);}
 	}
 	//if (TIMETEST) cout << "  nobj: " << nobjs << " ship: " << nsh << " proj: " << npr << " part: " << npa << endl;
+	cached_timer.end();
 	if (TIMETEST) PRINT_TIME("  Rmax + Ship Vector Creation");
 
 	if (animate2) {
+		highres_timer_t ai_timer("Univ AI", bench_timing);
+
+		if (PARALLEL_AI_PLAN) { // read-only, so objects see each other's start-of-frame state; results are validated and applied in ai_action()
+#pragma omp parallel for schedule(dynamic,16)
+			for (int i = 0; i < (int)nobjs; ++i) {
+				if (c_uobjs[i].flags & (OBJ_FLAGS_SHIP | OBJ_FLAGS_PROJ)) {c_uobjs[i].obj->plan_ai_action();}
+			}
+			if (TIMETEST) PRINT_TIME("  AI Plan");
+		}
 		// before or after advance time and collision detection?
 		for (unsigned i = 0; i < nobjs; ++i) { // can create new objects here
 			if (c_uobjs[i].flags & (OBJ_FLAGS_SHIP | OBJ_FLAGS_PROJ)) {c_uobjs[i].obj->ai_action();}
 		}
 		if (player_autopilot) {update_cpos();}
+		ai_timer.end();
 		if (TIMETEST) PRINT_TIME("  AI Action");
 
 		// c_uobjs is invalid at this point
 		// don't update nobjs - delay first physics event for new objects until next frame
+		highres_timer_t physics_timer("Univ Physics", bench_timing);
 		for (unsigned i = 0; i < nobjs; ++i) {uobjs[i]->apply_physics();}
+		physics_timer.end();
 		if (TIMETEST) PRINT_TIME("  Apply Physics");
 		float const timestep(fticks/NUM_TIMESTEPS);
 
 		for (unsigned t = 0; t < NUM_TIMESTEPS; ++t) { // here is where the objects move
+			highres_timer_t coll_timer("Univ Collision", bench_timing);
 			collision_detect_objects(coll_objs, t);
+			coll_timer.end();
 			if (t == 0) {remove_bad_cobjs_and_particles(coll_objs);}
+			highres_timer_t advance_timer("Univ Advance", bench_timing);
 
 			for (unsigned i = 0; i < nobjs; ++i) {
 				if (!uobjs[i]->is_ok()) {
@@ -629,29 +651,46 @@ bool proc_coll(free_obj *o1, free_obj *o2) {
 }
 
 
-void collision_detect_objects(vector<cached_obj> &objs, unsigned t) {
+// returns the flags of other objects that obj with these flags shouldn't collide with
+inline unsigned get_coll_bad_flags(unsigned flags) {
+
+	unsigned bad_flags(OBJ_FLAGS_BAD_);
+	if ( flags & OBJ_FLAGS_PART) {bad_flags |= OBJ_FLAGS_PART;} // skip particle-particle collisions
+	if ( flags & OBJ_FLAGS_NOC2) {bad_flags |= OBJ_FLAGS_NOC2;} // both objects have their C2 flags set, skip the collision
+	if ((flags & OBJ_FLAGS_PROJ) && (flags & OBJ_FLAGS_NOPC)) {bad_flags |= OBJ_FLAGS_PROJ;} // no projectile-projectile collision
+	return bad_flags;
+}
+
+// refreshes obj for timestep t and returns true if it should be collision tested
+bool update_coll_obj(cached_obj &obj, unsigned t) {
+
+	if (obj.flags & OBJ_FLAGS_BAD_) return 0;
+
+	if (t > 0 && (obj.flags & (OBJ_FLAGS_DIST | OBJ_FLAGS_ORBT))) {
+		if (t == 1) {obj.refresh();}
+		return 0;
+	}
+	if (t > 0) {obj.refresh();} // physics advance was run since last refresh
+	double const radius(obj.radius), val(obj.pos.x);
+	float const left(float(val - radius)), right(float(val + radius));
+	assert(radius > 0.0);
+	if (left == right) return 0; // floating point precision limitation or bug?
+	assert(left < right);
+	return 1;
+}
+
+
+void collision_detect_objects_sweep(vector<cached_obj> &objs, vector<unsigned> const &test_ixs, unsigned &npairs) {
 
-	//RESET_TIME;
 	unsigned const size((unsigned)objs.size());
 	static vector<interval> intervals;
 	intervals.clear();
-	intervals.reserve(2*size);
-
-	for (unsigned i = 0; i < size; ++i) {
-		if (objs[i].flags & OBJ_FLAGS_BAD_) continue;
+	intervals.reserve(2*test_ixs.size());
 
-		if (t > 0 && (objs[i].flags & (OBJ_FLAGS_DIST | OBJ_FLAGS_ORBT))) {
-			if (t == 1) {objs[i].refresh();}
-			continue;
-		}
-		if (t > 0) {objs[i].refresh();} // physics advance was run since last refresh
+	for (unsigned i : test_ixs) {
 		double const radius(objs[i].radius), val(objs[i].pos.x);
-		float const left(float(val - radius)), right(float(val + radius));
-		assert(radius > 0.0);
-		if (left == right) continue; // floating point precision limitation or bug?
-		assert(left < right);
-		intervals.push_back(interval(left,  i, 1));
-		intervals.push_back(interval(right, i, 0));
+		intervals.push_back(interval(float(val - radius), i, 1));
+		intervals.push_back(interval(float(val + radius), i, 0));
 	}
 	unsigned const size2((unsigned)intervals.size());
 	static vector<unsigned> locs, work;
@@ -660,11 +699,7 @@ void collision_detect_objects(vector<cached_obj> &objs, unsigned t) {
 	sort(intervals.begin(), intervals.end());
 
 	for (unsigned i = 0; i < size2; ++i) {
-		unsigned const ix(intervals[i].ix & ~LEFT_EDGE_BIT), ix_flags(objs[ix].flags);
-		unsigned bad_flags(OBJ_FLAGS_BAD_);
-		if ( ix_flags & OBJ_FLAGS_PART) {bad_flags |= OBJ_FLAGS_PART;} // skip particle-particle collisions
-		if ( ix_flags & OBJ_FLAGS_NOC2) {bad_flags |= OBJ_FLAGS_NOC2;} // both objects have their C2 flags set, skip the collision
-		if ((ix_flags & OBJ_FLAGS_PROJ) && (ix_flags & OBJ_FLAGS_NOPC)) {bad_flags |= OBJ_FLAGS_PROJ;} // no projectile-projectile collision
+		unsigned const ix(intervals[i].ix & ~LEFT_EDGE_BIT), bad_flags(get_coll_bad_flags(objs[ix].flags));
 		
 		if (intervals[i].ix & LEFT_EDGE_BIT) { // start a new sphere
 			unsigned const wsize((unsigned)work.size());
@@ -678,6 +713,7 @@ void collision_detect_objects(vector<cached_obj> &objs, unsigned t) {
 					if (obj.flags & bad_flags) continue;
 					float const radius(c_radius_i + obj.radius);
 					if (fabs(pisd - obj.pos.y) > radius || !dist_less_than(pos_i, obj.pos, radius)) continue; // no intersection
+					++npairs;
 
 					if (proc_coll(objs[ix].obj, obj.obj)) {
 						objs[ix].refresh(); // ???
@@ -698,7 +734,189 @@ void collision_detect_objects(vector<cached_obj> &objs, unsigned t) {
 		}
 	}
 	assert(work.empty());
-	//PRINT_TIME("Collision");
+}
+
+
+// hierarchical hashed uniform grid broadphase; doesn't degenerate like the x-axis sweep when many objects are clustered in x;
+// each object is added to the finest level whose cells are at least as large as its radius, so that it spans at most 3x3x3 cells
+class coll_grid_broadphase_t {
+
+	typedef pair<unsigned, unsigned> obj_pair_t;
+	static unsigned const LEVEL_SCALE = 4; // cell size ratio between adjacent levels
+
+	struct grid_entry_t {
+		uint64_t key;
+		int x, y, z; // exact cell; different cells may hash to the same key
+		unsigned level, ix;
+		bool same_cell(grid_entry_t const &e) const {return (level == e.level && x == e.x && y == e.y && z == e.z);}
+		bool operator<(grid_entry_t const &e) const {
+			if (level != e.level) return (level < e.level);
+			if (key   != e.key  ) return (key   < e.key  );
+			if (x   != e.x  ) return (x   < e.x  );
+			if (y   != e.y  ) return (y   < e.y  );
+			if (z   != e.z  ) return (z   < e.z  );
+			return (ix < e.ix);
+		}
+	};
+	// structure-of-arrays copy of the objects to test, indexed by test index
+	vector<float> px, py, pz, rad;
+	vector<unsigned> oix, oflags, olevel;
+	vector<grid_entry_t> entries;
+	vector<unsigned> runs, level_sz; // runs: start of each grid cell in entries; level_sz: number of objects in each level
+	vector<vector<obj_pair_t>> thread_pairs;
+	vector<float> inv_cell_sz; // per level
+
+	int get_cell(float v, unsigned level) const {return int(floor(v*inv_cell_sz[level]));}
+
+	static uint64_t get_key(int x, int y, int z) { // used for sorting only; entries are grouped by exact cell
+		return ((uint64_t(uint32_t(x))*73856093ULL) ^ (uint64_t(uint32_t(y))*19349663ULL) ^ (uint64_t(uint32_t(z))*83492791ULL));
+	}
+	bool test_pair(unsigned i, unsigned j) const {
+		if ((oflags[j] & get_coll_bad_flags(oflags[i])) || (oflags[i] & get_coll_bad_flags(oflags[j]))) return 0;
+		float const r(rad[i] + rad[j]), dx(px[i] - px[j]), dy(py[i] - py[j]), dz(pz[i] - pz[j]);
+		return (dx*dx + dy*dy + dz*dz < r*r);
+	}
+	void add_pair(unsigned i, unsigned j, vector<obj_pair_t> &pairs) const { // first object has the larger left edge, as in the sweep
+		if (px[i] - rad[i] < px[j] - rad[j]) {swap(i, j);}
+		pairs.emplace_back(oix[i], oix[j]);
+	}
+	// a pair that shares multiple cells is only added in the cell containing the min corner of the overlap of their bounds
+	bool is_owning_cell(unsigned i, unsigned j, grid_entry_t const &cell) const {
+		return (get_cell(max(px[i] - rad[i], px[j] - rad[j]), cell.level) == cell.x && get_cell(max(py[i] - rad[i], py[j] - rad[j]), cell.level) == cell.y &&
+			    get_cell(max(pz[i] - rad[i], pz[j] - rad[j]), cell.level) == cell.z);
+	}
+	void find_coarser_level_pairs(unsigned i, vector<obj_pair_t> &pairs) const { // pairs of object i with larger objects in coarser levels
+		for (unsigned level = olevel[i]+1; level < level_sz.size(); ++level) {
+			if (level_sz[level] == 0) continue;
+			int const x1(get_cell(px[i] - rad[i], level)), y1(get_cell(py[i] - rad[i], level)), z1(get_cell(pz[i] - rad[i], level));
+			int const x2(get_cell(px[i] + rad[i], level)), y2(get_cell(py[i] + rad[i], level)), z2(get_cell(pz[i] + rad[i], level));
+
+			for (int z = z1; z <= z2; ++z) {
+				for (int y = y1; y <= y2; ++y) {
+					for (int x = x1; x <= x2; ++x) {
+						grid_entry_t const cell{get_key(x, y, z), x, y, z, level, 0};
+
+						for (auto e = lower_bound(entries.begin(), entries.end(), cell); e != entries.end() && e->same_cell(cell); ++e) {
+							if (test_pair(i, e->ix) && is_owning_cell(i, e->ix, cell)) {add_pair(i, e->ix, pairs);}
+						}
+					}
+				}
+			}
+		} // for level
+	}
+public:
+	void find_pairs(vector<cached_obj> const &objs, vector<unsigned> const &test_ixs, vector<obj_pair_t> &pairs) {
+		unsigned const num((unsigned)test_ixs.size());
+		px.resize(num); py.resize(num); pz.resize(num); rad.resize(num); oix.resize(num); oflags.resize(num); olevel.resize(num);
+
+		float max_coord(0.0);
+
+		for (unsigned i = 0; i < num; ++i) {
+			cached_obj const &obj(objs[test_ixs[i]]);
+			px[i] = obj.pos.x; py[i] = obj.pos.y; pz[i] = obj.pos.z; rad[i] = obj.radius; oix[i] = test_ixs[i]; oflags[i] = obj.flags;
+			max_coord = max(max_coord, (max(fabs(obj.pos.x), max(fabs(obj.pos.y), fabs(obj.pos.z))) + obj.radius));
+		}
+		pairs.clear();
+		if (num < 2) return;
+		// size cells to the median object so that most objects span at most 3x3x3 cells, but keep cell indices well within int range
+		vector<float> sorted_rad(rad);
+		nth_element(sorted_rad.begin(), sorted_rad.begin()+num/2, sorted_rad.end());
+		float const cell_sz(max(4.0f*sorted_rad[num/2], 1.0E-6f*max_coord));
+		inv_cell_sz.clear();
+		level_sz.clear();
+		entries.clear();
+
+		for (unsigned i = 0; i < num; ++i) {
+			unsigned level(0);
+			for (float sz = cell_sz; rad[i] > sz; sz *= LEVEL_SCALE) {++level;}
+			olevel[i] = level;
+
+			while (inv_cell_sz.size() <= level) {
+				inv_cell_sz.push_back(1.0/(cell_sz*pow(float(LEVEL_SCALE), float(inv_cell_sz.size()))));
+				level_sz.push_back(0);
+			}
+			++level_sz[level];
+			int const x1(get_cell(px[i] - rad[i], level)), y1(get_cell(py[i] - rad[i], level)), z1(get_cell(pz[i] - rad[i], level));
+			int const x2(get_cell(px[i] + rad[i], level)), y2(get_cell(py[i] + rad[i], level)), z2(get_cell(pz[i] + rad[i], level));
+
+			for (int z = z1; z <= z2; ++z) {
+				for (int y = y1; y <= y2; ++y) {
+					for (int x = x1; x <= x2; ++x) {entries.push_back(grid_entry_t{get_key(x, y, z), x, y, z, level, i});}
+				}
+			}
+		}
+		sort(entries.begin(), entries.end());
+		runs.clear();
+
+		for (unsigned e = 0; e < entries.size(); ++e) {
+			if (e == 0 || !entries[e].same_cell(entries[e-1])) {runs.push_back(e);} // each object appears at most once per cell
+		}
+		runs.push_back((unsigned)entries.size()); // end marker
+		thread_pairs.resize(omp_get_max_threads_3dw());
+		for (auto &tp : thread_pairs) {tp.clear();}
+		unsigned const num_runs((unsigned)runs.size() - 1), num_queries((level_sz.size() > 1) ? num : 0);
+
+#pragma omp parallel for schedule(dynamic,64)
+		for (int r = 0; r < int(num_runs + num_queries); ++r) {
+			vector<obj_pair_t> &tpairs(thread_pairs[omp_get_thread_num_3dw()]);
+			if (unsigned(r) >= num_runs) {find_coarser_level_pairs(r - num_runs, tpairs); continue;} // pairs between levels
+			// pairs within a cell of the same level
+			unsigned const rs(runs[r]), re(runs[r+1]);
+			grid_entry_t const &cell(entries[rs]);
+
+			for (unsigned a = rs; a < re; ++a) {
+				unsigned const i(entries[a].ix);
+
+				for (unsigned b = a+1; b < re; ++b) {
+					unsigned const j(entries[b].ix);
+					if (test_pair(i, j) && is_owning_cell(i, j, cell)) {add_pair(i, j, tpairs);}
+				}
+			}
+		}
+		for (auto const &tp : thread_pairs) {pairs.insert(pairs.end(), tp.begin(), tp.end());}
+		sort(pairs.begin(), pairs.end()); // process in a deterministic order independent of thread scheduling
+	}
+};
+
+
+void collision_detect_objects_grid(vector<cached_obj> &objs, vector<unsigned> const &test_ixs, unsigned &npairs) {
+
+	static coll_grid_broadphase_t broadphase;
+	static vector<pair<unsigned, unsigned>> pairs;
+	broadphase.find_pairs(objs, test_ixs, pairs);
+
+	for (auto const &p : pairs) {
+		cached_obj &obj1(objs[p.first]), &obj2(objs[p.second]);
+		// flags and positions may have changed from previous collisions in this loop
+		if ((obj1.flags & get_coll_bad_flags(obj2.flags)) || (obj2.flags & get_coll_bad_flags(obj1.flags))) continue;
+		if (!dist_less_than(obj1.pos, obj2.pos, (obj1.radius + obj2.radius))) continue;
+		++npairs;
+
+		if (proc_coll(obj1.obj, obj2.obj)) {
+			obj1.refresh();
+			obj2.refresh();
+		}
+	}
+}
+
+
+void collision_detect_objects(vector<cached_obj> &objs, unsigned t) {
+
+	RESET_TIME;
+	static vector<unsigned> test_ixs;
+	test_ixs.clear();
+	unsigned npairs(0);
+
+	for (unsigned i = 0; i < objs.size(); ++i) {
+		if (update_coll_obj(objs[i], t)) {test_ixs.push_back(i);}
+	}
+	if (univ_broadphase == 1) {collision_detect_objects_grid (objs, test_ixs, npairs);}
+	else                      {collision_detect_objects_sweep(objs, test_ixs, npairs);}
+
+	if (TIMETEST) {
+		cout << "  Collision timestep " << t << ": objects: " << test_ixs.size() << ", pairs: " << npairs << endl;
+		PRINT_TIME(((univ_broadphase == 1) ? "  Collision Grid" : "  Collision Sweep"));
+	}
 }
 
 
@@ -806,6 +806,7 @@ public:
 	virtual void draw_obj(uobj_draw_data &ddata) const = 0;
 	virtual void draw_flares_only() const {assert(0);}
 	virtual void set_temp(float temp, point const &tcenter, free_obj const *source=NULL);
+	virtual void plan_ai_action() {} // default: no AI; may be called in parallel across objects, so must only modify this object
 	virtual void ai_action() {} // default: no AI
 	virtual void first_frame_hook() {}
 	virtual void apply_physics();
@@ -1040,7 +1041,9 @@ class us_projectile : public free_obj { // for a weapon
 private:
 	unsigned wclass;
 	unsigned tup_time;
-	float armor;
+	int seek_plan_frame;
+	float armor, seek_plan_dist;
+	free_obj const *seek_plan_targ;
 	free_obj_block<us_projectile> *alloc_block;
 
 public:
@@ -1048,13 +1051,15 @@ public:
 	static unsigned const max_type = NUM_UWEAP;
 
 	us_projectile(unsigned type=UWEAP_NONE);
-	void reset() {alloc_block = NULL; free_obj::reset();}
+	void reset() {alloc_block = NULL; seek_plan_frame = -1; free_obj::reset();}
 	void set_type(unsigned type);
 	bool dec_ref();
 	us_weapon const &specs() const;
 	float get_max_t() const {return specs().max_t;}
 	float get_mass()  const {return (specs().mass + extra_mass);} // more mass than a ship to give higher collision impact
 	unsigned get_eflags() const;
+	free_obj const *get_seek_target(float seek_dist) const;
+	void plan_ai_action();
 	void ai_action();
 	void apply_physics();
 	free_obj const *get_src() const {return ((parent == NULL) ? NULL : parent->get_src());}
@@ -1182,6 +1187,15 @@ public:
 
 class u_ship : public free_obj, public u_ship_base {
 
+	struct target_plan_t { // result of calc_target_plan(), applied later by apply_target_plan()
+		bool target_set=0;
+		int frame=-1; // frame_counter when computed by plan_ai_action(), -1 if invalid
+		unsigned tup_time=0;
+		float min_dist=0.0;
+		free_obj const *prev_target=nullptr, *target=nullptr;
+		free_obj const *retarget=nullptr; // newly chosen target, which may differ from the final target if it was later rejected
+	};
+
 	unsigned ai_type; // us_class of this ship
 	bool lhyper, damaged, target_set, fire_primary, has_obstacle, captured, dest_override, is_flagship;
 	float tow_mass, exp_val, cloaked, roll_val, pitch_r, yaw_r, roll_r, cached_rsv, child_stray_dist;
@@ -1191,6 +1205,7 @@ class u_ship : public free_obj, public u_ship_base {
 	vector3d hit_dir, obs_orient, target_dir;
 	string name;
 	mesh2d surface_mesh;
+	target_plan_t target_plan;
 
 	u_ship(u_ship const &) = delete; // forbidden
 	void operator=(u_ship const &) = delete; // forbidden
@@ -1229,7 +1244,9 @@ public:
 	int get_move_dir();
 	vector3d get_tot_vel_at(point const &cpos) const;
 	bool do_multi_target() const;
-	free_obj const *find_closest_target(point const &pos0, float min_dist, float max_dist, bool req_shields) const;
+	free_obj const *find_closest_target(point const &pos0, float min_dist, float max_dist, bool req_shields, rand_gen_t *rgen=nullptr) const;
+	void calc_target_plan(float min_dist, target_plan_t &plan, rand_gen_t *rgen=nullptr) const;
+	void apply_target_plan(target_plan_t const &plan);
 	void acquire_target(float min_dist);
 	free_obj *get_closest_dock(float max_dist) const;
 	int get_line_query_obj_types(float qdist) const {return ((sobj_dist < qdist) ? OBJ_TYPE_LGU : OBJ_TYPE_LARGE);} // only test planets, etc. if close to sobj
@@ -1251,6 +1268,7 @@ public:
 	float get_fast_target_dist(free_obj const *const target=NULL) const;
 	bool has_slow_fighters() const;
 	void fire_at_target(free_obj const *const targ_obj, float min_dist);
+	void plan_ai_action();
 	virtual void ai_action();
 	void fire_point_defenses();
 	bool find_coll_enemy_proj(float dmax, point &p_int) const;
@@ -26,7 +26,7 @@ map<unsigned, unsigned> sclasses_to_weapons;
 
 
 extern int do_run;
-extern unsigned team_credits[], init_credits[], alloced_fobjs[];
+extern unsigned team_credits[], init_credits[], alloced_fobjs[], univ_broadphase;
 extern point player_death_pos, universe_origin;
 extern char *ship_def_file;
 
@@ -155,7 +155,7 @@ class ship_defs_file_reader {
 		CMD_ADD, CMD_WEAP_PT, CMD_PLAYER_WEAP, CMD_MESH_PARAMS, CMD_SHIP_CYLINDER, CMD_SHIP_CUBE, CMD_SHIP_SPHERE, CMD_SHIP_TORUS,
 		CMD_SHIP_BCYLIN, CMD_SHIP_BCAPSULE, CMD_SHIP_TRIANGLE, CMD_FLEET, CMD_SHIP_ADD_INIT, CMD_SHIP_ADD_GEN, SHIP_ADD_RAND_SPAWN,
 		CMD_SHIP_BUILD, CMD_ALIGN, CMD_SHIP_NAMES, CMD_ADD_SHIP, CMD_ADD_ASTEROID, CMD_ADD_COMETS, CMD_BLACK_HOLE, CMD_PLAYER,
-		CMD_LAST_PARENT, CMD_PLAYER_SDIST_SCALE, CMD_NO_SHIFT_UNIVERSE, CMD_END};
+		CMD_LAST_PARENT, CMD_PLAYER_SDIST_SCALE, CMD_NO_SHIFT_UNIVERSE, CMD_BROADPHASE, CMD_END};
 
 	ifstream cfg;
 	kw_map command_m, ship_m, weap_m, explosion_m, align_m, align_m_all, ai_m, target_m, asteroid_m;
@@ -711,6 +711,10 @@ bool ship_defs_file_reader::parse_command(unsigned cmd) {
 			no_shift_universe = 1;
 			break;
 
+		case CMD_BROADPHASE: // <unsigned mode>: 0 = x-axis sweep, 1 = hashed uniform grid
+			if (!(cfg >> univ_broadphase) || univ_broadphase > 1) return 0;
+			break;
+
 		case CMD_LAST_PARENT:
 			last_parent = 1;
 			break;
@@ -729,7 +733,7 @@ bool ship_defs_file_reader::parse_command(unsigned cmd) {
 
 void ship_defs_file_reader::setup_keywords() {
 
-	string const commands  ("$GLOBAL_REGEN $SHIP_BUILD_DELAY $RAND_SEED $SPAWN_DIST $START_POS $HYPERSPEED $SPEED_SCALE $PLAYER_TURN $SPAWN_HWORLD $PLAYER_ENEMY $BUILD_ANY $TEAM_CREDITS $SHIP $WEAP $WBEAM $SHIP_WEAP $ADD $WEAP_PT $PLAYER_WEAP $MESH_PARAMS $SHIP_CYLINDER $SHIP_CUBE $SHIP_SPHERE $SHIP_TORUS $SHIP_BCYLIN $SHIP_BCAPSULE $SHIP_TRIANGLE $FLEET $SHIP_ADD_INIT $SHIP_ADD_GEN $SHIP_ADD_RAND_SPAWN $SHIP_BUILD $ALIGN $SHIP_NAMES $ADD_SHIP $ADD_ASTEROID $ADD_COMETS $BLACK_HOLE $PLAYER $LAST_PARENT $PLAYER_SDIST_SCALE $NO_SHIFT_UNIVERSE $END");
+	string const commands  ("$GLOBAL_REGEN $SHIP_BUILD_DELAY $RAND_SEED $SPAWN_DIST $START_POS $HYPERSPEED $SPEED_SCALE $PLAYER_TURN $SPAWN_HWORLD $PLAYER_ENEMY $BUILD_ANY $TEAM_CREDITS $SHIP $WEAP $WBEAM $SHIP_WEAP $ADD $WEAP_PT $PLAYER_WEAP $MESH_PARAMS $SHIP_CYLINDER $SHIP_CUBE $SHIP_SPHERE $SHIP_TORUS $SHIP_BCYLIN $SHIP_BCAPSULE $SHIP_TRIANGLE $FLEET $SHIP_ADD_INIT $SHIP_ADD_GEN $SHIP_ADD_RAND_SPAWN $SHIP_BUILD $ALIGN $SHIP_NAMES $ADD_SHIP $ADD_ASTEROID $ADD_COMETS $BLACK_HOLE $PLAYER $LAST_PARENT $PLAYER_SDIST_SCALE $NO_SHIFT_UNIVERSE $BROADPHASE $END");
 	string const ship_strs ("USC_FIGHTER USC_X1EXTREME USC_FRIGATE USC_DESTROYER USC_LCRUISER USC_HCRUISER USC_BCRUISER USC_ENFORCER USC_CARRIER USC_ARMAGEDDON USC_SHADOW USC_DEFSAT USC_STARBASE USC_BCUBE USC_BSPHERE USC_BTCUBE USC_BSPH_SM USC_BSHUTTLE USC_TRACTOR USC_GUNSHIP USC_NIGHTMARE USC_DWCARRIER USC_DWEXTERM USC_WRAITH USC_ABOMIN USC_REAPER USC_DEATH_ORB USC_SUPPLY USC_ANTI_MISS USC_JUGGERNAUT USC_SAUCER USC_SAUCER_V2 USC_MOTHERSHIP USC_HUNTER USC_SEIGE USC_COLONY USC_ARMED_COL USC_HW_COL USC_STARPORT USC_HW_SPORT");
 	string const weap_strs ("UWEAP_NONE UWEAP_TARGET UWEAP_QUERY UWEAP_RENAME UWEAP_DESTROY UWEAP_PBEAM UWEAP_EBEAM UWEAP_REPULSER UWEAP_TRACTORB UWEAP_G_HOOK UWEAP_LRCPA UWEAP_ENERGY UWEAP_ATOMIC UWEAP_ROCKET UWEAP_NUKEDEV UWEAP_TORPEDO UWEAP_EMP UWEAP_PT_DEF UWEAP_DFLARE UWEAP_CHAFF UWEAP_FIGHTER UWEAP_B_BAY UWEAP_CRU_BAY UWEAP_SOD_BAY UWEAP_BOARDING UWEAP_NM_BAY UWEAP_RFIRE UWEAP_FUSCUT UWEAP_SHIELDD UWEAP_THUNDER UWEAP_ESTEAL UWEAP_WRAI_BAY UWEAP_STAR UWEAP_HUNTER UWEAP_DEATHORB UWEAP_LITNING UWEAP_INFERNO UWEAP_PARALYZE UWEAP_MIND_C UWEAP_SAUC_BAY UWEAP_SEIGEC UWEAP_HYPER");
 	string const exp_strs  ("ETYPE_NONE ETYPE_FIRE ETYPE_NUCLEAR ETYPE_ENERGY ETYPE_ATOMIC ETYPE_PLASMA ETYPE_EMP ETYPE_STARB ETYPE_FUSION ETYPE_EBURST ETYPE_ESTEAL ETYPE_ANIM_FIRE ETYPE_SIEGE ETYPE_FUSION_ROT ETYPE_PART_CLOUD ETYPE_PC_ICE, ETYPE_PBALL");
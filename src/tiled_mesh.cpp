@@ -8,6 +8,9 @@
 #include "openal_wrap.h"
 #include "heightmap.h"
 #include "profiler.h"
+#include "binary_file_io.h"
+#include "file_utils.h"
+#include <atomic>
 
 
 bool const DEBUG_TILES        = 0;
@@ -52,15 +55,16 @@ struct clear_area_t : public cube_t {
 
 bool tt_lightning_enabled(0), check_tt_mesh_occlusion(1), shadow_maps_disabled(0);
 unsigned inf_terrain_fire_mode(0); // none, increase height, decrease height
-string read_hmap_modmap_fn, write_hmap_modmap_fn("heightmap.mod");
+string read_hmap_modmap_fn, write_hmap_modmap_fn("heightmap.mod"), tt_tile_cache_dir; // tt_tile_cache_dir: empty = disabled
 hmap_brush_param_t cur_brush_param;
 tile_offset_t model3d_offset;
 vector<clear_area_t> tile_smaps_to_clear;
 
 extern bool inf_terrain_scenery, enable_tiled_mesh_ao, underwater, fog_enabled, volume_lighting, combined_gu, enable_depth_clamp, tt_triplanar_tex, use_grass_tess;
 extern bool use_instanced_pine_trees, enable_tt_model_reflect, water_is_lava, tt_fire_button_down, flashlight_on, camera_in_building, rotate_trees;
-extern bool player_in_int_elevator;
-extern unsigned grass_density, max_unique_trees, shadow_map_sz, erosion_iters_tt, num_rnd_grass_blocks, tiled_terrain_gen_heightmap_sz;
+extern bool player_in_int_elevator, in_loading_screen;
+extern thread_local bool mesh_noise_cpu_only;
+extern unsigned grass_density, max_unique_trees, shadow_map_sz, erosion_iters_tt, num_rnd_grass_blocks, tiled_terrain_gen_heightmap_sz, tt_gen_worker_threads, NUM_THREADS;
 extern unsigned num_birds_per_tile, num_fish_per_tile, num_bflies_per_tile, room_geom_mem;
 extern int DISABLE_WATER, display_mode, tree_mode, leaf_color_changed, ground_effects_level, animate2, iticks, num_trees, window_width, window_height, player_in_basement;
 extern int invert_mh_image, is_cloudy, camera_surf_collide, show_fog, mesh_gen_mode, mesh_gen_shape, cloud_model, precip_mode, auto_time_adv, draw_model;
@@ -96,6 +100,8 @@ int check_city_contains_overlaps(cube_t const &query);
 bool check_inside_city(point const &pos, float radius);
 cube_t get_city_bcube_overlapping(cube_t const &c);
 void show_gpu_mem_info();
+void print_room_geom_alloc_stats();
+void stop_tile_gen_pipeline();
 
 
 float get_inf_terrain_fog_dist() {return FOG_DIST_TILES*get_scaled_tile_radius()*(is_cloudy ? 0.25 : 1.0);} // lower fog distance when rainy/cloudy
@@ -180,35 +186,35 @@ void update_tiled_grass_colors() {grass_tile_manager.clear();} // regenerate gra
 
 class tiled_terrain_hmap_manager_t : public terrain_hmap_manager_t {
 
-	tile_t *cur_tile=nullptr;
-	bool modified[3][3];
-
+	void invalidate_tiles_in_region(int x1, int y1, int x2, int y2) const { // region is in mesh index space
+		int const tsize(get_tile_size()), ao_pad(AO_RAY_LEN + 1);
+		auto get_tile_ix([tsize](int v) {return int(floor(float(v)/tsize));});
+
+		for (int ty = get_tile_ix(y1 - ao_pad); ty <= get_tile_ix(y2 + ao_pad); ++ty) {
+			for (int tx = get_tile_ix(x1 - ao_pad); tx <= get_tile_ix(x2 + ao_pad); ++tx) {
+				tile_t *tile(get_tile_from_xy(tile_xy_pair(tx, ty)));
+				if (tile == nullptr) continue; // not loaded
+				// tile zvals span [tx*tsize, (tx+1)*tsize+1]; tiles that only see the region in their AO context just need to update AO and shadows
+				int const zx1(tx*tsize), zy1(ty*tsize), zx2(zx1 + tsize + 1), zy2(zy1 + tsize + 1);
+				if (x2 >= zx1 && x1 <= zx2 && y2 >= zy1 && y1 <= zy2) {tile->invalidate_mesh_height();}
+				else {tile->invalidate_ao_and_shadows();}
+			}
+		}
+	}
 public:
-	tiled_terrain_hmap_manager_t() {clear_modified();}
-	void clear_modified() {for (unsigned i = 0; i < 3; ++i) {UNROLL_3X(modified[i][i_] = 0;)}}
-
+	// Note: tile is only used to determine if tiles should be updated; the set of tiles is determined by the brush bounds
 	void apply_brush(tex_mod_map_manager_t::hmap_brush_t brush, tile_t *tile, bool cache) { // Note: brush is copied and may be modified
-		cur_tile = tile;
-		assert(brush.radius <= get_tile_size()); // only allow for a single adjacent tile
-		clear_modified();
-
 		if (brush.is_flatten_brush()) { // use heightmap value at brush center instead of a delta
 			brush.delta = get_clamped_pixel_value(brush.x, brush.y); // Note: original delta is overwritten/unused in this case
 		}
 		int const step_sz(max(1, int(1.0/mesh_scale + SMALL_NUMBER))); // Note: only intended to work when mesh_scale is a power of 0.5 (or generally an integer reciprocol)
 		unsigned const num_steps(max(1U, unsigned(mesh_scale + SMALL_NUMBER))); // Note: only intended to work when mesh_scale is a power of 2 (or generally an integer)
+		// tiles in the background pipeline aren't in the tile map yet, so they can't be invalidated; discard them before modifying the heightmap
+		stop_tile_gen_pipeline();
 		if (cache) {apply_and_cache_brush(brush, step_sz, num_steps);} else {terrain_hmap_manager_t::apply_brush(brush, step_sz, num_steps);}
-		if (cur_tile == NULL) return; // no tile specified, so can't do any updates
-		tile_xy_pair const tp(cur_tile->get_tile_xy_pair());
-
-		for (int dy = -1; dy <= 1; ++dy) {
-			for (int dx = -1; dx <= 1; ++dx) {
-				if (!modified[dy+1][dx+1]) continue;
-				tile_t *adj_tile(get_tile_from_xy(tile_xy_pair(tp.x + dx, tp.y + dy)));
-				if (adj_tile) {adj_tile->invalidate_mesh_height();}
-			}
-		}
-		cur_tile = NULL;
+		if (tile == nullptr) return; // no tile specified, so can't do any updates
+		int const pad(step_sz + 1); // zvals are interpolated across texels when mesh_scale < 1
+		invalidate_tiles_in_region((brush.x - (int)brush.radius - pad), (brush.y - (int)brush.radius - pad), (brush.x + (int)brush.radius + pad), (brush.y + (int)brush.radius + pad));
 	}
 	void flatten_region(cube_t const &cube) {
 		// Note: to be applied before tiles are generated so that they don't need to be invalidated
@@ -241,8 +247,8 @@ public:
 		int clamped_x(x), clamped_y(y);
 		if (!clamp_xy(clamped_x, clamped_y, fract_x, fract_y, allow_wrap)) return 0;
 		assert(clamped_x >= 0 && clamped_y >= 0);
-		modify_height(tex_mod_map_manager_t::mod_elem_t(clamped_x, clamped_y, val), is_delta); // Note: *not* cached at this level
-		if (cur_tile) {cur_tile->fill_adj_mask(modified, x, y);}
+		hmap_val_t const applied(modify_height(tex_mod_map_manager_t::mod_elem_t(clamped_x, clamped_y, val), is_delta));
+		if (applied != 0) {record_mod(tex_mod_map_manager_t::mod_elem_t(clamped_x, clamped_y, applied));} // record the net delta for the mod map
 		return 1;
 	}
 };
@@ -276,6 +282,96 @@ bool write_default_hmap_modmap() {
 }
 
 
+// *** tile disk cache ***
+
+// persistent cache of procedural tile data (zvals, AO lighting, and weight noise), keyed by tile position and all parameters used to generate them;
+// heightmap tiles aren't cached since they're cheap to create and the heightmap can be modified by cities, buildings, and mesh editing
+class tile_disk_cache_t {
+	static uint32_t const MAGIC   = 0x31435454; // "TTC1"
+	static uint32_t const VERSION = 1; // increment when the file format or tile generation code changes
+
+	mutable std::mutex key_mutex; // key is written by the main thread and read by gen pipeline worker threads
+	vector<uint8_t> key, new_key; // serialized gen params; written to each file header and compared on read so that hash collisions are misses
+	uint32_t key_hash=0;
+	std::atomic<unsigned> num_hits{0}, num_misses{0}, num_writes{0}, num_write_fails{0};
+
+	string get_filename(tile_xy_pair const &tp, uint32_t hash) const {
+		std::ostringstream oss;
+		oss << tt_tile_cache_dir << "/tile_" << std::hex << hash << std::dec << "_" << tp.x << "_" << tp.y << ".gz";
+		return oss.str();
+	}
+	uint32_t get_key(vector<uint8_t> &cur_key) const {
+		std::lock_guard<std::mutex> lock(key_mutex);
+		cur_key = key;
+		return key_hash;
+	}
+public:
+	static unsigned const SECT_ZVALS=1, SECT_AO=2, SECT_WEIGHTS=4; // file section bits
+
+	bool enabled() const {return (!tt_tile_cache_dir.empty() && !using_tiled_terrain_hmap_tex());}
+
+	void update_key() { // called by the main thread before tiles are created
+		if (!enabled()) return;
+		new_key.clear();
+		get_mesh_gen_state(new_key);
+		append_pod_bytes(new_key, MESH_X_SIZE);
+		append_pod_bytes(new_key, DX_VAL);
+		append_pod_bytes(new_key, DY_VAL);
+		append_pod_bytes(new_key, zmin); // used for erosion
+		append_pod_bytes(new_key, erosion_iters_tt);
+		if (new_key == key) return; // no change
+		std::lock_guard<std::mutex> lock(key_mutex);
+		key.swap(new_key);
+		key_hash = jenkins_one_at_a_time_hash(key.data(), key.size());
+	}
+	bool open_read(tile_xy_pair const &tp, binary_file_reader &reader) {
+		vector<uint8_t> cur_key;
+		uint32_t const hash(get_key(cur_key));
+		if (cur_key.empty()) return 0; // update_key() not yet called
+		string const fn(get_filename(tp, hash));
+		uint32_t header[3] = {}; // {magic, version, key size}
+		vector<uint8_t> file_key;
+
+		if (check_file_exists(fn) && reader.open(fn) && reader.read(header, sizeof(uint32_t), 3) && header[0] == MAGIC && header[1] == VERSION && header[2] == cur_key.size()) {
+			file_key.resize(header[2]);
+			if (reader.read(file_key.data(), 1, file_key.size()) && file_key == cur_key) return 1;
+		}
+		reader.try_close(); // close() exits on gzclose() errors, which can happen for truncated files
+		return 0;
+	}
+	bool open_write(tile_xy_pair const &tp, binary_file_writer &writer, string &fn, string &tmp_fn) {
+		vector<uint8_t> cur_key;
+		uint32_t const hash(get_key(cur_key));
+		if (cur_key.empty()) return 0; // update_key() not yet called
+		fn     = get_filename(tp, hash);
+		tmp_fn = fn + ".tmp.gz"; // written to a temp file then renamed so that readers never see a partial file
+		uint32_t const header[3] = {MAGIC, VERSION, (uint32_t)cur_key.size()};
+
+		// open errors (such as a missing cache directory) are reported once by finish_write() rather than for every tile
+		if (writer.binary_file_io::open(tmp_fn, "wb1", "tile cache writing", 0) && writer.write(header, sizeof(uint32_t), 3) && writer.write(cur_key.data(), 1, cur_key.size())) return 1;
+		writer.try_close();
+		return 0;
+	}
+	void finish_write(string const &fn, string const &tmp_fn, bool success) {
+#ifdef _WIN32
+		if (success) {remove(fn.c_str());} // rename() fails on Windows if the destination exists
+#endif
+		if (success && rename(tmp_fn.c_str(), fn.c_str()) == 0) {++num_writes; return;}
+		remove(tmp_fn.c_str());
+		if (num_write_fails++ == 0) {cerr << "Error writing tiled terrain cache file " << fn << "; does the directory " << tt_tile_cache_dir << " exist?" << endl;}
+	}
+	void register_hit () {++num_hits;}
+	void register_miss() {++num_misses;}
+
+	void show_stats() const {
+		if (tt_tile_cache_dir.empty()) return;
+		cout << "tile cache: hits: " << num_hits << ", misses: " << num_misses << ", writes: " << num_writes << ", write fails: " << num_write_fails << endl;
+	}
+};
+
+tile_disk_cache_t tile_disk_cache;
+
+
 // *** tile_t ***
 
 tile_t::tile_t() : decid_trees(tree_data_manager) {}
@@ -325,15 +421,6 @@ void tile_t::update_terrain_params() { // setup biomes
 
 
 // used to determine what adjacent tiles modifying this location in global space can affect
-void tile_t::fill_adj_mask(bool mask[3][3], int x, int y) const { // mask is {y-1, y, y+1} x {x-1, x, x+1}
-
-	if (x >= x1 && x <= x2 && y >= y1 && y <= y2) {mask[1][1] |= 1;} // ourself
-	if (x <= x1) {mask[1][0] |= 1; mask[0][0] |= (y <= y1); mask[2][0] |= (y >= y2);} // left  + top/bottom left  corners
-	if (x >= x2) {mask[1][2] |= 1; mask[0][2] |= (y <= y1); mask[2][2] |= (y >= y2);} // right + top/bottom right corners
-	mask[0][1] |= (y <= y1); mask[2][1] |= (y >= y2); // top/bottom edges
-}
-
-
 float tile_t::get_min_dist_to_pt(point const &pt, bool xy_only, bool mesh_only) const {
 
 	cube_t const bcube(mesh_only ? get_mesh_bcube() : get_bcube());
@@ -445,10 +532,9 @@ bool tile_t::create_zvals(mesh_xy_grid_cache_t &height_gen, bool no_wait) {
 	//timer_t timer("Create Zvals");
 	inside_city = check_city_contains_overlaps(get_mesh_bcube_global());
 	if (enable_terrain_env) {update_terrain_params();}
+	if (read_from_disk_cache()) return 1; // results are ready
 	zvals.resize(zvsize*zvsize);
-	mzmin =  FAR_DISTANCE;
-	mzmax = -FAR_DISTANCE;
-	unsigned const block_size(zvsize/4), context_sz(stride + 2*AO_RAY_LEN);
+	unsigned const context_sz(stride + 2*AO_RAY_LEN);
 	bool const using_hmap(using_tiled_terrain_hmap_tex()), add_detail(using_hmap_with_detail()); // add procedural detail to heightmap
 
 	// When using AO + GPU noise generation, it's faster to compute the AO + context and clip the zvals from this rather than making two separate compute calls (one without blocking)
@@ -466,7 +552,7 @@ bool tile_t::create_zvals(mesh_xy_grid_cache_t &height_gen, bool no_wait) {
 		bool results_ready(setup_height_gen(height_gen, get_xval(x1), get_yval(y1), deltax, deltay, zvsize, zvsize, 0, no_wait)); // cache_values=0
 		if (!results_ready) {assert(no_wait); return 0;} // cached heights are not yet ready
 	}
-	float const xy_mult(1.0/float(size)), wpz_max(get_max_sea_level());
+	float const xy_mult(1.0/float(size));
 
 #pragma omp parallel for schedule(static,1)
 	for (int y = 0; y < (int)zvsize; ++y) {
@@ -489,6 +575,19 @@ bool tile_t::create_zvals(mesh_xy_grid_cache_t &height_gen, bool no_wait) {
 		} // for x
 	} // for y
 	if (!using_hmap) {apply_erosion(&zvals.front(), zvsize, zvsize, zmin, erosion_iters_tt);} // heightmap is eroded during load
+	calc_zval_bounds();
+	if (DEBUG_TILES) {cout << "new tile coords: " << x1 << " " << y1 << " " << x2 << " " << y2 << endl;}
+	return 1; // results are ready
+}
+
+void tile_t::calc_zval_bounds() {
+
+	unsigned const block_size(zvsize/4);
+	float const wpz_max(get_max_sea_level());
+	mzmin =  FAR_DISTANCE;
+	mzmax = -FAR_DISTANCE;
+	wx1 = x2; wy1 = y2; wx2 = x1; wy2 = y1; // start denormalized
+	mesh_dz = 0.0;
 
 	for (unsigned yy = 0; yy < 4; ++yy) {
 		for (unsigned xx = 0; xx < 4; ++xx) {
@@ -517,8 +616,86 @@ bool tile_t::create_zvals(mesh_xy_grid_cache_t &height_gen, bool no_wait) {
 	radius = 0.5*sqrt((deltax*deltax + deltay*deltay)*size*size + (mzmax - mzmin)*(mzmax - mzmin));
 	ptzmax = dtzmax = mzmin; // no trees yet
 	if (!can_have_trees()) {no_trees = 1;} // mark as no_trees so that trees don't pop when water is disabled later
-	if (DEBUG_TILES) {cout << "new tile coords: " << x1 << " " << y1 << " " << x2 << " " << y2 << endl;}
-	return 1; // results are ready
+}
+
+// called when the heightmap has been edited under this tile; recomputes zvals and frees everything derived from them,
+// but keeps the tile, its animals and clouds, and the GPU state of unaffected tiles
+void tile_t::refresh_mesh_height(tile_shadow_map_manager &smap_manager) {
+
+	clear_vbo_tid(&smap_manager); // height, normal, weight, and shadow textures will be recreated when drawn
+	clear(); // trees, scenery, grass, and flowers will be regenerated on the new surface
+	decid_trees.reset(); // clear() doesn't allow regeneration
+	ao_lighting.clear();
+	mesh_xy_grid_cache_t height_gen; // only used for heightmap detail
+	create_zvals(height_gen, 0); // no_wait=0
+	mesh_height_invalid = 0;
+}
+
+bool tile_t::read_from_disk_cache() { // may be called by gen pipeline worker threads
+
+	if (!tile_disk_cache.enabled()) return 0;
+	binary_file_reader reader;
+	if (!tile_disk_cache.open_read(get_tile_xy_pair(), reader)) {tile_disk_cache.register_miss(); return 0;}
+	uint32_t info[3] = {}; // {zvsize, stride, sections}
+	bool success(reader.read(info, sizeof(uint32_t), 3) && info[0] == zvsize && info[1] == stride);
+
+	if (success) {
+		zvals.resize(zvsize*zvsize);
+		success = reader.read(zvals.data(), sizeof(float), zvals.size());
+	}
+	if (success && (info[2] & tile_disk_cache_t::SECT_AO)) {
+		ao_lighting.resize(stride*stride);
+		success = reader.read(ao_lighting.data(), sizeof(unsigned char), ao_lighting.size());
+	}
+	if (success && (info[2] & tile_disk_cache_t::SECT_WEIGHTS)) {
+		weight_rand_vals.resize(stride*stride);
+		success = reader.read(weight_rand_vals.data(), sizeof(float), weight_rand_vals.size());
+	}
+	reader.try_close(); // non-fatal; the data has already been read and checked
+	if (!success) { // truncated or incompatible file; regenerate and overwrite it
+		zvals.clear();
+		ao_lighting.clear();
+		weight_rand_vals.clear();
+		tile_disk_cache.register_miss();
+		return 0;
+	}
+	if (!enable_tiled_mesh_ao) {ao_lighting.clear();}
+	calc_zval_bounds();
+	disk_cache_sects = (info[2] | tile_disk_cache_t::SECT_ZVALS);
+	tile_disk_cache.register_hit();
+	return 1;
+}
+
+// may be called by gen pipeline worker threads; writes whichever of AO and weight noise have been computed,
+// and rewrites the file if it was read without sections that have been computed since then
+void tile_t::write_to_disk_cache() {
+
+	if (!tile_disk_cache.enabled() || zvals.empty()) return;
+	assert(zvals.size() == zvsize*zvsize);
+	bool const has_ao(ao_lighting.size() == stride*stride), has_weights(weight_rand_vals.size() == stride*stride);
+	unsigned const sects(tile_disk_cache_t::SECT_ZVALS | (has_ao ? tile_disk_cache_t::SECT_AO : 0) | (has_weights ? tile_disk_cache_t::SECT_WEIGHTS : 0));
+	if ((sects & ~disk_cache_sects) == 0) return; // nothing new to write
+	uint32_t const info[3] = {zvsize, stride, sects};
+	binary_file_writer writer;
+	string fn, tmp_fn;
+	bool success(tile_disk_cache.open_write(get_tile_xy_pair(), writer, fn, tmp_fn));
+	success = (success && writer.write(info, sizeof(uint32_t), 3) && writer.write(zvals.data(), sizeof(float), zvals.size()));
+	if (success && has_ao     ) {success = writer.write(ao_lighting.data(),      sizeof(unsigned char), ao_lighting.size());}
+	if (success && has_weights) {success = writer.write(weight_rand_vals.data(), sizeof(float),         weight_rand_vals.size());}
+	success &= writer.try_close(); // must be closed before the rename; non-fatal, since this may be called on a worker thread
+	tile_disk_cache.finish_write(fn, tmp_fn, success);
+	disk_cache_sects |= sects; // don't retry on failure
+}
+
+// called on a gen pipeline worker thread before the tile is inserted; must not make GL calls or access other tiles
+void tile_t::run_gen_stage(unsigned stage, mesh_xy_grid_cache_t &height_gen) {
+
+	switch (stage) {
+	case TGEN_STAGE_ZVALS:   create_zvals(height_gen, 0); break; // no_wait=0, so always completes
+	case TGEN_STAGE_AO:      if (enable_tiled_mesh_ao && ao_lighting.empty()) {calc_mesh_ao_lighting();} break; // may have been read from the disk cache
+	case TGEN_STAGE_WEIGHTS: if (weight_rand_vals.empty()) {calc_weight_rand_vals(height_gen);} break;
+	default: assert(0);
+	}
 }
 
 void tile_t::get_z_minmax_for_area(point const &pos, float radius, float &zmin, float &zmax) const {
@@ -1047,6 +1224,25 @@ bool check_region_int(cube_t const &region, vect_cube_t const &cubes) { // has_b
 	}
 	return 0;
 }
+// noise used to vary the texture weights; this is in global space and has no GL calls, so it can be computed by the gen pipeline
+void tile_t::calc_weight_rand_vals(mesh_xy_grid_cache_t &height_gen) {
+
+	unsigned const tsize(stride);
+	float const MESH_NOISE_SCALE = 0.003;
+	float const MESH_NOISE_FREQ  = 80.0;
+	float const noise_scale(((mesh_gen_shape == 2) ? 2.0 : 1.0)*MESH_NOISE_SCALE*mesh_scale_z); // add more noise for ridged
+	height_gen.build_arrays(MESH_NOISE_FREQ*get_xval(x1), MESH_NOISE_FREQ*get_yval(y1), MESH_NOISE_FREQ*deltax,
+		MESH_NOISE_FREQ*deltay, tsize, tsize, 0, 1); // force_sine_mode=1
+	weight_rand_vals.resize(tsize*tsize);
+
+#pragma omp parallel for schedule(static,1) num_threads(2)
+	for (int y = 0; y < (int)tsize-DEBUG_TILE_BOUNDS; ++y) {
+		for (unsigned x = 0; x < tsize-DEBUG_TILE_BOUNDS; ++x) {
+			weight_rand_vals[y*tsize + x] = noise_scale*height_gen.eval_index(x, y, 50);
+		}
+	}
+}
+
 void tile_t::create_texture(mesh_xy_grid_cache_t &height_gen) {
 
 	//highres_timer_t timer("Create Tile Weights Texture"); // 1.38ms base, 1.5ms with buildings/roads/driveways/porches/doorsteps
@@ -1061,10 +1257,7 @@ void tile_t::create_texture(mesh_xy_grid_cache_t &height_gen) {
 		mesh_weight_data.resize(4*num_texels); // RGBA
 		unsigned const grass_block_dim(get_grass_block_dim());
 		float const xy_mult(1.0/float(size)), water_level(get_water_z_height());
-		float const MESH_NOISE_SCALE = 0.003;
-		float const MESH_NOISE_FREQ  = 80.0;
 		float const dz_inv(1.0f/(zmax - zmin));
-		float const noise_scale(((mesh_gen_shape == 2) ? 2.0 : 1.0)*MESH_NOISE_SCALE*mesh_scale_z); // add more noise for ridged
 		float const steep_mult_grass(1.0f/(sthresh[0][1] - sthresh[0][0]));
 		float const steep_mult_snow (1.0f/(sthresh[1][1] - sthresh[1][0]));
 		float const steep_mult_rock (1.0f/(0.8f*sthresh[0][0] - 0.5f*sthresh[0][0]));
@@ -1073,21 +1266,15 @@ void tile_t::create_texture(mesh_xy_grid_cache_t &height_gen) {
 		point const query_pos(get_xval(tsize/2 + llc_x), get_yval(tsize/2 + llc_y), 0.0); // in local tile space, not camera space
 		bool const check_mesh_mask(check_mesh_disable(query_pos, radius)), check_buildings(no_grass_under_buildings());
 		int k1, k2, k3, k4;
-		height_gen.build_arrays(MESH_NOISE_FREQ*get_xval(x1), MESH_NOISE_FREQ*get_yval(y1), MESH_NOISE_FREQ*deltax,
-			MESH_NOISE_FREQ*deltay, tsize, tsize, 0, 1); // force_sine_mode=1
-		vector<float> rand_vals(tsize*tsize);
+		if (weight_rand_vals.empty()) {calc_weight_rand_vals(height_gen);} // not precomputed
+		vector<float> rand_vals;
+		rand_vals.swap(weight_rand_vals); // only needed once
 		bool row_ec_valid(0);
 		vect_cube_t exclude_cubes, row_exclude_cubes, allow_cubes; // in camera space
 		cube_t const mesh_bcube(get_mesh_bcube());
 		get_city_grass_coll_cubes(mesh_bcube, exclude_cubes, allow_cubes);
 		has_tunnel |= tile_contains_tunnel(mesh_bcube);
 
-#pragma omp parallel for schedule(static,1) num_threads(2)
-		for (int y = 0; y < (int)tsize-DEBUG_TILE_BOUNDS; ++y) {
-			for (unsigned x = 0; x < tsize-DEBUG_TILE_BOUNDS; ++x) {
-				rand_vals[y*tsize + x] = noise_scale*height_gen.eval_index(x, y, 50);
-			}
-		}
 		for (unsigned y = 0; y < tsize-DEBUG_TILE_BOUNDS; ++y) { // not threadsafe
 			float const yv(float(y)*xy_mult), ry(get_yval(y + llc_y + yoff)), radius_y(0.75*DY_VAL), ry1(ry - radius_y), ry2(ry + radius_y);
 			row_ec_valid = 0;
@@ -1287,13 +1474,13 @@ bool tile_t::update_range(tile_shadow_map_manager &smap_manager) { // if returns
 	update_animals(); // if any were generated
 	float const dist(get_rel_dist_to_camera());
 	
-	if (dist > CLEAR_DIST_TILES || mesh_height_invalid) {
+	if (dist > CLEAR_DIST_TILES) {
 		if (!just_cleared) {clear_vbo_tid(&smap_manager);} // avoid clearing every frame
 		just_cleared = 1;
 	}
 	else {just_cleared = 0;}
 	if (dist*TILE_RADIUS > SMAP_DEL_THRESH*smap_thresh_scale) {clear_shadow_map(&smap_manager);} // too far, delete old shadow maps
-	return (dist < DELETE_DIST_TILES && !mesh_height_invalid);
+	return (dist < DELETE_DIST_TILES);
 }
 
 
@@ -2186,11 +2373,108 @@ void tile_draw_t::clear(bool no_regen_buildings) {
 	for (tile_map::iterator i = tiles.begin(); i != tiles.end(); ++i) {i->second->clear();} // may not be necessary
 	to_draw.clear();
 	tiles.clear();
+	gen_pipeline.stop(); // discard tiles that are being generated
 	shadow_recomp_queue.clear();
 	if (!no_regen_buildings && !have_cities()) {buildings_valid = 0;} // can't regenerate buildings after cities and cars have been placed
 }
 
+// *** tile_gen_pipeline_t ***
+
+void tile_gen_pipeline_t::start(unsigned num_threads) {
+
+	assert(workers.empty() && num_threads > 0);
+	kill_threads = 0;
+	for (unsigned i = 0; i < num_threads; ++i) {workers.emplace_back(&tile_gen_pipeline_t::worker_loop, this, num_threads);}
+}
+
+void tile_gen_pipeline_t::stop() { // waits for running stages to complete, then deletes all tiles that haven't been taken
+
+	if (workers.empty()) return;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		kill_threads = 1;
+	}
+	cv.notify_all();
+	for (std::thread &t : workers) {t.join();}
+	workers.clear();
+	for (job_t const &job : queue) {delete job.tile;}
+	for (tile_t *tile : finished) {delete tile;}
+	queue.clear();
+	finished.clear();
+	in_flight.clear();
+}
+
+void tile_gen_pipeline_t::worker_loop(unsigned num_workers) {
+
+	mesh_noise_cpu_only = 1; // no GL context on this thread
+	omp_set_num_threads_3dw(max(1U, NUM_THREADS/num_workers)); // split the cores across workers for the parallel loops inside each stage
+	mesh_xy_grid_cache_t height_gen; // reused across tiles
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while (1) {
+		cv.wait(lock, [this]() {return (kill_threads || !queue.empty());});
+		if (kill_threads) break;
+		auto best(queue.begin());
+
+		for (auto j = queue.begin(); j != queue.end(); ++j) {
+			if (j->priority < best->priority) {best = j;}
+		}
+		job_t job(*best);
+		*best = queue.back(); // swap and pop
+		queue.pop_back();
+		lock.unlock();
+		job.tile->run_gen_stage(job.stage, height_gen);
+		if (job.stage+1 == NUM_TGEN_STAGES) {job.tile->write_to_disk_cache();} // all stages done
+		lock.lock();
+		// requeue for the next stage rather than continuing, so that higher priority tiles that were added in the meantime run first
+		if (++job.stage < NUM_TGEN_STAGES) {queue.push_back(job); cv.notify_one();}
+		else {finished.push_back(job.tile);}
+	} // end while()
+}
+
+void tile_gen_pipeline_t::add_tile(tile_t *tile) {
+
+	bool const did_ins(in_flight.insert(tile->get_tile_xy_pair()).second);
+	assert(did_ins);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queue.emplace_back(tile, tile->get_draw_priority());
+	}
+	cv.notify_one();
+}
+
+void tile_gen_pipeline_t::update_queue(float max_rel_dist) { // update priorities for the current camera and drop tiles that are no longer needed
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (unsigned i = 0; i < queue.size(); ) { // Note: no ++i
+		tile_t *const tile(queue[i].tile); // not running, so it's safe to access
+
+		if (!tile->rel_dist_to_camera_xy_lt(max_rel_dist)) { // too far away
+			in_flight.erase(tile->get_tile_xy_pair());
+			delete tile;
+			queue[i] = queue.back();
+			queue.pop_back();
+		}
+		else {queue[i++].priority = tile->get_draw_priority();}
+	}
+}
+
+void tile_gen_pipeline_t::take_finished(vector<tile_t *> &tiles) {
+
+	assert(tiles.empty());
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		tiles.swap(finished);
+	}
+	for (tile_t *tile : tiles) {in_flight.erase(tile->get_tile_xy_pair());}
+}
+
+
+// *** tile_draw_t ***
+
 void tile_draw_t::insert_tile(tile_t *tile) {
+	tile->write_to_disk_cache(); // no-op for gen pipeline tiles, which were written by the worker thread
 	bool const did_ins(tiles.insert(make_pair(tile->get_tile_xy_pair(), tile)).second);
 	assert(did_ins);
 }
@@ -2222,6 +2506,7 @@ float tile_draw_t::update(float &min_camera_dist) { // view-independent updates;
 		buildings_valid = 1;
 	}
 	auto_calc_model_zvals(); // must be done after heightmap loading but before any tiles are created
+	tile_disk_cache.update_key();
 	to_draw.clear();
 	terrain_zmin = FAR_DISTANCE;
 	grass_tile_manager.update(); // every frame, even if not in tiled terrain mode?
@@ -2247,7 +2532,28 @@ float tile_draw_t::update(float &min_camera_dist) { // view-independent updates;
 		}
 		to_gen_zvals.clear();
 	}
+	// mesh editing modifies the heightmap, and loading screen updates make GL calls, so tiles are generated synchronously in these cases
+	bool const use_gen_pipeline(tt_gen_worker_threads > 0 && inf_terrain_fire_mode == FM_NONE && !in_loading_screen);
+	if (use_gen_pipeline && !gen_pipeline.is_running()) {gen_pipeline.start(tt_gen_worker_threads);}
+
+	if (gen_pipeline.is_running()) { // insert tiles that have completed background generation
+		gen_finished.clear();
+		gen_pipeline.take_finished(gen_finished);
+
+		for (tile_t *tile : gen_finished) {
+			if (tile->rel_dist_to_camera_xy_lt(CREATE_DIST_TILES)) {insert_tile(tile);}
+			else {delete tile;} // camera has moved away
+		}
+		gen_finished.clear();
+		gen_pipeline.update_queue(CREATE_DIST_TILES);
+	}
+	// workers must not run while the heightmap is edited; this waits for running stages and discards unfinished tiles, which are regenerated synchronously
+	if (!use_gen_pipeline) {gen_pipeline.stop();}
 	for (tile_map::iterator i = tiles.begin(); i != tiles.end(); ) { // update tiles and free old tiles (Note: no ++i)
+		if (i->second->is_mesh_height_invalid()) { // heightmap was edited; update in place rather than deleting and recreating the tile
+			remove_buildings_tile(i->first.x, i->first.y); // recreated below at the new mesh height
+			i->second->refresh_mesh_height(smap_manager);
+		}
 		if (!i->second->update_range(smap_manager)) { // delete this tile
 			remove_buildings_tile(i->first.x, i->first.y); // required to avoid memory leak when player teleports to a new location
 			i->second->clear();
@@ -2258,13 +2564,14 @@ float tile_draw_t::update(float &min_camera_dist) { // view-independent updates;
 	for (int y = y1; y <= y2; ++y ) { // create new tiles
 		for (int x = x1; x <= x2; ++x ) {
 			tile_xy_pair const txy(x, y);
-			if (tiles.find(txy) != tiles.end()) continue; // already exists
+			if (tiles.find(txy) != tiles.end() || gen_pipeline.contains(txy)) continue; // already exists or is being generated
 			tile_t tile(get_tile_size(), x, y);
 			if (!tile.rel_dist_to_camera_xy_lt(CREATE_DIST_TILES)) continue; // too far away to create
 			tile_t *new_tile(new tile_t(tile));
-			to_gen_zvals.push_back(make_pair(new_tile->get_draw_priority(), new_tile));
 			// in this mode, we need to place buildings and flatten the heightmap before calculating tile heights
 			if (create_buildings_first) {create_buildings_tile(x, y, 1);}
+			if (use_gen_pipeline) {gen_pipeline.add_tile(new_tile);} // zvals, AO, and weights are generated in the background
+			else {to_gen_zvals.push_back(make_pair(new_tile->get_draw_priority(), new_tile));}
 		} // for x
 	} // for y
 	//if (to_gen_zvals.size() < max_cpu_tiles) {to_gen_zvals.clear();} // block until at least max_cpu_tiles tiles to generate (lower average gen time, but causes more slow frames/lag)
@@ -2610,6 +2917,8 @@ uint64_t tile_draw_t::show_debug_stats(bool calc_mem_only) const {
 		<< ", grass MB: " << in_mb(grass_mem) << ", smap MB: " << in_mb(smap_mem) << ", smap free list MB: " << in_mb(smap_free_list_mem)
 		<< ", dlights smap mem MB: " << in_mb(dlights_smap_mem) << ", frame buf MB: " << in_mb(frame_buf_mem) << ", texture MB: " << in_mb(texture_mem)
 		<< ", building MB: " << in_mb(building_mem) << ", room_geom MB: " << in_mb(room_geom_mem) << ", model MB: " << in_mb(models_mem) << endl;
+	tile_disk_cache.show_stats();
+	if (room_geom_mem > 0) {print_room_geom_alloc_stats();}
 	//show_gpu_mem_info(); // shows total and available video memory
 	return tot_mem;
 }
@@ -3513,6 +3822,7 @@ bool tile_smap_data_t::needs_update(point const &lpos) {
 
 tile_t *get_tile_from_xy  (tile_xy_pair const &tp) {return terrain_tile_draw.get_tile_from_xy(tp);}
 float update_tiled_terrain(float &min_camera_dist) {return terrain_tile_draw.update(min_camera_dist);}
+void stop_tile_gen_pipeline() {terrain_tile_draw.stop_gen_pipeline();}
 void pre_draw_tiled_terrain() {terrain_tile_draw.pre_draw();}
 void show_tiled_terrain_debug_stats() {terrain_tile_draw.show_debug_stats(0);} // calc_mem_only=0
 uint64_t get_tiled_terrain_gpu_mem() {return terrain_tile_draw.show_debug_stats(1);} // calc_mem_only=1
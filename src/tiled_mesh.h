@@ -15,6 +15,9 @@
 #include "animals.h"
 #include <unordered_map>
 #include <unordered_set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 
 bool const ENABLE_TREE_LOD    = 1; // faster but has popping artifacts
@@ -167,10 +170,11 @@ private:
 	float radius=0, mzmin=0, mzmax=0, mesh_dz=0, ptzmax=0, dtzmax=0, trmax=0, xstart=0, ystart=0, min_normal_z=0, deltax=0, deltay=0;
 	bool sun_shadows_invalid=1, moon_shadows_invalid=1, recalc_tree_grass_weights=1, mesh_height_invalid=0, in_queue=0, last_occluded=0, has_any_grass=0;
 	bool is_distant=0, no_trees=0, just_cleared=0, has_tunnel=0;
+	unsigned char disk_cache_sects=0; // tile_disk_cache_t section bits that are in this tile's cache file
 	colorRGB avg_mesh_tex_color;
 	tile_offset_t mesh_off, ptree_off, dtree_off, scenery_off;
 	float sub_zmin[4][4] = {0}, sub_zmax[4][4] = {0};
-	vector<float> zvals, ao_zvals;
+	vector<float> zvals, ao_zvals, weight_rand_vals; // weight_rand_vals may be precomputed by the gen pipeline
 	vector<tree_map_val> tree_map;
 	vector<unsigned char> mesh_weight_data, weight_data, ao_lighting;
 	vector<unsigned char> smask[NUM_LIGHT_SRC];
@@ -225,6 +229,8 @@ public:
 	bool has_grass() const {return !grass_blocks.empty();}
 	bool get_checkerboard_bit() const {return (((x1/128) + (y1/128)) & 1);}
 	void invalidate_mesh_height() {mesh_height_invalid = 1;}
+	bool is_mesh_height_invalid() const {return mesh_height_invalid;}
+	void invalidate_ao_and_shadows() {ao_lighting.clear(); sun_shadows_invalid = moon_shadows_invalid = 1;}
 	float get_avg_veg() const {return 0.25f*(params[0][0].veg + params[0][1].veg + params[1][0].veg + params[1][1].veg);}
 	void set_last_occluded(bool val) {last_occluded = val; last_occluded_frame = frame_counter;}
 	bool was_last_occluded  () const {return (last_occluded_frame == frame_counter &&  last_occluded);}
@@ -266,7 +272,6 @@ public:
 		float const xv1(get_xval(x1)), yv1(get_yval(y1));
 		return cube_t(xv1, xv1+(x2-x1)*deltax, yv1, yv1+(y2-y1)*deltay, mzmin, mzmax);
 	}
-	void fill_adj_mask(bool mask[3][3], int x, int y) const;
 	float get_min_dist_to_pt(point const &pt, bool xy_only=0, bool mesh_only=1) const;
 	float get_max_xy_dist_to_pt(point const &pt) const;
 	bool contains_point(point const &pos) const {return get_bcube().contains_pt_xy(pos);} // XY only
@@ -285,6 +290,10 @@ public:
 	void clear_vbo_tid(tile_shadow_map_manager *smap_manager);
 	void clear_pine_tree_vbos() {pine_trees.clear_vbos();}
 	bool create_zvals(mesh_xy_grid_cache_t &height_gen, bool no_wait);
+	void calc_zval_bounds();
+	void refresh_mesh_height(tile_shadow_map_manager &smap_manager);
+	bool read_from_disk_cache();
+	void write_to_disk_cache();
 	void get_z_minmax_for_area(point const &pos, float radius, float &zmin, float &zmax) const;
 	float get_zval_at(float x, float y, bool in_global_space) const;
 
@@ -328,6 +337,8 @@ public:
 	void ensure_height_tid();
 	unsigned get_grass_block_dim() const {return (1+(size-1)/GRASS_BLOCK_SZ);} // ceil
 	void create_texture(mesh_xy_grid_cache_t &height_gen);
+	void calc_weight_rand_vals(mesh_xy_grid_cache_t &height_gen);
+	void run_gen_stage(unsigned stage, mesh_xy_grid_cache_t &height_gen);
 	void add_grass_block_at(unsigned x, unsigned y, float mhmin, float mhmax, unsigned grass_block_dim);
 	void create_or_update_weight_tex();
 	void calc_avg_mesh_color();
@@ -419,6 +430,40 @@ public:
 }; // tile_t
 
 
+enum {TGEN_STAGE_ZVALS=0, TGEN_STAGE_AO, TGEN_STAGE_WEIGHTS, NUM_TGEN_STAGES};
+
+// generates new tiles on a persistent pool of worker threads; each tile runs through the CPU-only stages in order, with the
+// closest/visible tiles first, and is handed back to the render thread once all stages are done; only the render thread calls the public functions
+class tile_gen_pipeline_t {
+
+	struct job_t {
+		tile_t *tile;
+		unsigned stage;
+		float priority; // lower values run first
+		job_t(tile_t *tile_, float priority_) : tile(tile_), stage(TGEN_STAGE_ZVALS), priority(priority_) {}
+	};
+	vector<std::thread> workers;
+	std::mutex mutex; // protects queue, finished, and kill_threads
+	std::condition_variable cv;
+	vector<job_t> queue; // waiting for a worker; not all jobs are running, so this is a vector rather than a priority_queue
+	vector<tile_t *> finished;
+	unordered_set<tile_xy_pair, hash_tile_xy_pair> in_flight; // all tiles owned by the pipeline
+	bool kill_threads=0;
+
+	void worker_loop(unsigned num_workers);
+public:
+	~tile_gen_pipeline_t() {stop();}
+	bool is_running() const {return !workers.empty();}
+	bool contains(tile_xy_pair const &tp) const {return (in_flight.find(tp) != in_flight.end());}
+	unsigned size() const {return in_flight.size();}
+	void start(unsigned num_threads);
+	void stop();
+	void add_tile(tile_t *tile);
+	void update_queue(float max_rel_dist);
+	void take_finished(vector<tile_t *> &tiles);
+}; // tile_gen_pipeline_t
+
+
 class tile_draw_t : public indexed_vbo_manager_t {
 
 	typedef unordered_map<tile_xy_pair, unique_ptr<tile_t>, hash_tile_xy_pair> tile_map;
@@ -433,6 +478,8 @@ class tile_draw_t : public indexed_vbo_manager_t {
 	vector<tile_t *> occluded_tiles, to_draw_trunk_pts;
 	cloud_draw_list_t to_draw_clouds;
 	vector<mesh_xy_grid_cache_t> height_gens;
+	vector<tile_t *> gen_finished;
+	tile_gen_pipeline_t gen_pipeline;
 	lightning_strike_t lightning_strike;
 	tree_lod_render_t lod_renderer;
 	crack_ibuf_t crack_ibuf;
@@ -459,6 +506,7 @@ public:
 	~tile_draw_t() {/*clear();*/}
 	void clear(bool no_regen_buildings);
 	void free_compute_shader();
+	void stop_gen_pipeline() {gen_pipeline.stop();}
 	float update(float &min_camera_dist);
 private:
 	static void setup_terrain_textures(shader_t &s, unsigned start_tu_id);
@@ -380,6 +380,7 @@ public:
 	void calc_bcube();
 	void clear_context();
 	void clear() {delete_all(); vector<tree>::clear();}
+	void reset() {clear(); generated = 0;} // allows trees to be regenerated
 	unsigned get_gpu_mem() const;
 	float get_rmax() const;
 	unsigned get_closest_tree_type(point const &pos) const;
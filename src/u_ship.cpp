@@ -408,7 +408,7 @@ bool u_ship::do_multi_target() const { // add time delay/rand-mod?
 }
 
 
-free_obj const *u_ship::find_closest_target(point const &pos0, float min_dist, float max_dist, bool req_shields) const {
+free_obj const *u_ship::find_closest_target(point const &pos0, float min_dist, float max_dist, bool req_shields, rand_gen_t *rgen) const {
 
 	bool const dir_pref(specs().max_turn > 0.0);
 
@@ -425,7 +425,7 @@ free_obj const *u_ship::find_closest_target(point const &pos0, float min_dist, f
 			case ALIGN_PLAYER:
 				if (!player_enemy) return NULL;
 			default: // ALIGN_PIRATE, ALIGN_RED, ALIGN_BLUE, etc.
-				if (COMMON_TARGETS && (rand()&7) == 0) { // every 8th frame
+				if (COMMON_TARGETS && ((rgen ? rgen->rand() : rand())&7) == 0) { // every 8th frame
 					free_obj const *friendly(get_closest_ship(pos0, min_dist, max_dist, 0, 0, 0, 0, 0));
 					
 					if (friendly) { // see if a friendly has chosen a target, and if so, then accept the target as our own
@@ -446,59 +446,65 @@ free_obj const *u_ship::find_closest_target(point const &pos0, float min_dist, f
 }
 
 
-void u_ship::acquire_target(float min_dist) {
+// computes the new target without modifying any state so that it can be called in parallel;
+// rgen is used in place of rand() when non-null to make the result independent of thread scheduling
+void u_ship::calc_target_plan(float min_dist, target_plan_t &plan, rand_gen_t *rgen) const {
 
+	auto rand_int([rgen]() {return (rgen ? rgen->rand() : rand());});
 	unsigned const ai_base_type(ai_type & AI_BASE_TYPE);
 	float const tdist((target_obj == NULL) ? 0.0 : p2p_dist(pos, target_obj->get_pos()));
 	float search_dist(specs().sensor_dist);
+	free_obj const *targ(target_obj);
+	plan             = target_plan_t();
+	plan.min_dist    = min_dist;
+	plan.prev_target = target_obj;
+	plan.tup_time    = tup_time;
 
 	if (!can_move() && fighters.empty()) { // if can't move, then there is no point to acquiring a target out of weapons range
 		float const weap_range(specs().get_weap_range());
 		if (weap_range > 0.0) {search_dist = min(search_dist, (1.1f*weap_range + c_radius));}
 	}
-	if (target_obj != NULL && (target_obj->is_resetting() || target_obj->is_invisible() || (COMMON_TARGETS < 2 && tdist > search_dist))) {
-		target_obj = NULL; // don't target a ship that's out of sensor range or already dead
+	if (targ != NULL && (targ->is_resetting() || targ->is_invisible() || (COMMON_TARGETS < 2 && tdist > search_dist))) {
+		targ = NULL; // don't target a ship that's out of sensor range or already dead
 	}
 
 	// RETREAT, WAIT, ENEMY, ALL
 	if (ai_base_type != AI_ATT_WAIT) { // RETREAT, ENEMY, ALL
-		if (target_obj == NULL || target_obj == parent || target_obj->invalid() ||
-			time > (tup_time + TARGET_CTIME) || tdist > search_dist || tdist < min_dist)
-		{
-			tup_time = time + ((rand()%TARGET_CTIME) >> 1);  // update target every so often, randomize
+		if (targ == NULL || targ == parent || targ->invalid() || time > (tup_time + TARGET_CTIME) || tdist > search_dist || tdist < min_dist) {
+			plan.tup_time = time + ((rand_int()%TARGET_CTIME) >> 1);  // update target every so often, randomize
 			free_obj const *new_target_obj(NULL);
 			bool find_closest(0);
 
 			switch (target_mode) {
 			case TARGET_CLOSEST:
-				find_closest = (target_obj == NULL || retarg_time == 0);
+				find_closest = (targ == NULL || retarg_time == 0);
 				break;
 			case TARGET_ATTACKER:
 			case TARGET_LAST:
-				find_closest = (target_obj == NULL);
+				find_closest = (targ == NULL);
 				break;
 			case TARGET_PARENT:
-				if (parent != NULL && target_valid(parent->get_target()) && !parent->get_target()->is_invisible()) {target_obj = parent->get_target();}
+				if (parent != NULL && target_valid(parent->get_target()) && !parent->get_target()->is_invisible()) {targ = parent->get_target();}
 				else {find_closest = 1;}
 				break;
 			default:
 				assert(0);
 			}
 			bool const has_dest(dest_mgr.is_valid());
-			if (has_dest && (rand()&3)) {find_closest = 0;} // every 4th frame if already have a destination
+			if (has_dest && (rand_int()&3)) {find_closest = 0;} // every 4th frame if already have a destination
 			
 			if (find_closest) {
-				if (target_obj != NULL) {
-					if (alignment == ALIGN_NEUTRAL && ai_base_type == AI_ATT_ENEMY && (rand() % NEUT_CHASE_T) == 0) {
-						target_obj = NULL; // give up the chase after awhile
+				if (targ != NULL) {
+					if (alignment == ALIGN_NEUTRAL && ai_base_type == AI_ATT_ENEMY && (rand_int() % NEUT_CHASE_T) == 0) {
+						targ = NULL; // give up the chase after awhile
 					}
-					if (tdist > 2.0*search_dist) {target_obj = NULL;} // (tdist < min_dist) is ignored for now, out of range
+					if (tdist > 2.0*search_dist) {targ = NULL;} // (tdist < min_dist) is ignored for now, out of range
 				}
 				float eff_search_dist(search_dist);
 				if (has_dest) {eff_search_dist = min(search_dist, p2p_dist(pos, dest_mgr.get_pos()));}
-				if (target_obj != NULL && tdist >= min_dist) {eff_search_dist = min(search_dist, 0.8f*tdist);}
-				new_target_obj = find_closest_target(pos, min_dist, eff_search_dist, 0);
-				if (new_target_obj == NULL) {new_target_obj = target_obj;} // keep the same target
+				if (targ != NULL && tdist >= min_dist) {eff_search_dist = min(search_dist, 0.8f*tdist);}
+				new_target_obj = find_closest_target(pos, min_dist, eff_search_dist, 0, rgen);
+				if (new_target_obj == NULL) {new_target_obj = targ;} // keep the same target
 
 				if (new_target_obj == NULL && alignment != ALIGN_NEUTRAL) { // no target, choose to attack same target as teammates
 					assert(alignment < a_targets.size());
@@ -508,7 +514,7 @@ void u_ship::acquire_target(float min_dist) {
 					}
 				}
 				if ((ai_type & AI_GUARDIAN) && new_target_obj == NULL) { // seek out the last attacker
-					unsigned const start_i(rand() % NUM_ALIGNMENT); // don't show favoritism
+					unsigned const start_i(rand_int() % NUM_ALIGNMENT); // don't show favoritism
 					
 					for (unsigned i = 0; i < NUM_ALIGNMENT; ++i) {
 						unsigned const ii((start_i + i) % NUM_ALIGNMENT);
@@ -525,21 +531,34 @@ void u_ship::acquire_target(float min_dist) {
 				}
 			}
 			if (new_target_obj != NULL) {
-				target_obj  = new_target_obj;
-				retarg_time = RETARG_DELAY;
-				
-				if (target_obj->is_player_ship() && target_obj != parent) {
-					send_warning_message((string("Enemy Ship Detected: ") + get_name()), 1); // no_duplicate=1
-				}
+				targ          = new_target_obj;
+				plan.retarget = new_target_obj;
 			}
-			if (target_obj != NULL && target_mode == TARGET_LAST) {target_set = 1;}
+			if (targ != NULL && target_mode == TARGET_LAST) {plan.target_set = 1;}
 		}
 	}
-	if ((ai_type & AI_GUARDIAN) && target_obj != NULL && target_obj->get_align() == alignment) {
-		target_obj = NULL; // don't attack a friendly
+	if ((ai_type & AI_GUARDIAN) && targ != NULL && targ->get_align() == alignment) {
+		targ = NULL; // don't attack a friendly
 	}
-	if (target_obj == NULL && parent != NULL && target_valid(parent->get_target())) {
-		target_obj = parent->get_target(); // as a last resort, even if not TARGET_PARENT
+	if (targ == NULL && parent != NULL && target_valid(parent->get_target())) {
+		targ = parent->get_target(); // as a last resort, even if not TARGET_PARENT
+	}
+	plan.target = targ;
+}
+
+
+void u_ship::apply_target_plan(target_plan_t const &plan) {
+
+	target_obj = plan.target;
+	tup_time   = plan.tup_time;
+	if (plan.target_set) {target_set = 1;}
+
+	if (plan.retarget != NULL) { // Note: target_obj may have been reset after this was chosen
+		retarg_time = RETARG_DELAY;
+		
+		if (plan.retarget->is_player_ship() && plan.retarget != parent) {
+			send_warning_message((string("Enemy Ship Detected: ") + get_name()), 1); // no_duplicate=1
+		}
 	}
 	if (!fighters.empty()) get_fighter_target(this);
 	
@@ -551,6 +570,14 @@ void u_ship::acquire_target(float min_dist) {
 }
 
 
+void u_ship::acquire_target(float min_dist) {
+
+	target_plan_t plan;
+	calc_target_plan(min_dist, plan);
+	apply_target_plan(plan);
+}
+
+
 uobject const *u_ship::setup_int_query(vector3d const &qdir, float qdist, free_obj *&fobj,
 									   float &tdist, bool sobjs_only, float line_radius) const
 {
@@ -951,6 +978,23 @@ bool is_valid_fire_dir(vector3d const &target_dir, vector3d const &fire_dir, boo
 	return (fire_dir != zero_vector && (is_close || get_angle(target_dir, fire_dir) < MAX_LEAD_SHOT_DOTP)); // check dir if not close
 }
 
+// the expensive target query part of ai_action(), run in parallel across ships before any ai_action() calls;
+// the world is not modified here, so all ships see the same start-of-frame state independent of object order
+void u_ship::plan_ai_action() {
+
+	target_plan.frame = -1;
+	if (time < SHIP_AI_DELAY || invalid_or_disabled() || !begin_motion || player_controlled()) return;
+	if (is_orbiting() && (time&3) != 0) return; // see ai_action()
+	bool const boarding(specs().for_boarding && ncrew > specs().ncrew/2), kamikaze((ai_type & AI_KAMIKAZE) != 0);
+	float const min_dist((out_of_ammo(0) || kamikaze || boarding) ? 0.0 : get_min_att_dist()); // must agree with ai_action()
+	rand_gen_t rgen;
+	rgen.set_state(obj_id+1, frame_counter+1); // per-ship sequence so that results don't depend on thread scheduling
+	rgen.rand_mix();
+	calc_target_plan(min_dist, target_plan, &rgen);
+	target_plan.frame = frame_counter;
+}
+
+
 void u_ship::ai_action() {
 
 	float const old_cloaked(cloaked);
@@ -1014,7 +1058,11 @@ void u_ship::ai_action() {
 	dest_override = 0;
 	
 	if (!is_orbiting() || (time&3) == 0) { // every 4th frame if orbiting
-		acquire_target(min_dist); // slow
+		// use the plan from plan_ai_action() if it was computed this frame with the same inputs and its target is still valid
+		bool const use_plan(target_plan.frame == frame_counter && target_plan.min_dist == min_dist && target_plan.prev_target == target_obj &&
+			(target_plan.target == NULL || !target_plan.target->invalid()));
+		target_plan.frame = -1; // only used once
+		if (use_plan) {apply_target_plan(target_plan);} else {acquire_target(min_dist);} // slow
 	}
 	free_obj const *const acquired_target(target_obj);
 	if (local_dest) {target_obj = NULL;}
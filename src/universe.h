@@ -8,6 +8,7 @@
 #include "draw_utils.h"
 #include "gl_ext_arb.h"
 #include <map>
+#include <unordered_map>
 #include <sstream>
 
 using std::string;
@@ -198,11 +199,19 @@ struct rotated_obj { // size = 48
 };
 
 
-class urev_body : public uobj_solid, public color_gen_class, public rotated_obj { // size = 360
+struct surface_color_params_t { // copy of the body state used to color rocky textures, so that they can be generated off the main thread
+
+	unsigned char a[3]={}, b[3]={}, wic[2][3]={}; // wic = {water, ice}
+	float temp=0.0, water=0.0, lava=0.0, atmos=0.0, snow_thresh=0.0, wr_scale=1.0;
+	void get_surface_color(unsigned char *data, float val, float phi) const;
+};
+
+void gen_rocky_texture_data(surface_color_params_t const &cparams, upsurface const &surface, unsigned num_sines, unsigned size, unsigned char *data, float *heightmap);
+void purge_stale_async_textures();
+
+
+class urev_body : public uobj_solid, public color_gen_class, public rotated_obj { // size = 352
 
-	// for textures/colors
-	unsigned char a[3], b[3];
-	
 protected:
 	void calc_snow_thresh();
 
@@ -210,23 +219,29 @@ public:
 	bool gas_giant; // planets only?
 	int owner;
 	unsigned orbiting_refs, tid, tsize;
-	float orbit, rot_rate, rev_rate, atmos, water, lava, resources, cloud_density, cloud_scale, wr_scale, snow_thresh, population, prev_pop;
+	float orbit, rot_rate, rev_rate, atmos, water, lava, resources, cloud_density, cloud_scale, snow_thresh, population, prev_pop;
 	vector3d rev_axis, v_orbit, orbit_scale;
 	std::shared_ptr<upsurface> surface;
 	string comment;
 
 	urev_body(char type_) : uobj_solid(type_), gas_giant(0), owner(NO_OWNER), orbiting_refs(0), tid(0), tsize(0), orbit(0.0), rot_rate(0.0), rev_rate(0.0), atmos(0.0),
-		water(0.0), lava(0.0), resources(0.0), cloud_density(1.0), cloud_scale(1.0), wr_scale(1.0), snow_thresh(0.0), population(0.0), prev_pop(0.0), orbit_scale(all_ones)
-	{a[0] = a[1] = a[2] = b[0] = b[1] = b[2] = 0;}
+		water(0.0), lava(0.0), resources(0.0), cloud_density(1.0), cloud_scale(1.0), snow_thresh(0.0), population(0.0), prev_pop(0.0), orbit_scale(all_ones) {}
 	virtual ~urev_body() {unset_owner();}
 	void gen_rotrev();
 	template<typename T> bool create_orbit(vector<T> const &objs, int i, point const &pos0, vector3d const &raxis,
 		float radius0, float max_size, float min_size, float rspacing, float ispacing, float minspacing, float min_gap, vector3d const &oscale);
+	upsurface *create_surface(float &mag, float &freq) const;
 	void gen_surface();
 	void check_gen_texture(unsigned size);
 	void create_rocky_texture(unsigned size);
 	void create_gas_giant_texture();
 	void gen_texture_data_and_heightmap(unsigned char *data, unsigned size);
+	void upload_texture_data(unsigned size, vector<unsigned char> const &data, vector<float> &heightmap);
+	bool upload_async_texture(unsigned max_size);
+	bool upload_async_surface_texture(unsigned max_size);
+	void prefetch_texture(unsigned size) const;
+	void prefetch_surface_texture(unsigned size) const;
+	surface_color_params_t get_color_params() const;
 	bool has_heightmap() const {return (surface != nullptr && surface->has_heightmap() && !use_procedural_shader());}
 	bool surface_test(float rad, point const &p, float &coll_r, bool simple) const;
 	float get_radius_at(point const &p, bool exact=0) const;
@@ -597,6 +612,34 @@ public:
 };
 
 
+// caches the star system and nearby bodies for small grid cells inside star systems so that closest object queries for the many
+// moving objects in a system don't have to walk the cell => galaxy => cluster => system hierarchy; must be cleared when bodies move
+class sobj_query_cache_t {
+
+	struct entry_t {
+		bool valid=0, asteroids_near=0;
+		int cellxyz[3]={}, galaxy=-1, cluster=-1, system=-1;
+		unsigned p_start=0, p_end=0; // range in planets
+		point cell_pos;
+	};
+	struct planet_ref_t {
+		unsigned pix=0, m_start=0, m_end=0; // range in moons
+		planet_ref_t(unsigned pix_=0, unsigned m_start_=0) : pix(pix_), m_start(m_start_), m_end(m_start_) {}
+	};
+	std::unordered_map<uint64_t, unsigned> entry_map; // grid cell key => index into entries
+	vector<entry_t> entries;
+	vector<planet_ref_t> planets;
+	vector<unsigned> moons;
+
+	void build_entry(universe_t const &universe, entry_t &entry, point const &center);
+public:
+	unsigned num_hits=0, num_misses=0;
+
+	void clear();
+	int get_object_closest_to_pos(universe_t const &universe, s_object &result, point const &pos, bool include_asteroids, float r_add=0.0);
+};
+
+
 typedef string modmap_val_t;
 typedef map<s_object, modmap_val_t> modmap;
 
@@ -128,14 +128,20 @@ void upsurface::setup(unsigned size, float mcut, bool alloc_hmap) {
 	ssize      = size;
 	min_cutoff = mcut;
 	if (alloc_hmap) heightmap.resize(ssize*ssize);
+	num_sines  = calc_num_sines(ssize);
+}
+
+
+unsigned upsurface::calc_num_sines(unsigned size) { // fewer high frequency sines for smaller textures
+
 	unsigned max_freq(MAX_FREQ_BINS - 4);
 
 	for (unsigned i = 8; i <= MAX_TEXTURE_SIZE; i <<= 1) {
-		if (ssize <= i) break;
+		if (size <= i) break;
 		++max_freq;
 	}
-	max_freq  = max(1u, min(MAX_FREQ_BINS, max_freq));
-	num_sines = max_freq*SINES_PER_FREQ;
+	max_freq = max(1u, min(MAX_FREQ_BINS, max_freq));
+	return max_freq*SINES_PER_FREQ;
 }
 
 
@@ -176,12 +182,21 @@ upsurface::~upsurface() {
 }
 
 
+upsurface *urev_body::create_surface(float &mag, float &freq) const { // the caller must call upsurface::gen(mag, freq)
+
+	upsurface *const s(new upsurface(type));
+	mag  = SURFACE_HEIGHT*radius;
+	freq = ((type == UTYPE_MOON) ? 1.5 : 1.0)*INITIAL_FREQ*TWO_PI;
+	s->rgen = rgen; // just copy it?
+	return s;
+}
+
+
 void urev_body::gen_surface() {
 
 	set_rseeds();
-	surface.reset(new upsurface(type)); // may delete a previous surface
-	float mag(SURFACE_HEIGHT*radius), freq(((type == UTYPE_MOON) ? 1.5 : 1.0)*INITIAL_FREQ*TWO_PI);
-	surface->rgen = rgen; // just copy it?
+	float mag(0.0), freq(0.0);
+	surface.reset(create_surface(mag, freq)); // may delete a previous surface
 	surface->gen(mag, freq);
 }
 
@@ -191,21 +206,26 @@ void urev_body::gen_surface() {
 // the rest of the 3DWorld sphere generation and drawing code; it also produces more uniform regions near the poles
 void urev_body::gen_texture_data_and_heightmap(unsigned char *data, unsigned size) {
 
+	assert(surface != nullptr);
+	surface->setup(size, max(water, lava), 1); // use_heightmap=1
+	gen_rocky_texture_data(get_color_params(), *surface, surface->num_sines, size, data, &surface->heightmap.front());
+}
+
+
+// reads only the immutable noise terms of surface, so it can be run on a background thread with a copy of the color params
+void gen_rocky_texture_data(surface_color_params_t const &cparams, upsurface const &surface, unsigned num_sines, unsigned size, unsigned char *data, float *heightmap) {
+
 	//RESET_TIME;
-	get_colors(a, b);
 	unsigned size_p2(0);
 	for (unsigned sz = size; sz > 1; sz >>= 1, ++size_p2);
 	assert((1U<<size_p2) == size); // size must be a power of 2
-	assert(surface != nullptr);
+	assert(num_sines <= TOT_NUM_SINES);
 	unsigned const table_size(MAX_TEXTURE_SIZE << 1); // larger is more accurate
-	static float xtable[TOT_NUM_SINES*table_size] = {}, ytable[TOT_NUM_SINES*table_size] = {};
-	surface->setup(size, max(water, lava), 1); // use_heightmap=1
-	unsigned const num_sines(surface->num_sines);
-	float const *const rdata(surface->rdata);
-	float const mt2(0.5*(table_size-1)), scale(1.5/surface->max_mag);
+	vector<float> xtable(num_sines*table_size), ytable(num_sines*table_size); // not static, since this may run on more than one thread
+	float const *const rdata(surface.rdata);
+	float const mt2(0.5*(table_size-1)), scale(1.5/surface.max_mag);
 	float const delta(TWO_PI/size), sin_ds(sin(delta)), cos_ds(cos(delta));
 	unsigned const pole_thresh(size>>3);
-	wr_scale = 1.0/max(0.01, (1.0 - water));
 
 	for (unsigned i = 0; i < table_size; ++i) { // build sin table
 		unsigned const offset(i*num_sines);
@@ -248,8 +268,8 @@ void urev_body::gen_texture_data_and_heightmap(unsigned char *data, unsigned siz
 				for (unsigned k = 0; k < num_sines; ++k) {val += ztable[k]*xtable[ox1+k]*ytable[oy1+k];}
 			}
 			val = 0.5*(max(-1.0f, min(1.0f, scale*val)) + 1.0);
-			surface->heightmap[hmoff + j] = val;
-			get_surface_color((data + index), val, phi);
+			heightmap[hmoff + j] = val;
+			cparams.get_surface_color((data + index), val, phi);
 			sin_s = s*cos_ds + c*sin_ds;
 			cos_s = c*cos_ds - s*sin_ds;
 		} // for j